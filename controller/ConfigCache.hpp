@@ -0,0 +1,200 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_CONTROLLER_CONFIGCACHE_HPP
+#define ZT_CONTROLLER_CONFIGCACHE_HPP
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Serialized configs are reused for at most this fraction of a network's credential time window
+#ifndef ZT_CONTROLLER_CONFIG_CACHE_WINDOW_DIVISOR
+#define ZT_CONTROLLER_CONFIG_CACHE_WINDOW_DIVISOR 8
+#endif
+
+namespace ZeroTier
+{
+
+/**
+ * Each member's last serialized network config and what it was built from
+ *
+ * Most config requests are periodic refreshes. If nothing a member's config
+ * is built from has changed, the last one can be sent again instead of
+ * building and signing a new one. Credentials in a config are only reused
+ * while the request falls in the same time bucket they were issued in, a
+ * fraction of the network's credential time window, so they never get
+ * much older than a freshly built config's would.
+ *
+ * Once the cache holds more than its size limit, other members' entries
+ * are dropped to make room for the one just added.
+ */
+class ConfigCache
+{
+public:
+	/**
+	 * What a config was built from; it can be sent again while this is unchanged
+	 */
+	struct Stamp
+	{
+		Stamp() : networkRevision(0),memberRevision(0),timeBucket(0),bridges(0),legacy(false),noRulesEngine(false) {}
+		uint64_t networkRevision;
+		uint64_t memberRevision;
+		int64_t timeBucket;
+		uint64_t bridges; // hash of the network's active bridges
+		bool legacy;
+		bool noRulesEngine;
+		inline bool operator==(const Stamp &s) const
+		{
+			return ((networkRevision == s.networkRevision)&&(memberRevision == s.memberRevision)&&(timeBucket == s.timeBucket)&&(bridges == s.bridges)&&(legacy == s.legacy)&&(noRulesEngine == s.noRulesEngine));
+		}
+		inline bool operator!=(const Stamp &s) const { return !(*this == s); }
+	};
+
+	/**
+	 * @param now Current time in milliseconds
+	 * @param credentialTimeMaxDelta Network's credential time window in milliseconds
+	 * @return Time bucket for a stamp
+	 */
+	static inline int64_t timeBucket(const int64_t now,const int64_t credentialTimeMaxDelta)
+	{
+		return now / (credentialTimeMaxDelta / ZT_CONTROLLER_CONFIG_CACHE_WINDOW_DIVISOR);
+	}
+
+	ConfigCache(const unsigned long maxBytes) :
+		_maxBytes(maxBytes),
+		_bytes(0)
+	{
+	}
+
+	/**
+	 * @param networkId Network ID
+	 * @param memberId Member ID
+	 * @param stamp What the config would be built from now
+	 * @param dict Filled with the cached config if there's one with the same stamp
+	 * @return True if dict was filled
+	 */
+	inline bool get(const uint64_t networkId,const uint64_t memberId,const Stamp &stamp,std::string &dict) const
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		auto c = _entries.find(_Key(networkId,memberId));
+		if ((c == _entries.end())||(c->second.stamp != stamp))
+			return false;
+		dict = c->second.dict;
+		return true;
+	}
+
+	/**
+	 * @param networkId Network ID
+	 * @param memberId Member ID
+	 * @param stamp What the config was built from
+	 * @param dict Serialized config
+	 * @param len Length of dict in bytes
+	 */
+	inline void put(const uint64_t networkId,const uint64_t memberId,const Stamp &stamp,const void *dict,const unsigned int len)
+	{
+		const _Key k(networkId,memberId);
+		std::lock_guard<std::mutex> l(_lock);
+		_Entry &e = _entries[k];
+		_bytes -= e.dict.size();
+		e.stamp = stamp;
+		e.dict.assign(reinterpret_cast<const char *>(dict),len);
+		_bytes += e.dict.size();
+		for(auto i=_entries.begin();((_bytes > _maxBytes)&&(i!=_entries.end()));) {
+			if (i->first == k) {
+				++i;
+			} else {
+				_bytes -= i->second.dict.size();
+				_entries.erase(i++);
+			}
+		}
+	}
+
+	/**
+	 * Drop a member's config, e.g. after its record changed
+	 */
+	inline void forgetMember(const uint64_t networkId,const uint64_t memberId)
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		auto c = _entries.find(_Key(networkId,memberId));
+		if (c != _entries.end()) {
+			_bytes -= c->second.dict.size();
+			_entries.erase(c);
+		}
+	}
+
+	/**
+	 * Drop the configs of all of a network's members, e.g. after its record changed
+	 */
+	inline void forgetNetwork(const uint64_t networkId)
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		for(auto i=_entries.begin();i!=_entries.end();) {
+			if (i->first.networkId == networkId) {
+				_bytes -= i->second.dict.size();
+				_entries.erase(i++);
+			} else {
+				++i;
+			}
+		}
+	}
+
+	/**
+	 * @return Number of cached configs
+	 */
+	inline unsigned long size() const
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		return (unsigned long)_entries.size();
+	}
+
+	/**
+	 * @return Total size of cached configs in bytes
+	 */
+	inline unsigned long bytes() const
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		return _bytes;
+	}
+
+private:
+	struct _Key
+	{
+		_Key(const uint64_t nwid,const uint64_t mid) : networkId(nwid),memberId(mid) {}
+		uint64_t networkId;
+		uint64_t memberId;
+		inline bool operator==(const _Key &k) const { return ((networkId == k.networkId)&&(memberId == k.memberId)); }
+	};
+
+	struct _KeyHash
+	{
+		inline std::size_t operator()(const _Key &k) const { return (std::size_t)(k.networkId + k.memberId); }
+	};
+
+	struct _Entry
+	{
+		Stamp stamp;
+		std::string dict;
+	};
+
+	const unsigned long _maxBytes;
+	unsigned long _bytes;
+	std::unordered_map< _Key,_Entry,_KeyHash > _entries;
+	mutable std::mutex _lock;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_CONTROLLER_CONFIGREQUESTQUEUE_HPP
+#define ZT_CONTROLLER_CONFIGREQUESTQUEUE_HPP
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace ZeroTier
+{
+
+/**
+ * Queue of network config requests waiting for a controller thread
+ *
+ * Holds at most one request per network and member. Another request from a
+ * member that is still waiting replaces the waiting one in place, so retries
+ * from a member after a restart are served once rather than once each. The
+ * replacement first takes over what it should keep from the waiting one by
+ * way of T::coalesce(), e.g. the first arrival time so the time measured
+ * from it covers the member's whole wait.
+ *
+ * Requests are served in two priority levels (joins before refreshes) and,
+ * within a level, round robin across networks, so one large network can't
+ * starve the rest. Once the queue holds its limit, new requests are refused
+ * so the caller can tell the requester to come back later.
+ *
+ * The queue owns everything posted to it and hands it over again in get().
+ *
+ * @tparam T Request type, with a void coalesce(const T &waiting) method
+ */
+template<typename T>
+class ConfigRequestQueue
+{
+public:
+	enum Priority
+	{
+		PRIORITY_JOIN = 0,
+		PRIORITY_REFRESH = 1
+	};
+
+	enum PostResult
+	{
+		QUEUED,
+		COALESCED, // replaced a waiting request from the same member
+		FULL       // refused and deleted
+	};
+
+	enum TimedWaitResult
+	{
+		OK,
+		TIMED_OUT,
+		STOP
+	};
+
+	ConfigRequestQueue(const unsigned long limit) :
+		_limit(limit),
+		_count(0),
+		_running(true)
+	{
+	}
+
+	~ConfigRequestQueue()
+	{
+		for(auto p=_pending.begin();p!=_pending.end();++p) {
+			delete p->second->t;
+			delete p->second;
+		}
+	}
+
+	/**
+	 * @param networkId Network ID
+	 * @param memberId Requesting member's address
+	 * @param priority Priority, ignored if this replaces a waiting request
+	 * @param t Request, owned by the queue from now on
+	 * @return What happened to it
+	 */
+	inline PostResult post(const uint64_t networkId,const uint64_t memberId,const Priority priority,T *t)
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		_Item *&i = _pending[_Key(networkId,memberId)];
+		if (i) {
+			t->coalesce(*(i->t));
+			delete i->t;
+			i->t = t;
+			return COALESCED;
+		}
+		if (_count >= _limit) {
+			_pending.erase(_Key(networkId,memberId));
+			delete t;
+			return FULL;
+		}
+		i = new _Item(networkId,memberId,t);
+		std::deque<_Item *> &q = _networks[priority][networkId];
+		if (q.empty())
+			_rr[priority].push_back(networkId);
+		q.push_back(i);
+		++_count;
+		_c.notify_one();
+		return QUEUED;
+	}
+
+	/**
+	 * @param t Set to next request, which the caller must delete
+	 * @param priority Set to request's priority level
+	 * @param ms Maximum time to wait
+	 */
+	inline TimedWaitResult get(T *&t,Priority &priority,const unsigned long ms)
+	{
+		std::unique_lock<std::mutex> l(_lock);
+		if (!_running)
+			return STOP;
+		while (!_count) {
+			if (_c.wait_for(l,std::chrono::milliseconds(ms)) == std::cv_status::timeout)
+				return ((_running) ? TIMED_OUT : STOP);
+			else if (!_running)
+				return STOP;
+		}
+		for(unsigned int p=0;p<2;++p) {
+			if (!_rr[p].empty()) {
+				const uint64_t networkId = _rr[p].front();
+				_rr[p].pop_front();
+				auto q = _networks[p].find(networkId);
+				_Item *const i = q->second.front();
+				q->second.pop_front();
+				if (q->second.empty()) {
+					_networks[p].erase(q);
+				} else {
+					_rr[p].push_back(networkId);
+				}
+				_pending.erase(_Key(i->networkId,i->memberId));
+				--_count;
+				t = i->t;
+				priority = (Priority)p;
+				delete i;
+				return OK;
+			}
+		}
+		return TIMED_OUT; // not reached, _count and _rr agree
+	}
+
+	inline void stop()
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		_running = false;
+		_c.notify_all();
+	}
+
+	inline unsigned long size() const
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		return _count;
+	}
+
+private:
+	struct _Key
+	{
+		_Key(const uint64_t n,const uint64_t m) : networkId(n),memberId(m) {}
+		inline bool operator==(const _Key &k) const { return ((networkId == k.networkId)&&(memberId == k.memberId)); }
+		uint64_t networkId;
+		uint64_t memberId;
+	};
+
+	struct _KeyHasher
+	{
+		inline std::size_t operator()(const _Key &k) const { return (std::size_t)((k.networkId * 0x9e3779b97f4a7c15ULL) ^ k.memberId); }
+	};
+
+	struct _Item
+	{
+		_Item(const uint64_t n,const uint64_t m,T *tt) : networkId(n),memberId(m),t(tt) {}
+		const uint64_t networkId;
+		const uint64_t memberId;
+		T *t;
+	};
+
+	const unsigned long _limit;
+	unsigned long _count;
+	bool _running;
+	std::unordered_map< _Key,_Item *,_KeyHasher > _pending;        // every waiting request
+	std::unordered_map< uint64_t,std::deque<_Item *> > _networks[2]; // per priority: network ID -> its requests in order
+	std::deque<uint64_t> _rr[2];                                     // per priority: networks with requests, in service order
+	mutable std::mutex _lock;
+	std::condition_variable _c;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -91,15 +91,258 @@ void DB::cleanNetwork(nlohmann::json &network)
 	network.erase("lastModified");
 }
 
+// Fields cleanMember() removes before a member is saved
+static const char *const s_memberCleanedFields[] = { "clock","physicalAddr","recentLog","lastModified","lastRequestMetaData","authenticationURL","authenticationClientID" };
+
 void DB::cleanMember(nlohmann::json &member)
 {
-	member.erase("clock");
-	member.erase("physicalAddr");
-	member.erase("recentLog");
-	member.erase("lastModified");
-	member.erase("lastRequestMetaData");
-	member.erase("authenticationURL"); // computed
-	member.erase("authenticationClientID"); // computed
+	for(unsigned int i=0;i<(sizeof(s_memberCleanedFields) / sizeof(s_memberCleanedFields[0]));++i)
+		member.erase(s_memberCleanedFields[i]);
+}
+
+static const char *const s_memberIntFields[] = { "creationTime","revision","lastAuthorizedTime","lastDeauthorizedTime","authenticationExpiryTime","vMajor","vMinor","vRev","vProto","remoteTraceLevel" };
+static const char *const s_memberBoolFields[] = { "authorized","activeBridge","ssoExempt","noAutoAssignIps" };
+static const char *const s_memberStringFields[] = { "identity","lastAuthorizedCredentialType","lastAuthorizedCredential","remoteTraceTarget","objtype" };
+
+// True if s is exactly the zero-padded lower case hex of its value, so it can be stored as that value
+static bool _isCanonicalHex(const nlohmann::json &v,const unsigned int digits,uint64_t &n)
+{
+	if ((!v.is_string())||(v.get_ref<const std::string &>().length() != digits))
+		return false;
+	const std::string &s = v.get_ref<const std::string &>();
+	char tmp[24];
+	n = Utils::hexStrToU64(s.c_str());
+	OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.*llx",(int)digits,(unsigned long long)n);
+	return (s == tmp);
+}
+
+static inline bool _isU32(const nlohmann::json &v)
+{
+	if (v.is_number_unsigned())
+		return (v.get<uint64_t>() <= 0xffffffffULL);
+	if (v.is_number_integer())
+		return ((v.get<int64_t>() >= 0)&&(v.get<int64_t>() <= 0xffffffffLL));
+	return false;
+}
+
+DB::MemberRecord::MemberRecord() :
+	_id(0),
+	_nwid(0),
+	_has(0),
+	_bools(0),
+	_nullStrings(0)
+{
+	for(unsigned int i=0;i<_INT_FIELD_COUNT;++i)
+		_ints[i] = 0;
+}
+
+DB::MemberRecord::MemberRecord(const nlohmann::json &member) :
+	MemberRecord()
+{
+	if (member.is_object()) {
+		for(auto f=member.begin();f!=member.end();++f) {
+			if (!_take(f.key(),f.value()))
+				_extra[f.key()] = f.value();
+		}
+	}
+}
+
+bool DB::MemberRecord::_take(const std::string &k,const nlohmann::json &v)
+{
+	for(unsigned int i=0;i<_INT_FIELD_COUNT;++i) {
+		if (k == s_memberIntFields[i]) {
+			if ((!v.is_number_integer())||((v.is_number_unsigned())&&(v.get<uint64_t>() > 0x7fffffffffffffffULL)))
+				return false;
+			_ints[i] = v.get<int64_t>();
+			_has |= 1U << i;
+			return true;
+		}
+	}
+	for(unsigned int i=0;i<_BOOL_FIELD_COUNT;++i) {
+		if (k == s_memberBoolFields[i]) {
+			if (!v.is_boolean())
+				return false;
+			if (v.get<bool>())
+				_bools |= (uint8_t)(1U << i);
+			_has |= 1U << (_INT_FIELD_COUNT + i);
+			return true;
+		}
+	}
+	for(unsigned int i=0;i<_STRING_FIELD_COUNT;++i) {
+		if (k == s_memberStringFields[i]) {
+			if (v.is_string()) {
+				_strings[i] = v.get<std::string>();
+			} else if (v.is_null()) {
+				_nullStrings |= (uint8_t)(1U << i);
+			} else {
+				return false;
+			}
+			_has |= 1U << (_INT_FIELD_COUNT + _BOOL_FIELD_COUNT + i);
+			return true;
+		}
+	}
+
+	uint64_t n = 0;
+	if (k == "id") {
+		if ((!_isCanonicalHex(v,10,n))||((_has & (1U << _HAS_ADDRESS))&&(n != _id)))
+			return false;
+		_id = n;
+		_has |= 1U << _HAS_ID;
+		return true;
+	} else if (k == "address") {
+		// Always the same as id, so only its presence is kept
+		if ((!_isCanonicalHex(v,10,n))||((_has & (1U << _HAS_ID))&&(n != _id)))
+			return false;
+		_id = n;
+		_has |= 1U << _HAS_ADDRESS;
+		return true;
+	} else if (k == "nwid") {
+		if (!_isCanonicalHex(v,16,n))
+			return false;
+		_nwid = n;
+		_has |= 1U << _HAS_NWID;
+		return true;
+	} else if (k == "ipAssignments") {
+		if (!v.is_array())
+			return false;
+		for(auto i=v.begin();i!=v.end();++i) {
+			if (!i->is_string())
+				return false;
+		}
+		_ipAssignments.reserve(v.size());
+		for(auto i=v.begin();i!=v.end();++i)
+			_ipAssignments.push_back(i->get<std::string>());
+		_has |= 1U << _HAS_IP_ASSIGNMENTS;
+		return true;
+	} else if (k == "tags") {
+		if (!v.is_array())
+			return false;
+		for(auto i=v.begin();i!=v.end();++i) {
+			if ((!i->is_array())||(i->size() != 2)||(!_isU32((*i)[0]))||(!_isU32((*i)[1])))
+				return false;
+		}
+		_tags.reserve(v.size());
+		for(auto i=v.begin();i!=v.end();++i)
+			_tags.push_back(std::pair<uint32_t,uint32_t>((*i)[0].get<uint32_t>(),(*i)[1].get<uint32_t>()));
+		_has |= 1U << _HAS_TAGS;
+		return true;
+	} else if (k == "capabilities") {
+		if (!v.is_array())
+			return false;
+		for(auto i=v.begin();i!=v.end();++i) {
+			if (!_isU32(*i))
+				return false;
+		}
+		_capabilities.reserve(v.size());
+		for(auto i=v.begin();i!=v.end();++i)
+			_capabilities.push_back(i->get<uint32_t>());
+		_has |= 1U << _HAS_CAPABILITIES;
+		return true;
+	}
+
+	return false;
+}
+
+bool DB::MemberRecord::complete() const
+{
+	if (_has != ((1U << (_HAS_CAPABILITIES + 1)) - 1))
+		return false;
+	if ((_nullStrings & ((1U << _IDENTITY)|(1U << _OBJTYPE)))||(_strings[_OBJTYPE] != "member"))
+		return false;
+	if (_extra.is_object()) {
+		for(unsigned int i=0;i<(sizeof(s_memberCleanedFields) / sizeof(s_memberCleanedFields[0]));++i) {
+			if (_extra.contains(s_memberCleanedFields[i]))
+				return false;
+		}
+	}
+	return true;
+}
+
+void DB::MemberRecord::toJson(nlohmann::json &member) const
+{
+	if (_extra.is_object()) {
+		member = _extra;
+	} else {
+		member = nlohmann::json::object();
+	}
+
+	for(unsigned int i=0;i<_INT_FIELD_COUNT;++i) {
+		if (_has & (1U << i)) {
+			if (_ints[i] < 0) {
+				member[s_memberIntFields[i]] = _ints[i];
+			} else {
+				member[s_memberIntFields[i]] = (uint64_t)_ints[i];
+			}
+		}
+	}
+	for(unsigned int i=0;i<_BOOL_FIELD_COUNT;++i) {
+		if (_has & (1U << (_INT_FIELD_COUNT + i)))
+			member[s_memberBoolFields[i]] = ((_bools & (1U << i)) != 0);
+	}
+	for(unsigned int i=0;i<_STRING_FIELD_COUNT;++i) {
+		if (_has & (1U << (_INT_FIELD_COUNT + _BOOL_FIELD_COUNT + i))) {
+			if (_nullStrings & (1U << i)) {
+				member[s_memberStringFields[i]] = nlohmann::json();
+			} else {
+				member[s_memberStringFields[i]] = _strings[i];
+			}
+		}
+	}
+
+	char tmp[24];
+	if (_has & ((1U << _HAS_ID)|(1U << _HAS_ADDRESS))) {
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.10llx",(unsigned long long)_id);
+		if (_has & (1U << _HAS_ID))
+			member["id"] = tmp;
+		if (_has & (1U << _HAS_ADDRESS))
+			member["address"] = tmp;
+	}
+	if (_has & (1U << _HAS_NWID)) {
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),"%.16llx",(unsigned long long)_nwid);
+		member["nwid"] = tmp;
+	}
+	if (_has & (1U << _HAS_IP_ASSIGNMENTS)) {
+		nlohmann::json &ips = member["ipAssignments"];
+		ips = nlohmann::json::array();
+		for(auto i=_ipAssignments.begin();i!=_ipAssignments.end();++i)
+			ips.push_back(*i);
+	}
+	if (_has & (1U << _HAS_TAGS)) {
+		nlohmann::json &tags = member["tags"];
+		tags = nlohmann::json::array();
+		for(auto t=_tags.begin();t!=_tags.end();++t)
+			tags.push_back(nlohmann::json::array({ t->first,t->second }));
+	}
+	if (_has & (1U << _HAS_CAPABILITIES)) {
+		nlohmann::json &caps = member["capabilities"];
+		caps = nlohmann::json::array();
+		for(auto c=_capabilities.begin();c!=_capabilities.end();++c)
+			caps.push_back(*c);
+	}
+}
+
+bool DB::AllocatedIps::contains(const InetAddress &ip) const
+{
+	if (!_nw)
+		return false;
+	std::shared_lock<std::shared_mutex> l(_nw->lock);
+	return _nw->allocatedIps.contains(ip);
+}
+
+bool DB::AllocatedIps::nextFreeV4(const uint32_t from,const uint32_t last,uint32_t &ip) const
+{
+	if (!_nw)
+		return false;
+	std::shared_lock<std::shared_mutex> l(_nw->lock);
+	return _nw->allocatedIps.nextFreeV4(from,last,ip);
+}
+
+unsigned long DB::AllocatedIps::size() const
+{
+	if (!_nw)
+		return 0;
+	std::shared_lock<std::shared_mutex> l(_nw->lock);
+	return _nw->allocatedIps.size();
 }
 
 DB::DB() {}
@@ -117,9 +360,15 @@ bool DB::get(const uint64_t networkId,nlohmann::json &network)
 			return false;
 		nw = nwi->second;
 	}
+	std::shared_ptr<const nlohmann::json> config;
 	{
 		std::shared_lock<std::shared_mutex> l2(nw->lock);
-		network = nw->config;
+		config = nw->config;
+	}
+	if (config) {
+		network = *config;
+	} else {
+		network = nlohmann::json();
 	}
 	return true;
 }
@@ -136,18 +385,27 @@ bool DB::get(const uint64_t networkId,nlohmann::json &network,const uint64_t mem
 			return false;
 		nw = nwi->second;
 	}
+	std::shared_ptr<const nlohmann::json> config;
+	std::shared_ptr<const MemberRecord> m;
 	{
 		std::shared_lock<std::shared_mutex> l2(nw->lock);
-		network = nw->config;
-		auto m = nw->members.find(memberId);
-		if (m == nw->members.end())
-			return false;
-		member = m->second;
+		config = nw->config;
+		auto mi = nw->members.find(memberId);
+		if (mi != nw->members.end())
+			m = mi->second;
+	}
+	if (config) {
+		network = *config;
+	} else {
+		network = nlohmann::json();
 	}
+	if (!m)
+		return false;
+	m->toJson(member);
 	return true;
 }
 
-bool DB::get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,nlohmann::json &member,NetworkSummaryInfo &info)
+bool DB::get(const uint64_t networkId,std::shared_ptr<const nlohmann::json> &network,const uint64_t memberId,std::shared_ptr<const MemberRecord> &member,NetworkSummaryInfo &info)
 {
 	waitForReady();
 	Metrics::db_get_network_and_member_and_summary++;
@@ -164,8 +422,10 @@ bool DB::get(const uint64_t networkId,nlohmann::json &network,const uint64_t mem
 		network = nw->config;
 		_fillSummaryInfo(nw,info);
 		auto m = nw->members.find(memberId);
-		if (m == nw->members.end())
+		if (m == nw->members.end()) {
+			member.reset();
 			return false;
+		}
 		member = m->second;
 	}
 	return true;
@@ -183,12 +443,24 @@ bool DB::get(const uint64_t networkId,nlohmann::json &network,std::vector<nlohma
 			return false;
 		nw = nwi->second;
 	}
+	std::shared_ptr<const nlohmann::json> config;
+	std::vector< std::shared_ptr<const MemberRecord> > m;
 	{
 		std::shared_lock<std::shared_mutex> l2(nw->lock);
-		network = nw->config;
-		for(auto m=nw->members.begin();m!=nw->members.end();++m) {
-			members.push_back(m->second);
-		}
+		config = nw->config;
+		m.reserve(nw->members.size());
+		for(auto mi=nw->members.begin();mi!=nw->members.end();++mi)
+			m.push_back(mi->second);
+	}
+	if (config) {
+		network = *config;
+	} else {
+		network = nlohmann::json();
+	}
+	members.reserve(members.size() + m.size());
+	for(auto mi=m.begin();mi!=m.end();++mi) {
+		members.push_back(nlohmann::json());
+		(*mi)->toJson(members.back());
 	}
 	return true;
 }
@@ -202,6 +474,46 @@ void DB::networks(std::set<uint64_t> &networks)
 		networks.insert(n->first);
 }
 
+void DB::revisions(std::unordered_map< uint64_t,NetworkRevision > &networks)
+{
+	std::vector< std::pair< uint64_t,std::shared_ptr<_Network> > > nws;
+	{
+		std::shared_lock<std::shared_mutex> l(_networks_l);
+		nws.reserve(_networks.size());
+		for(auto n=_networks.begin();n!=_networks.end();++n)
+			nws.push_back(*n);
+	}
+	for(auto n=nws.begin();n!=nws.end();++n) {
+		NetworkRevision &r = networks[n->first];
+		std::shared_lock<std::shared_mutex> l(n->second->lock);
+		if (n->second->config) {
+			r.hasConfig = true;
+			auto rev = n->second->config->find("revision");
+			if (rev != n->second->config->end())
+				r.revision = OSUtils::jsonInt(*rev,0ULL);
+		}
+		r.memberCount = (unsigned long)n->second->members.size();
+		r.memberDigest = n->second->memberDigest;
+	}
+}
+
+bool DB::memberRevisions(const uint64_t networkId,std::unordered_map< uint64_t,uint64_t > &members)
+{
+	std::shared_ptr<_Network> nw;
+	{
+		std::shared_lock<std::shared_mutex> l(_networks_l);
+		auto nwi = _networks.find(networkId);
+		if (nwi == _networks.end())
+			return false;
+		nw = nwi->second;
+	}
+	std::shared_lock<std::shared_mutex> l(nw->lock);
+	members.reserve(nw->members.size());
+	for(auto m=nw->members.begin();m!=nw->members.end();++m)
+		members[m->first] = m->second->revision();
+	return true;
+}
+
 void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool notifyListeners)
 {
 	Metrics::db_member_change++;
@@ -239,7 +551,7 @@ void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool no
 							const std::string ips = ipj;
 							InetAddress ipa(ips.c_str());
 							ipa.setPort(0);
-							nw->allocatedIps.erase(ipa);
+							nw->allocatedIps.remove(ipa);
 						}
 					}
 				}
@@ -263,7 +575,11 @@ void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool no
 		{
 			std::unique_lock<std::shared_mutex> l(nw->lock);
 
-			nw->members[memberId] = memberConfig;
+			std::shared_ptr<const MemberRecord> &r = nw->members[memberId];
+			if (r)
+				nw->memberDigest ^= _memberDigest(r);
+			r.reset(new MemberRecord(memberConfig));
+			nw->memberDigest ^= _memberDigest(r);
 
 			if (OSUtils::jsonBool(memberConfig["activeBridge"],false)) {
 				nw->activeBridgeMembers.insert(memberId);
@@ -281,7 +597,7 @@ void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool no
 						const std::string ips = ipj;
 						InetAddress ipa(ips.c_str());
 						ipa.setPort(0);
-						nw->allocatedIps.insert(ipa);
+						nw->allocatedIps.add(ipa);
 					}
 				}
 			}
@@ -302,7 +618,11 @@ void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool no
 	} else if (memberId) {
 		if (nw) {
 			std::unique_lock<std::shared_mutex> l(nw->lock);
-			nw->members.erase(memberId);
+			auto m = nw->members.find(memberId);
+			if (m != nw->members.end()) {
+				nw->memberDigest ^= _memberDigest(m->second);
+				nw->members.erase(m);
+			}
 		}
 		if (networkId) {
 			std::unique_lock<std::shared_mutex> l(_networks_l);
@@ -342,6 +662,91 @@ void DB::_memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool no
 	}
 }
 
+unsigned long DB::_loadMembers(const uint64_t networkId,const std::vector<nlohmann::json> &members)
+{
+	struct _Loaded
+	{
+		std::shared_ptr<const MemberRecord> record;
+		std::vector<InetAddress> ips;
+		int64_t lastDeauthorizedTime;
+		bool activeBridge;
+		bool authorized;
+	};
+	std::vector<_Loaded> loaded;
+	loaded.reserve(members.size());
+	for(auto m=members.begin();m!=members.end();++m) {
+		if ((!m->is_object())||(!m->contains("id"))||(!m->contains("nwid")))
+			continue;
+		const uint64_t memberId = OSUtils::jsonIntHex((*m)["id"],0ULL);
+		if ((!memberId)||(OSUtils::jsonIntHex((*m)["nwid"],0ULL) != networkId))
+			continue;
+		loaded.push_back(_Loaded());
+		_Loaded &l = loaded.back();
+		l.record.reset(new MemberRecord(*m));
+		l.activeBridge = OSUtils::jsonBool(m->value("activeBridge",nlohmann::json()),false);
+		l.authorized = OSUtils::jsonBool(m->value("authorized",nlohmann::json()),false);
+		l.lastDeauthorizedTime = (int64_t)OSUtils::jsonInt(m->value("lastDeauthorizedTime",nlohmann::json()),0ULL);
+		auto ips = m->find("ipAssignments");
+		if ((ips != m->end())&&(ips->is_array())) {
+			for(auto ipj=ips->begin();ipj!=ips->end();++ipj) {
+				if (ipj->is_string()) {
+					const std::string ips = *ipj;
+					InetAddress ipa(ips.c_str());
+					ipa.setPort(0);
+					l.ips.push_back(ipa);
+				}
+			}
+		}
+	}
+	if (loaded.empty())
+		return 0;
+
+	std::shared_ptr<_Network> nw;
+	{
+		std::unique_lock<std::shared_mutex> l(_networks_l);
+		std::shared_ptr<_Network> &nw2 = _networks[networkId];
+		if (!nw2)
+			nw2.reset(new _Network);
+		nw = nw2;
+	}
+
+	std::vector<nlohmann::json> replaced;
+	{
+		std::unique_lock<std::shared_mutex> l(nw->lock);
+		for(auto m=loaded.begin();m!=loaded.end();++m) {
+			const uint64_t memberId = m->record->id();
+			std::shared_ptr<const MemberRecord> &r = nw->members[memberId];
+			if (r) {
+				// Already loaded, e.g. changed while loading: let _memberChanged() sort it out below
+				replaced.push_back(nlohmann::json());
+				m->record->toJson(replaced.back());
+				continue;
+			}
+			r = m->record;
+			nw->memberDigest ^= _memberDigest(r);
+			if (m->activeBridge)
+				nw->activeBridgeMembers.insert(memberId);
+			if (m->authorized) {
+				Metrics::member_auths++;
+				nw->authorizedMembers.insert(memberId);
+			} else if (m->lastDeauthorizedTime > nw->mostRecentDeauthTime) {
+				nw->mostRecentDeauthTime = m->lastDeauthorizedTime;
+			}
+			for(auto ip=m->ips.begin();ip!=m->ips.end();++ip)
+				nw->allocatedIps.add(*ip);
+		}
+	}
+	Metrics::db_member_change += (double)(loaded.size() - replaced.size());
+
+	for(auto m=replaced.begin();m!=replaced.end();++m) {
+		nlohmann::json network,old;
+		get(networkId,network,OSUtils::jsonIntHex((*m)["id"],0ULL),old);
+		_memberChanged(old,*m,false);
+	}
+
+	return (unsigned long)loaded.size();
+}
+
 void DB::_networkChanged(nlohmann::json &old,nlohmann::json &networkConfig,bool notifyListeners)
 {
 	Metrics::db_network_change++;
@@ -369,7 +774,7 @@ void DB::_networkChanged(nlohmann::json &old,nlohmann::json &networkConfig,bool
 			}
 			{
 				std::unique_lock<std::shared_mutex> l2(nw->lock);
-				nw->config = networkConfig;
+				nw->config.reset(new nlohmann::json(networkConfig));
 			}
 			if (notifyListeners) {
 				std::unique_lock<std::shared_mutex> ll(_changeListeners_l);
@@ -411,9 +816,7 @@ void DB::_fillSummaryInfo(const std::shared_ptr<_Network> &nw,NetworkSummaryInfo
 	for(auto ab=nw->activeBridgeMembers.begin();ab!=nw->activeBridgeMembers.end();++ab)
 		info.activeBridges.push_back(Address(*ab));
 	std::sort(info.activeBridges.begin(),info.activeBridges.end());
-	for(auto ip=nw->allocatedIps.begin();ip!=nw->allocatedIps.end();++ip)
-		info.allocatedIps.push_back(*ip);
-	std::sort(info.allocatedIps.begin(),info.allocatedIps.end());
+	info.allocatedIps._nw = nw;
 	info.authorizedMemberCount = (unsigned long)nw->authorizedMembers.size();
 	info.totalMemberCount = (unsigned long)nw->members.size();
 	info.mostRecentDeauthTime = nw->mostRecentDeauthTime;
@@ -21,6 +21,8 @@
 #include "../node/InetAddress.hpp"
 #include "../osdep/OSUtils.hpp"
 #include "../osdep/BlockingQueue.hpp"
+#include "IPAllocation.hpp"
+#include "MemberOnlineTable.hpp"
 
 #include <memory>
 #include <string>
@@ -75,6 +77,9 @@ public:
  */
 class DB
 {
+protected:
+	struct _Network;
+
 public:
 	class ChangeListener
 	{
@@ -86,16 +91,151 @@ public:
 		virtual void onNetworkMemberDeauthorize(const void *db,uint64_t networkId,uint64_t memberId) {}
 	};
 
+	/**
+	 * Member record as held in memory
+	 *
+	 * A controller can hold millions of members and a json object costs a few
+	 * allocations per field, so members are kept as fixed fields and only turned
+	 * into json at the HTTP and storage boundaries. Fields this doesn't know
+	 * about, and known fields with an unexpected type or format, are kept
+	 * verbatim in an overflow object so that converting back always gives an
+	 * equal document.
+	 */
+	class MemberRecord
+	{
+	public:
+		MemberRecord();
+		explicit MemberRecord(const nlohmann::json &member);
+
+		void toJson(nlohmann::json &member) const;
+
+		inline uint64_t id() const { return _id; }
+		inline uint64_t networkId() const { return _nwid; }
+		inline uint64_t revision() const { return ((_has & (1U << _REVISION))&&(_ints[_REVISION] > 0)) ? (uint64_t)_ints[_REVISION] : 0ULL; }
+		inline bool authorized() const { return ((_bools & (1U << _AUTHORIZED)) != 0); }
+		inline bool ssoExempt() const { return ((_bools & (1U << _SSO_EXEMPT)) != 0); }
+		inline const std::string &identity() const { return _strings[_IDENTITY]; }
+
+		/**
+		 * @return True if every field initMember() sets is present with its usual type and none cleanMember() removes is
+		 */
+		bool complete() const;
+
+		/**
+		 * @return True if the member's recorded software version is exactly this one
+		 */
+		inline bool versionIs(const uint64_t vMajor,const uint64_t vMinor,const uint64_t vRev,const uint64_t vProto) const
+		{
+			return ((_ints[_V_MAJOR] == (int64_t)vMajor)&&(_ints[_V_MINOR] == (int64_t)vMinor)&&(_ints[_V_REV] == (int64_t)vRev)&&(_ints[_V_PROTO] == (int64_t)vProto));
+		}
+
+	private:
+		enum {
+			// Integer fields
+			_CREATION_TIME = 0,
+			_REVISION,
+			_LAST_AUTHORIZED_TIME,
+			_LAST_DEAUTHORIZED_TIME,
+			_AUTHENTICATION_EXPIRY_TIME,
+			_V_MAJOR,
+			_V_MINOR,
+			_V_REV,
+			_V_PROTO,
+			_REMOTE_TRACE_LEVEL,
+			_INT_FIELD_COUNT
+		};
+		enum {
+			// Boolean fields
+			_AUTHORIZED = 0,
+			_ACTIVE_BRIDGE,
+			_SSO_EXEMPT,
+			_NO_AUTO_ASSIGN_IPS,
+			_BOOL_FIELD_COUNT
+		};
+		enum {
+			// String fields (may also be null)
+			_IDENTITY = 0,
+			_LAST_AUTHORIZED_CREDENTIAL_TYPE,
+			_LAST_AUTHORIZED_CREDENTIAL,
+			_REMOTE_TRACE_TARGET,
+			_OBJTYPE,
+			_STRING_FIELD_COUNT
+		};
+		enum {
+			// Bits in _has after the above
+			_HAS_ID = _INT_FIELD_COUNT + _BOOL_FIELD_COUNT + _STRING_FIELD_COUNT,
+			_HAS_ADDRESS,
+			_HAS_NWID,
+			_HAS_IP_ASSIGNMENTS,
+			_HAS_TAGS,
+			_HAS_CAPABILITIES
+		};
+
+		bool _take(const std::string &k,const nlohmann::json &v);
+
+		uint64_t _id;
+		uint64_t _nwid;
+		int64_t _ints[_INT_FIELD_COUNT];
+		std::string _strings[_STRING_FIELD_COUNT];
+		std::vector<std::string> _ipAssignments;
+		std::vector< std::pair<uint32_t,uint32_t> > _tags;
+		std::vector<uint32_t> _capabilities;
+		nlohmann::json _extra; // null unless something didn't fit
+		uint32_t _has; // fields present in the original document
+		uint8_t _bools;
+		uint8_t _nullStrings; // string fields that were null
+	};
+
+	/**
+	 * Read access to the IPs assigned in one network
+	 *
+	 * Each query reads the network's live index under its read lock, so
+	 * holding one of these never makes a member write copy the index. As
+	 * with any lookup, an answer can be out of date by the time it's used.
+	 */
+	class AllocatedIps
+	{
+		friend class DB;
+
+	public:
+		bool contains(const InetAddress &ip) const;
+		bool nextFreeV4(const uint32_t from,const uint32_t last,uint32_t &ip) const;
+		unsigned long size() const;
+		inline void reset() { _nw.reset(); }
+
+	private:
+		std::shared_ptr<_Network> _nw;
+	};
+
 	struct NetworkSummaryInfo
 	{
 		NetworkSummaryInfo() : authorizedMemberCount(0),totalMemberCount(0),mostRecentDeauthTime(0) {}
 		std::vector<Address> activeBridges;
-		std::vector<InetAddress> allocatedIps;
+		AllocatedIps allocatedIps;
 		unsigned long authorizedMemberCount;
 		unsigned long totalMemberCount;
 		int64_t mostRecentDeauthTime;
 	};
 
+	/**
+	 * Summary of one network's revisions, compared between mirrored DBs
+	 *
+	 * The member digest is an XOR of a hash of each member's ID and revision,
+	 * kept up to date as members change, so two DBs holding the same members
+	 * at the same revisions have equal summaries without either walking its
+	 * members.
+	 */
+	struct NetworkRevision
+	{
+		NetworkRevision() : revision(0),memberCount(0),memberDigest(0),hasConfig(false) {}
+		inline bool operator==(const NetworkRevision &r) const { return ((revision == r.revision)&&(memberCount == r.memberCount)&&(memberDigest == r.memberDigest)&&(hasConfig == r.hasConfig)); }
+		inline bool operator!=(const NetworkRevision &r) const { return !(*this == r); }
+		uint64_t revision;
+		unsigned long memberCount;
+		uint64_t memberDigest;
+		bool hasConfig;
+	};
+
 	static void initNetwork(nlohmann::json &network);
 	static void initMember(nlohmann::json &member);
 	static void cleanNetwork(nlohmann::json &network);
@@ -113,31 +253,86 @@ public:
 		return (_networks.find(networkId) != _networks.end());
 	}
 
+	inline bool hasMember(const uint64_t networkId,const uint64_t memberId) const
+	{
+		std::shared_ptr<_Network> nw;
+		{
+			std::shared_lock<std::shared_mutex> l(_networks_l);
+			auto nwi = _networks.find(networkId);
+			if (nwi == _networks.end())
+				return false;
+			nw = nwi->second;
+		}
+		std::shared_lock<std::shared_mutex> l2(nw->lock);
+		return (nw->members.find(memberId) != nw->members.end());
+	}
+
 	bool get(const uint64_t networkId,nlohmann::json &network);
 	bool get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,nlohmann::json &member);
-	bool get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,nlohmann::json &member,NetworkSummaryInfo &info);
+
+	/**
+	 * Get shared read-only snapshots of a network and one of its members
+	 *
+	 * This copies nothing, so it's what the config request path uses. The
+	 * network is set (if it exists) even if the member does not.
+	 *
+	 * @return True if both network and member were found
+	 */
+	bool get(const uint64_t networkId,std::shared_ptr<const nlohmann::json> &network,const uint64_t memberId,std::shared_ptr<const MemberRecord> &member,NetworkSummaryInfo &info);
+
 	bool get(const uint64_t networkId,nlohmann::json &network,std::vector<nlohmann::json> &members);
 
 	void networks(std::set<uint64_t> &networks);
 
+	/**
+	 * @param networks Filled with the revision summary of every network
+	 */
+	void revisions(std::unordered_map< uint64_t,NetworkRevision > &networks);
+
+	/**
+	 * @param members Filled with member ID -> revision
+	 * @return False if network does not exist
+	 */
+	bool memberRevisions(const uint64_t networkId,std::unordered_map< uint64_t,uint64_t > &members);
+
 	template<typename F>
 	inline void each(F f)
 	{
-		nlohmann::json nullJson;
+		nlohmann::json nullJson,member;
 		std::unique_lock<std::shared_mutex> lck(_networks_l);
 		for(auto nw=_networks.begin();nw!=_networks.end();++nw) {
-			f(nw->first,nw->second->config,0,nullJson); // first provide network with 0 for member ID
+			std::shared_lock<std::shared_mutex> l2(nw->second->lock);
+			const nlohmann::json &network = (nw->second->config) ? *(nw->second->config) : nullJson;
+			f(nw->first,network,0,nullJson); // first provide network with 0 for member ID
 			for(auto m=nw->second->members.begin();m!=nw->second->members.end();++m) {
-				f(nw->first,nw->second->config,m->first,m->second);
+				m->second->toJson(member);
+				f(nw->first,network,m->first,member);
 			}
 		}
 	}
 
-	virtual bool save(nlohmann::json &record,bool notifyListeners) = 0;
+	/**
+	 * @param record Network or member record, its revision updated to the one saved
+	 * @param notifyListeners If true, tell change listeners
+	 * @param keepRevision Save at the record's own revision rather than the next one (for copying between mirrors)
+	 * @return True if anything changed
+	 */
+	virtual bool save(nlohmann::json &record,bool notifyListeners,bool keepRevision = false) = 0;
 	virtual void eraseNetwork(const uint64_t networkId) = 0;
 	virtual void eraseMember(const uint64_t networkId,const uint64_t memberId) = 0;
 	virtual void nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const InetAddress &physicalAddress) = 0;
 
+	/**
+	 * @return When each member of a network was last seen, or NULL if this DB does not track it
+	 */
+	virtual std::shared_ptr<const MemberOnlineTable::Network> lastSeen(const uint64_t networkId) const { return std::shared_ptr<const MemberOnlineTable::Network>(); }
+
+	/**
+	 * @param m Set to member's recent sightings
+	 * @return True if this DB tracks online state and has seen member
+	 */
+	virtual bool lastSeen(const uint64_t networkId,const uint64_t memberId,MemberOnlineTable::Member &m) const { return false; }
+
 	virtual AuthInfo getSSOAuthInfo(const nlohmann::json &member, const std::string &redirectURL) { return AuthInfo(); }
 
 	inline void addListener(DB::ChangeListener *const listener)
@@ -169,20 +364,52 @@ protected:
 		return false;
 	}
 
+	// Whether save() has anything to store; a copy kept at its revision also differs if only that does
+	static inline bool _saveNeeded(nlohmann::json &old,nlohmann::json &record,const bool keepRevision)
+	{
+		if ((!old.is_object())||(!_compareRecords(old,record)))
+			return true;
+		return ((keepRevision)&&(OSUtils::jsonInt(old["revision"],0ULL) != OSUtils::jsonInt(record["revision"],0ULL)));
+	}
+
 	struct _Network
 	{
-		_Network() : mostRecentDeauthTime(0) {}
-		nlohmann::json config;
-		std::unordered_map<uint64_t,nlohmann::json> members;
+		_Network() : mostRecentDeauthTime(0),memberDigest(0) {}
+		std::shared_ptr<const nlohmann::json> config; // replaced, never modified, on change
+		std::unordered_map< uint64_t,std::shared_ptr<const MemberRecord> > members;
 		std::unordered_set<uint64_t> activeBridgeMembers;
 		std::unordered_set<uint64_t> authorizedMembers;
-		std::unordered_set<InetAddress,InetAddress::Hasher> allocatedIps;
+		IPAllocation allocatedIps;
 		int64_t mostRecentDeauthTime;
+		uint64_t memberDigest; // see NetworkRevision
 		std::shared_mutex lock;
 	};
 
+	// Contribution of one member to _Network::memberDigest
+	static inline uint64_t _memberDigest(const std::shared_ptr<const MemberRecord> &m)
+	{
+		uint64_t x = (m->id() * 0x9e3779b97f4a7c15ULL) ^ m->revision();
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+
 	virtual void _memberChanged(nlohmann::json &old,nlohmann::json &memberConfig,bool notifyListeners);
 	virtual void _networkChanged(nlohmann::json &old,nlohmann::json &networkConfig,bool notifyListeners);
+
+	/**
+	 * Add many members of one network at once while loading
+	 *
+	 * Same as _memberChanged() with no old record and no listeners for each,
+	 * but records are built before any lock is taken and the network is only
+	 * locked once, so several threads can load members (of the same network
+	 * or not) at the same time.
+	 *
+	 * @param networkId Network ID
+	 * @param members Member records, members not in this network are skipped
+	 * @return Number of members added
+	 */
+	unsigned long _loadMembers(const uint64_t networkId,const std::vector<nlohmann::json> &members);
 	void _fillSummaryInfo(const std::shared_ptr<_Network> &nw,NetworkSummaryInfo &info);
 
 	std::vector<DB::ChangeListener *> _changeListeners;
@@ -13,6 +13,8 @@
 
 #include "DBMirrorSet.hpp"
 
+#include "../node/Metrics.hpp"
+
 namespace ZeroTier {
 
 DBMirrorSet::DBMirrorSet(DB::ChangeListener *listener)
@@ -30,43 +32,7 @@ DBMirrorSet::DBMirrorSet(DB::ChangeListener *listener)
 				std::this_thread::sleep_for(std::chrono::milliseconds(500));
 			}
 
-			std::vector< std::shared_ptr<DB> > dbs;
-			{
-				std::unique_lock<std::shared_mutex> l(_dbs_l);
-				if (_dbs.size() <= 1)
-					continue; // no need to do this if there's only one DB, so skip the iteration
-				dbs = _dbs;
-			}
-
-			for(auto db=dbs.begin();db!=dbs.end();++db) {
-				(*db)->each([&dbs,&db](uint64_t networkId,const nlohmann::json &network,uint64_t memberId,const nlohmann::json &member) {
-					try {
-						if (network.is_object()) {
-							if (memberId == 0) {
-								for(auto db2=dbs.begin();db2!=dbs.end();++db2) {
-									if (db->get() != db2->get()) {
-										nlohmann::json nw2;
-										if ((!(*db2)->get(networkId,nw2))||((nw2.is_object())&&(OSUtils::jsonInt(nw2["revision"],0) < OSUtils::jsonInt(network["revision"],0)))) {
-											nw2 = network;
-											(*db2)->save(nw2,false);
-										}
-									}
-								}
-							} else if (member.is_object()) {
-								for(auto db2=dbs.begin();db2!=dbs.end();++db2) {
-									if (db->get() != db2->get()) {
-										nlohmann::json nw2,m2;
-										if ((!(*db2)->get(networkId,nw2,memberId,m2))||((m2.is_object())&&(OSUtils::jsonInt(m2["revision"],0) < OSUtils::jsonInt(member["revision"],0)))) {
-											m2 = member;
-											(*db2)->save(m2,false);
-										}
-									}
-								}
-							}
-						}
-					} catch ( ... ) {} // skip entries that generate JSON errors
-				});
-			}
+			sync();
 		}
 	});
 }
@@ -77,6 +43,109 @@ DBMirrorSet::~DBMirrorSet()
 	_syncCheckerThread.join();
 }
 
+unsigned long DBMirrorSet::sync()
+{
+	std::vector< std::shared_ptr<DB> > dbs;
+	{
+		std::shared_lock<std::shared_mutex> l(_dbs_l);
+		if (_dbs.size() <= 1)
+			return 0; // no need to do this if there's only one DB
+		dbs = _dbs;
+	}
+
+	std::vector< std::unordered_map< uint64_t,DB::NetworkRevision > > summaries(dbs.size());
+	std::set<uint64_t> networks;
+	for(unsigned long d=0;d<dbs.size();++d) {
+		dbs[d]->revisions(summaries[d]);
+		for(auto n=summaries[d].begin();n!=summaries[d].end();++n)
+			networks.insert(n->first);
+	}
+
+	unsigned long repaired = 0;
+	std::vector<const DB::NetworkRevision *> nwr(dbs.size());
+	for(auto nwid=networks.begin();nwid!=networks.end();++nwid) {
+		bool same = true;
+		for(unsigned long d=0;d<dbs.size();++d) {
+			auto r = summaries[d].find(*nwid);
+			nwr[d] = (r == summaries[d].end()) ? (const DB::NetworkRevision *)0 : &(r->second);
+			if ((!nwr[d])||((d > 0)&&(nwr[0])&&(*nwr[d] != *nwr[0])))
+				same = false;
+		}
+		if (same)
+			continue;
+		Metrics::db_mirror_sync_networks_diffed++;
+
+		try {
+			// Newest network config goes to any DB that lacks it or is behind. Copies
+			// keep their revision, or the target would end up one ahead and differ.
+			long newest = -1;
+			for(unsigned long d=0;d<dbs.size();++d) {
+				if ((nwr[d])&&(nwr[d]->hasConfig)&&((newest < 0)||(nwr[d]->revision > nwr[newest]->revision)))
+					newest = (long)d;
+			}
+			if (newest < 0)
+				continue; // members without a network are left alone
+			nlohmann::json network;
+			for(unsigned long d=0;d<dbs.size();++d) {
+				if ((!nwr[d])||(!nwr[d]->hasConfig)||(nwr[d]->revision < nwr[newest]->revision)) {
+					if ((network.is_object())||(dbs[newest]->get(*nwid,network))) {
+						nlohmann::json nw2(network);
+						if (dbs[d]->save(nw2,false,true)) {
+							Metrics::db_mirror_sync_networks_repaired++;
+							++repaired;
+						}
+					}
+				}
+			}
+
+			bool membersSame = true;
+			for(unsigned long d=1;d<dbs.size();++d) {
+				if ((!nwr[d])||(!nwr[0])||(nwr[d]->memberCount != nwr[0]->memberCount)||(nwr[d]->memberDigest != nwr[0]->memberDigest))
+					membersSame = false;
+			}
+			if (membersSame)
+				continue;
+
+			// Only now look at individual members, and only their revisions
+			std::vector< std::unordered_map< uint64_t,uint64_t > > revisions(dbs.size());
+			std::unordered_map< uint64_t,unsigned long > newestMember; // member ID -> DB with newest revision
+			for(unsigned long d=0;d<dbs.size();++d) {
+				dbs[d]->memberRevisions(*nwid,revisions[d]);
+				for(auto m=revisions[d].begin();m!=revisions[d].end();++m) {
+					auto nm = newestMember.find(m->first);
+					if (nm == newestMember.end()) {
+						newestMember[m->first] = d;
+					} else if (m->second > revisions[nm->second][m->first]) {
+						nm->second = d;
+					}
+				}
+			}
+			for(auto nm=newestMember.begin();nm!=newestMember.end();++nm) {
+				const uint64_t rev = revisions[nm->second][nm->first];
+				nlohmann::json member;
+				for(unsigned long d=0;d<dbs.size();++d) {
+					auto m = revisions[d].find(nm->first);
+					if ((m == revisions[d].end())||(m->second < rev)) {
+						Metrics::db_mirror_sync_members_diffed++;
+						if (!member.is_object()) {
+							nlohmann::json nw2;
+							if (!dbs[nm->second]->get(*nwid,nw2,nm->first,member))
+								break;
+						}
+						nlohmann::json m2(member);
+						if (dbs[d]->save(m2,false,true)) {
+							Metrics::db_mirror_sync_members_repaired++;
+							++repaired;
+						}
+					}
+				}
+			}
+		} catch ( ... ) {} // skip networks whose records generate JSON errors
+	}
+
+	return repaired;
+}
+
 bool DBMirrorSet::hasNetwork(const uint64_t networkId) const
 {
 	std::shared_lock<std::shared_mutex> l(_dbs_l);
@@ -87,6 +156,16 @@ bool DBMirrorSet::hasNetwork(const uint64_t networkId) const
 	return false;
 }
 
+bool DBMirrorSet::hasMember(const uint64_t networkId,const uint64_t memberId) const
+{
+	std::shared_lock<std::shared_mutex> l(_dbs_l);
+	for(auto d=_dbs.begin();d!=_dbs.end();++d) {
+		if ((*d)->hasMember(networkId,memberId))
+			return true;
+	}
+	return false;
+}
+
 bool DBMirrorSet::get(const uint64_t networkId,nlohmann::json &network)
 {
 	std::shared_lock<std::shared_mutex> l(_dbs_l);
@@ -108,7 +187,7 @@ bool DBMirrorSet::get(const uint64_t networkId,nlohmann::json &network,const uin
 	return false;
 }
 
-bool DBMirrorSet::get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,nlohmann::json &member,DB::NetworkSummaryInfo &info)
+bool DBMirrorSet::get(const uint64_t networkId,std::shared_ptr<const nlohmann::json> &network,const uint64_t memberId,std::shared_ptr<const DB::MemberRecord> &member,DB::NetworkSummaryInfo &info)
 {
 	std::shared_lock<std::shared_mutex> l(_dbs_l);
 	for(auto d=_dbs.begin();d!=_dbs.end();++d) {
@@ -214,6 +293,27 @@ void DBMirrorSet::nodeIsOnline(const uint64_t networkId,const uint64_t memberId,
 	}
 }
 
+std::shared_ptr<const MemberOnlineTable::Network> DBMirrorSet::lastSeen(const uint64_t networkId) const
+{
+	std::shared_lock<std::shared_mutex> l(_dbs_l);
+	for(auto d=_dbs.begin();d!=_dbs.end();++d) {
+		std::shared_ptr<const MemberOnlineTable::Network> nw((*d)->lastSeen(networkId));
+		if (nw)
+			return nw;
+	}
+	return std::shared_ptr<const MemberOnlineTable::Network>();
+}
+
+bool DBMirrorSet::lastSeen(const uint64_t networkId,const uint64_t memberId,MemberOnlineTable::Member &m) const
+{
+	std::shared_lock<std::shared_mutex> l(_dbs_l);
+	for(auto d=_dbs.begin();d!=_dbs.end();++d) {
+		if ((*d)->lastSeen(networkId,memberId,m))
+			return true;
+	}
+	return false;
+}
+
 void DBMirrorSet::onNetworkUpdate(const void *db,uint64_t networkId,const nlohmann::json &network)
 {
 	nlohmann::json record(network);
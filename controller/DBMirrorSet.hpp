@@ -31,20 +31,36 @@ public:
 	virtual ~DBMirrorSet();
 
 	bool hasNetwork(const uint64_t networkId) const;
+	bool hasMember(const uint64_t networkId,const uint64_t memberId) const;
 
 	bool get(const uint64_t networkId,nlohmann::json &network);
 	bool get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,nlohmann::json &member);
-	bool get(const uint64_t networkId,nlohmann::json &network,const uint64_t memberId,nlohmann::json &member,DB::NetworkSummaryInfo &info);
+	bool get(const uint64_t networkId,std::shared_ptr<const nlohmann::json> &network,const uint64_t memberId,std::shared_ptr<const DB::MemberRecord> &member,DB::NetworkSummaryInfo &info);
 	bool get(const uint64_t networkId,nlohmann::json &network,std::vector<nlohmann::json> &members);
 
 	void networks(std::set<uint64_t> &networks);
 
+	/**
+	 * Copy records that some DBs lack or hold older revisions of from the DBs that have the newest
+	 *
+	 * DBs first compare per-network revision summaries. Member revisions are
+	 * only compared for networks whose summaries differ, and full records are
+	 * only read for members that need copying, so a pass over DBs that already
+	 * agree costs one summary per network. The sync thread runs this once a
+	 * minute.
+	 *
+	 * @return Number of records copied
+	 */
+	unsigned long sync();
+
 	bool waitForReady();
 	bool isReady();
 	bool save(nlohmann::json &record,bool notifyListeners);
 	void eraseNetwork(const uint64_t networkId);
 	void eraseMember(const uint64_t networkId,const uint64_t memberId);
 	void nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const InetAddress &physicalAddress);
+	std::shared_ptr<const MemberOnlineTable::Network> lastSeen(const uint64_t networkId) const;
+	bool lastSeen(const uint64_t networkId,const uint64_t memberId,MemberOnlineTable::Member &m) const;
 
 	// These are called by various DB instances when changes occur.
 	virtual void onNetworkUpdate(const void *db,uint64_t networkId,const nlohmann::json &network);
@@ -32,6 +32,7 @@
 #include <iomanip>
 #include <sstream>
 #include <cctype>
+#include <chrono>
 
 #include "../include/ZeroTierOne.h"
 #include "../version.h"
@@ -39,6 +40,7 @@
 #include "EmbeddedNetworkController.hpp"
 #include "LFDB.hpp"
 #include "FileDB.hpp"
+#include "LogDB.hpp"
 #ifdef ZT_CONTROLLER_USE_LIBPQ
 #include "PostgreSQL.hpp"
 #endif
@@ -57,9 +59,15 @@ using json = nlohmann::json;
 // Min duration between requests for an address/nwid combo to prevent floods
 #define ZT_NETCONF_MIN_REQUEST_PERIOD 1000
 
+// Requests allowed to wait for a handling thread before members are told to come back later
+#define ZT_NETCONF_MAX_QUEUED_REQUESTS 16384
+
 // Global maximum size of arrays in JSON objects
 #define ZT_CONTROLLER_MAX_ARRAY_SIZE 16384
 
+// Maximum total size of cached serialized configs
+#define ZT_CONTROLLER_CONFIG_CACHE_MAX_BYTES (64 * 1024 * 1024)
+
 namespace ZeroTier {
 
 namespace {
@@ -252,18 +260,54 @@ static json _renderRule(ZT_VirtualNetworkRule &rule)
 	return r;
 }
 
-static bool _parseRule(json &r,ZT_VirtualNetworkRule &rule)
+// Field of a shared read-only record, or null if absent (operator[] would insert it)
+static inline const json &_jsonField(const json &j,const char *k)
+{
+	static const json nullJson;
+	if (j.is_object()) {
+		auto f = j.find(k);
+		if (f != j.end())
+			return *f;
+	}
+	return nullJson;
+}
+
+// Credential time window of a network's certificates, clamped to the allowed range
+static int64_t _credentialTimeMaxDelta(const json &network)
+{
+	int64_t credentialtmd = ZT_NETWORKCONFIG_DEFAULT_CREDENTIAL_TIME_DFL_MAX_DELTA;
+	if (network.contains("certificateTimeoutWindowSize")) {
+		credentialtmd = (int64_t)_jsonField(network,"certificateTimeoutWindowSize");
+	}
+	return std::max(std::min(credentialtmd, ZT_NETWORKCONFIG_DEFAULT_CREDENTIAL_TIME_MAX_MAX_DELTA), ZT_NETWORKCONFIG_DEFAULT_CREDENTIAL_TIME_MIN_MAX_DELTA);
+}
+
+// What a member's config would be built from right now
+static ConfigCache::Stamp _configStamp(const json &network,const uint64_t memberRevision,const int64_t now,const int64_t credentialtmd,const DB::NetworkSummaryInfo &ns,const Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> &metaData)
+{
+	ConfigCache::Stamp stamp;
+	stamp.networkRevision = OSUtils::jsonInt(_jsonField(network,"revision"),0ULL);
+	stamp.memberRevision = memberRevision;
+	stamp.timeBucket = ConfigCache::timeBucket(now,credentialtmd);
+	for(std::vector<Address>::const_iterator ab(ns.activeBridges.begin());ab!=ns.activeBridges.end();++ab)
+		stamp.bridges = (stamp.bridges + ab->toInt()) * 0x9e3779b97f4a7c15ULL;
+	stamp.legacy = (metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_VERSION,0) < 6);
+	stamp.noRulesEngine = (metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_RULES_ENGINE_REV,0) <= 0);
+	return stamp;
+}
+
+static bool _parseRule(const json &r,ZT_VirtualNetworkRule &rule)
 {
 	if (!r.is_object())
 		return false;
 
-	const std::string t(OSUtils::jsonString(r["type"],""));
+	const std::string t(OSUtils::jsonString(_jsonField(r,"type"),""));
 	memset(&rule,0,sizeof(ZT_VirtualNetworkRule));
 
-	if (OSUtils::jsonBool(r["not"],false))
+	if (OSUtils::jsonBool(_jsonField(r,"not"),false))
 		rule.t = 0x80;
 	else rule.t = 0x00;
-	if (OSUtils::jsonBool(r["or"],false))
+	if (OSUtils::jsonBool(_jsonField(r,"or"),false))
 		rule.t |= 0x40;
 
 	bool tag = false;
@@ -275,102 +319,102 @@ static bool _parseRule(json &r,ZT_VirtualNetworkRule &rule)
 		return true;
 	} else if (t == "ACTION_TEE") {
 		rule.t |= ZT_NETWORK_RULE_ACTION_TEE;
-		rule.v.fwd.address = Utils::hexStrToU64(OSUtils::jsonString(r["address"],"0").c_str()) & 0xffffffffffULL;
-		rule.v.fwd.flags = (uint32_t)(OSUtils::jsonInt(r["flags"],0ULL) & 0xffffffffULL);
-		rule.v.fwd.length = (uint16_t)(OSUtils::jsonInt(r["length"],0ULL) & 0xffffULL);
+		rule.v.fwd.address = Utils::hexStrToU64(OSUtils::jsonString(_jsonField(r,"address"),"0").c_str()) & 0xffffffffffULL;
+		rule.v.fwd.flags = (uint32_t)(OSUtils::jsonInt(_jsonField(r,"flags"),0ULL) & 0xffffffffULL);
+		rule.v.fwd.length = (uint16_t)(OSUtils::jsonInt(_jsonField(r,"length"),0ULL) & 0xffffULL);
 		return true;
 	} else if (t == "ACTION_WATCH") {
 		rule.t |= ZT_NETWORK_RULE_ACTION_WATCH;
-		rule.v.fwd.address = Utils::hexStrToU64(OSUtils::jsonString(r["address"],"0").c_str()) & 0xffffffffffULL;
-		rule.v.fwd.flags = (uint32_t)(OSUtils::jsonInt(r["flags"],0ULL) & 0xffffffffULL);
-		rule.v.fwd.length = (uint16_t)(OSUtils::jsonInt(r["length"],0ULL) & 0xffffULL);
+		rule.v.fwd.address = Utils::hexStrToU64(OSUtils::jsonString(_jsonField(r,"address"),"0").c_str()) & 0xffffffffffULL;
+		rule.v.fwd.flags = (uint32_t)(OSUtils::jsonInt(_jsonField(r,"flags"),0ULL) & 0xffffffffULL);
+		rule.v.fwd.length = (uint16_t)(OSUtils::jsonInt(_jsonField(r,"length"),0ULL) & 0xffffULL);
 		return true;
 	} else if (t == "ACTION_REDIRECT") {
 		rule.t |= ZT_NETWORK_RULE_ACTION_REDIRECT;
-		rule.v.fwd.address = Utils::hexStrToU64(OSUtils::jsonString(r["address"],"0").c_str()) & 0xffffffffffULL;
-		rule.v.fwd.flags = (uint32_t)(OSUtils::jsonInt(r["flags"],0ULL) & 0xffffffffULL);
+		rule.v.fwd.address = Utils::hexStrToU64(OSUtils::jsonString(_jsonField(r,"address"),"0").c_str()) & 0xffffffffffULL;
+		rule.v.fwd.flags = (uint32_t)(OSUtils::jsonInt(_jsonField(r,"flags"),0ULL) & 0xffffffffULL);
 		return true;
 	} else if (t == "ACTION_BREAK") {
 		rule.t |= ZT_NETWORK_RULE_ACTION_BREAK;
 		return true;
 	} else if (t == "MATCH_SOURCE_ZEROTIER_ADDRESS") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_SOURCE_ZEROTIER_ADDRESS;
-		rule.v.zt = Utils::hexStrToU64(OSUtils::jsonString(r["zt"],"0").c_str()) & 0xffffffffffULL;
+		rule.v.zt = Utils::hexStrToU64(OSUtils::jsonString(_jsonField(r,"zt"),"0").c_str()) & 0xffffffffffULL;
 		return true;
 	} else if (t == "MATCH_DEST_ZEROTIER_ADDRESS") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_DEST_ZEROTIER_ADDRESS;
-		rule.v.zt = Utils::hexStrToU64(OSUtils::jsonString(r["zt"],"0").c_str()) & 0xffffffffffULL;
+		rule.v.zt = Utils::hexStrToU64(OSUtils::jsonString(_jsonField(r,"zt"),"0").c_str()) & 0xffffffffffULL;
 		return true;
 	} else if (t == "MATCH_VLAN_ID") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_VLAN_ID;
-		rule.v.vlanId = (uint16_t)(OSUtils::jsonInt(r["vlanId"],0ULL) & 0xffffULL);
+		rule.v.vlanId = (uint16_t)(OSUtils::jsonInt(_jsonField(r,"vlanId"),0ULL) & 0xffffULL);
 		return true;
 	} else if (t == "MATCH_VLAN_PCP") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_VLAN_PCP;
-		rule.v.vlanPcp = (uint8_t)(OSUtils::jsonInt(r["vlanPcp"],0ULL) & 0xffULL);
+		rule.v.vlanPcp = (uint8_t)(OSUtils::jsonInt(_jsonField(r,"vlanPcp"),0ULL) & 0xffULL);
 		return true;
 	} else if (t == "MATCH_VLAN_DEI") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_VLAN_DEI;
-		rule.v.vlanDei = (uint8_t)(OSUtils::jsonInt(r["vlanDei"],0ULL) & 0xffULL);
+		rule.v.vlanDei = (uint8_t)(OSUtils::jsonInt(_jsonField(r,"vlanDei"),0ULL) & 0xffULL);
 		return true;
 	} else if (t == "MATCH_MAC_SOURCE") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_MAC_SOURCE;
-		std::string mac(OSUtils::jsonString(r["mac"],"0"));
+		std::string mac(OSUtils::jsonString(_jsonField(r,"mac"),"0"));
 		Utils::cleanMac(mac);
 		Utils::unhex(mac.c_str(),(unsigned int)mac.length(),rule.v.mac,6);
 		return true;
 	} else if (t == "MATCH_MAC_DEST") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_MAC_DEST;
-		std::string mac(OSUtils::jsonString(r["mac"],"0"));
+		std::string mac(OSUtils::jsonString(_jsonField(r,"mac"),"0"));
 		Utils::cleanMac(mac);
 		Utils::unhex(mac.c_str(),(unsigned int)mac.length(),rule.v.mac,6);
 		return true;
 	} else if (t == "MATCH_IPV4_SOURCE") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_IPV4_SOURCE;
-		InetAddress ip(OSUtils::jsonString(r["ip"],"0.0.0.0").c_str());
+		InetAddress ip(OSUtils::jsonString(_jsonField(r,"ip"),"0.0.0.0").c_str());
 		rule.v.ipv4.ip = reinterpret_cast<struct sockaddr_in *>(&ip)->sin_addr.s_addr;
 		rule.v.ipv4.mask = Utils::ntoh(reinterpret_cast<struct sockaddr_in *>(&ip)->sin_port) & 0xff;
 		if (rule.v.ipv4.mask > 32) rule.v.ipv4.mask = 32;
 		return true;
 	} else if (t == "MATCH_IPV4_DEST") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_IPV4_DEST;
-		InetAddress ip(OSUtils::jsonString(r["ip"],"0.0.0.0").c_str());
+		InetAddress ip(OSUtils::jsonString(_jsonField(r,"ip"),"0.0.0.0").c_str());
 		rule.v.ipv4.ip = reinterpret_cast<struct sockaddr_in *>(&ip)->sin_addr.s_addr;
 		rule.v.ipv4.mask = Utils::ntoh(reinterpret_cast<struct sockaddr_in *>(&ip)->sin_port) & 0xff;
 		if (rule.v.ipv4.mask > 32) rule.v.ipv4.mask = 32;
 		return true;
 	} else if (t == "MATCH_IPV6_SOURCE") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_IPV6_SOURCE;
-		InetAddress ip(OSUtils::jsonString(r["ip"],"::0").c_str());
+		InetAddress ip(OSUtils::jsonString(_jsonField(r,"ip"),"::0").c_str());
 		memcpy(rule.v.ipv6.ip,reinterpret_cast<struct sockaddr_in6 *>(&ip)->sin6_addr.s6_addr,16);
 		rule.v.ipv6.mask = Utils::ntoh(reinterpret_cast<struct sockaddr_in6 *>(&ip)->sin6_port) & 0xff;
 		if (rule.v.ipv6.mask > 128) rule.v.ipv6.mask = 128;
 		return true;
 	} else if (t == "MATCH_IPV6_DEST") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_IPV6_DEST;
-		InetAddress ip(OSUtils::jsonString(r["ip"],"::0").c_str());
+		InetAddress ip(OSUtils::jsonString(_jsonField(r,"ip"),"::0").c_str());
 		memcpy(rule.v.ipv6.ip,reinterpret_cast<struct sockaddr_in6 *>(&ip)->sin6_addr.s6_addr,16);
 		rule.v.ipv6.mask = Utils::ntoh(reinterpret_cast<struct sockaddr_in6 *>(&ip)->sin6_port) & 0xff;
 		if (rule.v.ipv6.mask > 128) rule.v.ipv6.mask = 128;
 		return true;
 	} else if (t == "MATCH_IP_TOS") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_IP_TOS;
-		rule.v.ipTos.mask = (uint8_t)(OSUtils::jsonInt(r["mask"],0ULL) & 0xffULL);
-		rule.v.ipTos.value[0] = (uint8_t)(OSUtils::jsonInt(r["start"],0ULL) & 0xffULL);
-		rule.v.ipTos.value[1] = (uint8_t)(OSUtils::jsonInt(r["end"],0ULL) & 0xffULL);
+		rule.v.ipTos.mask = (uint8_t)(OSUtils::jsonInt(_jsonField(r,"mask"),0ULL) & 0xffULL);
+		rule.v.ipTos.value[0] = (uint8_t)(OSUtils::jsonInt(_jsonField(r,"start"),0ULL) & 0xffULL);
+		rule.v.ipTos.value[1] = (uint8_t)(OSUtils::jsonInt(_jsonField(r,"end"),0ULL) & 0xffULL);
 		return true;
 	} else if (t == "MATCH_IP_PROTOCOL") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_IP_PROTOCOL;
-		rule.v.ipProtocol = (uint8_t)(OSUtils::jsonInt(r["ipProtocol"],0ULL) & 0xffULL);
+		rule.v.ipProtocol = (uint8_t)(OSUtils::jsonInt(_jsonField(r,"ipProtocol"),0ULL) & 0xffULL);
 		return true;
 	} else if (t == "MATCH_ETHERTYPE") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_ETHERTYPE;
-		rule.v.etherType = (uint16_t)(OSUtils::jsonInt(r["etherType"],0ULL) & 0xffffULL);
+		rule.v.etherType = (uint16_t)(OSUtils::jsonInt(_jsonField(r,"etherType"),0ULL) & 0xffffULL);
 		return true;
 	} else if (t == "MATCH_ICMP") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_ICMP;
-		rule.v.icmp.type = (uint8_t)(OSUtils::jsonInt(r["icmpType"],0ULL) & 0xffULL);
-		json &code = r["icmpCode"];
+		rule.v.icmp.type = (uint8_t)(OSUtils::jsonInt(_jsonField(r,"icmpType"),0ULL) & 0xffULL);
+		const json &code = _jsonField(r,"icmpCode");
 		if (code.is_null()) {
 			rule.v.icmp.code = 0;
 			rule.v.icmp.flags = 0x00;
@@ -381,18 +425,18 @@ static bool _parseRule(json &r,ZT_VirtualNetworkRule &rule)
 		return true;
 	} else if (t == "MATCH_IP_SOURCE_PORT_RANGE") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_IP_SOURCE_PORT_RANGE;
-		rule.v.port[0] = (uint16_t)(OSUtils::jsonInt(r["start"],0ULL) & 0xffffULL);
-		rule.v.port[1] = (uint16_t)(OSUtils::jsonInt(r["end"],(uint64_t)rule.v.port[0]) & 0xffffULL);
+		rule.v.port[0] = (uint16_t)(OSUtils::jsonInt(_jsonField(r,"start"),0ULL) & 0xffffULL);
+		rule.v.port[1] = (uint16_t)(OSUtils::jsonInt(_jsonField(r,"end"),(uint64_t)rule.v.port[0]) & 0xffffULL);
 		return true;
 	} else if (t == "MATCH_IP_DEST_PORT_RANGE") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_IP_DEST_PORT_RANGE;
-		rule.v.port[0] = (uint16_t)(OSUtils::jsonInt(r["start"],0ULL) & 0xffffULL);
-		rule.v.port[1] = (uint16_t)(OSUtils::jsonInt(r["end"],(uint64_t)rule.v.port[0]) & 0xffffULL);
+		rule.v.port[0] = (uint16_t)(OSUtils::jsonInt(_jsonField(r,"start"),0ULL) & 0xffffULL);
+		rule.v.port[1] = (uint16_t)(OSUtils::jsonInt(_jsonField(r,"end"),(uint64_t)rule.v.port[0]) & 0xffffULL);
 		return true;
 	} else if (t == "MATCH_CHARACTERISTICS") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_CHARACTERISTICS;
 		if (r.count("mask")) {
-			json &v = r["mask"];
+			const json &v = _jsonField(r,"mask");
 			if (v.is_number()) {
 				rule.v.characteristics = v;
 			} else {
@@ -403,12 +447,12 @@ static bool _parseRule(json &r,ZT_VirtualNetworkRule &rule)
 		return true;
 	} else if (t == "MATCH_FRAME_SIZE_RANGE") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_FRAME_SIZE_RANGE;
-		rule.v.frameSize[0] = (uint16_t)(OSUtils::jsonInt(r["start"],0ULL) & 0xffffULL);
-		rule.v.frameSize[1] = (uint16_t)(OSUtils::jsonInt(r["end"],(uint64_t)rule.v.frameSize[0]) & 0xffffULL);
+		rule.v.frameSize[0] = (uint16_t)(OSUtils::jsonInt(_jsonField(r,"start"),0ULL) & 0xffffULL);
+		rule.v.frameSize[1] = (uint16_t)(OSUtils::jsonInt(_jsonField(r,"end"),(uint64_t)rule.v.frameSize[0]) & 0xffffULL);
 		return true;
 	} else if (t == "MATCH_RANDOM") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_RANDOM;
-		rule.v.randomProbability = (uint32_t)(OSUtils::jsonInt(r["probability"],0ULL) & 0xffffffffULL);
+		rule.v.randomProbability = (uint32_t)(OSUtils::jsonInt(_jsonField(r,"probability"),0ULL) & 0xffffffffULL);
 		return true;
 	} else if (t == "MATCH_TAGS_DIFFERENCE") {
 		rule.t |= ZT_NETWORK_RULE_MATCH_TAGS_DIFFERENCE;
@@ -432,28 +476,28 @@ static bool _parseRule(json &r,ZT_VirtualNetworkRule &rule)
 		rule.t |= ZT_NETWORK_RULE_MATCH_TAG_RECEIVER;
 		tag = true;
 	} else if (t == "INTEGER_RANGE") {
-		json &s = r["start"];
+		const json &s = _jsonField(r,"start");
 		if (s.is_string()) {
 			std::string tmp = s;
 			rule.v.intRange.start = Utils::hexStrToU64(tmp.c_str());
 		} else {
 			rule.v.intRange.start = OSUtils::jsonInt(s,0ULL);
 		}
-		json &e = r["end"];
+		const json &e = _jsonField(r,"end");
 		if (e.is_string()) {
 			std::string tmp = e;
 			rule.v.intRange.end = (uint32_t)(Utils::hexStrToU64(tmp.c_str()) - rule.v.intRange.start);
 		} else {
 			rule.v.intRange.end = (uint32_t)(OSUtils::jsonInt(e,0ULL) - rule.v.intRange.start);
 		}
-		rule.v.intRange.idx = (uint16_t)OSUtils::jsonInt(r["idx"],0ULL);
-		rule.v.intRange.format = (OSUtils::jsonBool(r["little"],false)) ? 0x80 : 0x00;
-		rule.v.intRange.format |= (uint8_t)((OSUtils::jsonInt(r["bits"],1ULL) - 1) & 63);
+		rule.v.intRange.idx = (uint16_t)OSUtils::jsonInt(_jsonField(r,"idx"),0ULL);
+		rule.v.intRange.format = (OSUtils::jsonBool(_jsonField(r,"little"),false)) ? 0x80 : 0x00;
+		rule.v.intRange.format |= (uint8_t)((OSUtils::jsonInt(_jsonField(r,"bits"),1ULL) - 1) & 63);
 	}
 
 	if (tag) {
-		rule.v.tag.id = (uint32_t)(OSUtils::jsonInt(r["id"],0ULL) & 0xffffffffULL);
-		rule.v.tag.value = (uint32_t)(OSUtils::jsonInt(r["value"],0ULL) & 0xffffffffULL);
+		rule.v.tag.id = (uint32_t)(OSUtils::jsonInt(_jsonField(r,"id"),0ULL) & 0xffffffffULL);
+		rule.v.tag.value = (uint32_t)(OSUtils::jsonInt(_jsonField(r,"value"),0ULL) & 0xffffffffULL);
 		return true;
 	}
 
@@ -472,13 +516,14 @@ EmbeddedNetworkController::EmbeddedNetworkController(Node *node,const char *ztPa
 	, _signingIdAddressString()
 	, _sender((NetworkController::Sender *)0)
 	, _db(this)
-	, _queue()
+	, _queue(ZT_NETCONF_MAX_QUEUED_REQUESTS)
 	, _threads()
 	, _threads_l()
 	, _memberStatus()
 	, _memberStatus_l()
 	, _expiringSoon()
 	, _expiringSoon_l()
+	, _configCache(ZT_CONTROLLER_CONFIG_CACHE_MAX_BYTES)
 	, _rc(rc)
 	, _ssoExpiryRunning(true)
 	, _ssoExpiry(std::thread(&EmbeddedNetworkController::_ssoExpiryThread, this))
@@ -535,12 +580,13 @@ void EmbeddedNetworkController::init(const Identity &signingId,Sender *sender)
 #ifdef ZT_CONTROLLER_USE_LIBPQ
 	if ((_path.length() > 9)&&(_path.substr(0,9) == "postgres:")) {
 		_db.addDB(std::shared_ptr<DB>(new PostgreSQL(_signingId,_path.substr(9).c_str(), _listenPort, _rc)));
-	} else {
+	} else
 #endif
+	if ((_path.length() > 4)&&(_path.substr(0,4) == "log:")) {
+		_db.addDB(std::shared_ptr<DB>(new LogDB(_path.substr(4).c_str())));
+	} else {
 		_db.addDB(std::shared_ptr<DB>(new FileDB(_path.c_str())));
-#ifdef ZT_CONTROLLER_USE_LIBPQ
 	}
-#endif
 
 	std::string lfJSON;
 	OSUtils::readFile((_ztPath + ZT_PATH_SEPARATOR_S "local.conf").c_str(),lfJSON);
@@ -597,14 +643,30 @@ void EmbeddedNetworkController::request(
 		ms.lastRequestTime = now;
 	}
 
+	// Members the controller has no record of yet are joining and go ahead of
+	// members refreshing a config they already have.
+	const uint64_t memberId = identity.address().toInt();
 	_RQEntry *qe = new _RQEntry;
 	qe->nwid = nwid;
 	qe->requestPacketId = requestPacketId;
 	qe->fromAddr = fromAddr;
 	qe->identity = identity;
 	qe->metaData = metaData;
+	qe->receivedAt = now;
 	qe->type = _RQEntry::RQENTRY_TYPE_REQUEST;
-	_queue.post(qe);
+	switch(_queue.post(nwid,memberId,(_db.hasMember(nwid,memberId)) ? ConfigRequestQueue<_RQEntry>::PRIORITY_REFRESH : ConfigRequestQueue<_RQEntry>::PRIORITY_JOIN,qe)) {
+		case ConfigRequestQueue<_RQEntry>::QUEUED:
+			Metrics::network_config_request_queued++;
+			break;
+		case ConfigRequestQueue<_RQEntry>::COALESCED:
+			Metrics::network_config_request_coalesced++;
+			break;
+		case ConfigRequestQueue<_RQEntry>::FULL:
+			Metrics::network_config_request_rejected++;
+			if (requestPacketId) // a push has nobody waiting for an answer
+				_sender->ncSendError(nwid,requestPacketId,identity.address(),NetworkController::NC_ERROR_BUSY,nullptr,0);
+			break;
+	}
 }
 
 std::string EmbeddedNetworkController::networkUpdateFromPostData(uint64_t networkID, const std::string &body)
@@ -1101,9 +1163,18 @@ void EmbeddedNetworkController::configureHTTPControlPlane(
 		if (_db.get(nwid, network, memTmp)) {
 			uint64_t authorizedCount = 0;
 			uint64_t totalCount = memTmp.size();
+			const std::shared_ptr<const MemberOnlineTable::Network> online(_db.lastSeen(nwid));
 			for (auto m = memTmp.begin(); m != memTmp.end(); ++m) {
 				bool a = OSUtils::jsonBool((*m)["authorized"], 0);
 				if (a) { authorizedCount++; }
+				if (online) {
+					auto o = online->find(OSUtils::jsonIntHex((*m)["id"], 0ULL));
+					if (o != online->end()) {
+						char tmp[64];
+						(*m)["lastOnline"] = o->second.ts;
+						(*m)["physicalAddress"] = o->second.physicalAddress.toString(tmp);
+					}
+				}
 			}
 
 			meta["totalCount"] = totalCount;
@@ -1133,6 +1204,18 @@ void EmbeddedNetworkController::configureHTTPControlPlane(
 			return;
 		}
 
+		MemberOnlineTable::Member online;
+		if (_db.lastSeen(nwid, memid, online)) {
+			char tmp[64];
+			member["lastOnline"] = online.latest().ts;
+			member["physicalAddress"] = online.latest().physicalAddress.toString(tmp);
+			json recent = json::array();
+			for (unsigned int i = 0; i < online.count; ++i) {
+				recent.push_back({{ "lastOnline", online.at(i).ts },{ "physicalAddress", online.at(i).physicalAddress.toString(tmp) }});
+			}
+			member["recentPhysicalAddresses"] = recent;
+		}
+
 		setContent(req, res, member.dump());
 	};
 	s.Get(memberPath, memberGet);
@@ -1331,6 +1414,8 @@ void EmbeddedNetworkController::handleRemoteTrace(const ZT_RemoteTrace &rt)
 
 void EmbeddedNetworkController::onNetworkUpdate(const void *db,uint64_t networkId,const nlohmann::json &network)
 {
+	_configCache.forgetNetwork(networkId);
+
 	// Send an update to all members of the network that are online
 	const int64_t now = OSUtils::now();
 	std::lock_guard<std::mutex> l(_memberStatus_l);
@@ -1342,6 +1427,8 @@ void EmbeddedNetworkController::onNetworkUpdate(const void *db,uint64_t networkI
 
 void EmbeddedNetworkController::onNetworkMemberUpdate(const void *db,uint64_t networkId,uint64_t memberId,const nlohmann::json &member)
 {
+	_configCache.forgetMember(networkId,memberId);
+
 	// Push update to member if online
 	try {
 		std::lock_guard<std::mutex> l(_memberStatus_l);
@@ -1353,6 +1440,8 @@ void EmbeddedNetworkController::onNetworkMemberUpdate(const void *db,uint64_t ne
 
 void EmbeddedNetworkController::onNetworkMemberDeauthorize(const void *db,uint64_t networkId,uint64_t memberId)
 {
+	_configCache.forgetMember(networkId,memberId);
+
 	const int64_t now = OSUtils::now();
 	Revocation rev((uint32_t)_node->prng(),networkId,0,now,ZT_REVOCATION_FLAG_FAST_PROPAGATE,Address(memberId),Revocation::CREDENTIAL_TYPE_COM);
 	rev.sign(_signingId);
@@ -1385,7 +1474,9 @@ void EmbeddedNetworkController::_request(
 
 	char nwids[24];
 	DB::NetworkSummaryInfo ns;
-	json network,member;
+	std::shared_ptr<const json> networkSnapshot;
+	std::shared_ptr<const DB::MemberRecord> memberRecord;
+	json member;
 
 	if (((!_signingId)||(!_signingId.hasPrivate()))||(_signingId.address().toInt() != (nwid >> 24))||(!_sender)) {
 		return;
@@ -1410,17 +1501,49 @@ void EmbeddedNetworkController::_request(
 	b3.start();
 #endif
 	Utils::hex(nwid,nwids);
-	_db.get(nwid,network,identity.address().toInt(),member,ns);
-	if ((!network.is_object())||(network.empty())) {
+	_db.get(nwid,networkSnapshot,identity.address().toInt(),memberRecord,ns);
+	if ((!networkSnapshot)||(!networkSnapshot->is_object())||(networkSnapshot->empty())) {
 		_sender->ncSendError(nwid,requestPacketId,identity.address(),NetworkController::NC_ERROR_OBJECT_NOT_FOUND, nullptr, 0);
 #ifdef CENTRAL_CONTROLLER_REQUEST_BENCHMARK
 		b3.stop();
 #endif
 		return;
 	}
+	const json &network = *networkSnapshot; // shared, so read only through _jsonField()
+	const bool networkSSOEnabled = OSUtils::jsonBool(_jsonField(network,"ssoEnabled"), false);
+	const int64_t credentialtmd = _credentialTimeMaxDelta(network);
+	_MemberStatusKey msk(nwid,identity.address().toInt());
+
+	// Most requests are periodic refreshes from authorized members that change nothing in
+	// their records. If this is one and its config is cached, answer it from the record
+	// without building the member's json. Anything else takes the full path below.
+	if ((memberRecord)&&(memberRecord->complete())&&(memberRecord->authorized())&&(memberRecord->id() == identity.address().toInt())&&(memberRecord->networkId() == nwid)&&((!networkSSOEnabled)||(memberRecord->ssoExempt()))) {
+		const std::chrono::steady_clock::time_point buildStart(std::chrono::steady_clock::now());
+		char idtmp[1024];
+		if ((memberRecord->identity() == identity.toString(false,idtmp))&&((!requestPacketId)||(memberRecord->versionIs(
+			metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_NODE_MAJOR_VERSION,0),
+			metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_NODE_MINOR_VERSION,0),
+			metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_NODE_REVISION,0),
+			metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_PROTOCOL_VERSION,0))))) {
+			std::string dict;
+			if (_configCache.get(nwid,identity.address().toInt(),_configStamp(network,memberRecord->revision(),now,credentialtmd,ns,metaData),dict)) {
+				Metrics::network_config_cache_hit++;
+				Metrics::network_config_build_time_hit.Observe((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - buildStart).count());
+				if (requestPacketId)
+					_setMemberStatus(msk,-1,identity,metaData);
+#ifdef CENTRAL_CONTROLLER_REQUEST_BENCHMARK
+				b3.stop();
+#endif
+				_sender->ncSendSerializedConfig(nwid,requestPacketId,identity.address(),dict.data(),(unsigned int)dict.size());
+				return;
+			}
+		}
+	}
+
+	if (memberRecord)
+		memberRecord->toJson(member);
 	const bool newMember = ((!member.is_object())||(member.empty()));
 	DB::initMember(member);
-	_MemberStatusKey msk(nwid,identity.address().toInt());
 #ifdef CENTRAL_CONTROLLER_REQUEST_BENCHMARK
 	b3.stop();
 #endif
@@ -1483,7 +1606,7 @@ void EmbeddedNetworkController::_request(
 	json autoAuthCredentialType,autoAuthCredential;
 	if (OSUtils::jsonBool(member["authorized"],false)) {
 		authorized = true;
-	} else if (!OSUtils::jsonBool(network["private"],true)) {
+	} else if (!OSUtils::jsonBool(_jsonField(network,"private"),true)) {
 		authorized = true;
 		autoAuthorized = true;
 		autoAuthCredentialType = "public";
@@ -1493,7 +1616,7 @@ void EmbeddedNetworkController::_request(
 			presentedAuth[511] = (char)0; // sanity check
 			if ((strlen(presentedAuth) > 6)&&(!strncmp(presentedAuth,"token:",6))) {
 				const char *const presentedToken = presentedAuth + 6;
-				json authTokens(network["authTokens"]);
+				json authTokens(_jsonField(network,"authTokens"));
 				json &tokenExpires = authTokens[presentedToken];
 				if (tokenExpires.is_number()) {
 					if ((tokenExpires == 0)||(tokenExpires > now)) {
@@ -1529,7 +1652,6 @@ void EmbeddedNetworkController::_request(
 #endif
 	AuthInfo info;
 	int64_t authenticationExpiryTime = -1;
-	bool networkSSOEnabled = OSUtils::jsonBool(network["ssoEnabled"], false);
 	bool memberSSOExempt = OSUtils::jsonBool(member["ssoExempt"], false);
 	if (networkSSOEnabled && !memberSSOExempt) {
 		authenticationExpiryTime = (int64_t)OSUtils::jsonInt(member["authenticationExpiryTime"], 0);
@@ -1581,22 +1703,7 @@ void EmbeddedNetworkController::_request(
 			member["vRev"] = vRev;
 			member["vProto"] = vProto;
 
-			{
-				std::lock_guard<std::mutex> l(_memberStatus_l);
-				_MemberStatus &ms = _memberStatus[msk];
-				ms.authenticationExpiryTime = authenticationExpiryTime;
-				ms.vMajor = (int)vMajor;
-				ms.vMinor = (int)vMinor;
-				ms.vRev = (int)vRev;
-				ms.vProto = (int)vProto;
-				ms.lastRequestMetaData = metaData;
-				ms.identity = identity;
-			}
-
-			if (authenticationExpiryTime > 0) {
-				std::lock_guard<std::mutex> l(_expiringSoon_l);
-				_expiringSoon.insert(std::pair<int64_t, _MemberStatusKey>(authenticationExpiryTime, msk));
-			}
+			_setMemberStatus(msk,authenticationExpiryTime,identity,metaData);
 		}
 	} else {
 		// If they are not authorized, STOP!
@@ -1624,26 +1731,42 @@ void EmbeddedNetworkController::_request(
 	c8++;
 	b8.start();
 #endif
-	int64_t credentialtmd = ZT_NETWORKCONFIG_DEFAULT_CREDENTIAL_TIME_DFL_MAX_DELTA;
-	if (network.contains("certificateTimeoutWindowSize")) {
-		credentialtmd = (int64_t)network["certificateTimeoutWindowSize"];
+	// Most requests are periodic refreshes, so if nothing this member's config is built from
+	// has changed and its credentials are recent enough, send the last one again. SSO configs
+	// carry per-request auth state so they are always built.
+	const std::chrono::steady_clock::time_point buildStart(std::chrono::steady_clock::now());
+	const ConfigCache::Stamp stamp(_configStamp(network,OSUtils::jsonInt(member["revision"],0ULL),now,credentialtmd,ns,metaData));
+	bool cacheable = !(networkSSOEnabled && !memberSSOExempt);
+	if (cacheable) {
+		std::string dict;
+		if (_configCache.get(nwid,identity.address().toInt(),stamp,dict)) {
+			Metrics::network_config_cache_hit++;
+			Metrics::network_config_build_time_hit.Observe((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - buildStart).count());
+#ifdef CENTRAL_CONTROLLER_REQUEST_BENCHMARK
+			b8.stop();
+#endif
+			DB::cleanMember(member);
+			_db.save(member,true);
+			_sender->ncSendSerializedConfig(nwid,requestPacketId,identity.address(),dict.data(),(unsigned int)dict.size());
+			return;
+		}
 	}
-	credentialtmd = std::max(std::min(credentialtmd, ZT_NETWORKCONFIG_DEFAULT_CREDENTIAL_TIME_MAX_MAX_DELTA), ZT_NETWORKCONFIG_DEFAULT_CREDENTIAL_TIME_MIN_MAX_DELTA);
+	Metrics::network_config_cache_miss++;
 
 	std::unique_ptr<NetworkConfig> nc(new NetworkConfig());
 
 	nc->networkId = nwid;
-	nc->type = OSUtils::jsonBool(network["private"],true) ? ZT_NETWORK_TYPE_PRIVATE : ZT_NETWORK_TYPE_PUBLIC;
+	nc->type = OSUtils::jsonBool(_jsonField(network,"private"),true) ? ZT_NETWORK_TYPE_PRIVATE : ZT_NETWORK_TYPE_PUBLIC;
 	nc->timestamp = now;
 	nc->credentialTimeMaxDelta = credentialtmd;
-	nc->revision = OSUtils::jsonInt(network["revision"],0ULL);
+	nc->revision = OSUtils::jsonInt(_jsonField(network,"revision"),0ULL);
 	nc->issuedTo = identity.address();
-	if (OSUtils::jsonBool(network["enableBroadcast"],true)) nc->flags |= ZT_NETWORKCONFIG_FLAG_ENABLE_BROADCAST;
-	Utils::scopy(nc->name,sizeof(nc->name),OSUtils::jsonString(network["name"],"").c_str());
-	nc->mtu = std::max(std::min((unsigned int)OSUtils::jsonInt(network["mtu"],ZT_DEFAULT_MTU),(unsigned int)ZT_MAX_MTU),(unsigned int)ZT_MIN_MTU);
-	nc->multicastLimit = (unsigned int)OSUtils::jsonInt(network["multicastLimit"],32ULL);
+	if (OSUtils::jsonBool(_jsonField(network,"enableBroadcast"),true)) nc->flags |= ZT_NETWORKCONFIG_FLAG_ENABLE_BROADCAST;
+	Utils::scopy(nc->name,sizeof(nc->name),OSUtils::jsonString(_jsonField(network,"name"),"").c_str());
+	nc->mtu = std::max(std::min((unsigned int)OSUtils::jsonInt(_jsonField(network,"mtu"),ZT_DEFAULT_MTU),(unsigned int)ZT_MAX_MTU),(unsigned int)ZT_MIN_MTU);
+	nc->multicastLimit = (unsigned int)OSUtils::jsonInt(_jsonField(network,"multicastLimit"),32ULL);
 
-	nc->ssoEnabled = networkSSOEnabled; //OSUtils::jsonBool(network["ssoEnabled"], false);
+	nc->ssoEnabled = networkSSOEnabled; //OSUtils::jsonBool(_jsonField(network,"ssoEnabled"), false);
 	nc->ssoVersion = info.version;
 
 	if (info.version == 0) {
@@ -1682,29 +1805,29 @@ void EmbeddedNetworkController::_request(
 		nc->remoteTraceTarget = Address(Utils::hexStrToU64(rtt.c_str()));
 		nc->remoteTraceLevel = (Trace::Level)OSUtils::jsonInt(member["remoteTraceLevel"],0ULL);
 	} else {
-		rtt = OSUtils::jsonString(network["remoteTraceTarget"],"");
+		rtt = OSUtils::jsonString(_jsonField(network,"remoteTraceTarget"),"");
 		if (rtt.length() == 10) {
 			nc->remoteTraceTarget = Address(Utils::hexStrToU64(rtt.c_str()));
 		} else {
 			nc->remoteTraceTarget.zero();
 		}
-		nc->remoteTraceLevel = (Trace::Level)OSUtils::jsonInt(network["remoteTraceLevel"],0ULL);
+		nc->remoteTraceLevel = (Trace::Level)OSUtils::jsonInt(_jsonField(network,"remoteTraceLevel"),0ULL);
 	}
 
 	for(std::vector<Address>::const_iterator ab(ns.activeBridges.begin());ab!=ns.activeBridges.end();++ab) {
 		nc->addSpecialist(*ab,ZT_NETWORKCONFIG_SPECIALIST_TYPE_ACTIVE_BRIDGE);
 	}
 
-	json &v4AssignMode = network["v4AssignMode"];
-	json &v6AssignMode = network["v6AssignMode"];
-	json &ipAssignmentPools = network["ipAssignmentPools"];
-	json &routes = network["routes"];
-	json &rules = network["rules"];
-	json &capabilities = network["capabilities"];
-	json &tags = network["tags"];
+	const json &v4AssignMode = _jsonField(network,"v4AssignMode");
+	const json &v6AssignMode = _jsonField(network,"v6AssignMode");
+	const json &ipAssignmentPools = _jsonField(network,"ipAssignmentPools");
+	const json &routes = _jsonField(network,"routes");
+	const json &rules = _jsonField(network,"rules");
+	const json &capabilities = _jsonField(network,"capabilities");
+	const json &tags = _jsonField(network,"tags");
 	json &memberCapabilities = member["capabilities"];
 	json &memberTags = member["tags"];
-	json &dns = network["dns"];
+	const json &dns = _jsonField(network,"dns");
 
 	//fprintf(stderr, "IP Assignment Pools for Network %s: %s\n", nwids, OSUtils::jsonDump(ipAssignmentPools, 2).c_str());
 
@@ -1724,16 +1847,16 @@ void EmbeddedNetworkController::_request(
 			}
 		}
 
-		std::map< uint64_t,json * > capsById;
+		std::map< uint64_t,const json * > capsById;
 		if (!memberCapabilities.is_array())
 			memberCapabilities = json::array();
 		if (capabilities.is_array()) {
 			for(unsigned long i=0;i<capabilities.size();++i) {
-				json &cap = capabilities[i];
+				const json &cap = capabilities[i];
 				if (cap.is_object()) {
-					const uint64_t id = OSUtils::jsonInt(cap["id"],0ULL) & 0xffffffffULL;
+					const uint64_t id = OSUtils::jsonInt(_jsonField(cap,"id"),0ULL) & 0xffffffffULL;
 					capsById[id] = &cap;
-					if ((newMember)&&(OSUtils::jsonBool(cap["default"],false))) {
+					if ((newMember)&&(OSUtils::jsonBool(_jsonField(cap,"default"),false))) {
 						bool have = false;
 						for(unsigned long i=0;i<memberCapabilities.size();++i) {
 							if (id == (OSUtils::jsonInt(memberCapabilities[i],0ULL) & 0xffffffffULL)) {
@@ -1749,13 +1872,13 @@ void EmbeddedNetworkController::_request(
 		}
 		for(unsigned long i=0;i<memberCapabilities.size();++i) {
 			const uint64_t capId = OSUtils::jsonInt(memberCapabilities[i],0ULL) & 0xffffffffULL;
-			std::map< uint64_t,json * >::const_iterator ctmp = capsById.find(capId);
+			std::map< uint64_t,const json * >::const_iterator ctmp = capsById.find(capId);
 			if (ctmp != capsById.end()) {
-				json *cap = ctmp->second;
+				const json *cap = ctmp->second;
 				if ((cap)&&(cap->is_object())&&(!cap->empty())) {
 					ZT_VirtualNetworkRule capr[ZT_MAX_CAPABILITY_RULES];
 					unsigned int caprc = 0;
-					json &caprj = (*cap)["rules"];
+					const json &caprj = _jsonField(*cap,"rules");
 					if ((caprj.is_array())&&(!caprj.empty())) {
 						for(unsigned long j=0;j<caprj.size();++j) {
 							if (caprc >= ZT_MAX_CAPABILITY_RULES)
@@ -1783,10 +1906,10 @@ void EmbeddedNetworkController::_request(
 		}
 		if (tags.is_array()) { // check network tags array for defaults that are not present in member tags
 			for(unsigned long i=0;i<tags.size();++i) {
-				json &t = tags[i];
+				const json &t = tags[i];
 				if (t.is_object()) {
-					const uint32_t id = (uint32_t)(OSUtils::jsonInt(t["id"],0) & 0xffffffffULL);
-					json &dfl = t["default"];
+					const uint32_t id = (uint32_t)(OSUtils::jsonInt(_jsonField(t,"id"),0) & 0xffffffffULL);
+					const json &dfl = _jsonField(t,"default");
 					if ((dfl.is_number())&&(memberTagsById.find(id) == memberTagsById.end())) {
 						memberTagsById[id] = (uint32_t)(OSUtils::jsonInt(dfl,0) & 0xffffffffULL);
 						json mt = json::array();
@@ -1810,9 +1933,9 @@ void EmbeddedNetworkController::_request(
 		for(unsigned long i=0;i<routes.size();++i) {
 			if (nc->routeCount >= ZT_MAX_NETWORK_ROUTES)
 				break;
-			json &route = routes[i];
-			json &target = route["target"];
-			json &via = route["via"];
+			const json &route = routes[i];
+			const json &target = _jsonField(route,"target");
+			const json &via = _jsonField(route,"via");
 			if (target.is_string()) {
 				const InetAddress t(target.get<std::string>().c_str());
 				InetAddress v;
@@ -1831,11 +1954,11 @@ void EmbeddedNetworkController::_request(
 	const bool noAutoAssignIps = OSUtils::jsonBool(member["noAutoAssignIps"],false);
 
 	if ((v6AssignMode.is_object())&&(!noAutoAssignIps)) {
-		if ((OSUtils::jsonBool(v6AssignMode["rfc4193"],false))&&(nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES)) {
+		if ((OSUtils::jsonBool(_jsonField(v6AssignMode,"rfc4193"),false))&&(nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES)) {
 			nc->staticIps[nc->staticIpCount++] = InetAddress::makeIpv6rfc4193(nwid,identity.address().toInt());
 			nc->flags |= ZT_NETWORKCONFIG_FLAG_ENABLE_IPV6_NDP_EMULATION;
 		}
-		if ((OSUtils::jsonBool(v6AssignMode["6plane"],false))&&(nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES)) {
+		if ((OSUtils::jsonBool(_jsonField(v6AssignMode,"6plane"),false))&&(nc->staticIpCount < ZT_MAX_ZT_ASSIGNED_ADDRESSES)) {
 			nc->staticIps[nc->staticIpCount++] = InetAddress::makeIpv66plane(nwid,identity.address().toInt());
 			nc->flags |= ZT_NETWORKCONFIG_FLAG_ENABLE_IPV6_NDP_EMULATION;
 		}
@@ -1875,12 +1998,13 @@ void EmbeddedNetworkController::_request(
 		ipAssignments = json::array();
 	}
 
-	if ( (ipAssignmentPools.is_array()) && ((v6AssignMode.is_object())&&(OSUtils::jsonBool(v6AssignMode["zt"],false))) && (!haveManagedIpv6AutoAssignment) && (!noAutoAssignIps) ) {
+	if ( (ipAssignmentPools.is_array()) && ((v6AssignMode.is_object())&&(OSUtils::jsonBool(_jsonField(v6AssignMode,"zt"),false))) && (!haveManagedIpv6AutoAssignment) && (!noAutoAssignIps) ) {
+		cacheable = false; // depends on which addresses are free
 		for(unsigned long p=0;((p<ipAssignmentPools.size())&&(!haveManagedIpv6AutoAssignment));++p) {
-			json &pool = ipAssignmentPools[p];
+			const json &pool = ipAssignmentPools[p];
 			if (pool.is_object()) {
-				InetAddress ipRangeStart(OSUtils::jsonString(pool["ipRangeStart"],"").c_str());
-				InetAddress ipRangeEnd(OSUtils::jsonString(pool["ipRangeEnd"],"").c_str());
+				InetAddress ipRangeStart(OSUtils::jsonString(_jsonField(pool,"ipRangeStart"),"").c_str());
+				InetAddress ipRangeEnd(OSUtils::jsonString(_jsonField(pool,"ipRangeEnd"),"").c_str());
 				if ( (ipRangeStart.ss_family == AF_INET6) && (ipRangeEnd.ss_family == AF_INET6) ) {
 					uint64_t s[2],e[2],x[2],xx[2];
 					memcpy(s,ipRangeStart.rawIpData(),16);
@@ -1920,7 +2044,7 @@ void EmbeddedNetworkController::_request(
 						}
 
 						// If it's routed, then try to claim and assign it and if successful end loop
-						if ( (routedNetmaskBits > 0) && (!std::binary_search(ns.allocatedIps.begin(),ns.allocatedIps.end(),ip6)) ) {
+						if ( (routedNetmaskBits > 0) && (!ns.allocatedIps.contains(ip6)) ) {
 							char tmpip[64];
 							const std::string ipStr(ip6.toIpString(tmpip));
 							if (std::find(ipAssignments.begin(),ipAssignments.end(),ipStr) == ipAssignments.end()) {
@@ -1939,12 +2063,13 @@ void EmbeddedNetworkController::_request(
 		}
 	}
 
-	if ( (ipAssignmentPools.is_array()) && ((v4AssignMode.is_object())&&(OSUtils::jsonBool(v4AssignMode["zt"],false))) && (!haveManagedIpv4AutoAssignment) && (!noAutoAssignIps) ) {
+	if ( (ipAssignmentPools.is_array()) && ((v4AssignMode.is_object())&&(OSUtils::jsonBool(_jsonField(v4AssignMode,"zt"),false))) && (!haveManagedIpv4AutoAssignment) && (!noAutoAssignIps) ) {
+		cacheable = false; // depends on which addresses are free
 		for(unsigned long p=0;((p<ipAssignmentPools.size())&&(!haveManagedIpv4AutoAssignment));++p) {
-			json &pool = ipAssignmentPools[p];
+			const json &pool = ipAssignmentPools[p];
 			if (pool.is_object()) {
-				InetAddress ipRangeStartIA(OSUtils::jsonString(pool["ipRangeStart"],"").c_str());
-				InetAddress ipRangeEndIA(OSUtils::jsonString(pool["ipRangeEnd"],"").c_str());
+				InetAddress ipRangeStartIA(OSUtils::jsonString(_jsonField(pool,"ipRangeStart"),"").c_str());
+				InetAddress ipRangeEndIA(OSUtils::jsonString(_jsonField(pool,"ipRangeEnd"),"").c_str());
 				if ( (ipRangeStartIA.ss_family == AF_INET) && (ipRangeEndIA.ss_family == AF_INET) ) {
 					uint32_t ipRangeStart = Utils::ntoh((uint32_t)(reinterpret_cast<struct sockaddr_in *>(&ipRangeStartIA)->sin_addr.s_addr));
 					uint32_t ipRangeEnd = Utils::ntoh((uint32_t)(reinterpret_cast<struct sockaddr_in *>(&ipRangeEndIA)->sin_addr.s_addr));
@@ -1953,12 +2078,31 @@ void EmbeddedNetworkController::_request(
 						continue;
 					uint32_t ipRangeLen = ipRangeEnd - ipRangeStart;
 
-					// Start with the LSB of the member's address
-					uint32_t ipTrialCounter = (uint32_t)(identity.address().toInt() & 0xffffffff);
+					// Start with the LSB of the member's address, then walk forward (wrapping once) over
+					// unassigned addresses. Assigned runs are skipped in one step, so a full pool doesn't
+					// use up trials; they are only spent on addresses that can't be used.
+					const uint32_t ipRangeLast = (ipRangeLen > 0) ? (ipRangeEnd - 1) : ipRangeStart;
+					const uint32_t ipFirstChoice = (ipRangeLen > 0) ? (ipRangeStart + ((uint32_t)(identity.address().toInt() & 0xffffffff) % ipRangeLen)) : ipRangeStart;
+					uint32_t ipNext = ipFirstChoice;
+					bool wrapped = false;
 
-					for(uint32_t k=ipRangeStart,trialCount=0;((k<=ipRangeEnd)&&(trialCount < 1000));++k,++trialCount) {
-						uint32_t ip = (ipRangeLen > 0) ? (ipRangeStart + (ipTrialCounter % ipRangeLen)) : ipRangeStart;
-						++ipTrialCounter;
+					for(unsigned int trialCount=0;trialCount<1000;++trialCount) {
+						uint32_t ip = 0;
+						if ((wrapped)&&(ipNext >= ipFirstChoice))
+							break;
+						if (!ns.allocatedIps.nextFreeV4(ipNext,(wrapped) ? (ipFirstChoice - 1) : ipRangeLast,ip)) {
+							if ((wrapped)||(ipFirstChoice == ipRangeStart))
+								break;
+							wrapped = true;
+							ipNext = ipRangeStart;
+							continue;
+						}
+						if (ip == ipRangeLast) {
+							wrapped = true;
+							ipNext = ipRangeStart;
+						} else {
+							ipNext = ip + 1;
+						}
 						if ((ip & 0x000000ff) == 0x000000ff) {
 							continue; // don't allow addresses that end in .255
 						}
@@ -1978,7 +2122,7 @@ void EmbeddedNetworkController::_request(
 
 						// If it's routed, then try to claim and assign it and if successful end loop
 						const InetAddress ip4(Utils::hton(ip),0);
-						if ( (routedNetmaskBits > 0) && (!std::binary_search(ns.allocatedIps.begin(),ns.allocatedIps.end(),ip4)) ) {
+						if (routedNetmaskBits > 0) {
 							char tmpip[64];
 							const std::string ipStr(ip4.toIpString(tmpip));
 							if (std::find(ipAssignments.begin(),ipAssignments.end(),ipStr) == ipAssignments.end()) {
@@ -2001,17 +2145,15 @@ void EmbeddedNetworkController::_request(
 	}
 	
 	if(dns.is_object()) {
-		std::string domain = OSUtils::jsonString(dns["domain"],"");
+		std::string domain = OSUtils::jsonString(_jsonField(dns,"domain"),"");
 		memcpy(nc->dns.domain, domain.c_str(), domain.size());
-		json &addrArray = dns["servers"];
+		const json &addrArray = _jsonField(dns,"servers");
 		if (addrArray.is_array()) {
 			for(unsigned int j = 0; j < addrArray.size() && j < ZT_MAX_DNS_SERVERS; ++j) {
-				json &addr = addrArray[j];
+				const json &addr = addrArray[j];
 				nc->dns.server_addr[j] = InetAddress(OSUtils::jsonString(addr,"").c_str());
 			}
 		}
-	} else {
-		dns = json::object();
 	}
 #ifdef CENTRAL_CONTROLLER_REQUEST_BENCHMARK
 	b8.stop();
@@ -2043,6 +2185,14 @@ void EmbeddedNetworkController::_request(
 		#endif
 		return;
 	}
+
+	std::unique_ptr< Dictionary<ZT_NETWORKCONFIG_DICT_CAPACITY> > dconf(new Dictionary<ZT_NETWORKCONFIG_DICT_CAPACITY>());
+	const bool serialized = nc->toDictionary(*dconf,stamp.legacy);
+	Metrics::network_config_build_time_miss.Observe((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - buildStart).count());
+	if ((serialized)&&(cacheable)) {
+		// Cache before saving, so if saving changes the member the listener drops this again
+		_configCache.put(nwid,identity.address().toInt(),stamp,dconf->data(),dconf->sizeBytes());
+	}
 #ifdef CENTRAL_CONTROLLER_REQUEST_BENCHMARK
 	b9.stop();
 
@@ -2061,12 +2211,33 @@ void EmbeddedNetworkController::_request(
 	c11++;
 	b11.start();
 #endif
-	_sender->ncSendConfig(nwid,requestPacketId,identity.address(),*(nc.get()),metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_VERSION,0) < 6);
+	if (serialized)
+		_sender->ncSendSerializedConfig(nwid,requestPacketId,identity.address(),dconf->data(),dconf->sizeBytes());
 #ifdef CENTRAL_CONTROLLER_REQUEST_BENCHMARK
 	b11.stop();
 #endif
 }
 
+void EmbeddedNetworkController::_setMemberStatus(const _MemberStatusKey &msk,const int64_t authenticationExpiryTime,const Identity &identity,const Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> &metaData)
+{
+	{
+		std::lock_guard<std::mutex> l(_memberStatus_l);
+		_MemberStatus &ms = _memberStatus[msk];
+		ms.authenticationExpiryTime = authenticationExpiryTime;
+		ms.vMajor = (int)metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_NODE_MAJOR_VERSION,0);
+		ms.vMinor = (int)metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_NODE_MINOR_VERSION,0);
+		ms.vRev = (int)metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_NODE_REVISION,0);
+		ms.vProto = (int)metaData.getUI(ZT_NETWORKCONFIG_REQUEST_METADATA_KEY_PROTOCOL_VERSION,0);
+		ms.lastRequestMetaData = metaData;
+		ms.identity = identity;
+	}
+
+	if (authenticationExpiryTime > 0) {
+		std::lock_guard<std::mutex> l(_expiringSoon_l);
+		_expiringSoon.insert(std::pair<int64_t, _MemberStatusKey>(authenticationExpiryTime, msk));
+	}
+}
+
 void EmbeddedNetworkController::_startThreads()
 {
 	std::lock_guard<std::mutex> l(_threads_l);
@@ -2079,12 +2250,16 @@ void EmbeddedNetworkController::_startThreads()
 			Metrics::network_config_request_threads++;
 			for(;;) {
 				_RQEntry *qe = (_RQEntry *)0;
+				ConfigRequestQueue<_RQEntry>::Priority priority;
 				Metrics::network_config_request_queue_size = _queue.size();
-				auto timedWaitResult = _queue.get(qe, 1000);
-				if (timedWaitResult == BlockingQueue<_RQEntry *>::STOP) {
+				auto timedWaitResult = _queue.get(qe, priority, 1000);
+				if (timedWaitResult == ConfigRequestQueue<_RQEntry>::STOP) {
 					break;
-				} else if (timedWaitResult == BlockingQueue<_RQEntry *>::OK) {
+				} else if (timedWaitResult == ConfigRequestQueue<_RQEntry>::OK) {
 					if (qe) {
+						const int64_t waited = OSUtils::now() - qe->receivedAt;
+						((priority == ConfigRequestQueue<_RQEntry>::PRIORITY_JOIN) ? Metrics::network_config_request_queue_wait_join : Metrics::network_config_request_queue_wait_refresh).Observe((uint64_t)std::max(waited,(int64_t)0));
+						const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
 						try {
 							_request(qe->nwid,qe->fromAddr,qe->requestPacketId,qe->identity,qe->metaData);
 						} catch (std::exception &e) {
@@ -2092,6 +2267,7 @@ void EmbeddedNetworkController::_startThreads()
 						} catch ( ... ) {
 							fprintf(stderr,"ERROR: exception in controller request handling thread: unknown exception" ZT_EOL_S);
 						}
+						Metrics::network_config_request_service_time_all.Observe((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
 						delete qe;
 						qe = nullptr;
 					}
@@ -41,6 +41,8 @@
 
 #include "DB.hpp"
 #include "DBMirrorSet.hpp"
+#include "ConfigRequestQueue.hpp"
+#include "ConfigCache.hpp"
 
 namespace ZeroTier {
 
@@ -93,9 +95,22 @@ private:
 		InetAddress fromAddr;
 		Identity identity;
 		Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> metaData;
+		int64_t receivedAt;
 		enum {
 			RQENTRY_TYPE_REQUEST = 0
 		} type;
+
+		// Called on a newer entry before it replaces this member's waiting one.
+		// A push after a member update has no packet ID or physical address, and
+		// must not cost the member the reply to a request it actually sent.
+		inline void coalesce(const _RQEntry &waiting)
+		{
+			receivedAt = waiting.receivedAt;
+			if ((!requestPacketId)&&(waiting.requestPacketId))
+				requestPacketId = waiting.requestPacketId;
+			if ((!fromAddr)&&(waiting.fromAddr))
+				fromAddr = waiting.fromAddr;
+		}
 	};
 
 	struct _MemberStatusKey
@@ -125,6 +140,8 @@ private:
 		}
 	};
 
+	void _setMemberStatus(const _MemberStatusKey &msk,int64_t authenticationExpiryTime,const Identity &identity,const Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> &metaData);
+
 	const int64_t _startTime;
 	int _listenPort;
 	Node *const _node;
@@ -135,7 +152,7 @@ private:
 	NetworkController::Sender *_sender;
 
 	DBMirrorSet _db;
-	BlockingQueue< _RQEntry * > _queue;
+	ConfigRequestQueue< _RQEntry > _queue;
 
 	std::vector<std::thread> _threads;
 	std::mutex _threads_l;
@@ -146,6 +163,8 @@ private:
 	std::set< std::pair<int64_t, _MemberStatusKey> > _expiringSoon;
 	std::mutex _expiringSoon_l;
 
+	ConfigCache _configCache;
+
 	RedisConfig *_rc;
 	std::string _ssoRedirectURL;
 
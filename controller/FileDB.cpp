@@ -15,10 +15,15 @@
 
 #include "../node/Metrics.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
 namespace ZeroTier
 {
 
-FileDB::FileDB(const char *path) :
+FileDB::FileDB(const char *path,const unsigned long loadThreads) :
 	DB(),
 	_path(path),
 	_networksPath(_path + ZT_PATH_SEPARATOR_S + "network"),
@@ -30,11 +35,25 @@ FileDB::FileDB(const char *path) :
 	OSUtils::mkdir(_networksPath.c_str());
 	OSUtils::mkdir(_tracePath.c_str());
 
+	// Load networks and then their members. With more than one thread, each
+	// reads and parses a batch of member files and adds them with one
+	// _loadMembers(). This has not been measured faster yet, so by default
+	// members are loaded one at a time on this thread.
+	struct _MemberBatch
+	{
+		uint64_t networkId;
+		std::string path;
+		std::vector<std::string> files;
+	};
 	std::vector<std::string> networks(OSUtils::listDirectory(_networksPath.c_str(),false));
-	std::string buf;
-	for(auto n=networks.begin();n!=networks.end();++n) {
-		buf.clear();
-		if ((n->length() == 21)&&(OSUtils::readFile((_networksPath + ZT_PATH_SEPARATOR_S + *n).c_str(),buf))) {
+	std::vector<_MemberBatch> batches;
+	std::mutex batches_l;
+	std::atomic<unsigned long> memberCount(0);
+	const unsigned long threadCount = (loadThreads) ? loadThreads : std::min(std::max((unsigned long)std::thread::hardware_concurrency(),1UL),(unsigned long)ZT_FILEDB_LOAD_MAX_THREADS);
+	_parallel(threadCount,networks.size(),[&](const unsigned long i) {
+		const std::string &n = networks[i];
+		std::string buf;
+		if ((n.length() == 21)&&(OSUtils::readFile((_networksPath + ZT_PATH_SEPARATOR_S + n).c_str(),buf))) {
 			try {
 				nlohmann::json network(OSUtils::jsonParse(buf));
 				const std::string nwids = network["id"];
@@ -42,26 +61,84 @@ FileDB::FileDB(const char *path) :
 					nlohmann::json nullJson;
 					_networkChanged(nullJson,network,false);
 					Metrics::network_count++;
-					std::string membersPath(_networksPath + ZT_PATH_SEPARATOR_S + nwids + ZT_PATH_SEPARATOR_S "member");
-					std::vector<std::string> members(OSUtils::listDirectory(membersPath.c_str(),false));
-					for(auto m=members.begin();m!=members.end();++m) {
-						buf.clear();
-						if ((m->length() == 15)&&(OSUtils::readFile((membersPath + ZT_PATH_SEPARATOR_S + *m).c_str(),buf))) {
-							try {
-								nlohmann::json member(OSUtils::jsonParse(buf));
-								const std::string addrs = member["id"];
-								if (addrs.length() == 10) {
-									nlohmann::json nullJson2;
-									_memberChanged(nullJson2,member,false);
-									Metrics::member_count++;
-								}
-							} catch ( ... ) {}
+					_MemberBatch b;
+					b.networkId = Utils::hexStrToU64(nwids.c_str());
+					b.path = _networksPath + ZT_PATH_SEPARATOR_S + nwids + ZT_PATH_SEPARATOR_S "member";
+					std::vector<std::string> members(OSUtils::listDirectory(b.path.c_str(),false));
+					if (threadCount <= 1) {
+						// Batches only pay off across threads, so add members as they're read
+						for(auto m=members.begin();m!=members.end();++m) {
+							buf.clear();
+							if ((m->length() == 15)&&(OSUtils::readFile((b.path + ZT_PATH_SEPARATOR_S + *m).c_str(),buf))) {
+								try {
+									nlohmann::json member(OSUtils::jsonParse(buf));
+									const std::string addrs = member["id"];
+									if (addrs.length() == 10) {
+										nlohmann::json nullJson2;
+										_memberChanged(nullJson2,member,false);
+										++memberCount;
+									}
+								} catch ( ... ) {}
+							}
 						}
+						return;
+					}
+					std::lock_guard<std::mutex> l(batches_l);
+					for(unsigned long m=0;m<members.size();m+=ZT_FILEDB_LOAD_BATCH) {
+						batches.push_back(b);
+						batches.back().files.assign(members.begin() + m,members.begin() + std::min(m + ZT_FILEDB_LOAD_BATCH,(unsigned long)members.size()));
 					}
 				}
 			} catch ( ... ) {}
 		}
+	});
+	_parallel(threadCount,batches.size(),[&](const unsigned long i) {
+		const _MemberBatch &b = batches[i];
+		std::vector<nlohmann::json> members;
+		members.reserve(b.files.size());
+		std::string buf;
+		for(auto m=b.files.begin();m!=b.files.end();++m) {
+			buf.clear();
+			if ((m->length() == 15)&&(OSUtils::readFile((b.path + ZT_PATH_SEPARATOR_S + *m).c_str(),buf))) {
+				try {
+					nlohmann::json member(OSUtils::jsonParse(buf));
+					const std::string addrs = member["id"];
+					if (addrs.length() == 10)
+						members.push_back(std::move(member));
+				} catch ( ... ) {}
+			}
+		}
+		memberCount += _loadMembers(b.networkId,members);
+	});
+	Metrics::member_count += (double)memberCount.load();
+
+	_onlineUpdateThread = std::thread([this]() {
+		std::unique_lock<std::mutex> l(_online_l);
+		while (_running) {
+			_online_c.wait_for(l,std::chrono::milliseconds(ZT_FILEDB_ONLINE_EXPORT_INTERVAL));
+			if (!_running)
+				break;
+			l.unlock();
+			_online.exportNetworks();
+			l.lock();
+		}
+	});
+}
+
+void FileDB::_parallel(const unsigned long threadCount,const unsigned long n,const std::function<void(unsigned long)> &f)
+{
+	std::atomic<unsigned long> next(0);
+	std::vector<std::thread> threads;
+	for(unsigned long t=1;t<std::min(threadCount,n);++t) {
+		threads.push_back(std::thread([&]() {
+			for(unsigned long i=next++;i<n;i=next++)
+				f(i);
+		}));
 	}
+	for(unsigned long i=next++;i<n;i=next++)
+		f(i);
+	for(auto t=threads.begin();t!=threads.end();++t)
+		t->join();
 }
 
 FileDB::~FileDB()
@@ -70,6 +147,7 @@ FileDB::~FileDB()
 		_online_l.lock();
 		_running = false;
 		_online_l.unlock();
+		_online_c.notify_all();
 		_onlineUpdateThread.join();
 	} catch ( ... ) {}
 }
@@ -77,7 +155,7 @@ FileDB::~FileDB()
 bool FileDB::waitForReady() { return true; }
 bool FileDB::isReady() { return true; }
 
-bool FileDB::save(nlohmann::json &record,bool notifyListeners)
+bool FileDB::save(nlohmann::json &record,bool notifyListeners,bool keepRevision)
 {
 	char p1[4096],p2[4096],pb[4096];
 	bool modified = false;
@@ -89,8 +167,9 @@ bool FileDB::save(nlohmann::json &record,bool notifyListeners)
 			if (nwid) {
 				nlohmann::json old;
 				get(nwid,old);
-				if ((!old.is_object())||(!_compareRecords(old,record))) {
-					record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
+				if (_saveNeeded(old,record,keepRevision)) {
+					if (!keepRevision)
+						record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
 					OSUtils::ztsnprintf(p1,sizeof(p1),"%s" ZT_PATH_SEPARATOR_S "%.16llx.json",_networksPath.c_str(),nwid);
 					if (!OSUtils::writeFile(p1,OSUtils::jsonDump(record,-1))) {
 						fprintf(stderr,"WARNING: controller unable to write to path: %s" ZT_EOL_S,p1);
@@ -107,8 +186,9 @@ bool FileDB::save(nlohmann::json &record,bool notifyListeners)
 			if ((id)&&(nwid)) {
 				nlohmann::json network,old;
 				get(nwid,network,id,old);
-				if ((!old.is_object())||(!_compareRecords(old,record))) {
-					record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
+				if (_saveNeeded(old,record,keepRevision)) {
+					if (!keepRevision)
+						record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
 					OSUtils::ztsnprintf(pb,sizeof(pb),"%s" ZT_PATH_SEPARATOR_S "%.16llx" ZT_PATH_SEPARATOR_S "member",_networksPath.c_str(),(unsigned long long)nwid);
 					OSUtils::ztsnprintf(p1,sizeof(p1),"%s" ZT_PATH_SEPARATOR_S "%.10llx.json",pb,(unsigned long long)id);
 					if (!OSUtils::writeFile(p1,OSUtils::jsonDump(record,-1))) {
@@ -139,8 +219,7 @@ void FileDB::eraseNetwork(const uint64_t networkId)
 	OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx",_networksPath.c_str(),(unsigned long long)networkId);
 	OSUtils::rmDashRf(p);
 	_networkChanged(network,nullJson,true);
-	std::lock_guard<std::mutex> l(this->_online_l);
-	this->_online.erase(networkId);
+	_online.erase(networkId);
 }
 
 void FileDB::eraseMember(const uint64_t networkId,const uint64_t memberId)
@@ -151,17 +230,22 @@ void FileDB::eraseMember(const uint64_t networkId,const uint64_t memberId)
 	OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx" ZT_PATH_SEPARATOR_S "member" ZT_PATH_SEPARATOR_S "%.10llx.json",_networksPath.c_str(),networkId,memberId);
 	OSUtils::rm(p);
 	_memberChanged(member,nullJson,true);
-	std::lock_guard<std::mutex> l(this->_online_l);
-	this->_online[networkId].erase(memberId);
+	_online.erase(networkId,memberId);
 }
 
 void FileDB::nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const InetAddress &physicalAddress)
 {
-	char mid[32],atmp[64];
-	OSUtils::ztsnprintf(mid,sizeof(mid),"%.10llx",(unsigned long long)memberId);
-	physicalAddress.toString(atmp);
-	std::lock_guard<std::mutex> l(this->_online_l);
-	this->_online[networkId][memberId][OSUtils::now()] = physicalAddress;
+	_online.seen(networkId,memberId,physicalAddress,OSUtils::now());
+}
+
+std::shared_ptr<const MemberOnlineTable::Network> FileDB::lastSeen(const uint64_t networkId) const
+{
+	return _online.network(networkId);
+}
+
+bool FileDB::lastSeen(const uint64_t networkId,const uint64_t memberId,MemberOnlineTable::Member &m) const
+{
+	return _online.get(networkId,memberId,m);
 }
 
 } // namespace ZeroTier
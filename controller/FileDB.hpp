@@ -16,29 +16,57 @@
 
 #include "DB.hpp"
 
+#include <condition_variable>
+#include <functional>
+
+// Member files read and added at a time by each loading thread
+#ifndef ZT_FILEDB_LOAD_BATCH
+#define ZT_FILEDB_LOAD_BATCH 1024
+#endif
+
+// Maximum number of threads reading the database at startup (1 loads serially)
+#ifndef ZT_FILEDB_LOAD_MAX_THREADS
+#define ZT_FILEDB_LOAD_MAX_THREADS 1
+#endif
+
+// How often the member last-seen snapshot used by the API is rebuilt
+#ifndef ZT_FILEDB_ONLINE_EXPORT_INTERVAL
+#define ZT_FILEDB_ONLINE_EXPORT_INTERVAL 10000
+#endif
+
 namespace ZeroTier
 {
 
 class FileDB : public DB
 {
 public:
-	FileDB(const char *path);
+	/**
+	 * @param path Database directory
+	 * @param loadThreads Threads reading the database in this constructor, or 0 for up to ZT_FILEDB_LOAD_MAX_THREADS
+	 */
+	FileDB(const char *path,const unsigned long loadThreads = 0);
 	virtual ~FileDB();
 
 	virtual bool waitForReady();
 	virtual bool isReady();
-	virtual bool save(nlohmann::json &record,bool notifyListeners);
+	virtual bool save(nlohmann::json &record,bool notifyListeners,bool keepRevision = false);
 	virtual void eraseNetwork(const uint64_t networkId);
 	virtual void eraseMember(const uint64_t networkId,const uint64_t memberId);
 	virtual void nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const InetAddress &physicalAddress);
+	virtual std::shared_ptr<const MemberOnlineTable::Network> lastSeen(const uint64_t networkId) const;
+	virtual bool lastSeen(const uint64_t networkId,const uint64_t memberId,MemberOnlineTable::Member &m) const;
 
 protected:
+	// Run f(0) through f(n-1) on up to threadCount threads (this one included)
+	static void _parallel(const unsigned long threadCount,const unsigned long n,const std::function<void(unsigned long)> &f);
+
 	std::string _path;
 	std::string _networksPath;
 	std::string _tracePath;
-	std::thread _onlineUpdateThread;
-	std::map< uint64_t,std::map<uint64_t,std::map<int64_t,InetAddress> > > _online;
+	std::thread _onlineUpdateThread; // periodically exports _online for lastSeen(networkId)
+	MemberOnlineTable _online;
 	std::mutex _online_l;
+	std::condition_variable _online_c;
 	bool _running;
 };
 
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_CONTROLLER_IPALLOCATION_HPP
+#define ZT_CONTROLLER_IPALLOCATION_HPP
+
+#include "../node/Constants.hpp"
+#include "../node/InetAddress.hpp"
+#include "../node/Utils.hpp"
+
+#include <iterator>
+#include <map>
+#include <unordered_set>
+
+namespace ZeroTier
+{
+
+/**
+ * IP addresses assigned to members of one network
+ *
+ * IPv4 addresses are kept as a map of disjoint, non-adjacent ranges, so the
+ * first unassigned address at or after any point in a pool is found in
+ * O(log n) no matter how full the pool is. IPv6 addresses are only ever
+ * looked up (auto-assignment picks them at random from a huge space) so they
+ * stay in a hash set.
+ *
+ * Like the set it replaces, an address is either assigned or not: if two
+ * members list the same address, removing it from one frees it.
+ */
+class IPAllocation
+{
+public:
+	IPAllocation() : _v4Count(0) {}
+
+	inline void add(const InetAddress &ip)
+	{
+		if (ip.ss_family == AF_INET) {
+			const uint32_t a = _v4(ip);
+			auto next = _ranges.upper_bound(a);
+			if (next != _ranges.begin()) {
+				auto prev = std::prev(next);
+				if (prev->second >= a)
+					return; // already assigned
+				if (prev->second + 1 == a) {
+					prev->second = a;
+					if ((next != _ranges.end())&&(next->first == a + 1)) {
+						prev->second = next->second;
+						_ranges.erase(next);
+					}
+					++_v4Count;
+					return;
+				}
+			}
+			if ((next != _ranges.end())&&(a != 0xffffffff)&&(next->first == a + 1)) {
+				const uint32_t last = next->second;
+				_ranges.erase(next);
+				_ranges[a] = last;
+			} else {
+				_ranges[a] = a;
+			}
+			++_v4Count;
+		} else if (ip.ss_family == AF_INET6) {
+			InetAddress tmp(ip);
+			tmp.setPort(0);
+			_v6.insert(tmp);
+		}
+	}
+
+	inline void remove(const InetAddress &ip)
+	{
+		if (ip.ss_family == AF_INET) {
+			const uint32_t a = _v4(ip);
+			auto r = _ranges.upper_bound(a);
+			if (r == _ranges.begin())
+				return;
+			--r;
+			if (r->second < a)
+				return;
+			const uint32_t first = r->first,last = r->second;
+			if (first == a) {
+				_ranges.erase(r);
+			} else {
+				r->second = a - 1;
+			}
+			if (last != a)
+				_ranges[a + 1] = last;
+			--_v4Count;
+		} else if (ip.ss_family == AF_INET6) {
+			InetAddress tmp(ip);
+			tmp.setPort(0);
+			_v6.erase(tmp);
+		}
+	}
+
+	inline bool contains(const InetAddress &ip) const
+	{
+		if (ip.ss_family == AF_INET) {
+			const uint32_t a = _v4(ip);
+			auto r = _ranges.upper_bound(a);
+			return ((r != _ranges.begin())&&(std::prev(r)->second >= a));
+		} else if (ip.ss_family == AF_INET6) {
+			InetAddress tmp(ip);
+			tmp.setPort(0);
+			return (_v6.find(tmp) != _v6.end());
+		}
+		return false;
+	}
+
+	/**
+	 * Find the first unassigned IPv4 address in [from,last]
+	 *
+	 * @param from First address to consider (host byte order)
+	 * @param last Last address to consider (host byte order)
+	 * @param ip Set to unassigned address if one is found
+	 * @return True if one was found
+	 */
+	inline bool nextFreeV4(const uint32_t from,const uint32_t last,uint32_t &ip) const
+	{
+		if (from > last)
+			return false;
+		auto r = _ranges.upper_bound(from);
+		if (r != _ranges.begin()) {
+			--r;
+			if (r->second >= from) {
+				// Ranges are never adjacent, so the address after one is free
+				if (r->second >= last)
+					return false;
+				ip = r->second + 1;
+				return true;
+			}
+		}
+		ip = from;
+		return true;
+	}
+
+	inline unsigned long size() const { return _v4Count + (unsigned long)_v6.size(); }
+
+private:
+	static inline uint32_t _v4(const InetAddress &ip) { return Utils::ntoh((uint32_t)(reinterpret_cast<const struct sockaddr_in *>(&ip)->sin_addr.s_addr)); }
+
+	std::map<uint32_t,uint32_t> _ranges; // first -> last (host byte order)
+	std::unordered_set<InetAddress,InetAddress::Hasher> _v6;
+	unsigned long _v4Count;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -339,7 +339,7 @@ bool LFDB::isReady()
 	return (_ready.load());
 }
 
-bool LFDB::save(nlohmann::json &record,bool notifyListeners)
+bool LFDB::save(nlohmann::json &record,bool notifyListeners,bool keepRevision)
 {
 	bool modified = false;
 	const std::string objtype = record["objtype"];
@@ -348,8 +348,9 @@ bool LFDB::save(nlohmann::json &record,bool notifyListeners)
 		if (nwid) {
 			nlohmann::json old;
 			get(nwid,old);
-			if ((!old.is_object())||(!_compareRecords(old,record))) {
-				record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
+			if (_saveNeeded(old,record,keepRevision)) {
+				if (!keepRevision)
+					record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
 				_networkChanged(old,record,notifyListeners);
 				{
 					std::lock_guard<std::mutex> l(_state_l);
@@ -364,8 +365,9 @@ bool LFDB::save(nlohmann::json &record,bool notifyListeners)
 		if ((id)&&(nwid)) {
 			nlohmann::json network,old;
 			get(nwid,network,id,old);
-			if ((!old.is_object())||(!_compareRecords(old,record))) {
-				record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
+			if (_saveNeeded(old,record,keepRevision)) {
+				if (!keepRevision)
+					record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
 				_memberChanged(old,record,notifyListeners);
 				{
 					std::lock_guard<std::mutex> l(_state_l);
@@ -0,0 +1,604 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#include "LogDB.hpp"
+#include "FileDB.hpp"
+#include "../node/Metrics.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+
+#ifdef __WINDOWS__
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Snapshot header: magic followed by the first log segment not covered (big-endian)
+#define ZT_LOGDB_SNAPSHOT_MAGIC "ZTLOGDB1"
+#define ZT_LOGDB_SNAPSHOT_HEADER_SIZE 16
+
+// Frame header: payload length and payload CRC-32C (both big-endian)
+#define ZT_LOGDB_FRAME_HEADER_SIZE 8
+
+namespace ZeroTier {
+
+LogDB::LogDB(const char *path) :
+	DB(),
+	_path(path),
+	_queued(0),
+	_written(0),
+	_compactRequested(false),
+	_running(true),
+	_writeFailed(false),
+	_segment((FILE *)0),
+	_segmentSeq(0),
+	_segmentBytes(0),
+	_firstSegmentSeq(0),
+	_logBytes(0),
+	_snapshotBytes(0),
+	_onlineRunning(true)
+{
+	OSUtils::mkdir(_path.c_str());
+	OSUtils::lockDownFile(_path.c_str(),true);
+
+	std::string buf;
+	if (OSUtils::readFile((_path + ZT_PATH_SEPARATOR_S "snapshot").c_str(),buf)) {
+		if ((buf.length() >= ZT_LOGDB_SNAPSHOT_HEADER_SIZE)&&(!memcmp(buf.data(),ZT_LOGDB_SNAPSHOT_MAGIC,8))) {
+			uint64_t first;
+			memcpy(&first,buf.data() + 8,8);
+			_firstSegmentSeq = Utils::ntoh(first);
+			_replay(buf,ZT_LOGDB_SNAPSHOT_HEADER_SIZE);
+			_snapshotBytes = buf.length();
+		} else {
+			fprintf(stderr,"WARNING: controller log database snapshot in %s is not valid, ignoring it" ZT_EOL_S,_path.c_str());
+		}
+	}
+
+	std::vector<uint64_t> segments;
+	std::vector<std::string> files(OSUtils::listDirectory(_path.c_str(),false));
+	for(auto f=files.begin();f!=files.end();++f) {
+		if ((f->length() == 20)&&(f->substr(0,4) == "log."))
+			segments.push_back(Utils::hexStrToU64(f->c_str() + 4));
+	}
+	std::sort(segments.begin(),segments.end());
+	_segmentSeq = _firstSegmentSeq;
+	char tmp[64];
+	for(auto s=segments.begin();s!=segments.end();++s) {
+		OSUtils::ztsnprintf(tmp,sizeof(tmp),ZT_PATH_SEPARATOR_S "log.%.16llx",(unsigned long long)*s);
+		if (*s < _firstSegmentSeq) {
+			OSUtils::rm((_path + tmp).c_str()); // left behind by an interrupted compaction
+			continue;
+		}
+		buf.clear();
+		if (OSUtils::readFile((_path + tmp).c_str(),buf)) {
+			_logBytes += buf.length();
+			_replay(buf,0);
+		}
+		_segmentSeq = *s + 1;
+	}
+
+	{
+		std::shared_lock<std::shared_mutex> l(_networks_l);
+		for(auto nw=_networks.begin();nw!=_networks.end();++nw) {
+			std::shared_lock<std::shared_mutex> l2(nw->second->lock);
+			if (nw->second->config)
+				Metrics::network_count++;
+			Metrics::member_count += (double)nw->second->members.size();
+		}
+	}
+
+	_openSegment(_segmentSeq);
+	_writerThread = std::thread([this]() { _writer(); });
+
+	_onlineUpdateThread = std::thread([this]() {
+		std::unique_lock<std::mutex> l(_online_l);
+		while (_onlineRunning) {
+			_online_c.wait_for(l,std::chrono::milliseconds(ZT_FILEDB_ONLINE_EXPORT_INTERVAL));
+			if (!_onlineRunning)
+				break;
+			l.unlock();
+			_online.exportNetworks();
+			l.lock();
+		}
+	});
+}
+
+LogDB::~LogDB()
+{
+	{
+		std::lock_guard<std::mutex> l(_online_l);
+		_onlineRunning = false;
+	}
+	_online_c.notify_all();
+	_onlineUpdateThread.join();
+	{
+		std::lock_guard<std::mutex> l(_queue_l);
+		_running = false;
+	}
+	_queue_c.notify_all();
+	_writerThread.join();
+	if (_segment) {
+		fclose(_segment);
+		if (!_segmentBytes) {
+			char tmp[64];
+			OSUtils::ztsnprintf(tmp,sizeof(tmp),ZT_PATH_SEPARATOR_S "log.%.16llx",(unsigned long long)_segmentSeq);
+			OSUtils::rm((_path + tmp).c_str());
+		}
+	}
+}
+
+bool LogDB::waitForReady() { return true; }
+bool LogDB::isReady() { return true; }
+
+bool LogDB::save(nlohmann::json &record,bool notifyListeners,bool keepRevision)
+{
+	bool modified = false;
+	try {
+		const std::string objtype = record["objtype"];
+		if (objtype == "network") {
+
+			const uint64_t nwid = OSUtils::jsonIntHex(record["id"],0ULL);
+			if (nwid) {
+				std::lock_guard<std::mutex> l(_save_l);
+				nlohmann::json old;
+				get(nwid,old);
+				if (_saveNeeded(old,record,keepRevision)) {
+					if (!keepRevision)
+						record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
+					std::string f;
+					_putFrame(f,record);
+					_networkChanged(old,record,notifyListeners);
+					_append(f);
+					modified = true;
+				}
+			}
+
+		} else if (objtype == "member") {
+
+			const uint64_t id = OSUtils::jsonIntHex(record["id"],0ULL);
+			const uint64_t nwid = OSUtils::jsonIntHex(record["nwid"],0ULL);
+			if ((id)&&(nwid)) {
+				std::lock_guard<std::mutex> l(_save_l);
+				nlohmann::json network,old;
+				get(nwid,network,id,old);
+				if (_saveNeeded(old,record,keepRevision)) {
+					if (!keepRevision)
+						record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
+					std::string f;
+					_putFrame(f,record);
+					_memberChanged(old,record,notifyListeners);
+					_append(f);
+					modified = true;
+				}
+			}
+
+		}
+	} catch ( ... ) {} // drop invalid records missing fields
+	return modified;
+}
+
+void LogDB::eraseNetwork(const uint64_t networkId)
+{
+	nlohmann::json network,nullJson;
+	const uint64_t id = Utils::hton(networkId);
+	std::string f;
+	_frame(f,_OP_ERASE_NETWORK,&id,8);
+	std::lock_guard<std::mutex> l(_save_l);
+	get(networkId,network);
+	_networkChanged(network,nullJson,true);
+	_append(f);
+	_online.erase(networkId);
+}
+
+void LogDB::eraseMember(const uint64_t networkId,const uint64_t memberId)
+{
+	nlohmann::json network,member,nullJson;
+	const uint64_t ids[2] = { Utils::hton(networkId),Utils::hton(memberId) };
+	std::string f;
+	_frame(f,_OP_ERASE_MEMBER,ids,16);
+	std::lock_guard<std::mutex> l(_save_l);
+	get(networkId,network,memberId,member);
+	_memberChanged(member,nullJson,true);
+	_append(f);
+	_online.erase(networkId,memberId);
+}
+
+void LogDB::nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const InetAddress &physicalAddress)
+{
+	_online.seen(networkId,memberId,physicalAddress,OSUtils::now());
+}
+
+std::shared_ptr<const MemberOnlineTable::Network> LogDB::lastSeen(const uint64_t networkId) const
+{
+	return _online.network(networkId);
+}
+
+bool LogDB::lastSeen(const uint64_t networkId,const uint64_t memberId,MemberOnlineTable::Member &m) const
+{
+	return _online.get(networkId,memberId,m);
+}
+
+bool LogDB::flush()
+{
+	std::unique_lock<std::mutex> l(_queue_l);
+	const uint64_t target = _queued;
+	while ((_written < target)&&(!_writeFailed))
+		_written_c.wait(l);
+	return (_written >= target);
+}
+
+void LogDB::compact()
+{
+	std::unique_lock<std::mutex> l(_queue_l);
+	_compactRequested = true;
+	_queue_c.notify_all();
+	while ((_compactRequested)&&(!_writeFailed))
+		_written_c.wait(l);
+}
+
+long LogDB::importFileDB(const char *fileDbPath,const char *path)
+{
+	const std::string p(path);
+	if (OSUtils::fileExists((p + ZT_PATH_SEPARATOR_S "snapshot").c_str()))
+		return -1;
+	OSUtils::mkdir(p.c_str());
+	OSUtils::lockDownFile(p.c_str(),true);
+
+	FileDB src(fileDbPath);
+	std::string records;
+	long n = 0;
+	src.each([&records,&n](uint64_t networkId,const nlohmann::json &network,uint64_t memberId,const nlohmann::json &member) {
+		const nlohmann::json &record = (memberId) ? member : network;
+		if (record.is_object()) {
+			_putFrame(records,record);
+			++n;
+		}
+	});
+	return (_writeSnapshot(p + ZT_PATH_SEPARATOR_S "snapshot",records,0)) ? n : -1;
+}
+
+long LogDB::exportFileDB(const char *path,const char *fileDbPath)
+{
+	const std::string networksPath(std::string(fileDbPath) + ZT_PATH_SEPARATOR_S "network");
+	OSUtils::mkdir(fileDbPath);
+	OSUtils::lockDownFile(fileDbPath,true);
+	OSUtils::mkdir(networksPath.c_str());
+
+	LogDB src(path);
+	long n = 0;
+	src.each([&networksPath,&n](uint64_t networkId,const nlohmann::json &network,uint64_t memberId,const nlohmann::json &member) {
+		char p[4096];
+		if (memberId) {
+			if (!member.is_object())
+				return;
+			OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx",networksPath.c_str(),(unsigned long long)networkId);
+			OSUtils::mkdir(p);
+			OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx" ZT_PATH_SEPARATOR_S "member",networksPath.c_str(),(unsigned long long)networkId);
+			OSUtils::mkdir(p);
+			OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx" ZT_PATH_SEPARATOR_S "member" ZT_PATH_SEPARATOR_S "%.10llx.json",networksPath.c_str(),(unsigned long long)networkId,(unsigned long long)memberId);
+			if (OSUtils::writeFile(p,OSUtils::jsonDump(member,-1)))
+				++n;
+		} else {
+			if (!network.is_object())
+				return;
+			OSUtils::ztsnprintf(p,sizeof(p),"%s" ZT_PATH_SEPARATOR_S "%.16llx.json",networksPath.c_str(),(unsigned long long)networkId);
+			if (OSUtils::writeFile(p,OSUtils::jsonDump(network,-1)))
+				++n;
+		}
+	});
+	return n;
+}
+
+void LogDB::_frame(std::string &out,const unsigned int op,const void *data,const unsigned int len)
+{
+	const size_t start = out.size();
+	out.resize(start + ZT_LOGDB_FRAME_HEADER_SIZE + 1);
+	out[start + ZT_LOGDB_FRAME_HEADER_SIZE] = (char)op;
+	out.append(reinterpret_cast<const char *>(data),len);
+	const uint32_t h[2] = {
+		Utils::hton((uint32_t)(len + 1)),
+		Utils::hton(_crc32c(reinterpret_cast<const uint8_t *>(out.data()) + start + ZT_LOGDB_FRAME_HEADER_SIZE,len + 1))
+	};
+	memcpy(&(out[start]),h,ZT_LOGDB_FRAME_HEADER_SIZE);
+}
+
+void LogDB::_putFrame(std::string &out,const nlohmann::json &record)
+{
+	const std::vector<uint8_t> mp(nlohmann::json::to_msgpack(record));
+	_frame(out,_OP_PUT,mp.data(),(unsigned int)mp.size());
+}
+
+bool LogDB::_writeSnapshot(const std::string &path,const std::string &records,const uint64_t firstSegment)
+{
+	const std::string tmpPath(path + ".tmp");
+	FILE *f = fopen(tmpPath.c_str(),"wb");
+	if (!f)
+		return false;
+	char hdr[ZT_LOGDB_SNAPSHOT_HEADER_SIZE];
+	memcpy(hdr,ZT_LOGDB_SNAPSHOT_MAGIC,8);
+	const uint64_t first = Utils::hton(firstSegment);
+	memcpy(hdr + 8,&first,8);
+	const bool ok = ((fwrite(hdr,1,sizeof(hdr),f) == sizeof(hdr))&&(fwrite(records.data(),1,records.size(),f) == records.size())&&(_sync(f)));
+	fclose(f);
+	if ((!ok)||(!OSUtils::rename(tmpPath.c_str(),path.c_str()))) {
+		OSUtils::rm(tmpPath.c_str());
+		return false;
+	}
+	OSUtils::lockDownFile(path.c_str(),false);
+	return true;
+}
+
+bool LogDB::_sync(FILE *f)
+{
+	if (fflush(f) != 0)
+		return false;
+#ifdef __WINDOWS__
+	return (_commit(_fileno(f)) == 0);
+#else
+	return (fsync(fileno(f)) == 0);
+#endif
+}
+
+namespace {
+struct _Crc32cTable
+{
+	_Crc32cTable()
+	{
+		for(uint32_t i=0;i<256;++i) {
+			uint32_t c = i;
+			for(int k=0;k<8;++k)
+				c = (c & 1) ? ((c >> 1) ^ 0x82f63b78U) : (c >> 1);
+			t[i] = c;
+		}
+	}
+	uint32_t t[256];
+};
+} // anonymous namespace
+
+uint32_t LogDB::_crc32c(const uint8_t *p,unsigned long len)
+{
+	static const _Crc32cTable table;
+	uint32_t crc = 0xffffffffU;
+	while (len--)
+		crc = table.t[(crc ^ *(p++)) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+long LogDB::_replay(const std::string &data,const unsigned long start)
+{
+	const uint8_t *const d = reinterpret_cast<const uint8_t *>(data.data());
+	unsigned long p = start;
+	long n = 0;
+	nlohmann::json old,nullJson;
+	while ((p + ZT_LOGDB_FRAME_HEADER_SIZE) <= data.length()) {
+		uint32_t h[2];
+		memcpy(h,d + p,ZT_LOGDB_FRAME_HEADER_SIZE);
+		const uint32_t len = Utils::ntoh(h[0]);
+		if ((!len)||((p + ZT_LOGDB_FRAME_HEADER_SIZE + len) > data.length()))
+			break;
+		const uint8_t *const payload = d + p + ZT_LOGDB_FRAME_HEADER_SIZE;
+		if (_crc32c(payload,len) != Utils::ntoh(h[1]))
+			break;
+		p += ZT_LOGDB_FRAME_HEADER_SIZE + len;
+
+		try {
+			switch(payload[0]) {
+				case _OP_PUT: {
+					nlohmann::json record(nlohmann::json::from_msgpack(payload + 1,payload + len));
+					const std::string objtype = OSUtils::jsonString(record["objtype"],"");
+					if (objtype == "network") {
+						old = nlohmann::json();
+						_networkChanged(old,record,false);
+					} else if (objtype == "member") {
+						_current(OSUtils::jsonIntHex(record["nwid"],0ULL),OSUtils::jsonIntHex(record["id"],0ULL),old);
+						_memberChanged(old,record,false);
+					}
+				}	break;
+				case _OP_ERASE_NETWORK:
+					if (len == 9) {
+						uint64_t nwid;
+						memcpy(&nwid,payload + 1,8);
+						if (_current(Utils::ntoh(nwid),0,old))
+							_networkChanged(old,nullJson,false);
+					}
+					break;
+				case _OP_ERASE_MEMBER:
+					if (len == 17) {
+						uint64_t ids[2];
+						memcpy(ids,payload + 1,16);
+						if (_current(Utils::ntoh(ids[0]),Utils::ntoh(ids[1]),old))
+							_memberChanged(old,nullJson,false);
+					}
+					break;
+			}
+			++n;
+		} catch ( ... ) {} // skip records that aren't valid
+	}
+	if (p < data.length())
+		fprintf(stderr,"WARNING: controller log database in %s has %lu bytes of incomplete or corrupt records, ignoring them" ZT_EOL_S,_path.c_str(),(unsigned long)(data.length() - p));
+	return n;
+}
+
+bool LogDB::_current(const uint64_t networkId,const uint64_t memberId,nlohmann::json &record)
+{
+	// Like get() but for use while loading, so it doesn't count as a lookup
+	record = nlohmann::json();
+	std::shared_ptr<_Network> nw;
+	{
+		std::shared_lock<std::shared_mutex> l(_networks_l);
+		auto nwi = _networks.find(networkId);
+		if (nwi == _networks.end())
+			return false;
+		nw = nwi->second;
+	}
+	std::shared_lock<std::shared_mutex> l2(nw->lock);
+	if (memberId) {
+		auto m = nw->members.find(memberId);
+		if (m == nw->members.end())
+			return false;
+		m->second->toJson(record);
+	} else {
+		if (!nw->config)
+			return false;
+		record = *(nw->config);
+	}
+	return true;
+}
+
+void LogDB::_append(const std::string &frames)
+{
+	{
+		std::lock_guard<std::mutex> l(_queue_l);
+		_queue.append(frames);
+		++_queued;
+	}
+	_queue_c.notify_one();
+}
+
+void LogDB::_writer()
+{
+	std::string batch;
+	for(;;) {
+		uint64_t upTo;
+		bool compactNow;
+		{
+			std::unique_lock<std::mutex> l(_queue_l);
+			while ((batch.empty())&&(_queue.empty())&&(!_compactRequested)&&(_running))
+				_queue_c.wait(l);
+			if ((batch.empty())&&(_queue.empty())&&(!_compactRequested))
+				break;
+			if (batch.empty()) {
+				batch.swap(_queue);
+			} else {
+				batch.append(_queue); // still holding a batch that failed to write
+				_queue.clear();
+			}
+			upTo = _queued;
+			compactNow = _compactRequested;
+		}
+
+		if (!batch.empty()) {
+			// After a failed write the segment may end in part of that batch, which
+			// would end replay of it there. If it held nothing else it is emptied and
+			// reused, so a full disk does not leave a new segment behind per retry.
+			if (!_segment) {
+				if (_segmentBytes == 0)
+					_openSegment(_segmentSeq,true);
+				else _openSegment(_segmentSeq + 1);
+			}
+			if ((_segment)&&(fwrite(batch.data(),1,batch.size(),_segment) == batch.size())&&(_sync(_segment))) {
+				_segmentBytes += batch.size();
+				_logBytes += batch.size();
+				batch.clear();
+			} else {
+				if (_segment) {
+					fclose(_segment);
+					_segment = (FILE *)0;
+				}
+				std::unique_lock<std::mutex> l(_queue_l);
+				if (_running) {
+					fprintf(stderr,"WARNING: controller unable to write to log database in %s, will retry" ZT_EOL_S,_path.c_str());
+					_queue_c.wait_for(l,std::chrono::milliseconds(ZT_LOGDB_WRITE_RETRY_DELAY),[this]() { return !_running; });
+					continue;
+				}
+				fprintf(stderr,"WARNING: controller unable to write to log database in %s, changes since the last write are lost" ZT_EOL_S,_path.c_str());
+				_writeFailed = true;
+				l.unlock();
+				_written_c.notify_all();
+				break;
+			}
+		}
+
+		if ((compactNow)||(_logBytes > std::max((uint64_t)ZT_LOGDB_COMPACT_MIN_BYTES,_snapshotBytes)))
+			_compact();
+
+		{
+			std::lock_guard<std::mutex> l(_queue_l);
+			_written = upTo;
+			if (compactNow)
+				_compactRequested = false;
+		}
+		_written_c.notify_all();
+	}
+}
+
+void LogDB::_compact()
+{
+	// Start a new segment first. Changes queued from here on may also be in the
+	// snapshot, which is fine since replaying a change twice has the same effect.
+	const uint64_t first = _segmentSeq + 1;
+	if (!_openSegment(first))
+		return;
+
+	std::vector< std::shared_ptr<const nlohmann::json> > networks;
+	std::vector< std::shared_ptr<const MemberRecord> > members;
+	{
+		std::shared_lock<std::shared_mutex> l(_networks_l);
+		for(auto nw=_networks.begin();nw!=_networks.end();++nw) {
+			std::shared_lock<std::shared_mutex> l2(nw->second->lock);
+			if (nw->second->config)
+				networks.push_back(nw->second->config);
+			for(auto m=nw->second->members.begin();m!=nw->second->members.end();++m)
+				members.push_back(m->second);
+		}
+	}
+
+	std::string records;
+	for(auto n=networks.begin();n!=networks.end();++n)
+		_putFrame(records,**n);
+	networks.clear();
+	nlohmann::json tmp;
+	for(auto m=members.begin();m!=members.end();++m) {
+		(*m)->toJson(tmp);
+		_putFrame(records,tmp);
+	}
+	members.clear();
+
+	if (!_writeSnapshot(_path + ZT_PATH_SEPARATOR_S "snapshot",records,first)) {
+		fprintf(stderr,"WARNING: controller unable to write log database snapshot in %s" ZT_EOL_S,_path.c_str());
+		return;
+	}
+	_snapshotBytes = ZT_LOGDB_SNAPSHOT_HEADER_SIZE + records.size();
+	_logBytes = _segmentBytes;
+
+	char tmpPath[64];
+	for(uint64_t s=_firstSegmentSeq;s<first;++s) {
+		OSUtils::ztsnprintf(tmpPath,sizeof(tmpPath),ZT_PATH_SEPARATOR_S "log.%.16llx",(unsigned long long)s);
+		OSUtils::rm((_path + tmpPath).c_str());
+	}
+	_firstSegmentSeq = first;
+}
+
+bool LogDB::_openSegment(const uint64_t seq,const bool truncate)
+{
+	char tmp[64];
+	OSUtils::ztsnprintf(tmp,sizeof(tmp),ZT_PATH_SEPARATOR_S "log.%.16llx",(unsigned long long)seq);
+	FILE *f = fopen((_path + tmp).c_str(),(truncate) ? "wb" : "ab");
+	if (!f) {
+		fprintf(stderr,"WARNING: controller unable to open log database segment %s%s" ZT_EOL_S,_path.c_str(),tmp);
+		return false;
+	}
+	OSUtils::lockDownFile((_path + tmp).c_str(),false);
+	if (_segment) {
+		_sync(_segment);
+		fclose(_segment);
+	}
+	_segment = f;
+	_segmentSeq = seq;
+	_segmentBytes = 0;
+	return true;
+}
+
+} // namespace ZeroTier
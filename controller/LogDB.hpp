@@ -0,0 +1,168 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_CONTROLLER_LOGDB_HPP
+#define ZT_CONTROLLER_LOGDB_HPP
+
+#include "DB.hpp"
+
+#include <stdio.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Compact once the log has grown past this and past the size of the last snapshot
+#ifndef ZT_LOGDB_COMPACT_MIN_BYTES
+#define ZT_LOGDB_COMPACT_MIN_BYTES (64 * 1024 * 1024)
+#endif
+
+// Delay before the writer retries a batch it could not write or sync
+#ifndef ZT_LOGDB_WRITE_RETRY_DELAY
+#define ZT_LOGDB_WRITE_RETRY_DELAY 1000
+#endif
+
+namespace ZeroTier
+{
+
+/**
+ * DB implementation for controller that keeps an append-only log on disk
+ *
+ * FileDB writes one JSON file per record as it is saved and reads every
+ * file back at startup, which gets slow with hundreds of thousands of
+ * members. This instead appends each change to a log segment and keeps
+ * the index in memory (the one DB already has). Saves return as soon as
+ * memory is updated; a writer thread appends whatever has queued up since
+ * its last write in one go and syncs once per batch, so bursts of changes
+ * cost one sync rather than one per record. Once the log outgrows the last
+ * snapshot, the writer starts a new segment, writes all current records to
+ * a new snapshot and drops the segments the snapshot covers.
+ *
+ * Startup reads the snapshot and then replays the segments after it. A
+ * record torn by a crash fails its checksum and ends replay of that
+ * segment. New writes always go to a new segment. If a write or sync
+ * fails, the writer keeps the batch, moves to a new segment and tries
+ * again until it succeeds or the DB is shut down.
+ *
+ * Member online state is kept in memory only, as with FileDB.
+ *
+ * Files in the database directory:
+ *   snapshot          - all records as of the start of segment N
+ *   log.<N in hex>    - changes, in order
+ *
+ * Use "log:<path>" as the controller database path to select this, and
+ * zerotier-one -L to import or export the FileDB directory layout.
+ */
+class LogDB : public DB
+{
+public:
+	LogDB(const char *path);
+	virtual ~LogDB();
+
+	virtual bool waitForReady();
+	virtual bool isReady();
+	virtual bool save(nlohmann::json &record,bool notifyListeners,bool keepRevision = false);
+	virtual void eraseNetwork(const uint64_t networkId);
+	virtual void eraseMember(const uint64_t networkId,const uint64_t memberId);
+	virtual void nodeIsOnline(const uint64_t networkId,const uint64_t memberId,const InetAddress &physicalAddress);
+	virtual std::shared_ptr<const MemberOnlineTable::Network> lastSeen(const uint64_t networkId) const;
+	virtual bool lastSeen(const uint64_t networkId,const uint64_t memberId,MemberOnlineTable::Member &m) const;
+
+	/**
+	 * Wait until everything saved so far has been written and synced
+	 *
+	 * @return False if the writer gave up on some of it at shutdown
+	 */
+	bool flush();
+
+	/**
+	 * Write a snapshot and drop the log segments it covers, then return
+	 */
+	void compact();
+
+	/**
+	 * Create a log database from a FileDB directory
+	 *
+	 * @param fileDbPath FileDB directory (e.g. controller.d)
+	 * @param path Directory for log database, which must not already hold one
+	 * @return Number of records copied or -1 on error
+	 */
+	static long importFileDB(const char *fileDbPath,const char *path);
+
+	/**
+	 * Write every record in a log database out in the FileDB directory layout
+	 *
+	 * Records are written as they are, revisions included.
+	 *
+	 * @param path Log database directory
+	 * @param fileDbPath FileDB directory to write to
+	 * @return Number of records copied or -1 on error
+	 */
+	static long exportFileDB(const char *path,const char *fileDbPath);
+
+private:
+	enum {
+		_OP_PUT = 1,           // payload: record as MessagePack
+		_OP_ERASE_NETWORK = 2, // payload: network ID
+		_OP_ERASE_MEMBER = 3   // payload: network ID, member ID
+	};
+
+	static void _frame(std::string &out,const unsigned int op,const void *data,const unsigned int len);
+	static void _putFrame(std::string &out,const nlohmann::json &record);
+	static bool _writeSnapshot(const std::string &path,const std::string &records,const uint64_t firstSegment);
+	static bool _sync(FILE *f);
+	static uint32_t _crc32c(const uint8_t *p,unsigned long len);
+
+	long _replay(const std::string &data,const unsigned long start);
+	bool _current(const uint64_t networkId,const uint64_t memberId,nlohmann::json &record);
+	void _append(const std::string &frames);
+	void _writer();
+	void _compact();
+	bool _openSegment(const uint64_t seq,const bool truncate = false);
+
+	const std::string _path;
+
+	std::string _queue; // frames waiting for the writer
+	uint64_t _queued;   // number of _append() calls so far
+	uint64_t _written;  // _queued as of the last completed write
+	bool _compactRequested;
+	bool _running;
+	bool _writeFailed;  // writer dropped changes it could not write before shutdown
+	std::mutex _queue_l;
+	std::condition_variable _queue_c;   // wakes the writer
+	std::condition_variable _written_c; // wakes flush() and compact()
+
+	// Held across updating memory and queueing the change, so the log has changes in the order memory saw them
+	std::mutex _save_l;
+
+	// Writer thread only
+	FILE *_segment;
+	uint64_t _segmentSeq;
+	uint64_t _segmentBytes;
+	uint64_t _firstSegmentSeq;
+	uint64_t _logBytes;
+	uint64_t _snapshotBytes;
+
+	std::thread _writerThread;
+
+	std::thread _onlineUpdateThread; // periodically exports _online for lastSeen(networkId)
+	MemberOnlineTable _online;
+	std::mutex _online_l;
+	std::condition_variable _online_c;
+	bool _onlineRunning;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_CONTROLLER_MEMBERONLINETABLE_HPP
+#define ZT_CONTROLLER_MEMBERONLINETABLE_HPP
+
+#include "../node/Constants.hpp"
+#include "../node/InetAddress.hpp"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Sightings kept per member (most recent distinct physical addresses)
+#ifndef ZT_CONTROLLER_ONLINE_HISTORY
+#define ZT_CONTROLLER_ONLINE_HISTORY 4
+#endif
+
+// Number of independently locked shards (power of two)
+#define ZT_CONTROLLER_ONLINE_SHARDS 32
+
+namespace ZeroTier
+{
+
+/**
+ * When and from where each member last requested its config
+ *
+ * Each member has a fixed ring of its last ZT_CONTROLLER_ONLINE_HISTORY
+ * sightings. A sighting from the same address as the last one only moves
+ * its time forward, so the ring holds recent distinct addresses rather than
+ * filling up with repeats. Members are spread over ZT_CONTROLLER_ONLINE_SHARDS
+ * separately locked maps so config requests on different threads rarely
+ * wait on each other.
+ *
+ * Readers that want a whole network at once (e.g. the member list API) use
+ * the snapshot made by the last call to exportNetworks() so they never walk
+ * the shards. The DB calls that periodically.
+ */
+class MemberOnlineTable
+{
+public:
+	struct Sighting
+	{
+		int64_t ts;
+		InetAddress physicalAddress;
+	};
+
+	struct Member
+	{
+		Member() : head(0),count(0) {}
+
+		inline const Sighting &latest() const { return s[head]; }
+
+		// Sighting i back from the most recent, i < count
+		inline const Sighting &at(const unsigned int i) const { return s[(head + ZT_CONTROLLER_ONLINE_HISTORY - i) % ZT_CONTROLLER_ONLINE_HISTORY]; }
+
+		Sighting s[ZT_CONTROLLER_ONLINE_HISTORY];
+		unsigned int head;
+		unsigned int count;
+	};
+
+	// Latest sighting per member ID of one network
+	typedef std::unordered_map< uint64_t,Sighting > Network;
+
+	MemberOnlineTable() :
+		_exported(new std::unordered_map< uint64_t,std::shared_ptr<const Network> >())
+	{
+	}
+
+	inline void seen(const uint64_t networkId,const uint64_t memberId,const InetAddress &physicalAddress,const int64_t now)
+	{
+		_Shard &s = _shard(networkId,memberId);
+		std::lock_guard<std::mutex> l(s.lock);
+		Member &m = s.members[_Key(networkId,memberId)];
+		if ((m.count)&&(m.s[m.head].physicalAddress == physicalAddress)) {
+			m.s[m.head].ts = now;
+		} else {
+			if (m.count) {
+				m.head = (m.head + 1) % ZT_CONTROLLER_ONLINE_HISTORY;
+			}
+			m.s[m.head].ts = now;
+			m.s[m.head].physicalAddress = physicalAddress;
+			if (m.count < ZT_CONTROLLER_ONLINE_HISTORY) {
+				++m.count;
+			}
+		}
+	}
+
+	/**
+	 * @param m Set to member's sightings if any
+	 * @return True if member has been seen
+	 */
+	inline bool get(const uint64_t networkId,const uint64_t memberId,Member &m) const
+	{
+		_Shard &s = _shard(networkId,memberId);
+		std::lock_guard<std::mutex> l(s.lock);
+		auto i = s.members.find(_Key(networkId,memberId));
+		if (i == s.members.end())
+			return false;
+		m = i->second;
+		return true;
+	}
+
+	inline void erase(const uint64_t networkId,const uint64_t memberId)
+	{
+		_Shard &s = _shard(networkId,memberId);
+		std::lock_guard<std::mutex> l(s.lock);
+		s.members.erase(_Key(networkId,memberId));
+	}
+
+	inline void erase(const uint64_t networkId)
+	{
+		for(unsigned int i=0;i<ZT_CONTROLLER_ONLINE_SHARDS;++i) {
+			std::lock_guard<std::mutex> l(_shards[i].lock);
+			for(auto m=_shards[i].members.begin();m!=_shards[i].members.end();) {
+				if (m->first.networkId == networkId) {
+					_shards[i].members.erase(m++);
+				} else {
+					++m;
+				}
+			}
+		}
+	}
+
+	/**
+	 * Rebuild the per-network snapshot returned by network()
+	 *
+	 * Locks one shard at a time, so config requests only ever wait on the
+	 * copy of a single shard.
+	 */
+	inline void exportNetworks()
+	{
+		std::unordered_map< uint64_t,std::shared_ptr<Network> > networks;
+		for(unsigned int i=0;i<ZT_CONTROLLER_ONLINE_SHARDS;++i) {
+			std::lock_guard<std::mutex> l(_shards[i].lock);
+			for(auto m=_shards[i].members.begin();m!=_shards[i].members.end();++m) {
+				std::shared_ptr<Network> &nw = networks[m->first.networkId];
+				if (!nw)
+					nw.reset(new Network());
+				(*nw)[m->first.memberId] = m->second.latest();
+			}
+		}
+		std::shared_ptr< std::unordered_map< uint64_t,std::shared_ptr<const Network> > > exported(new std::unordered_map< uint64_t,std::shared_ptr<const Network> >());
+		for(auto nw=networks.begin();nw!=networks.end();++nw)
+			(*exported)[nw->first] = nw->second;
+		std::lock_guard<std::mutex> l(_exported_l);
+		_exported = exported;
+	}
+
+	/**
+	 * @return Latest sighting of each member as of the last exportNetworks(), or NULL if none
+	 */
+	inline std::shared_ptr<const Network> network(const uint64_t networkId) const
+	{
+		std::shared_ptr< const std::unordered_map< uint64_t,std::shared_ptr<const Network> > > exported;
+		{
+			std::lock_guard<std::mutex> l(_exported_l);
+			exported = _exported;
+		}
+		auto nw = exported->find(networkId);
+		return (nw == exported->end()) ? std::shared_ptr<const Network>() : nw->second;
+	}
+
+	inline unsigned long size() const
+	{
+		unsigned long n = 0;
+		for(unsigned int i=0;i<ZT_CONTROLLER_ONLINE_SHARDS;++i) {
+			std::lock_guard<std::mutex> l(_shards[i].lock);
+			n += (unsigned long)_shards[i].members.size();
+		}
+		return n;
+	}
+
+private:
+	struct _Key
+	{
+		_Key(const uint64_t n,const uint64_t m) : networkId(n),memberId(m) {}
+		inline bool operator==(const _Key &k) const { return ((networkId == k.networkId)&&(memberId == k.memberId)); }
+		uint64_t networkId;
+		uint64_t memberId;
+	};
+
+	struct _KeyHasher
+	{
+		inline std::size_t operator()(const _Key &k) const { return (std::size_t)((k.networkId * 0x9e3779b97f4a7c15ULL) ^ k.memberId); }
+	};
+
+	struct _Shard
+	{
+		std::mutex lock;
+		std::unordered_map< _Key,Member,_KeyHasher > members;
+	};
+
+	// Member IDs are random 40-bit addresses, so their low bits spread members across shards
+	inline _Shard &_shard(const uint64_t networkId,const uint64_t memberId) const { return _shards[(unsigned int)(memberId ^ networkId) & (ZT_CONTROLLER_ONLINE_SHARDS - 1)]; }
+
+	mutable _Shard _shards[ZT_CONTROLLER_ONLINE_SHARDS];
+	std::shared_ptr< const std::unordered_map< uint64_t,std::shared_ptr<const Network> > > _exported;
+	mutable std::mutex _exported_l;
+};
+
+} // namespace ZeroTier
+
+#endif
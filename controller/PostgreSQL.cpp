@@ -28,10 +28,30 @@
 #include <iomanip>
 #include <climits>
 #include <chrono>
+#include <map>
+#include <set>
 
 
 // #define REDIS_TRACE 1
 
+// Members per network added to memory at a time while loading
+#define ZT_POSTGRESQL_LOAD_BATCH 1024
+
+// Most queued changes one commit thread takes at a time
+#define ZT_POSTGRESQL_COMMIT_BATCH_MAX 1024
+
+// How long a commit thread waits for more changes after the first (ms)
+#define ZT_POSTGRESQL_COMMIT_BATCH_WINDOW 20
+
+// Most members updated by one online status statement
+#define ZT_POSTGRESQL_ONLINE_BATCH_MAX 4096
+
+// Most parameters in one statement (the protocol limit is 65535)
+#define ZT_POSTGRESQL_STATEMENT_PARAMS_MAX 65535
+
+// How long a commit thread waits to try again for a database connection (ms)
+#define ZT_POSTGRESQL_COMMIT_RETRY_DELAY 1000
+
 using json = nlohmann::json;
 
 namespace {
@@ -106,6 +126,34 @@ std::string url_encode(const std::string &value) {
     return escaped.str();
 }
 
+// Append a row to a list, numbering each $ in row after the n parameters already bound
+void appendRow(std::string &list, size_t n, const char *row)
+{
+	if (!list.empty())
+		list.push_back(',');
+	for (const char *c = row; *c; ++c) {
+		list.push_back(*c);
+		if (*c == '$')
+			list.append(std::to_string(++n));
+	}
+}
+
+// Run head + rows + tail with each row's values bound to the $s in row, in as few
+// statements as the parameter limit allows
+void execRows(pqxx::work &w, const std::string &head, const char *row, const std::string &tail, const std::vector< std::vector<std::string> > &rows)
+{
+	for (auto r = rows.begin(); r != rows.end();) {
+		pqxx::params values;
+		std::string list;
+		for (; (r != rows.end()) && ((values.size() + r->size()) <= ZT_POSTGRESQL_STATEMENT_PARAMS_MAX); ++r) {
+			appendRow(list, values.size(), row);
+			for (auto v = r->begin(); v != r->end(); ++v)
+				values.append(*v);
+		}
+		w.exec_params0(head + list + tail, values);
+	}
+}
+
 } // anonymous namespace
 
 using namespace ZeroTier;
@@ -317,7 +365,7 @@ bool PostgreSQL::isReady()
 	return ((_ready == 2)&&(_connected));
 }
 
-bool PostgreSQL::save(nlohmann::json &record,bool notifyListeners)
+bool PostgreSQL::save(nlohmann::json &record,bool notifyListeners,bool keepRevision)
 {
 	bool modified = false;
 	try {
@@ -332,8 +380,9 @@ bool PostgreSQL::save(nlohmann::json &record,bool notifyListeners)
 			if (nwid) {
 				nlohmann::json old;
 				get(nwid,old);
-				if ((!old.is_object())||(!_compareRecords(old,record))) {
-					record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
+				if (_saveNeeded(old,record,keepRevision)) {
+					if (!keepRevision)
+						record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
 					_commitQueue.post(std::pair<nlohmann::json,bool>(record,notifyListeners));
 					modified = true;
 				}
@@ -347,9 +396,10 @@ bool PostgreSQL::save(nlohmann::json &record,bool notifyListeners)
 			if ((id)&&(nwid)) {
 				nlohmann::json network,old;
 				get(nwid,network,id,old);
-				if ((!old.is_object())||(!_compareRecords(old,record))) {
+				if (_saveNeeded(old,record,keepRevision)) {
 					//fprintf(stderr, "commit queue post\n");
-					record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
+					if (!keepRevision)
+						record["revision"] = OSUtils::jsonInt(record["revision"],0ULL) + 1ULL;
 					_commitQueue.post(std::pair<nlohmann::json,bool>(record,notifyListeners));
 					modified = true;
 				} else {
@@ -922,12 +972,14 @@ void PostgreSQL::initializeMembers()
 			, std::string					// assignedAddresses
 		> row;
 
+		// Members are added a batch per network at a time rather than one at a time
+		std::unordered_map< uint64_t,std::vector<json> > loading;
+
 		uint64_t count = 0;
 		auto tmp = std::chrono::high_resolution_clock::now();
 		uint64_t total = 0;
 		while (stream >> row) {
 			auto start = std::chrono::high_resolution_clock::now();
-			json empty;
 			json config;
 			
 			initMember(config);
@@ -990,7 +1042,13 @@ void PostgreSQL::initializeMembers()
 
 			Metrics::member_count++;
 
-			_memberChanged(empty, config, false);
+			const uint64_t nwid = Utils::hexStrToU64(networkId.c_str());
+			std::vector<json> &batch = loading[nwid];
+			batch.push_back(std::move(config));
+			if (batch.size() >= ZT_POSTGRESQL_LOAD_BATCH) {
+				_loadMembers(nwid, batch);
+				batch.clear();
+			}
 
 			memberId = "";
 			networkId = "";
@@ -1003,6 +1061,10 @@ void PostgreSQL::initializeMembers()
 				fprintf(stderr, "Averaging %llu us per member\n", (total/count));
 			}
 		}
+		for (auto b = loading.begin(); b != loading.end(); ++b) {
+			_loadMembers(b->first, b->second);
+		}
+		loading.clear();
 		if (count > 0) {
 			fprintf(stderr, "Took %llu us per member to load\n", (total/count));
 		}
@@ -1318,406 +1380,644 @@ void PostgreSQL::commitThread()
 {
 	fprintf(stderr, "%s: commitThread start\n", _myAddressStr.c_str());
 	std::pair<nlohmann::json,bool> qitem;
+	std::vector< std::pair<nlohmann::json,bool> > batch;
 	while(_commitQueue.get(qitem)&(_run == 1)) {
 		//fprintf(stderr, "commitThread tick\n");
-		if (!qitem.first.is_object()) {
-			fprintf(stderr, "not an object\n");
-			continue;
+		batch.clear();
+		batch.push_back(qitem);
+
+		// Take whatever else arrives within a short window so bursts commit together
+		const int64_t batchEnd = OSUtils::now() + ZT_POSTGRESQL_COMMIT_BATCH_WINDOW;
+		while (batch.size() < ZT_POSTGRESQL_COMMIT_BATCH_MAX) {
+			const int64_t wait = batchEnd - OSUtils::now();
+			if ((wait <= 0)||(_commitQueue.get(qitem,(unsigned long)wait) != BlockingQueue< std::pair<nlohmann::json,bool> >::OK))
+				break;
+			batch.push_back(qitem);
 		}
 
+		// Hold on to the batch until there is a connection to commit it on
 		std::shared_ptr<PostgresConnection> c;
-		try {
-			c = _pool->borrow();
-		} catch (std::exception &e) {
-			fprintf(stderr, "ERROR: %s\n", e.what());
-			continue;
+		while (_run == 1) {
+			try {
+				c = _pool->borrow();
+			} catch (std::exception &e) {
+				fprintf(stderr, "ERROR: %s\n", e.what());
+			}
+			if (c)
+				break;
+			fprintf(stderr, "Error getting database connection, will retry committing %d changes\n", (int)batch.size());
+			std::this_thread::sleep_for(std::chrono::milliseconds(ZT_POSTGRESQL_COMMIT_RETRY_DELAY));
 		}
 
 		if (!c) {
-			fprintf(stderr, "Error getting database connection\n");
+			fprintf(stderr, "ERROR: shutting down without a database connection, %d changes not committed\n", (int)batch.size());
 			continue;
 		}
-		
+
 		Metrics::pgsql_commit_ticks++;
-		try {
-			nlohmann::json &config = (qitem.first);
-			const std::string objtype = config["objtype"];
-			if (objtype == "member") {
-				// fprintf(stderr, "%s: commitThread: member\n", _myAddressStr.c_str());
-				std::string memberId;
-				std::string networkId;
-				try {
-					pqxx::work w(*c->c);
-
-					memberId = config["id"];
-					networkId = config["nwid"];
-					
-					std::string target = "NULL";
-					if (!config["remoteTraceTarget"].is_null()) {
-						target = config["remoteTraceTarget"];
-					}
-					
-					pqxx::row nwrow = w.exec_params1("SELECT COUNT(id) FROM ztc_network WHERE id = $1", networkId);
-					int nwcount = nwrow[0].as<int>();
-
-					if (nwcount != 1) {
-						fprintf(stderr, "network %s does not exist.  skipping member upsert\n", networkId.c_str());
-						w.abort();
-						_pool->unborrow(c);
-						continue;
-					}
+		Metrics::pgsql_commit_batch_size_all.Observe(batch.size());
 
+		// Runs of member saves go out as one transaction, everything else one at a time in order
+		std::vector< std::pair<nlohmann::json,bool> > members;
+		for(auto i=batch.begin();i!=batch.end();++i) {
+			if (!i->first.is_object()) {
+				fprintf(stderr, "not an object\n");
+				continue;
+			}
+			if (OSUtils::jsonString(i->first["objtype"],"") == "member") {
+				members.push_back(*i);
+			} else {
+				if (!members.empty()) {
+					_commitMembers(c, members);
+					members.clear();
+				}
+				_commitOne(c, *i);
+			}
+		}
+		if (!members.empty())
+			_commitMembers(c, members);
 
-					pqxx::row mrow = w.exec_params1("SELECT COUNT(id) FROM ztc_member WHERE id = $1 AND network_id = $2", memberId, networkId);
-					int membercount = mrow[0].as<int>();
-
-					bool isNewMember = false;
-					if (membercount == 0) {
-						// new member
-						isNewMember = true;
-						pqxx::result res = w.exec_params0(
-							"INSERT INTO ztc_member (id, network_id, active_bridge, authorized, capabilities, "
-							"identity, last_authorized_time, last_deauthorized_time, no_auto_assign_ips, "
-							"remote_trace_level, remote_trace_target, revision, tags, v_major, v_minor, v_rev, v_proto) "
-							"VALUES ($1, $2, $3, $4, $5, $6, "
-							"TO_TIMESTAMP($7::double precision/1000), TO_TIMESTAMP($8::double precision/1000), "
-							"$9, $10, $11, $12, $13, $14, $15, $16, $17)",
-							memberId,
-							networkId,
-							(bool)config["activeBridge"],
-							(bool)config["authorized"],
-							OSUtils::jsonDump(config["capabilities"], -1),
-							OSUtils::jsonString(config["identity"], ""),
-							(uint64_t)config["lastAuthorizedTime"],
-							(uint64_t)config["lastDeauthorizedTime"],
-							(bool)config["noAutoAssignIps"],
-							(int)config["remoteTraceLevel"],
-							target,
-							(uint64_t)config["revision"],
-							OSUtils::jsonDump(config["tags"], -1),
-							(int)config["vMajor"],
-							(int)config["vMinor"],
-							(int)config["vRev"],
-							(int)config["vProto"]);
-					} else {
-						// existing member
-						pqxx::result res = w.exec_params0(
-							"UPDATE ztc_member "
-							"SET active_bridge = $3, authorized = $4, capabilities = $5, identity = $6, "
-							"last_authorized_time = TO_TIMESTAMP($7::double precision/1000), "
-							"last_deauthorized_time = TO_TIMESTAMP($8::double precision/1000), "
-							"no_auto_assign_ips = $9, remote_trace_level = $10, remote_trace_target= $11, "
-							"revision = $12, tags = $13, v_major = $14, v_minor = $15, v_rev = $16, v_proto = $17 "
-							"WHERE id = $1 AND network_id = $2",
-							memberId,
-							networkId,
-							(bool)config["activeBridge"],
-							(bool)config["authorized"],
-							OSUtils::jsonDump(config["capabilities"], -1),
-							OSUtils::jsonString(config["identity"], ""),
-							(uint64_t)config["lastAuthorizedTime"],
-							(uint64_t)config["lastDeauthorizedTime"],
-							(bool)config["noAutoAssignIps"],
-							(int)config["remoteTraceLevel"],
-							target,
-							(uint64_t)config["revision"],
-							OSUtils::jsonDump(config["tags"], -1),
-							(int)config["vMajor"],
-							(int)config["vMinor"],
-							(int)config["vRev"],
-							(int)config["vProto"]
-						);
-					}
+		_pool->unborrow(c);
+		c.reset();
+	}
 
-					if (!isNewMember) {
-						pqxx::result res = w.exec_params0("DELETE FROM ztc_member_ip_assignment WHERE member_id = $1 AND network_id = $2",
-							memberId, networkId);
-					}
+	fprintf(stderr, "%s commitThread finished\n", _myAddressStr.c_str());
+}
 
-					std::vector<std::string> assignments;
-					bool ipAssignError = false;
-					for (auto i = config["ipAssignments"].begin(); i != config["ipAssignments"].end(); ++i) {
-						std::string addr = *i;
+void PostgreSQL::_commitOne(std::shared_ptr<PostgresConnection> &c, std::pair<nlohmann::json,bool> &qitem)
+{
+	try {
+		nlohmann::json &config = (qitem.first);
+		const std::string objtype = config["objtype"];
+		if (objtype == "member") {
+			// fprintf(stderr, "%s: commitThread: member\n", _myAddressStr.c_str());
+			std::string memberId;
+			std::string networkId;
+			try {
+				pqxx::work w(*c->c);
 
-						if (std::find(assignments.begin(), assignments.end(), addr) != assignments.end()) {
-							continue;
-						}
+				memberId = config["id"];
+				networkId = config["nwid"];
+				
+				std::string target = "NULL";
+				if (!config["remoteTraceTarget"].is_null()) {
+					target = config["remoteTraceTarget"];
+				}
+				
+				pqxx::row nwrow = w.exec_params1("SELECT COUNT(id) FROM ztc_network WHERE id = $1", networkId);
+				int nwcount = nwrow[0].as<int>();
 
-						pqxx::result res = w.exec_params0(
-							"INSERT INTO ztc_member_ip_assignment (member_id, network_id, address) VALUES ($1, $2, $3) ON CONFLICT (network_id, member_id, address) DO NOTHING",
-							memberId, networkId, addr);
+				if (nwcount != 1) {
+					fprintf(stderr, "network %s does not exist.  skipping member upsert\n", networkId.c_str());
+					w.abort();
+					return;
+				}
 
-						assignments.push_back(addr);
-					}
-					if (ipAssignError) {
-						fprintf(stderr, "%s: ipAssignError\n", _myAddressStr.c_str());
-						w.abort();
-						_pool->unborrow(c);
-						c.reset();
-						continue;
-					}
 
-					w.commit();
+				pqxx::row mrow = w.exec_params1("SELECT COUNT(id) FROM ztc_member WHERE id = $1 AND network_id = $2", memberId, networkId);
+				int membercount = mrow[0].as<int>();
 
-					if (_smee != NULL && isNewMember) {
-						pqxx::row row = w.exec_params1(
-							"SELECT "
-							"	count(h.hook_id) "
-							"FROM "
-							"	ztc_hook h "
-							"	INNER JOIN ztc_org o ON o.org_id = h.org_id "
-							"   INNER JOIN ztc_network n ON n.owner_id = o.owner_id "
-							" WHERE "
-							"n.id = $1 ",
-							networkId
-						);
-						int64_t hookCount = row[0].as<int64_t>();
-						if (hookCount > 0) {
-							notifyNewMember(networkId, memberId);
-						}
+				bool isNewMember = false;
+				if (membercount == 0) {
+					// new member
+					isNewMember = true;
+					pqxx::result res = w.exec_params0(
+						"INSERT INTO ztc_member (id, network_id, active_bridge, authorized, capabilities, "
+						"identity, last_authorized_time, last_deauthorized_time, no_auto_assign_ips, "
+						"remote_trace_level, remote_trace_target, revision, tags, v_major, v_minor, v_rev, v_proto) "
+						"VALUES ($1, $2, $3, $4, $5, $6, "
+						"TO_TIMESTAMP($7::double precision/1000), TO_TIMESTAMP($8::double precision/1000), "
+						"$9, $10, $11, $12, $13, $14, $15, $16, $17)",
+						memberId,
+						networkId,
+						(bool)config["activeBridge"],
+						(bool)config["authorized"],
+						OSUtils::jsonDump(config["capabilities"], -1),
+						OSUtils::jsonString(config["identity"], ""),
+						(uint64_t)config["lastAuthorizedTime"],
+						(uint64_t)config["lastDeauthorizedTime"],
+						(bool)config["noAutoAssignIps"],
+						(int)config["remoteTraceLevel"],
+						target,
+						(uint64_t)config["revision"],
+						OSUtils::jsonDump(config["tags"], -1),
+						(int)config["vMajor"],
+						(int)config["vMinor"],
+						(int)config["vRev"],
+						(int)config["vProto"]);
+				} else {
+					// existing member
+					pqxx::result res = w.exec_params0(
+						"UPDATE ztc_member "
+						"SET active_bridge = $3, authorized = $4, capabilities = $5, identity = $6, "
+						"last_authorized_time = TO_TIMESTAMP($7::double precision/1000), "
+						"last_deauthorized_time = TO_TIMESTAMP($8::double precision/1000), "
+						"no_auto_assign_ips = $9, remote_trace_level = $10, remote_trace_target= $11, "
+						"revision = $12, tags = $13, v_major = $14, v_minor = $15, v_rev = $16, v_proto = $17 "
+						"WHERE id = $1 AND network_id = $2",
+						memberId,
+						networkId,
+						(bool)config["activeBridge"],
+						(bool)config["authorized"],
+						OSUtils::jsonDump(config["capabilities"], -1),
+						OSUtils::jsonString(config["identity"], ""),
+						(uint64_t)config["lastAuthorizedTime"],
+						(uint64_t)config["lastDeauthorizedTime"],
+						(bool)config["noAutoAssignIps"],
+						(int)config["remoteTraceLevel"],
+						target,
+						(uint64_t)config["revision"],
+						OSUtils::jsonDump(config["tags"], -1),
+						(int)config["vMajor"],
+						(int)config["vMinor"],
+						(int)config["vRev"],
+						(int)config["vProto"]
+					);
+				}
+
+				if (!isNewMember) {
+					pqxx::result res = w.exec_params0("DELETE FROM ztc_member_ip_assignment WHERE member_id = $1 AND network_id = $2",
+						memberId, networkId);
+				}
+
+				std::vector<std::string> assignments;
+				bool ipAssignError = false;
+				for (auto i = config["ipAssignments"].begin(); i != config["ipAssignments"].end(); ++i) {
+					std::string addr = *i;
+
+					if (std::find(assignments.begin(), assignments.end(), addr) != assignments.end()) {
+						continue;
 					}
 
-					const uint64_t nwidInt = OSUtils::jsonIntHex(config["nwid"], 0ULL);
-					const uint64_t memberidInt = OSUtils::jsonIntHex(config["id"], 0ULL);
-					if (nwidInt && memberidInt) {
-						nlohmann::json nwOrig;
-						nlohmann::json memOrig;
+					pqxx::result res = w.exec_params0(
+						"INSERT INTO ztc_member_ip_assignment (member_id, network_id, address) VALUES ($1, $2, $3) ON CONFLICT (network_id, member_id, address) DO NOTHING",
+						memberId, networkId, addr);
 
-						nlohmann::json memNew(config);
+					assignments.push_back(addr);
+				}
+				if (ipAssignError) {
+					fprintf(stderr, "%s: ipAssignError\n", _myAddressStr.c_str());
+					w.abort();
+					return;
+				}
 
-						get(nwidInt, nwOrig, memberidInt, memOrig);
+				w.commit();
 
-						_memberChanged(memOrig, memNew, qitem.second);
-					} else {
-						fprintf(stderr, "%s: Can't notify of change.  Error parsing nwid or memberid: %llu-%llu\n", _myAddressStr.c_str(), (unsigned long long)nwidInt, (unsigned long long)memberidInt);
+				if (_smee != NULL && isNewMember) {
+					pqxx::row row = w.exec_params1(
+						"SELECT "
+						"	count(h.hook_id) "
+						"FROM "
+						"	ztc_hook h "
+						"	INNER JOIN ztc_org o ON o.org_id = h.org_id "
+						"   INNER JOIN ztc_network n ON n.owner_id = o.owner_id "
+						" WHERE "
+						"n.id = $1 ",
+						networkId
+					);
+					int64_t hookCount = row[0].as<int64_t>();
+					if (hookCount > 0) {
+						notifyNewMember(networkId, memberId);
 					}
-				} catch (std::exception &e) {
-					fprintf(stderr, "%s ERROR: Error updating member %s-%s: %s\n", _myAddressStr.c_str(), networkId.c_str(), memberId.c_str(), e.what());
 				}
-			} else if (objtype == "network") {
-				try {
-					// fprintf(stderr, "%s: commitThread: network\n", _myAddressStr.c_str());
-					pqxx::work w(*c->c);
 
-					std::string id = config["id"];
-					std::string remoteTraceTarget = "";
-					if(!config["remoteTraceTarget"].is_null()) {
-						remoteTraceTarget = config["remoteTraceTarget"];
-					}
-					std::string rulesSource = "";
-					if (config["rulesSource"].is_string()) {
-						rulesSource = config["rulesSource"];
-					}
+				const uint64_t nwidInt = OSUtils::jsonIntHex(config["nwid"], 0ULL);
+				const uint64_t memberidInt = OSUtils::jsonIntHex(config["id"], 0ULL);
+				if (nwidInt && memberidInt) {
+					nlohmann::json nwOrig;
+					nlohmann::json memOrig;
 
-					// This ugly query exists because when we want to mirror networks to/from
-					// another data store (e.g. FileDB or LFDB) it is possible to get a network
-					// that doesn't exist in Central's database. This does an upsert and sets
-					// the owner_id to the "first" global admin in the user DB if the record
-					// did not previously exist. If the record already exists owner_id is left
-					// unchanged, so owner_id should be left out of the update clause.
-					pqxx::result res = w.exec_params0(
-						"INSERT INTO ztc_network (id, creation_time, owner_id, controller_id, capabilities, enable_broadcast, "
-						"last_modified, mtu, multicast_limit, name, private, "
-						"remote_trace_level, remote_trace_target, rules, rules_source, "
-						"tags, v4_assign_mode, v6_assign_mode, sso_enabled) VALUES ("
-						"$1, TO_TIMESTAMP($5::double precision/1000), "
-						"(SELECT user_id AS owner_id FROM ztc_global_permissions WHERE authorize = true AND del = true AND modify = true AND read = true LIMIT 1),"
-						"$2, $3, $4, TO_TIMESTAMP($5::double precision/1000), "
-						"$6, $7, $8, $9, $10, $11, $12, $13, $14, $15, $16, $17) "
-						"ON CONFLICT (id) DO UPDATE set controller_id = EXCLUDED.controller_id, "
-						"capabilities = EXCLUDED.capabilities, enable_broadcast = EXCLUDED.enable_broadcast, "
-						"last_modified = EXCLUDED.last_modified, mtu = EXCLUDED.mtu, "
-						"multicast_limit = EXCLUDED.multicast_limit, name = EXCLUDED.name, "
-						"private = EXCLUDED.private, remote_trace_level = EXCLUDED.remote_trace_level, "
-						"remote_trace_target = EXCLUDED.remote_trace_target, rules = EXCLUDED.rules, "
-						"rules_source = EXCLUDED.rules_source, tags = EXCLUDED.tags, "
-						"v4_assign_mode = EXCLUDED.v4_assign_mode, v6_assign_mode = EXCLUDED.v6_assign_mode, "
-						"sso_enabled = EXCLUDED.sso_enabled",
-						id,
-						_myAddressStr,
-						OSUtils::jsonDump(config["capabilities"], -1),
-						(bool)config["enableBroadcast"],
-						OSUtils::now(),
-						(int)config["mtu"],
-						(int)config["multicastLimit"],
-						OSUtils::jsonString(config["name"],""),
-						(bool)config["private"],
-						(int)config["remoteTraceLevel"],
-						remoteTraceTarget,
-						OSUtils::jsonDump(config["rules"], -1),
-						rulesSource,
-						OSUtils::jsonDump(config["tags"], -1),
-						OSUtils::jsonDump(config["v4AssignMode"],-1),
-						OSUtils::jsonDump(config["v6AssignMode"], -1),
-						OSUtils::jsonBool(config["ssoEnabled"], false));
+					nlohmann::json memNew(config);
 
-					res = w.exec_params0("DELETE FROM ztc_network_assignment_pool WHERE network_id = $1", 0);
+					get(nwidInt, nwOrig, memberidInt, memOrig);
 
-					auto pool = config["ipAssignmentPools"];
-					bool err = false;
-					for (auto i = pool.begin(); i != pool.end(); ++i) {
-						std::string start = (*i)["ipRangeStart"];
-						std::string end = (*i)["ipRangeEnd"];
+					_memberChanged(memOrig, memNew, qitem.second);
+				} else {
+					fprintf(stderr, "%s: Can't notify of change.  Error parsing nwid or memberid: %llu-%llu\n", _myAddressStr.c_str(), (unsigned long long)nwidInt, (unsigned long long)memberidInt);
+				}
+			} catch (std::exception &e) {
+				fprintf(stderr, "%s ERROR: Error updating member %s-%s: %s\n", _myAddressStr.c_str(), networkId.c_str(), memberId.c_str(), e.what());
+			}
+		} else if (objtype == "network") {
+			try {
+				// fprintf(stderr, "%s: commitThread: network\n", _myAddressStr.c_str());
+				pqxx::work w(*c->c);
 
-						res = w.exec_params0(
-							"INSERT INTO ztc_network_assignment_pool (network_id, ip_range_start, ip_range_end) "
-							"VALUES ($1, $2, $3)", id, start, end);
-					}
+				std::string id = config["id"];
+				std::string remoteTraceTarget = "";
+				if(!config["remoteTraceTarget"].is_null()) {
+					remoteTraceTarget = config["remoteTraceTarget"];
+				}
+				std::string rulesSource = "";
+				if (config["rulesSource"].is_string()) {
+					rulesSource = config["rulesSource"];
+				}
 
-					res = w.exec_params0("DELETE FROM ztc_network_route WHERE network_id = $1", id);
-
-					auto routes = config["routes"];
-					err = false;
-					for (auto i = routes.begin(); i != routes.end(); ++i) {
-						std::string t = (*i)["target"];
-						std::vector<std::string> target;
-						std::istringstream f(t);
-						std::string s;
-						while(std::getline(f, s, '/')) {
-							target.push_back(s);
-						}
-						if (target.empty() || target.size() != 2) {
-							continue;
-						}
-						std::string targetAddr = target[0];
-						std::string targetBits = target[1];
-						std::string via = "NULL";
-						if (!(*i)["via"].is_null()) {
-							via = (*i)["via"];
-						}
+				// This ugly query exists because when we want to mirror networks to/from
+				// another data store (e.g. FileDB or LFDB) it is possible to get a network
+				// that doesn't exist in Central's database. This does an upsert and sets
+				// the owner_id to the "first" global admin in the user DB if the record
+				// did not previously exist. If the record already exists owner_id is left
+				// unchanged, so owner_id should be left out of the update clause.
+				pqxx::result res = w.exec_params0(
+					"INSERT INTO ztc_network (id, creation_time, owner_id, controller_id, capabilities, enable_broadcast, "
+					"last_modified, mtu, multicast_limit, name, private, "
+					"remote_trace_level, remote_trace_target, rules, rules_source, "
+					"tags, v4_assign_mode, v6_assign_mode, sso_enabled) VALUES ("
+					"$1, TO_TIMESTAMP($5::double precision/1000), "
+					"(SELECT user_id AS owner_id FROM ztc_global_permissions WHERE authorize = true AND del = true AND modify = true AND read = true LIMIT 1),"
+					"$2, $3, $4, TO_TIMESTAMP($5::double precision/1000), "
+					"$6, $7, $8, $9, $10, $11, $12, $13, $14, $15, $16, $17) "
+					"ON CONFLICT (id) DO UPDATE set controller_id = EXCLUDED.controller_id, "
+					"capabilities = EXCLUDED.capabilities, enable_broadcast = EXCLUDED.enable_broadcast, "
+					"last_modified = EXCLUDED.last_modified, mtu = EXCLUDED.mtu, "
+					"multicast_limit = EXCLUDED.multicast_limit, name = EXCLUDED.name, "
+					"private = EXCLUDED.private, remote_trace_level = EXCLUDED.remote_trace_level, "
+					"remote_trace_target = EXCLUDED.remote_trace_target, rules = EXCLUDED.rules, "
+					"rules_source = EXCLUDED.rules_source, tags = EXCLUDED.tags, "
+					"v4_assign_mode = EXCLUDED.v4_assign_mode, v6_assign_mode = EXCLUDED.v6_assign_mode, "
+					"sso_enabled = EXCLUDED.sso_enabled",
+					id,
+					_myAddressStr,
+					OSUtils::jsonDump(config["capabilities"], -1),
+					(bool)config["enableBroadcast"],
+					OSUtils::now(),
+					(int)config["mtu"],
+					(int)config["multicastLimit"],
+					OSUtils::jsonString(config["name"],""),
+					(bool)config["private"],
+					(int)config["remoteTraceLevel"],
+					remoteTraceTarget,
+					OSUtils::jsonDump(config["rules"], -1),
+					rulesSource,
+					OSUtils::jsonDump(config["tags"], -1),
+					OSUtils::jsonDump(config["v4AssignMode"],-1),
+					OSUtils::jsonDump(config["v6AssignMode"], -1),
+					OSUtils::jsonBool(config["ssoEnabled"], false));
+
+				res = w.exec_params0("DELETE FROM ztc_network_assignment_pool WHERE network_id = $1", 0);
+
+				auto pool = config["ipAssignmentPools"];
+				bool err = false;
+				for (auto i = pool.begin(); i != pool.end(); ++i) {
+					std::string start = (*i)["ipRangeStart"];
+					std::string end = (*i)["ipRangeEnd"];
+
+					res = w.exec_params0(
+						"INSERT INTO ztc_network_assignment_pool (network_id, ip_range_start, ip_range_end) "
+						"VALUES ($1, $2, $3)", id, start, end);
+				}
 
-						res = w.exec_params0("INSERT INTO ztc_network_route (network_id, address, bits, via) VALUES ($1, $2, $3, $4)",
-							id, targetAddr, targetBits, (via == "NULL" ? NULL : via.c_str()));
+				res = w.exec_params0("DELETE FROM ztc_network_route WHERE network_id = $1", id);
+
+				auto routes = config["routes"];
+				err = false;
+				for (auto i = routes.begin(); i != routes.end(); ++i) {
+					std::string t = (*i)["target"];
+					std::vector<std::string> target;
+					std::istringstream f(t);
+					std::string s;
+					while(std::getline(f, s, '/')) {
+						target.push_back(s);
 					}
-					if (err) {
-						fprintf(stderr, "%s: route add error\n", _myAddressStr.c_str());
-						w.abort();
-						_pool->unborrow(c);
+					if (target.empty() || target.size() != 2) {
 						continue;
 					}
+					std::string targetAddr = target[0];
+					std::string targetBits = target[1];
+					std::string via = "NULL";
+					if (!(*i)["via"].is_null()) {
+						via = (*i)["via"];
+					}
 
-					auto dns = config["dns"];
-					std::string domain = dns["domain"];
-					std::stringstream servers;
-					servers << "{";
-					for (auto j = dns["servers"].begin(); j < dns["servers"].end(); ++j) {
-						servers << *j;
-						if ( (j+1) != dns["servers"].end()) {
-							servers << ",";
-						}
+					res = w.exec_params0("INSERT INTO ztc_network_route (network_id, address, bits, via) VALUES ($1, $2, $3, $4)",
+						id, targetAddr, targetBits, (via == "NULL" ? NULL : via.c_str()));
+				}
+				if (err) {
+					fprintf(stderr, "%s: route add error\n", _myAddressStr.c_str());
+					w.abort();
+					return;
+				}
+
+				auto dns = config["dns"];
+				std::string domain = dns["domain"];
+				std::stringstream servers;
+				servers << "{";
+				for (auto j = dns["servers"].begin(); j < dns["servers"].end(); ++j) {
+					servers << *j;
+					if ( (j+1) != dns["servers"].end()) {
+						servers << ",";
 					}
-					servers << "}";
+				}
+				servers << "}";
 
-					std::string s = servers.str();
+				std::string s = servers.str();
 
-					res = w.exec_params0("INSERT INTO ztc_network_dns (network_id, domain, servers) VALUES ($1, $2, $3) ON CONFLICT (network_id) DO UPDATE SET domain = EXCLUDED.domain, servers = EXCLUDED.servers",
-						id, domain, s);
+				res = w.exec_params0("INSERT INTO ztc_network_dns (network_id, domain, servers) VALUES ($1, $2, $3) ON CONFLICT (network_id) DO UPDATE SET domain = EXCLUDED.domain, servers = EXCLUDED.servers",
+					id, domain, s);
 
-					w.commit();
+				w.commit();
 
-					const uint64_t nwidInt = OSUtils::jsonIntHex(config["nwid"], 0ULL);
-					if (nwidInt) {
-						nlohmann::json nwOrig;
-						nlohmann::json nwNew(config);
+				const uint64_t nwidInt = OSUtils::jsonIntHex(config["nwid"], 0ULL);
+				if (nwidInt) {
+					nlohmann::json nwOrig;
+					nlohmann::json nwNew(config);
 
-						get(nwidInt, nwOrig);
+					get(nwidInt, nwOrig);
 
-						_networkChanged(nwOrig, nwNew, qitem.second);
-					} else {
-						fprintf(stderr, "%s: Can't notify network changed: %llu\n", _myAddressStr.c_str(), (unsigned long long)nwidInt);
-					}
-				} catch (std::exception &e) {
-					fprintf(stderr, "%s ERROR: Error updating network: %s\n", _myAddressStr.c_str(), e.what());
+					_networkChanged(nwOrig, nwNew, qitem.second);
+				} else {
+					fprintf(stderr, "%s: Can't notify network changed: %llu\n", _myAddressStr.c_str(), (unsigned long long)nwidInt);
 				}
-				if (_redisMemberStatus) {
-					try {
-						std::string id = config["id"];
-						std::string controllerId = _myAddressStr.c_str();
-						std::string key = "networks:{" + controllerId + "}";
-						if (_rc->clusterMode) {
-							_cluster->sadd(key, id);
-						} else {
-							_redis->sadd(key, id);
-						}
-					} catch (sw::redis::Error &e) {
-						fprintf(stderr, "ERROR: Error adding network to Redis: %s\n", e.what());
+			} catch (std::exception &e) {
+				fprintf(stderr, "%s ERROR: Error updating network: %s\n", _myAddressStr.c_str(), e.what());
+			}
+			if (_redisMemberStatus) {
+				try {
+					std::string id = config["id"];
+					std::string controllerId = _myAddressStr.c_str();
+					std::string key = "networks:{" + controllerId + "}";
+					if (_rc->clusterMode) {
+						_cluster->sadd(key, id);
+					} else {
+						_redis->sadd(key, id);
 					}
+				} catch (sw::redis::Error &e) {
+					fprintf(stderr, "ERROR: Error adding network to Redis: %s\n", e.what());
 				}
-			} else if (objtype == "_delete_network") {
-				// fprintf(stderr, "%s: commitThread: delete network\n", _myAddressStr.c_str());
-				try {
-					pqxx::work w(*c->c);
+			}
+		} else if (objtype == "_delete_network") {
+			// fprintf(stderr, "%s: commitThread: delete network\n", _myAddressStr.c_str());
+			try {
+				pqxx::work w(*c->c);
 
-					std::string networkId = config["nwid"];
+				std::string networkId = config["nwid"];
 
-					pqxx::result res = w.exec_params0("UPDATE ztc_network SET deleted = true WHERE id = $1",
-						networkId);
+				pqxx::result res = w.exec_params0("UPDATE ztc_network SET deleted = true WHERE id = $1",
+					networkId);
 
-					w.commit();
-				} catch (std::exception &e) {
-					fprintf(stderr, "%s ERROR: Error deleting network: %s\n", _myAddressStr.c_str(), e.what());
-				}
-				if (_redisMemberStatus) {
-					try {
-						std::string id = config["id"];
-						std::string controllerId = _myAddressStr.c_str();
-						std::string key = "networks:{" + controllerId + "}";
-						if (_rc->clusterMode) {
-							_cluster->srem(key, id);
-							_cluster->del("network-nodes-online:{"+controllerId+"}:"+id);
-						} else {
-							_redis->srem(key, id);
-							_redis->del("network-nodes-online:{"+controllerId+"}:"+id);
-						}
-					} catch (sw::redis::Error &e) {
-						fprintf(stderr, "ERROR: Error adding network to Redis: %s\n", e.what());
+				w.commit();
+			} catch (std::exception &e) {
+				fprintf(stderr, "%s ERROR: Error deleting network: %s\n", _myAddressStr.c_str(), e.what());
+			}
+			if (_redisMemberStatus) {
+				try {
+					std::string id = config["id"];
+					std::string controllerId = _myAddressStr.c_str();
+					std::string key = "networks:{" + controllerId + "}";
+					if (_rc->clusterMode) {
+						_cluster->srem(key, id);
+						_cluster->del("network-nodes-online:{"+controllerId+"}:"+id);
+					} else {
+						_redis->srem(key, id);
+						_redis->del("network-nodes-online:{"+controllerId+"}:"+id);
 					}
+				} catch (sw::redis::Error &e) {
+					fprintf(stderr, "ERROR: Error adding network to Redis: %s\n", e.what());
 				}
+			}
 
-			} else if (objtype == "_delete_member") {
-				// fprintf(stderr, "%s commitThread: delete member\n", _myAddressStr.c_str());
-				try {
-					pqxx::work w(*c->c);
+		} else if (objtype == "_delete_member") {
+			// fprintf(stderr, "%s commitThread: delete member\n", _myAddressStr.c_str());
+			try {
+				pqxx::work w(*c->c);
+
+				std::string memberId = config["id"];
+				std::string networkId = config["nwid"];
 
+				pqxx::result res = w.exec_params0(
+					"UPDATE ztc_member SET hidden = true, deleted = true WHERE id = $1 AND network_id = $2",
+					memberId, networkId);
+
+				w.commit();
+			} catch (std::exception &e) {
+				fprintf(stderr, "%s ERROR: Error deleting member: %s\n", _myAddressStr.c_str(), e.what());
+			}
+			if (_redisMemberStatus) {
+				try {
 					std::string memberId = config["id"];
 					std::string networkId = config["nwid"];
+					std::string controllerId = _myAddressStr.c_str();
+					std::string key = "network-nodes-all:{" + controllerId + "}:" + networkId;
+					if (_rc->clusterMode) {
+						_cluster->srem(key, memberId);
+						_cluster->del("member:{"+controllerId+"}:"+networkId+":"+memberId);
+					} else {
+						_redis->srem(key, memberId);
+						_redis->del("member:{"+controllerId+"}:"+networkId+":"+memberId);
+					}
+				} catch (sw::redis::Error &e) {
+					fprintf(stderr, "ERROR: Error deleting member from Redis: %s\n", e.what());
+				}
+			}
+		} else {
+			fprintf(stderr, "%s ERROR: unknown objtype\n", _myAddressStr.c_str());
+		}
+	} catch (std::exception &e) {
+		fprintf(stderr, "%s ERROR: Error getting objtype: %s\n", _myAddressStr.c_str(), e.what());
+	}
+}
 
-					pqxx::result res = w.exec_params0(
-						"UPDATE ztc_member SET hidden = true, deleted = true WHERE id = $1 AND network_id = $2",
-						memberId, networkId);
+void PostgreSQL::_commitMembers(std::shared_ptr<PostgresConnection> &c, std::vector< std::pair<nlohmann::json,bool> > &members)
+{
+	if (members.size() == 1) {
+		_commitOne(c, members[0]);
+		return;
+	}
 
-					w.commit();
-				} catch (std::exception &e) {
-					fprintf(stderr, "%s ERROR: Error deleting member: %s\n", _myAddressStr.c_str(), e.what());
+	// Only the last save of each member in the batch matters, and a multi-row
+	// insert can't name the same member twice.
+	std::vector< std::pair<nlohmann::json,bool> > latest;
+	{
+		std::unordered_map< std::string,size_t > index;
+		for (auto m = members.begin(); m != members.end(); ++m) {
+			const std::string key = OSUtils::jsonString(m->first["nwid"], "") + "-" + OSUtils::jsonString(m->first["id"], "");
+			auto i = index.find(key);
+			if (i == index.end()) {
+				index[key] = latest.size();
+				latest.push_back(*m);
+			} else {
+				latest[i->second].first = m->first;
+				latest[i->second].second |= m->second;
+			}
+		}
+	}
+
+	std::vector<size_t> committed;
+	std::vector<bool> isNewMember(latest.size(), false);
+	try {
+		pqxx::work w(*c->c);
+
+		pqxx::params networkIds, memberKeys;
+		std::string networkList, memberList;
+		for (auto m = latest.begin(); m != latest.end(); ++m) {
+			appendRow(networkList, networkIds.size(), "$");
+			networkIds.append(OSUtils::jsonString(m->first["nwid"], ""));
+			appendRow(memberList, memberKeys.size(), "($,$)");
+			memberKeys.append(OSUtils::jsonString(m->first["nwid"], ""));
+			memberKeys.append(OSUtils::jsonString(m->first["id"], ""));
+		}
+
+		std::set<std::string> networks;
+		pqxx::result res = w.exec_params("SELECT id FROM ztc_network WHERE id IN (" + networkList + ")", networkIds);
+		for (auto r = res.begin(); r != res.end(); ++r) {
+			networks.insert(r[0].as<std::string>());
+		}
+		std::set< std::pair<std::string,std::string> > existing;
+		res = w.exec_params("SELECT network_id, id FROM ztc_member WHERE (network_id, id) IN (" + memberList + ")", memberKeys);
+		for (auto r = res.begin(); r != res.end(); ++r) {
+			existing.insert(std::pair<std::string,std::string>(r[0].as<std::string>(), r[1].as<std::string>()));
+		}
+
+		// Rows of values for memberColumns below, and for ztc_member_ip_assignment
+		std::vector< std::vector<std::string> > inserts, updates, existingKeys, ipAssignments;
+		for (size_t i = 0; i < latest.size(); ++i) {
+			nlohmann::json &config = latest[i].first;
+			const std::string memberId = config["id"];
+			const std::string networkId = config["nwid"];
+
+			if (networks.find(networkId) == networks.end()) {
+				fprintf(stderr, "network %s does not exist.  skipping member upsert\n", networkId.c_str());
+				continue;
+			}
+
+			std::string target = "NULL";
+			if (!config["remoteTraceTarget"].is_null()) {
+				target = config["remoteTraceTarget"];
+			}
+
+			std::vector<std::string> row;
+			row.push_back(memberId);
+			row.push_back(networkId);
+			row.push_back(((bool)config["activeBridge"]) ? "true" : "false");
+			row.push_back(((bool)config["authorized"]) ? "true" : "false");
+			row.push_back(OSUtils::jsonDump(config["capabilities"], -1));
+			row.push_back(OSUtils::jsonString(config["identity"], ""));
+			row.push_back(std::to_string((uint64_t)config["lastAuthorizedTime"]));
+			row.push_back(std::to_string((uint64_t)config["lastDeauthorizedTime"]));
+			row.push_back(((bool)config["noAutoAssignIps"]) ? "true" : "false");
+			row.push_back(std::to_string((int)config["remoteTraceLevel"]));
+			row.push_back(target);
+			row.push_back(std::to_string((uint64_t)config["revision"]));
+			row.push_back(OSUtils::jsonDump(config["tags"], -1));
+			row.push_back(std::to_string((int)config["vMajor"]));
+			row.push_back(std::to_string((int)config["vMinor"]));
+			row.push_back(std::to_string((int)config["vRev"]));
+			row.push_back(std::to_string((int)config["vProto"]));
+
+			if (existing.find(std::pair<std::string,std::string>(networkId, memberId)) == existing.end()) {
+				isNewMember[i] = true;
+				inserts.push_back(row);
+			} else {
+				updates.push_back(row);
+				existingKeys.push_back(std::vector<std::string>{ networkId, memberId });
+			}
+
+			std::vector<std::string> assignments;
+			for (auto a = config["ipAssignments"].begin(); a != config["ipAssignments"].end(); ++a) {
+				std::string addr = *a;
+				if (std::find(assignments.begin(), assignments.end(), addr) != assignments.end()) {
+					continue;
 				}
-				if (_redisMemberStatus) {
-					try {
-						std::string memberId = config["id"];
-						std::string networkId = config["nwid"];
-						std::string controllerId = _myAddressStr.c_str();
-						std::string key = "network-nodes-all:{" + controllerId + "}:" + networkId;
-						if (_rc->clusterMode) {
-							_cluster->srem(key, memberId);
-							_cluster->del("member:{"+controllerId+"}:"+networkId+":"+memberId);
-						} else {
-							_redis->srem(key, memberId);
-							_redis->del("member:{"+controllerId+"}:"+networkId+":"+memberId);
+				ipAssignments.push_back(std::vector<std::string>{ memberId, networkId, addr });
+				assignments.push_back(addr);
+			}
+
+			committed.push_back(i);
+		}
+
+		static const std::string memberColumns(
+			"(id, network_id, active_bridge, authorized, capabilities, "
+			"identity, last_authorized_time, last_deauthorized_time, no_auto_assign_ips, "
+			"remote_trace_level, remote_trace_target, revision, tags, v_major, v_minor, v_rev, v_proto) ");
+		static const char *const memberRow =
+			"($, $, $, $, $, $, TO_TIMESTAMP($::double precision/1000), TO_TIMESTAMP($::double precision/1000), $, $, $, $, $, $, $, $, $)";
+		if (!inserts.empty()) {
+			execRows(w, "INSERT INTO ztc_member " + memberColumns + "VALUES ", memberRow, "", inserts);
+		}
+		if (!updates.empty()) {
+			// Updates go through a table shaped like ztc_member so each value is bound as its column's type
+			w.exec0("CREATE TEMPORARY TABLE ztc_member_batch (LIKE ztc_member INCLUDING DEFAULTS) ON COMMIT DROP");
+			execRows(w, "INSERT INTO ztc_member_batch " + memberColumns + "VALUES ", memberRow, "", updates);
+			w.exec0(
+				"UPDATE ztc_member AS m "
+				"SET active_bridge = b.active_bridge, authorized = b.authorized, capabilities = b.capabilities, identity = b.identity, "
+				"last_authorized_time = b.last_authorized_time, last_deauthorized_time = b.last_deauthorized_time, "
+				"no_auto_assign_ips = b.no_auto_assign_ips, remote_trace_level = b.remote_trace_level, remote_trace_target = b.remote_trace_target, "
+				"revision = b.revision, tags = b.tags, v_major = b.v_major, v_minor = b.v_minor, v_rev = b.v_rev, v_proto = b.v_proto "
+				"FROM ztc_member_batch AS b WHERE m.id = b.id AND m.network_id = b.network_id");
+		}
+		if (!existingKeys.empty()) {
+			execRows(w, "DELETE FROM ztc_member_ip_assignment WHERE (network_id, member_id) IN (", "($,$)", ")", existingKeys);
+		}
+		if (!ipAssignments.empty()) {
+			execRows(w, "INSERT INTO ztc_member_ip_assignment (member_id, network_id, address) VALUES ", "($, $, $)", " ON CONFLICT (network_id, member_id, address) DO NOTHING", ipAssignments);
+		}
+
+		w.commit();
+	} catch (std::exception &e) {
+		// One bad member shouldn't cost the rest their changes, so retry them one at a time
+		fprintf(stderr, "%s ERROR: Error updating %d members at once, retrying one by one: %s\n", _myAddressStr.c_str(), (int)latest.size(), e.what());
+		for (auto m = latest.begin(); m != latest.end(); ++m) {
+			_commitOne(c, *m);
+		}
+		return;
+	}
+
+	if (_smee != NULL) {
+		try {
+			std::map< std::string,std::vector<std::string> > newMembers;
+			for (auto i = committed.begin(); i != committed.end(); ++i) {
+				if (isNewMember[*i]) {
+					const std::string networkId = latest[*i].first["nwid"];
+					const std::string memberId = latest[*i].first["id"];
+					newMembers[networkId].push_back(memberId);
+				}
+			}
+			if (!newMembers.empty()) {
+				pqxx::work w(*c->c);
+				for (auto n = newMembers.begin(); n != newMembers.end(); ++n) {
+					pqxx::row row = w.exec_params1(
+						"SELECT "
+						"	count(h.hook_id) "
+						"FROM "
+						"	ztc_hook h "
+						"	INNER JOIN ztc_org o ON o.org_id = h.org_id "
+						"   INNER JOIN ztc_network n ON n.owner_id = o.owner_id "
+						" WHERE "
+						"n.id = $1 ",
+						n->first
+					);
+					if (row[0].as<int64_t>() > 0) {
+						for (auto m = n->second.begin(); m != n->second.end(); ++m) {
+							notifyNewMember(n->first, *m);
 						}
-					} catch (sw::redis::Error &e) {
-						fprintf(stderr, "ERROR: Error deleting member from Redis: %s\n", e.what());
 					}
 				}
-			} else {
-				fprintf(stderr, "%s ERROR: unknown objtype\n", _myAddressStr.c_str());
+				w.commit();
 			}
 		} catch (std::exception &e) {
-			fprintf(stderr, "%s ERROR: Error getting objtype: %s\n", _myAddressStr.c_str(), e.what());
+			fprintf(stderr, "%s ERROR: Error notifying hooks of new members: %s\n", _myAddressStr.c_str(), e.what());
 		}
-		_pool->unborrow(c);
-		c.reset();
 	}
 
-	fprintf(stderr, "%s commitThread finished\n", _myAddressStr.c_str());
+	for (auto i = committed.begin(); i != committed.end(); ++i) {
+		nlohmann::json &config = latest[*i].first;
+		const uint64_t nwidInt = OSUtils::jsonIntHex(config["nwid"], 0ULL);
+		const uint64_t memberidInt = OSUtils::jsonIntHex(config["id"], 0ULL);
+		if (nwidInt && memberidInt) {
+			nlohmann::json nwOrig;
+			nlohmann::json memOrig;
+
+			nlohmann::json memNew(config);
+
+			get(nwidInt, nwOrig, memberidInt, memOrig);
+
+			_memberChanged(memOrig, memNew, latest[*i].second);
+		} else {
+			fprintf(stderr, "%s: Can't notify of change.  Error parsing nwid or memberid: %llu-%llu\n", _myAddressStr.c_str(), (unsigned long long)nwidInt, (unsigned long long)memberidInt);
+		}
+	}
 }
 
 void PostgreSQL::notifyNewMember(const std::string &networkID, const std::string &memberID) {
@@ -1753,7 +2053,6 @@ void PostgreSQL::onlineNotification_Postgres()
 	nlohmann::json jtmp1, jtmp2;
 	while (_run == 1) {
 		auto c = _pool->borrow();
-		auto c2 = _pool->borrow();
 		try {
 			fprintf(stderr, "%s onlineNotification_Postgres\n", _myAddressStr.c_str());
 			std::unordered_map< std::pair<uint64_t,uint64_t>,std::pair<int64_t,InetAddress>,_PairHasher > lastOnline;
@@ -1764,18 +2063,49 @@ void PostgreSQL::onlineNotification_Postgres()
 
 #ifndef DISABLE_MEMBER_STATUS
 			pqxx::work w(*c->c);
-			pqxx::work w2(*c2->c);
 
 			fprintf(stderr, "online notification tick\n");
-			
-			bool firstRun = true;
-			bool memberAdded = false;
-			int updateCount = 0;
 
-			pqxx::pipeline pipe(w);
+			// Everything seen this interval goes out in a few multi-row statements
+			// rather than a lookup and an upsert per member.
+			int updateCount = 0;
+			std::vector< std::vector<std::string> > pending; // network ID, member ID, time, then address if known
+			auto flush = [&]() {
+				if (pending.empty())
+					return;
+				pqxx::params keys;
+				std::string keyList;
+				for (auto p = pending.begin(); p != pending.end(); ++p) {
+					appendRow(keyList, keys.size(), "($,$)");
+					keys.append((*p)[0]);
+					keys.append((*p)[1]);
+				}
+				std::set< std::pair<std::string,std::string> > existing;
+				pqxx::result res = w.exec_params("SELECT network_id, id FROM ztc_member WHERE (network_id, id) IN (" + keyList + ")", keys);
+				for (auto r = res.begin(); r != res.end(); ++r) {
+					existing.insert(std::pair<std::string,std::string>(r[0].as<std::string>(), r[1].as<std::string>()));
+				}
+				std::vector< std::vector<std::string> > withAddress, withoutAddress;
+				for (auto p = pending.begin(); p != pending.end(); ++p) {
+					if (existing.find(std::pair<std::string,std::string>((*p)[0], (*p)[1])) == existing.end()) {
+						continue; // skip members not in the database yet
+					}
+					((p->size() > 3) ? withAddress : withoutAddress).push_back(*p);
+					++updateCount;
+					Metrics::pgsql_node_checkin++;
+				}
+				static const std::string insert("INSERT INTO ztc_member_status (network_id, member_id, last_updated, address) VALUES ");
+				static const std::string upsert(" ON CONFLICT (network_id, member_id) DO UPDATE SET address = EXCLUDED.address, last_updated = EXCLUDED.last_updated");
+				if (!withAddress.empty()) {
+					execRows(w, insert, "($, $, TO_TIMESTAMP($::double precision/1000), $)", upsert, withAddress);
+				}
+				if (!withoutAddress.empty()) {
+					execRows(w, insert, "($, $, TO_TIMESTAMP($::double precision/1000), NULL)", upsert, withoutAddress);
+				}
+				pending.clear();
+			};
 
 			for (auto i=lastOnline.begin(); i != lastOnline.end(); ++i) {
-				updateCount += 1;
 				uint64_t nwid_i = i->first.first;
 				char nwidTmp[64];
 				char memTmp[64];
@@ -1787,46 +2117,27 @@ void PostgreSQL::onlineNotification_Postgres()
 					continue; // skip non existent networks/members
 				}
 
-				std::string networkId(nwidTmp);
-				std::string memberId(memTmp);
-
-				try {
-					pqxx::row r = w2.exec_params1("SELECT id, network_id FROM ztc_member WHERE network_id = $1 AND id = $2",
-						networkId, memberId);		
-				} catch (pqxx::unexpected_rows &e) {
-					continue;
-				}
-
-				int64_t ts = i->second.first;
+				std::vector<std::string> row;
+				row.push_back(std::string(nwidTmp));
+				row.push_back(std::string(memTmp));
+				row.push_back(std::to_string(i->second.first));
 				std::string ipAddr = i->second.second.toIpString(ipTmp);
-				std::string timestamp = std::to_string(ts);
-
-				std::stringstream memberUpdate;
-				memberUpdate << "INSERT INTO ztc_member_status (network_id, member_id, address, last_updated) VALUES "
-					<< "('" << networkId << "', '" << memberId << "', ";
-				if (ipAddr.empty()) {
-					memberUpdate << "NULL, ";
-				} else {
-					memberUpdate << "'" << ipAddr << "', ";
+				if (!ipAddr.empty()) {
+					row.push_back(ipAddr);
+				}
+				pending.push_back(row);
+				if (pending.size() >= ZT_POSTGRESQL_ONLINE_BATCH_MAX) {
+					flush();
 				}
-				memberUpdate << "TO_TIMESTAMP(" << timestamp << "::double precision/1000)) "
-					<< " ON CONFLICT (network_id, member_id) DO UPDATE SET address = EXCLUDED.address, last_updated = EXCLUDED.last_updated";
-
-				pipe.insert(memberUpdate.str());
-				Metrics::pgsql_node_checkin++;
-			}
-			while(!pipe.empty()) {
-				pipe.retrieve();
 			}
+			flush();
 
-			pipe.complete();
 			w.commit();
 			fprintf(stderr, "%s: Updated online status of %d members\n", _myAddressStr.c_str(), updateCount);
 #endif
 		} catch (std::exception &e) {
 			fprintf(stderr, "%s: error in onlinenotification thread: %s\n", _myAddressStr.c_str(), e.what());
 		} 
-		_pool->unborrow(c2);
 		_pool->unborrow(c);
 
 		ConnectionPoolStats stats = _pool->get_stats();
@@ -110,7 +110,7 @@ public:
 
 	virtual bool waitForReady();
 	virtual bool isReady();
-	virtual bool save(nlohmann::json &record,bool notifyListeners);
+	virtual bool save(nlohmann::json &record,bool notifyListeners,bool keepRevision = false);
 	virtual void eraseNetwork(const uint64_t networkId);
 	virtual void eraseMember(const uint64_t networkId, const uint64_t memberId);
 	virtual void nodeIsOnline(const uint64_t networkId, const uint64_t memberId, const InetAddress &physicalAddress);
@@ -142,6 +142,8 @@ private:
 	void _networksWatcher_Redis();
 
 	void commitThread();
+	void _commitOne(std::shared_ptr<PostgresConnection> &c, std::pair<nlohmann::json,bool> &qitem);
+	void _commitMembers(std::shared_ptr<PostgresConnection> &c, std::vector< std::pair<nlohmann::json,bool> > &members);
 	void onlineNotificationThread();
 	void onlineNotification_Postgres();
 	void onlineNotification_Redis();
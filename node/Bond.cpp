@@ -429,18 +429,19 @@ SharedPtr<Path> Bond::getAppropriatePath(int64_t now, int32_t flowId)
 			int m_idx = _realIdxMap[_freeRandomByte % _numBondedPaths];
 			return _paths[m_idx].p;
 		}
-		Mutex::Lock _l(_flows_m);
-		std::map<int16_t, SharedPtr<Flow> >::iterator it = _flows.find(flowId);
-		if (likely(it != _flows.end())) {
-			it->second->lastActivity = now;
-			return _paths[it->second->assignedPath].p;
+		int pathIdx = _flows.get(flowId, now);
+		if (unlikely(pathIdx == ZT_MAX_PEER_NETWORK_PATHS)) {
+			pathIdx = createFlow(ZT_MAX_PEER_NETWORK_PATHS, flowId, now);
 		}
-		else {
-			unsigned char entropy;
-			Utils::getSecureRandom(&entropy, 1);
-			SharedPtr<Flow> flow = createFlow(ZT_MAX_PEER_NETWORK_PATHS, flowId, entropy, now);
-			_flows[flowId] = flow;
-			return _paths[flow->assignedPath].p;
+		if (likely(pathIdx != ZT_MAX_PEER_NETWORK_PATHS)) {
+			/**
+			 * processBalanceTasks() moves flows off of a link that went down, but may not
+			 * get to this one for a few passes. Until then steer it by hash as if untracked.
+			 */
+			if (unlikely(! _paths[pathIdx].p || ! _paths[pathIdx].eligible)) {
+				pathIdx = _realIdxMap[FlowTable::hash(flowId) % _numBondedPaths];
+			}
+			return _paths[pathIdx].p;
 		}
 	}
 	return SharedPtr<Path>();
@@ -475,15 +476,7 @@ void Bond::recordOutgoingPacket(const SharedPtr<Path>& path, uint64_t packetId,
 			//_paths[pathIdx].expectingAckAsOf = now;
 			//_paths[pathIdx].totalBytesSentSinceLastAckReceived += payloadLength;
 			//_paths[pathIdx].unackedBytes += payloadLength;
-			if (_paths[pathIdx].qosStatsOut.size() < ZT_QOS_MAX_PENDING_RECORDS) {
-				_paths[pathIdx].qosStatsOut[packetId] = now;
-			}
-		}
-	}
-	if (flowId != ZT_QOS_NO_FLOW) {
-		Mutex::Lock _l(_flows_m);
-		if (_flows.count(flowId)) {
-			_flows[flowId]->bytesOut += payloadLength;
+			_paths[pathIdx].qosStatsOut.set(packetId, now);
 		}
 	}
 }
@@ -508,25 +501,14 @@ void Bond::recordIncomingPacket(const SharedPtr<Path>& path, uint64_t packetId,
 				_lastFrame = now;
 			}
 			if (shouldRecord) {
-				if (_paths[pathIdx].qosStatsIn.size() < ZT_QOS_MAX_PENDING_RECORDS) {
+				if (_paths[pathIdx].qosStatsIn.push(packetId, now)) {
 					// debug("Recording QoS information (table size = %d)", _paths[pathIdx].qosStatsIn.size());
-					_paths[pathIdx].qosStatsIn[packetId] = now;
 					++(_paths[pathIdx].packetsReceivedSinceLastQoS);
 					//_paths[pathIdx].packetValiditySamples.push(true);
 				}
 				else {
 					// debug("QoS buffer full, will not record information");
 				}
-				/*
-				if (_paths[pathIdx].ackStatsIn.size() < ZT_ACK_MAX_PENDING_RECORDS) {
-					//debug("Recording ACK information (table size = %d)", _paths[pathIdx].ackStatsIn.size());
-					_paths[pathIdx].ackStatsIn[packetId] = payloadLength;
-					++(_paths[pathIdx].packetsReceivedSinceLastAck);
-				}
-				else {
-					debug("ACK buffer full, will not record information");
-				}
-				*/
 			}
 		}
 	}
@@ -537,16 +519,8 @@ void Bond::recordIncomingPacket(const SharedPtr<Path>& path, uint64_t packetId,
 	 * which path to use.
 	 */
 	if ((flowId != ZT_QOS_NO_FLOW) && (_policy == ZT_BOND_POLICY_BALANCE_RR || _policy == ZT_BOND_POLICY_BALANCE_XOR || _policy == ZT_BOND_POLICY_BALANCE_AWARE)) {
-		Mutex::Lock _l(_flows_m);
-		SharedPtr<Flow> flow;
-		if (! _flows.count(flowId)) {
-			flow = createFlow(pathIdx, flowId, 0, now);
-		}
-		else {
-			flow = _flows[flowId];
-		}
-		if (flow) {
-			flow->bytesIn += payloadLength;
+		if (_flows.get(flowId, now) == ZT_MAX_PEER_NETWORK_PATHS) {
+			createFlow(pathIdx, flowId, now);
 		}
 	}
 }
@@ -561,15 +535,13 @@ void Bond::receivedQoS(const SharedPtr<Path>& path, int64_t now, int count, uint
 	_paths[pathIdx].lastQoSReceived = now;
 	// debug("received QoS packet (sampling %d frames) via %s", count, pathToStr(path).c_str());
 	//  Look up egress times and compute latency values for each record
-	std::map<uint64_t, uint64_t>::iterator it;
+	int64_t egress = 0;
 	for (int j = 0; j < count; j++) {
-		it = _paths[pathIdx].qosStatsOut.find(rx_id[j]);
-		if (it != _paths[pathIdx].qosStatsOut.end()) {
-			_paths[pathIdx].latencySamples.push(((uint16_t)(now - it->second) - rx_ts[j]) / 2);
+		if (_paths[pathIdx].qosStatsOut.take(rx_id[j], egress)) {
+			_paths[pathIdx].latencyEstimator.update((uint16_t)(((uint16_t)(now - egress) - rx_ts[j]) / 2));
 			// if (_paths[pathIdx].shouldAvoid) {
 			//	debug("RX sample on avoided path %d", pathIdx);
 			// }
-			_paths[pathIdx].qosStatsOut.erase(it);
 		}
 	}
 	_paths[pathIdx].qosRecordSize.push(count);
@@ -588,35 +560,34 @@ void Bond::receivedAck(int pathIdx, int64_t now, int32_t ackedBytes)
 int32_t Bond::generateQoSPacket(int pathIdx, int64_t now, char* qosBuffer)
 {
 	int32_t len = 0;
-	std::map<uint64_t, uint64_t>::iterator it = _paths[pathIdx].qosStatsIn.begin();
+	uint64_t id = 0;
+	int64_t ts = 0;
 	int i = 0;
 	int numRecords = std::min(_paths[pathIdx].packetsReceivedSinceLastQoS, ZT_QOS_TABLE_SIZE);
-	// debug("numRecords=%3d, packetsReceivedSinceLastQoS=%3d, _paths[pathIdx].qosStatsIn.size()=%3zu", numRecords, _paths[pathIdx].packetsReceivedSinceLastQoS, _paths[pathIdx].qosStatsIn.size());
-	while (i < numRecords && it != _paths[pathIdx].qosStatsIn.end()) {
-		uint64_t id = it->first;
+	// debug("numRecords=%3d, packetsReceivedSinceLastQoS=%3d, _paths[pathIdx].qosStatsIn.size()=%3u", numRecords, _paths[pathIdx].packetsReceivedSinceLastQoS, _paths[pathIdx].qosStatsIn.size());
+	while (i < numRecords && _paths[pathIdx].qosStatsIn.pop(id, ts)) {
 		memcpy(qosBuffer, &id, sizeof(uint64_t));
 		qosBuffer += sizeof(uint64_t);
-		uint16_t holdingTime = (uint16_t)(now - it->second);
+		uint16_t holdingTime = (uint16_t)(now - ts);
 		memcpy(qosBuffer, &holdingTime, sizeof(uint16_t));
 		qosBuffer += sizeof(uint16_t);
 		len += sizeof(uint64_t) + sizeof(uint16_t);
-		_paths[pathIdx].qosStatsIn.erase(it++);
 		++i;
 	}
 	return len;
 }
 
-bool Bond::assignFlowToBondedPath(SharedPtr<Flow>& flow, int64_t now, bool reassign = false)
+int Bond::assignFlowToBondedPath(int32_t flowId, int currentPathIdx, bool reassign = false)
 {
 	if (! _numBondedPaths) {
-		debug("unable to assign flow %x (bond has no links)", flow->id);
-		return false;
+		debug("unable to assign flow %x (bond has no links)", flowId);
+		return ZT_MAX_PEER_NETWORK_PATHS;
 	}
+	int pathIdx = ZT_MAX_PEER_NETWORK_PATHS;
 	unsigned int bondedIdx = ZT_MAX_PEER_NETWORK_PATHS;
 	if (_policy == ZT_BOND_POLICY_BALANCE_XOR) {
-		bondedIdx = abs((int)(flow->id % _numBondedPaths));
-		flow->assignPath(_realIdxMap[bondedIdx], now);
-		++(_paths[_realIdxMap[bondedIdx]].assignedFlowCount);
+		bondedIdx = abs((int)(flowId % _numBondedPaths));
+		pathIdx = _realIdxMap[bondedIdx];
 	}
 	if (_policy == ZT_BOND_POLICY_BALANCE_AWARE) {
 		/** balance-aware generally works like balance-xor except that it will try to
@@ -627,7 +598,7 @@ bool Bond::assignFlowToBondedPath(SharedPtr<Flow>& flow, int64_t now, bool reass
 		int nextBestQualIdx = ZT_MAX_PEER_NETWORK_PATHS;
 
 		if (reassign) {
-			log("attempting to re-assign out-flow %04x previously on idx %d (%u / %zu flows)", flow->id, flow->assignedPath, _paths[_realIdxMap[flow->assignedPath]].assignedFlowCount, _flows.size());
+			log("attempting to re-assign out-flow %04x previously on idx %d (%u / %lu flows)", flowId, currentPathIdx, _paths[_realIdxMap[currentPathIdx]].assignedFlowCount, _flows.size());
 		}
 		else {
 			debug("attempting to assign flow for the first time");
@@ -642,7 +613,7 @@ bool Bond::assignFlowToBondedPath(SharedPtr<Flow>& flow, int64_t now, bool reass
 			Utils::getSecureRandom(&entropy, 1);
 
 			if (reassign) {
-				bondedIdx = (flow->assignedPath + offset) % (_numBondedPaths);
+				bondedIdx = (currentPathIdx + offset) % (_numBondedPaths);
 			}
 			else {
 				bondedIdx = abs((int)((entropy + offset) % (_numBondedPaths)));
@@ -652,7 +623,7 @@ bool Bond::assignFlowToBondedPath(SharedPtr<Flow>& flow, int64_t now, bool reass
 				continue;
 			}
 			if (! _paths[_realIdxMap[bondedIdx]].shouldAvoid && randomLinkCapacity <= _paths[_realIdxMap[bondedIdx]].relativeLinkCapacity) {
-				// debug("  assign out-flow %04x to link %s (%u / %zu flows)", flow->id, pathToStr(_paths[_realIdxMap[bondedIdx]].p).c_str(), _paths[_realIdxMap[bondedIdx]].assignedFlowCount, _flows.size());
+				// debug("  assign out-flow %04x to link %s (%u / %lu flows)", flowId, pathToStr(_paths[_realIdxMap[bondedIdx]].p).c_str(), _paths[_realIdxMap[bondedIdx]].assignedFlowCount, _flows.size());
 				break;	 // Acceptable -- No violation of quality spec
 			}
 			if (_paths[_realIdxMap[bondedIdx]].relativeQuality > bestQuality) {
@@ -664,91 +635,66 @@ bool Bond::assignFlowToBondedPath(SharedPtr<Flow>& flow, int64_t now, bool reass
 		}
 		if (offset < _numBondedPaths) {
 			// We were (able) to find a path that didn't violate any of the user's quality requirements
-			flow->assignPath(_realIdxMap[bondedIdx], now);
-			++(_paths[_realIdxMap[bondedIdx]].assignedFlowCount);
+			pathIdx = _realIdxMap[bondedIdx];
 			// debug("       ABLE to find optimal link %f idx %d", _paths[_realIdxMap[bondedIdx]].relativeQuality, bondedIdx);
 		}
 		else {
 			// We were (unable) to find a path that didn't violate at least one quality requirement, will choose next best option
-			flow->assignPath(_realIdxMap[nextBestQualIdx], now);
-			++(_paths[_realIdxMap[nextBestQualIdx]].assignedFlowCount);
+			pathIdx = _realIdxMap[nextBestQualIdx];
 			// debug("       UNABLE to find, will use link %f idx %d", _paths[_realIdxMap[nextBestQualIdx]].relativeQuality, nextBestQualIdx);
 		}
 	}
 	if (_policy == ZT_BOND_POLICY_ACTIVE_BACKUP) {
 		if (_abPathIdx == ZT_MAX_PEER_NETWORK_PATHS) {
-			log("unable to assign out-flow %x (no active backup link)", flow->id);
+			log("unable to assign out-flow %x (no active backup link)", flowId);
 		}
-		flow->assignPath(_abPathIdx, now);
+		pathIdx = _abPathIdx;
+	}
+	if (pathIdx != ZT_MAX_PEER_NETWORK_PATHS) {
+		log("assign out-flow %04x to link %s (%u / %lu flows)", flowId, pathToStr(_paths[pathIdx].p).c_str(), _paths[pathIdx].assignedFlowCount, _flows.size());
 	}
-	log("assign out-flow %04x to link %s (%u / %zu flows)", flow->id, pathToStr(_paths[flow->assignedPath].p).c_str(), _paths[flow->assignedPath].assignedFlowCount, _flows.size());
-	return true;
+	return pathIdx;
 }
 
-SharedPtr<Bond::Flow> Bond::createFlow(int pathIdx, int32_t flowId, unsigned char entropy, int64_t now)
+int Bond::createFlow(int pathIdx, int32_t flowId, int64_t now)
 {
 	if (! _numBondedPaths) {
 		debug("unable to assign flow %04x (bond has no links)", flowId);
-		return SharedPtr<Flow>();
+		return ZT_MAX_PEER_NETWORK_PATHS;
 	}
-	if (_flows.size() >= ZT_FLOW_MAX_COUNT) {
-		debug("forget oldest flow (max flows reached: %d)", ZT_FLOW_MAX_COUNT);
-		forgetFlowsWhenNecessary(0, true, now);
+	FlowTable::Slot* const slot = _flows.add(flowId, now);
+	if (slot) {
+		const int assignedPathIdx = slot->path.load(std::memory_order_acquire);
+		if (assignedPathIdx != ZT_MAX_PEER_NETWORK_PATHS) {
+			return assignedPathIdx;	  // Another thread added it first
+		}
 	}
-	SharedPtr<Flow> flow = new Flow(flowId, now);
-	_flows[flowId] = flow;
 	/**
 	 * Add a flow with a given Path already provided. This is the case when a packet
 	 * is received on a path but no flow exists, in this case we simply assign the path
 	 * that the remote peer chose for us.
 	 */
 	if (pathIdx != ZT_MAX_PEER_NETWORK_PATHS) {
-		flow->assignPath(pathIdx, now);
-		_paths[pathIdx].assignedFlowCount++;
-		debug("assign in-flow %04x to link %s (%u / %zu)", flow->id, pathToStr(_paths[pathIdx].p).c_str(), _paths[pathIdx].assignedFlowCount, _flows.size());
+		debug("assign in-flow %04x to link %s (%u / %lu)", flowId, pathToStr(_paths[pathIdx].p).c_str(), _paths[pathIdx].assignedFlowCount, _flows.size());
 	}
 	/**
 	 * Add a flow when no path was provided. This means that it is an outgoing packet
 	 * and that it is up to the local peer to decide how to load-balance its transmission.
 	 */
-	else {
-		assignFlowToBondedPath(flow, now);
+	else if (slot) {
+		pathIdx = assignFlowToBondedPath(flowId, ZT_MAX_PEER_NETWORK_PATHS);
 	}
-	return flow;
-}
-
-void Bond::forgetFlowsWhenNecessary(uint64_t age, bool oldest, int64_t now)
-{
-	std::map<int16_t, SharedPtr<Flow> >::iterator it = _flows.begin();
-	std::map<int16_t, SharedPtr<Flow> >::iterator oldestFlow = _flows.end();
-	SharedPtr<Flow> expiredFlow;
-	if (age) {	 // Remove by specific age
-		while (it != _flows.end()) {
-			if (it->second->age(now) > age) {
-				debug("forget flow %04x (age %" PRId64 ") (%u / %zu)", it->first, it->second->age(now), _paths[it->second->assignedPath].assignedFlowCount, (_flows.size() - 1));
-				_paths[it->second->assignedPath].assignedFlowCount--;
-				it = _flows.erase(it);
-			}
-			else {
-				++it;
-			}
-		}
+	/**
+	 * The flow's bucket in the flow table is full so it can't be remembered. Steer it by
+	 * hash instead so that it still sticks to one link as long as the bond doesn't change.
+	 */
+	else {
+		pathIdx = _realIdxMap[FlowTable::hash(flowId) % _numBondedPaths];
 	}
-	else if (oldest) {	 // Remove single oldest by natural expiration
-		uint64_t maxAge = 0;
-		while (it != _flows.end()) {
-			if (it->second->age(now) > maxAge) {
-				maxAge = (now - it->second->age(now));
-				oldestFlow = it;
-			}
-			++it;
-		}
-		if (oldestFlow != _flows.end()) {
-			debug("forget oldest flow %04x (age %" PRId64 ") (total flows: %zu)", oldestFlow->first, oldestFlow->second->age(now), _flows.size() - 1);
-			_paths[oldestFlow->second->assignedPath].assignedFlowCount--;
-			_flows.erase(oldestFlow);
-		}
+	if (slot) {
+		slot->path.store(pathIdx, std::memory_order_release);
 	}
+	return pathIdx;
 }
 
 void Bond::processIncomingPathNegotiationRequest(uint64_t now, SharedPtr<Path>& path, int16_t remoteUtility)
@@ -865,12 +811,7 @@ void Bond::sendACK(void* tPtr, int pathIdx, int64_t localSocket, const InetAddre
 	/*
 	Packet outp(_peer->_id.address(), RR->identity.address(), Packet::VERB_ACK);
 	int32_t bytesToAck = 0;
-	std::map<uint64_t, uint64_t>::iterator it = _paths[pathIdx].ackStatsIn.begin();
-	while (it != _paths[pathIdx].ackStatsIn.end()) {
-		bytesToAck += it->second;
-		++it;
-	}
-	debug("sending ACK of %d bytes on path %s (table size = %zu)", bytesToAck, pathToStr(_paths[pathIdx].p).c_str(), _paths[pathIdx].ackStatsIn.size());
+	debug("sending ACK of %d bytes on path %s", bytesToAck, pathToStr(_paths[pathIdx].p).c_str());
 	outp.append<uint32_t>(bytesToAck);
 	if (atAddress) {
 		outp.armor(_peer->key(), false, _peer->aesKeysIfSupported());
@@ -879,7 +820,6 @@ void Bond::sendACK(void* tPtr, int pathIdx, int64_t localSocket, const InetAddre
 	else {
 		RR->sw->send(tPtr, outp, false);
 	}
-	_paths[pathIdx].ackStatsIn.clear();
 	_paths[pathIdx].packetsReceivedSinceLastAck = 0;
 	_paths[pathIdx].lastAckSent = now;
 	*/
@@ -1247,17 +1187,7 @@ void Bond::estimatePathQuality(int64_t now)
 		}
 		// Drain unacknowledged QoS records
 		int qosRecordTimeout = (_qosSendInterval * 3);
-		std::map<uint64_t, uint64_t>::iterator it = _paths[i].qosStatsOut.begin();
-		int numDroppedQosOutRecords = 0;
-		while (it != _paths[i].qosStatsOut.end()) {
-			if ((now - it->second) >= qosRecordTimeout) {
-				it = _paths[i].qosStatsOut.erase(it);
-				++numDroppedQosOutRecords;
-			}
-			else {
-				++it;
-			}
-		}
+		unsigned int numDroppedQosOutRecords = _paths[i].qosStatsOut.expire(now, qosRecordTimeout);
 		if (numDroppedQosOutRecords) {
 			// debug("dropped %d QOS out-records", numDroppedQosOutRecords);
 		}
@@ -1276,17 +1206,7 @@ void Bond::estimatePathQuality(int64_t now)
 		}
 		*/
 
-		it = _paths[i].qosStatsIn.begin();
-		int numDroppedQosInRecords = 0;
-		while (it != _paths[i].qosStatsIn.end()) {
-			if ((now - it->second) >= qosRecordTimeout) {
-				it = _paths[i].qosStatsIn.erase(it);
-				++numDroppedQosInRecords;
-			}
-			else {
-				++it;
-			}
-		}
+		unsigned int numDroppedQosInRecords = _paths[i].qosStatsIn.expire(now, qosRecordTimeout);
 		if (numDroppedQosInRecords) {
 			// debug("dropped %d QOS in-records", numDroppedQosInRecords);
 		}
@@ -1359,12 +1279,10 @@ void Bond::estimatePathQuality(int64_t now)
 		if (! _paths[i].p || ! _paths[i].allowed()) {
 			continue;
 		}
-		// Compute/Smooth average of real-world observations
-		if (_paths[i].latencySamples.count() >= ZT_QOS_SHORTTERM_SAMPLE_WIN_MIN_REQ_SIZE) {
-			_paths[i].latency = _paths[i].latencySamples.mean();
-		}
-		if (_paths[i].latencySamples.count() >= ZT_QOS_SHORTTERM_SAMPLE_WIN_MIN_REQ_SIZE) {
-			_paths[i].latencyVariance = _paths[i].latencySamples.stddev();
+		// Smoothed averages of real-world observations are kept up to date as QoS reports arrive
+		if (_paths[i].latencyEstimator.count() >= ZT_QOS_SHORTTERM_SAMPLE_WIN_MIN_REQ_SIZE) {
+			_paths[i].latency = _paths[i].latencyEstimator.mean();
+			_paths[i].latencyVariance = _paths[i].latencyEstimator.stddev();
 		}
 
 		// Write values to external path object so that it can be propagated to the user
@@ -1420,54 +1338,58 @@ void Bond::processBalanceTasks(int64_t now)
 		return;
 	}
 	/**
-	 * Clean up and reset flows if necessary
-	 */
-	if ((now - _lastFlowExpirationCheck) > ZT_PEER_PATH_EXPIRATION) {
-		Mutex::Lock _l(_flows_m);
-		forgetFlowsWhenNecessary(ZT_PEER_PATH_EXPIRATION, false, now);
-		std::map<int16_t, SharedPtr<Flow> >::iterator it = _flows.begin();
-		while (it != _flows.end()) {
-			it->second->resetByteCounts();
-			++it;
-		}
-		_lastFlowExpirationCheck = now;
-	}
-	/**
-	 * Move (all) flows from dead paths
+	 * Expire flows and move them off of dead (and for balance-aware, avoided) links. Each call
+	 * sweeps the next slice of the flow table, or all of it while it is small, so the work per
+	 * call stays small, and packet threads never wait on it since they only touch the table with
+	 * atomics. Per-link flow counts are published whenever a full sweep completes. The flow table
+	 * has a fixed maximum size, so there is no need to evict flows beyond the expiry here.
 	 */
-	if (_policy == ZT_BOND_POLICY_BALANCE_XOR || _policy == ZT_BOND_POLICY_BALANCE_AWARE) {
-		Mutex::Lock _l(_flows_m);
-		std::map<int16_t, SharedPtr<Flow> >::iterator flow_it = _flows.begin();
-		while (flow_it != _flows.end()) {
-			if (_paths[flow_it->second->assignedPath].p) {
-				int originalPathIdx = flow_it->second->assignedPath;
-				if (! _paths[originalPathIdx].eligible) {
-					log("moving all flows from dead link %s", pathToStr(_paths[originalPathIdx].p).c_str());
-					if (assignFlowToBondedPath(flow_it->second, now, true)) {
-						_paths[originalPathIdx].assignedFlowCount--;
+	Mutex::Lock _l(_flows_m);
+	bool movedAvoidedFlow = false;
+	for (unsigned int n = 0; n < ZT_BOND_FLOW_SWEEP_BUCKETS; ++n) {
+		FlowTable::Slot* const bucket = _flows.bucket(_flowSweepBucket);
+		for (unsigned int i = 0; bucket && i < ZT_FLOW_TABLE_BUCKET_SLOTS; ++i) {
+			FlowTable::Slot& slot = bucket[i];
+			const uint32_t flowId = slot.key.load(std::memory_order_acquire);
+			if (flowId == FlowTable::EMPTY) {
+				continue;
+			}
+			const int64_t lastActivity = slot.lastActivity.load(std::memory_order_relaxed);
+			if (lastActivity && ((now - lastActivity) > ZT_PEER_PATH_EXPIRATION)) {
+				debug("forget flow %04x (age %" PRId64 ") (%lu flows)", flowId, (now - lastActivity), (_flows.size() - 1));
+				_flows.remove(slot);
+				continue;
+			}
+			int pathIdx = slot.path.load(std::memory_order_acquire);
+			if (pathIdx == ZT_MAX_PEER_NETWORK_PATHS) {
+				continue;
+			}
+			if (_policy == ZT_BOND_POLICY_BALANCE_XOR || _policy == ZT_BOND_POLICY_BALANCE_AWARE) {
+				bool move = false;
+				if (! _paths[pathIdx].p || ! _paths[pathIdx].eligible) {
+					log("moving flow %04x from dead link %s", flowId, pathToStr(_paths[pathIdx].p).c_str());
+					move = true;
+				}
+				else if (_policy == ZT_BOND_POLICY_BALANCE_AWARE && _paths[pathIdx].shouldAvoid && ! movedAvoidedFlow) {
+					move = movedAvoidedFlow = true;	  // Only move one flow off of an avoided link at a time
+				}
+				if (move) {
+					const int newPathIdx = assignFlowToBondedPath((int32_t)flowId, pathIdx, true);
+					if (newPathIdx != ZT_MAX_PEER_NETWORK_PATHS) {
+						slot.path.store(newPathIdx, std::memory_order_release);
+						pathIdx = newPathIdx;
 					}
 				}
 			}
-			++flow_it;
+			++_flowSweepCounts[pathIdx];
 		}
-	}
-	/**
-	 * Move (some) flows from low quality paths
-	 */
-	if (_policy == ZT_BOND_POLICY_BALANCE_AWARE) {
-		Mutex::Lock _l(_flows_m);
-		std::map<int16_t, SharedPtr<Flow> >::iterator flow_it = _flows.begin();
-		while (flow_it != _flows.end()) {
-			if (_paths[flow_it->second->assignedPath].p) {
-				int originalPathIdx = flow_it->second->assignedPath;
-				if (_paths[originalPathIdx].shouldAvoid) {
-					if (assignFlowToBondedPath(flow_it->second, now, true)) {
-						_paths[originalPathIdx].assignedFlowCount--;
-						return;	  // Only move one flow at a time
-					}
-				}
+		if (! bucket || ++_flowSweepBucket >= ZT_FLOW_TABLE_BUCKETS) {
+			_flowSweepBucket = 0;	// End of the table, or of the part of it allocated so far
+			for (unsigned int i = 0; i < ZT_MAX_PEER_NETWORK_PATHS; ++i) {
+				_paths[i].assignedFlowCount = _flowSweepCounts[i];
+				_flowSweepCounts[i] = 0;
 			}
-			++flow_it;
+			break;
 		}
 	}
 }
@@ -1849,7 +1771,8 @@ void Bond::processActiveBackupTasks(void* tPtr, int64_t now)
 
 void Bond::initTimers()
 {
-	_lastFlowExpirationCheck = 0;
+	_flowSweepBucket = 0;
+	memset(_flowSweepCounts, 0, sizeof(_flowSweepCounts));
 	_lastFlowRebalance = 0;
 	_lastSentPathNegotiationRequest = 0;
 	_lastPathNegotiationCheck = 0;
@@ -2038,7 +1961,7 @@ void Bond::dumpInfo(int64_t now, bool force)
 		_monitorInterval,
 		_upDelay,
 		_downDelay,
-		_flows.size(),
+		(size_t)_flows.size(),
 		_isLeaf,
 		overhead,
 		_numAliveLinks,
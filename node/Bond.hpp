@@ -16,8 +16,10 @@
 
 #include "../osdep/Binder.hpp"
 #include "../osdep/Phy.hpp"
+#include "FlowTable.hpp"
 #include "Packet.hpp"
 #include "Path.hpp"
+#include "QoSRecords.hpp"
 #include "RuntimeEnvironment.hpp"
 #include "Trace.hpp"
 
@@ -565,7 +567,6 @@ class Bond {
 	static std::map<std::string, std::map<std::string, SharedPtr<Link> > > _interfaceToLinkMap;
 
 	struct NominatedPath;
-	struct Flow;
 
 	friend class SharedPtr<Bond>;
 	friend class Peer;
@@ -733,33 +734,26 @@ class Bond {
 	SharedPtr<Path> getAppropriatePath(int64_t now, int32_t flowId);
 
 	/**
-	 * Creates a new flow record
+	 * Creates a new flow record (or finds one another thread just created)
 	 *
-	 * @param np Path over which flow shall be handled
-	 * @param flowId Flow ID
-	 * @param entropy A byte of entropy to be used by the bonding algorithm
-	 * @param now Current time
-	 * @return Pointer to newly-created Flow
-	 */
-	SharedPtr<Flow> createFlow(int pathIdx, int32_t flowId, unsigned char entropy, int64_t now);
-
-	/**
-	 * Removes flow records that are past a certain age limit.
+	 * Safe to call from packet threads without holding any lock.
 	 *
-	 * @param age Age threshold to be forgotten
-	 * @param oldest Whether only the oldest shall be forgotten
+	 * @param pathIdx Path over which flow shall be handled or ZT_MAX_PEER_NETWORK_PATHS to choose one
+	 * @param flowId Flow ID
 	 * @param now Current time
+	 * @return Index of path assigned to flow or ZT_MAX_PEER_NETWORK_PATHS if none
 	 */
-	void forgetFlowsWhenNecessary(uint64_t age, bool oldest, int64_t now);
+	int createFlow(int pathIdx, int32_t flowId, int64_t now);
 
 	/**
-	 * Assigns a new flow to a bonded path
+	 * Chooses a bonded path for a flow
 	 *
-	 * @param flow Flow to be assigned
-	 * @param now Current time
+	 * @param flowId Flow to be assigned
+	 * @param currentPathIdx Path flow is currently assigned to (if reassigning)
 	 * @param reassign Whether this flow is being re-assigned to another path
+	 * @return Index of chosen path or ZT_MAX_PEER_NETWORK_PATHS if none
 	 */
-	bool assignFlowToBondedPath(SharedPtr<Flow>& flow, int64_t now, bool reassign);
+	int assignFlowToBondedPath(int32_t flowId, int currentPathIdx, bool reassign);
 
 	/**
 	 * Determine whether a path change should occur given the remote peer's reported utility and our
@@ -1321,16 +1315,15 @@ class Bond {
 			packetsOut = 0;
 		}
 
-		std::map<uint64_t, uint64_t> qosStatsOut;	// id:egress_time
-		std::map<uint64_t, uint64_t> qosStatsIn;	// id:now
-		std::map<uint64_t, uint64_t> ackStatsIn;	// id:now
+		QoSPendingTable qosStatsOut;	// id:egress_time
+		QoSRecordQueue qosStatsIn;		// id:now
 
 		RingBuffer<int, ZT_QOS_SHORTTERM_SAMPLE_WIN_SIZE> qosRecordSize;
 		RingBuffer<float, ZT_QOS_SHORTTERM_SAMPLE_WIN_SIZE> qosRecordLossSamples;
 		RingBuffer<uint64_t, ZT_QOS_SHORTTERM_SAMPLE_WIN_SIZE> throughputSamples;
 		RingBuffer<bool, ZT_QOS_SHORTTERM_SAMPLE_WIN_SIZE> packetValiditySamples;
 		RingBuffer<float, ZT_QOS_SHORTTERM_SAMPLE_WIN_SIZE> throughputVarianceSamples;
-		RingBuffer<uint16_t, ZT_QOS_SHORTTERM_SAMPLE_WIN_SIZE> latencySamples;
+		QoSEstimator latencyEstimator;
 
 		uint64_t lastAckSent;
 		uint64_t lastAckReceived;
@@ -1355,8 +1348,8 @@ class Bond {
 		bool negotiated;			  // Whether this path was intentionally negotiated by either peer.
 		bool shouldAvoid;			  // Whether flows should be moved from this path. Current traffic flows will be re-allocated immediately.
 		uint16_t assignedFlowCount;	  // The number of flows currently assigned to this path.
-		float latency;				  // The mean latency (computed from a sliding window.)
-		float latencyVariance;		  // Packet delay variance (computed from a sliding window.)
+		float latency;				  // The mean latency (exponentially weighted.)
+		float latencyVariance;		  // Packet delay variance (exponentially weighted.)
 		float packetLossRatio;		  // The ratio of lost packets to received packets.
 		float packetErrorRatio;		  // The ratio of packets that failed their MAC/CRC checks to those that did not.
 		float relativeQuality;		  // The relative quality of the link.
@@ -1398,57 +1391,6 @@ class Bond {
 		return ZT_MAX_PEER_NETWORK_PATHS;
 	}
 
-	/**
-	 * A protocol flow that is identified by the origin and destination port.
-	 */
-	struct Flow {
-		/**
-		 * @param flowId Given flow ID
-		 * @param now Current time
-		 */
-		Flow(int32_t flowId, int64_t now) : id(flowId), bytesIn(0), bytesOut(0), lastActivity(now), lastPathReassignment(0), assignedPath(ZT_MAX_PEER_NETWORK_PATHS)
-		{
-		}
-
-		/**
-		 * Reset flow statistics
-		 */
-		inline void resetByteCounts()
-		{
-			bytesIn = 0;
-			bytesOut = 0;
-		}
-
-		/**
-		 * How long since a packet was sent or received in this flow
-		 *
-		 * @param now Current time
-		 * @return The age of the flow in terms of last recorded activity
-		 */
-		int64_t age(int64_t now)
-		{
-			return now - lastActivity;
-		}
-
-		/**
-		 * @param path Assigned path over which this flow should be handled
-		 */
-		inline void assignPath(int pathIdx, int64_t now)
-		{
-			assignedPath = pathIdx;
-			lastPathReassignment = now;
-		}
-
-		AtomicCounter __refCount;
-
-		int32_t id;						// Flow ID used for hashing and path selection
-		uint64_t bytesIn;				// Used for tracking flow size
-		uint64_t bytesOut;				// Used for tracking flow size
-		int64_t lastActivity;			// The last time that this flow handled traffic
-		int64_t lastPathReassignment;	// Time of last path assignment. Used for anti-flapping
-		int assignedPath;				// Index of path to which this flow is assigned
-	};
-
 	const RuntimeEnvironment* RR;
 	AtomicCounter __refCount;
 
@@ -1463,7 +1405,7 @@ class Bond {
 	 */
 	int _realIdxMap[ZT_MAX_PEER_NETWORK_PATHS] = { ZT_MAX_PEER_NETWORK_PATHS };
 	int _numBondedPaths;						  // Number of paths currently included in the _realIdxMap set.
-	std::map<int16_t, SharedPtr<Flow> > _flows;	  // Flows hashed according to port and protocol
+	FlowTable _flows;							  // Flows hashed according to port and protocol
 	float _qw[ZT_QOS_PARAMETER_SIZE];			  // Link quality specification (can be customized by user)
 
 	bool _run;
@@ -1544,14 +1486,15 @@ class Bond {
 	uint64_t _lastBondStatusLog;
 	uint64_t _lastPathNegotiationCheck;
 	uint64_t _lastSentPathNegotiationRequest;
-	uint64_t _lastFlowExpirationCheck;
+	unsigned long _flowSweepBucket;							// Next flow table bucket for processBalanceTasks() to look at
+	uint16_t _flowSweepCounts[ZT_MAX_PEER_NETWORK_PATHS];	// Flows seen per path so far in the current sweep
 	uint64_t _lastFlowRebalance;
 	uint64_t _lastFrame;
 	uint64_t _lastActiveBackupPathChange;
 
 	Mutex _paths_m;
 
-	Mutex _flows_m;
+	Mutex _flows_m;	  // Serializes flow table maintenance (lookups and inserts are lock-free)
 
 	bool _userHasSpecifiedLinks;				  // Whether the user has specified links for this bond.
 	bool _userHasSpecifiedPrimaryLink;			  // Whether the user has specified a primary link for this bond.
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_BORROWED_HPP
+#define ZT_BORROWED_HPP
+
+#include "Constants.hpp"
+#include "SharedPtr.hpp"
+#include "Epoch.hpp"
+
+namespace ZeroTier {
+
+/**
+ * Non-owning reference to a reference counted object kept alive by an epoch
+ *
+ * A Borrowed<T> comes from a table that retires entries through Epoch
+ * (e.g. Topology's peer and path tables) and is valid only while the
+ * thread that obtained it remains inside the Epoch::Guard it was obtained
+ * under. Using one costs nothing beyond the pointer: there is no atomic
+ * increment or decrement on the object's reference count, so hot objects
+ * like busy peers and paths don't have their cache lines bounced between
+ * cores by every packet that touches them.
+ *
+ * Never store a Borrowed<T> beyond the guard's scope. Call promote() to
+ * obtain an owning SharedPtr for anything that must outlive it.
+ *
+ * @tparam T Object type (must be usable with SharedPtr)
+ */
+template<typename T>
+class Borrowed
+{
+public:
+	Borrowed() : _ptr((T *)0) {}
+	explicit Borrowed(T *const p) : _ptr(p) {}
+
+	inline operator bool() const { return (_ptr != (T *)0); }
+	inline T &operator*() const { return *_ptr; }
+	inline T *operator->() const { return _ptr; }
+
+	/**
+	 * @return Raw pointer to borrowed object
+	 */
+	inline T *ptr() const { return _ptr; }
+
+	/**
+	 * Take an owning reference
+	 *
+	 * This is safe because the table the object was borrowed from still
+	 * holds a reference to it for at least as long as the guard is held.
+	 *
+	 * @return SharedPtr to object or NULL SharedPtr if this is NULL
+	 */
+	inline SharedPtr<T> promote() const
+	{
+		if (_ptr) {
+			return SharedPtr<T>(_ptr);
+		}
+		return SharedPtr<T>();
+	}
+
+	inline bool operator==(const Borrowed &b) const { return (_ptr == b._ptr); }
+	inline bool operator!=(const Borrowed &b) const { return (_ptr != b._ptr); }
+	inline bool operator==(const SharedPtr<T> &sp) const { return (_ptr == sp.ptr()); }
+	inline bool operator!=(const SharedPtr<T> &sp) const { return (_ptr != sp.ptr()); }
+
+private:
+	T *_ptr;
+};
+
+} // namespace ZeroTier
+
+#endif
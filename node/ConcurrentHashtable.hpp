@@ -0,0 +1,427 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_CONCURRENTHASHTABLE_HPP
+#define ZT_CONCURRENTHASHTABLE_HPP
+
+#include "Constants.hpp"
+#include "SharedPtr.hpp"
+#include "Mutex.hpp"
+#include "Epoch.hpp"
+
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+#include <utility>
+
+// Minimum number of slots (must be a power of two)
+#define ZT_CONCURRENTHASHTABLE_MIN_CAPACITY 16
+
+namespace ZeroTier {
+
+/**
+ * Read-mostly hash table of SharedPtr values with lock-free lookups
+ *
+ * Lookups and iteration take no locks and never block writers: they run
+ * inside an Epoch::Guard and return SharedPtr copies. Writers serialize on
+ * an internal mutex. Entries are immutable once published, so an erase or
+ * rehash unlinks entries and tables and hands them to Epoch for deferred
+ * reclamation rather than freeing them under a reader.
+ *
+ * This is meant for tables like Topology's peers and paths where nearly
+ * every access is a lookup from a packet processing thread and inserts and
+ * deletes are comparatively rare.
+ *
+ * @tparam K Key type
+ * @tparam T Type pointed to by stored SharedPtr values
+ */
+template<typename K,typename T>
+class ConcurrentHashtable
+{
+private:
+	struct _E
+	{
+		_E(const K &kk,const SharedPtr<T> &vv) : k(kk),v(vv) {}
+		const K k;
+		const SharedPtr<T> v;
+	};
+
+	struct _Table
+	{
+		_Table(const unsigned long c) :
+			cap(c),
+			slots(new std::atomic<_E *>[c])
+		{
+			for(unsigned long i=0;i<c;++i) {
+				slots[i].store((_E *)0,std::memory_order_relaxed);
+			}
+		}
+		~_Table() { delete [] slots; }
+		const unsigned long cap;
+		std::atomic<_E *> *const slots;
+	};
+
+public:
+	ConcurrentHashtable() :
+		_t(new _Table(ZT_CONCURRENTHASHTABLE_MIN_CAPACITY)),
+		_s(0),
+		_used(0)
+	{
+	}
+
+	/**
+	 * Destroy table
+	 *
+	 * No other thread may be accessing the table at this point.
+	 */
+	~ConcurrentHashtable()
+	{
+		_Table *const t = _t.load(std::memory_order_relaxed);
+		for(unsigned long i=0;i<t->cap;++i) {
+			_E *const e = t->slots[i].load(std::memory_order_relaxed);
+			if (_live(e)) {
+				delete e;
+			}
+		}
+		delete t;
+	}
+
+	/**
+	 * Look up a value without locking
+	 *
+	 * @param k Key
+	 * @return Value or NULL SharedPtr if not found
+	 */
+	inline SharedPtr<T> get(const K &k) const
+	{
+		Epoch::Guard _g;
+		const _E *const e = _lookup(k);
+		if (e) {
+			return e->v;
+		}
+		return SharedPtr<T>();
+	}
+
+	/**
+	 * Look up a value without locking or touching its reference count
+	 *
+	 * The caller must hold an Epoch::Guard. The returned pointer remains
+	 * valid until that guard is released, even if the entry is erased in
+	 * the meantime, since the erased entry's reference is only dropped
+	 * after a grace period.
+	 *
+	 * @param k Key
+	 * @return Pointer to value or NULL if not found
+	 */
+	inline T *borrow(const K &k) const
+	{
+		const _E *const e = _lookup(k);
+		if (e) {
+			return e->v.ptr();
+		}
+		return (T *)0;
+	}
+
+	/**
+	 * @param k Key
+	 * @return True if key is present
+	 */
+	inline bool contains(const K &k) const { return (bool)get(k); }
+
+	/**
+	 * Insert a value unless the key is already present
+	 *
+	 * @param k Key
+	 * @param v Value (must not be NULL)
+	 * @return Existing value if present, otherwise v
+	 */
+	inline SharedPtr<T> setIfAbsent(const K &k,const SharedPtr<T> &v)
+	{
+		Mutex::Lock _l(_w_m);
+		_Table *t = _t.load(std::memory_order_relaxed);
+		const uint64_t h = _hash(k);
+		const unsigned long f = _find(t,k,h);
+		if (f < t->cap) {
+			return t->slots[f].load(std::memory_order_relaxed)->v;
+		}
+		if (((_used + 1) * 2) > t->cap) {
+			_rebuild(_s + 1);
+			t = _t.load(std::memory_order_relaxed);
+		}
+		_place(t,new _E(k,v),h);
+		++_s;
+		return v;
+	}
+
+	/**
+	 * @param k Key to erase
+	 * @return True if key was found and erased
+	 */
+	inline bool erase(const K &k)
+	{
+		Mutex::Lock _l(_w_m);
+		_Table *const t = _t.load(std::memory_order_relaxed);
+		const unsigned long f = _find(t,k,_hash(k));
+		if (f < t->cap) {
+			_erase(t,f);
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Erase all entries for which a predicate returns true
+	 *
+	 * The predicate runs with the writer lock held, so it must not call
+	 * back into this table's writer methods. Lookups from it are fine.
+	 *
+	 * @param f Function or function object taking (const K &,const SharedPtr<T> &)
+	 * @return Number of entries erased
+	 */
+	template<typename F>
+	inline unsigned long eraseIf(F f)
+	{
+		Mutex::Lock _l(_w_m);
+		_Table *const t = _t.load(std::memory_order_relaxed);
+		unsigned long cnt = 0;
+		for(unsigned long i=0;i<t->cap;++i) {
+			const _E *const e = t->slots[i].load(std::memory_order_relaxed);
+			if ((_live(e))&&(f(e->k,e->v))) {
+				_erase(t,i);
+				++cnt;
+			}
+		}
+		return cnt;
+	}
+
+	/**
+	 * Erase a key if a predicate returns true for its current value
+	 *
+	 * The predicate runs with the writer lock held, as with eraseIf() above.
+	 * It is not called if the key is not present.
+	 *
+	 * @param k Key
+	 * @param f Function or function object taking (const SharedPtr<T> &)
+	 * @return True if key was found and erased
+	 */
+	template<typename F>
+	inline bool eraseIf(const K &k,F f)
+	{
+		Mutex::Lock _l(_w_m);
+		_Table *const t = _t.load(std::memory_order_relaxed);
+		const unsigned long i = _find(t,k,_hash(k));
+		if ((i < t->cap)&&(f(t->slots[i].load(std::memory_order_relaxed)->v))) {
+			_erase(t,i);
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Apply a function to every entry without locking
+	 *
+	 * Entries inserted or erased concurrently may or may not be visited.
+	 * The function may freely call any other method of this table.
+	 *
+	 * @param f Function or function object taking (const K &,const SharedPtr<T> &)
+	 */
+	template<typename F>
+	inline void each(F f) const
+	{
+		Epoch::Guard _g;
+		const _Table *const t = _t.load(std::memory_order_acquire);
+		for(unsigned long i=0;i<t->cap;++i) {
+			const _E *const e = t->slots[i].load(std::memory_order_acquire);
+			if (_live(e)) {
+				f(e->k,e->v);
+			}
+		}
+	}
+
+	/**
+	 * @return Snapshot of all key/value pairs
+	 */
+	inline std::vector< std::pair< K,SharedPtr<T> > > entries() const
+	{
+		std::vector< std::pair< K,SharedPtr<T> > > v;
+		v.reserve(size());
+		each([&v](const K &k,const SharedPtr<T> &p) {
+			v.push_back(std::pair< K,SharedPtr<T> >(k,p));
+		});
+		return v;
+	}
+
+	/**
+	 * Erase all entries
+	 */
+	inline void clear()
+	{
+		Mutex::Lock _l(_w_m);
+		_Table *const ot = _t.load(std::memory_order_relaxed);
+		_t.store(new _Table(ZT_CONCURRENTHASHTABLE_MIN_CAPACITY),std::memory_order_release);
+		for(unsigned long i=0;i<ot->cap;++i) {
+			_E *const e = ot->slots[i].load(std::memory_order_relaxed);
+			if (_live(e)) {
+				Epoch::retireDelete(e);
+			}
+		}
+		Epoch::retireDelete(ot);
+		_s = 0;
+		_used = 0;
+	}
+
+	/**
+	 * @return Number of entries (may be stale by the time it is used)
+	 */
+	inline unsigned long size() const { return _s.load(std::memory_order_relaxed); }
+
+	/**
+	 * @return True if table is empty
+	 */
+	inline bool empty() const { return (size() == 0); }
+
+private:
+	ConcurrentHashtable(const ConcurrentHashtable &) {}
+	ConcurrentHashtable &operator=(const ConcurrentHashtable &) { return *this; }
+
+	static inline _E *_tombstone() { return reinterpret_cast<_E *>((uintptr_t)1); }
+	static inline bool _live(const _E *const e) { return ((e)&&(e != _tombstone())); }
+
+	template<typename O>
+	static inline unsigned long _hc(const O &obj)
+	{
+		return (unsigned long)obj.hashCode();
+	}
+	static inline unsigned long _hc(const uint64_t i)
+	{
+		return (unsigned long)(i ^ (i >> 32));
+	}
+	static inline unsigned long _hc(const uint32_t i)
+	{
+		return (unsigned long)i;
+	}
+	static inline unsigned long _hc(const int i)
+	{
+		return (unsigned long)i;
+	}
+
+	// Same finalizer as FlatHashtable, since hashCode() is often just the
+	// raw key and linear probing clusters badly on sequential keys.
+	static inline uint64_t _hash(const K &k)
+	{
+		uint64_t h = (uint64_t)_hc(k);
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	// Reader side (caller holds an Epoch::Guard)
+	inline const _E *_lookup(const K &k) const
+	{
+		const _Table *const t = _t.load(std::memory_order_acquire);
+		const unsigned long mask = t->cap - 1;
+		unsigned long i = (unsigned long)_hash(k) & mask;
+		for(unsigned long n=0;n<t->cap;++n) {
+			const _E *const e = t->slots[i].load(std::memory_order_acquire);
+			if (!e) {
+				break;
+			}
+			if ((e != _tombstone())&&(e->k == k)) {
+				return e;
+			}
+			i = (i + 1) & mask;
+		}
+		return (const _E *)0;
+	}
+
+	// Writer side only (caller holds _w_m); returns cap if not found
+	static inline unsigned long _find(const _Table *const t,const K &k,const uint64_t h)
+	{
+		const unsigned long mask = t->cap - 1;
+		unsigned long i = (unsigned long)h & mask;
+		for(unsigned long n=0;n<t->cap;++n) {
+			const _E *const e = t->slots[i].load(std::memory_order_relaxed);
+			if (!e) {
+				break;
+			}
+			if ((e != _tombstone())&&(e->k == k)) {
+				return i;
+			}
+			i = (i + 1) & mask;
+		}
+		return t->cap;
+	}
+
+	// Publish an entry into the first free slot; the release store makes
+	// the entry's contents visible to readers that observe the pointer
+	inline void _place(_Table *const t,_E *const e,const uint64_t h)
+	{
+		const unsigned long mask = t->cap - 1;
+		unsigned long i = (unsigned long)h & mask;
+		for(;;) {
+			_E *const x = t->slots[i].load(std::memory_order_relaxed);
+			if (!x) {
+				++_used;
+				break;
+			}
+			if (x == _tombstone()) {
+				break;
+			}
+			i = (i + 1) & mask;
+		}
+		t->slots[i].store(e,std::memory_order_release);
+	}
+
+	inline void _erase(_Table *const t,const unsigned long i)
+	{
+		_E *const e = t->slots[i].load(std::memory_order_relaxed);
+		t->slots[i].store(_tombstone(),std::memory_order_release);
+		--_s;
+		Epoch::retireDelete(e);
+	}
+
+	// Copy live entries into a fresh table sized for n entries, dropping
+	// tombstones. Entries are shared with the old table, which is retired
+	// as soon as the new one is published.
+	inline void _rebuild(const unsigned long n)
+	{
+		unsigned long c = ZT_CONCURRENTHASHTABLE_MIN_CAPACITY;
+		while (c < (n * 4)) {
+			c <<= 1;
+		}
+		_Table *const ot = _t.load(std::memory_order_relaxed);
+		_Table *const nt = new _Table(c);
+		_used = 0;
+		for(unsigned long i=0;i<ot->cap;++i) {
+			_E *const e = ot->slots[i].load(std::memory_order_relaxed);
+			if (_live(e)) {
+				_place(nt,e,_hash(e->k));
+			}
+		}
+		_t.store(nt,std::memory_order_release);
+		Epoch::retireDelete(ot);
+	}
+
+	std::atomic<_Table *> _t;
+	std::atomic<unsigned long> _s;
+	unsigned long _used; // live + tombstone slots in current table, guarded by _w_m
+	Mutex _w_m;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -387,6 +387,29 @@
  */
 #define ZT_PEER_PING_PERIOD 60000
 
+/**
+ * How often per-peer metrics are re-ranked and exported series updated
+ */
+#define ZT_PEER_METRICS_REFRESH_PERIOD ZT_PEER_PING_PERIOD
+
+/**
+ * Default number of peers (busiest first) to export per-peer metrics for
+ */
+#define ZT_PEER_METRICS_DEFAULT_TOP_K 256
+
+/**
+ * Maximum number of peers (busiest first) to export per-peer metrics for
+ */
+#define ZT_PEER_METRICS_MAX_TOP_K 65536
+
+/**
+ * Latency samples a peer keeps for per-peer metrics between refreshes
+ *
+ * Latency is measured from each direct HELLO reply, a few per path per
+ * refresh period. Past this only the most recent are kept.
+ */
+#define ZT_PEER_METRICS_LATENCY_SAMPLES 16
+
 /**
  * Paths are considered expired if they have not sent us a real packet in this long
  */
@@ -532,6 +555,13 @@
  */
 #define ZT_NETWORK_AUTOCONF_DELAY 60000
 
+/**
+ * Minimum delay before asking a controller that reported it was busy again
+ *
+ * A random delay of up to this much again is added so retries spread out.
+ */
+#define ZT_NETWORK_CONTROLLER_BUSY_DELAY 15000
+
 /**
  * Minimum interval between attempts by relays to unite peers
  *
@@ -639,9 +669,9 @@
 #define ZT_BOND_OPTIMIZE_INTERVAL 15000
 
 /**
- * Maximum number of flows allowed before we start forcibly forgetting old ones
+ * Number of flow table buckets each bond background pass sweeps for expiry and rebalancing
  */
-#define ZT_FLOW_MAX_COUNT (1024 * 64)
+#define ZT_BOND_FLOW_SWEEP_BUCKETS 256
 
 /**
  * How often we emit a bond summary for each bond
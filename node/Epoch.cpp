@@ -0,0 +1,189 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#include "Epoch.hpp"
+#include "Mutex.hpp"
+
+#include <vector>
+#include <thread>
+
+namespace ZeroTier {
+
+namespace {
+
+static const uint64_t QUIESCENT = 0xffffffffffffffffULL;
+
+// One per thread that has ever entered a guard. Records are never freed,
+// only released for reuse when their thread exits, so the list can be
+// walked without locking.
+struct alignas(64) _Record
+{
+	_Record() : active(QUIESCENT),inUse(true),next((_Record *)0) {}
+	std::atomic<uint64_t> active;
+	std::atomic<bool> inUse;
+	_Record *next;
+};
+
+struct _Retired
+{
+	uint64_t epoch;
+	void *obj;
+	void (*reclaim)(void *);
+};
+
+struct _State
+{
+	_State() : epoch(1),records((_Record *)0) {}
+	std::atomic<uint64_t> epoch;
+	std::atomic<_Record *> records;
+	Mutex retired_m;
+	std::vector<_Retired> retired;
+};
+
+static _State &_state()
+{
+	static _State s;
+	return s;
+}
+
+static _Record *_acquireRecord()
+{
+	_State &s = _state();
+	for(_Record *r=s.records.load(std::memory_order_acquire);r;r=r->next) {
+		bool f = false;
+		if ((!r->inUse.load(std::memory_order_relaxed))&&(r->inUse.compare_exchange_strong(f,true))) {
+			return r;
+		}
+	}
+	_Record *const r = new _Record();
+	_Record *h = s.records.load(std::memory_order_relaxed);
+	do {
+		r->next = h;
+	} while (!s.records.compare_exchange_weak(h,r,std::memory_order_release,std::memory_order_relaxed));
+	return r;
+}
+
+struct _ThreadState
+{
+	_ThreadState() : rec(_acquireRecord()),depth(0) {}
+	~_ThreadState()
+	{
+		rec->active.store(QUIESCENT,std::memory_order_release);
+		rec->inUse.store(false,std::memory_order_release);
+	}
+	_Record *const rec;
+	unsigned long depth;
+};
+
+static _ThreadState &_thread()
+{
+	static thread_local _ThreadState t;
+	return t;
+}
+
+} // anonymous namespace
+
+void Epoch::enter()
+{
+	_ThreadState &t = _thread();
+	if (t.depth++ == 0) {
+		// seq_cst so this store is ordered before any loads of shared
+		// pointers that follow it in the critical section
+		t.rec->active.store(_state().epoch.load(std::memory_order_relaxed),std::memory_order_seq_cst);
+	}
+}
+
+void Epoch::leave()
+{
+	_ThreadState &t = _thread();
+	if (--t.depth == 0) {
+		t.rec->active.store(QUIESCENT,std::memory_order_release);
+	}
+}
+
+bool Epoch::active()
+{
+	return (_thread().depth > 0);
+}
+
+void Epoch::retire(void *obj,void (*reclaim)(void *))
+{
+	_State &s = _state();
+	bool doCollect;
+	{
+		Mutex::Lock _l(s.retired_m);
+		_Retired r;
+		// Any reader that could have seen obj entered at or before this epoch
+		r.epoch = s.epoch.fetch_add(1,std::memory_order_seq_cst);
+		r.obj = obj;
+		r.reclaim = reclaim;
+		s.retired.push_back(r);
+		doCollect = (s.retired.size() >= ZT_EPOCH_COLLECT_THRESHOLD);
+	}
+	if (doCollect) {
+		collect();
+	}
+}
+
+void Epoch::collect()
+{
+	_State &s = _state();
+
+	uint64_t minActive = QUIESCENT;
+	for(_Record *r=s.records.load(std::memory_order_acquire);r;r=r->next) {
+		const uint64_t a = r->active.load(std::memory_order_seq_cst);
+		if (a < minActive) {
+			minActive = a;
+		}
+	}
+
+	std::vector<_Retired> ready;
+	{
+		Mutex::Lock _l(s.retired_m);
+		std::vector<_Retired>::iterator w(s.retired.begin());
+		for(std::vector<_Retired>::iterator r(s.retired.begin());r!=s.retired.end();++r) {
+			if (r->epoch < minActive) {
+				ready.push_back(*r);
+			} else {
+				*(w++) = *r;
+			}
+		}
+		s.retired.erase(w,s.retired.end());
+	}
+
+	// Reclaim outside the lock since destructors may retire more objects
+	for(std::vector<_Retired>::iterator r(ready.begin());r!=ready.end();++r) {
+		r->reclaim(r->obj);
+	}
+}
+
+void Epoch::synchronize()
+{
+	_State &s = _state();
+	const uint64_t target = s.epoch.fetch_add(1,std::memory_order_seq_cst) + 1;
+	for(_Record *r=s.records.load(std::memory_order_acquire);r;r=r->next) {
+		while (r->active.load(std::memory_order_seq_cst) < target) {
+			std::this_thread::yield();
+		}
+	}
+	collect();
+}
+
+unsigned long Epoch::pending()
+{
+	_State &s = _state();
+	Mutex::Lock _l(s.retired_m);
+	return (unsigned long)s.retired.size();
+}
+
+} // namespace ZeroTier
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_EPOCH_HPP
+#define ZT_EPOCH_HPP
+
+#include "Constants.hpp"
+
+#include <stdint.h>
+
+#include <atomic>
+
+// Retired objects are collected once this many are pending
+#define ZT_EPOCH_COLLECT_THRESHOLD 64
+
+namespace ZeroTier {
+
+/**
+ * Process-wide epoch based memory reclamation
+ *
+ * This lets lock-free readers dereference objects that a writer may unlink
+ * concurrently. A reader wraps its accesses in an Epoch::Guard. A writer
+ * that unlinks an object hands it to retire() instead of freeing it, and
+ * it is reclaimed only once every thread that was inside a guard at the
+ * time of retirement has left it.
+ *
+ * Guards are cheap (one store to a thread-private cache line on enter and
+ * on leave) and may be nested. Don't block indefinitely while holding one
+ * since that stalls reclamation for everyone.
+ */
+class Epoch
+{
+public:
+	/**
+	 * Scoped read-side critical section
+	 */
+	class Guard
+	{
+	public:
+		Guard() { Epoch::enter(); }
+		~Guard() { Epoch::leave(); }
+	private:
+		Guard(const Guard &) {}
+		Guard &operator=(const Guard &) { return *this; }
+	};
+
+	/**
+	 * Enter a read-side critical section (prefer Guard)
+	 */
+	static void enter();
+
+	/**
+	 * Leave a read-side critical section (prefer Guard)
+	 */
+	static void leave();
+
+	/**
+	 * @return True if the calling thread is inside a guard
+	 */
+	static bool active();
+
+	/**
+	 * Defer reclamation of an unlinked object until no reader can see it
+	 *
+	 * @param obj Object (must already be unreachable for new readers)
+	 * @param reclaim Function to call with obj when safe
+	 */
+	static void retire(void *obj,void (*reclaim)(void *));
+
+	/**
+	 * Retire an object allocated with new
+	 */
+	template<typename T>
+	static inline void retireDelete(T *obj) { retire((void *)obj,&_delete<T>); }
+
+	/**
+	 * Reclaim everything that no current reader could still be using
+	 *
+	 * This is called automatically as objects are retired but can also be
+	 * called from periodic housekeeping.
+	 */
+	static void collect();
+
+	/**
+	 * Wait for all in-progress guards to exit, then collect
+	 *
+	 * Everything retired before this call is reclaimed before it returns.
+	 * This must not be called from within a guard.
+	 */
+	static void synchronize();
+
+	/**
+	 * @return Number of retired objects awaiting reclamation
+	 */
+	static unsigned long pending();
+
+private:
+	template<typename T>
+	static void _delete(void *obj) { delete reinterpret_cast<T *>(obj); }
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -0,0 +1,537 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_FLATHASHTABLE_HPP
+#define ZT_FLATHASHTABLE_HPP
+
+#include "Constants.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+// Slots are probed a group at a time using one control byte per slot
+#define ZT_FLATHASHTABLE_GROUP 16
+
+namespace ZeroTier {
+
+/**
+ * Open addressing hash table with the same API as Hashtable
+ *
+ * Entries live inline in a single flat array instead of in individually
+ * allocated chained buckets, so a lookup is one hash, one 16-byte control
+ * group compare (SSE2 where available), and usually one key compare with
+ * no pointer chasing. The layout follows the SwissTable scheme: each slot
+ * has a control byte that is either empty, deleted, or the low 7 bits of
+ * the entry's hash.
+ *
+ * Iterator semantics are the same as Hashtable: erasing any key (including
+ * the current one) during iteration is safe, but set() or operator[] may
+ * rehash and invalidate the iterator.
+ *
+ * Unlike Hashtable, pointers and references to values are invalidated by
+ * any insert that grows the table. Don't hold a V * or V & across set() or
+ * operator[] on the same table.
+ */
+template<typename K,typename V>
+class FlatHashtable
+{
+private:
+	struct _Slot
+	{
+		_Slot(const K &k,const V &v) : k(k),v(v) {}
+		_Slot(const K &k) : k(k),v() {}
+		K k;
+		V v;
+	};
+
+	static const int8_t _EMPTY = (int8_t)-128; // 0x80
+	static const int8_t _DELETED = (int8_t)-2; // 0xfe
+
+public:
+	/**
+	 * A simple forward iterator (different from STL)
+	 *
+	 * It's safe to erase any key during iteration. Don't use set() since that
+	 * may rehash and invalidate the iterator. Note that erasing a key will
+	 * destroy the targets of the pointers returned by next().
+	 */
+	class Iterator
+	{
+	public:
+		/**
+		 * @param ht Hash table to iterate over
+		 */
+		Iterator(FlatHashtable &ht) :
+			_idx(0),
+			_ht(&ht)
+		{
+		}
+
+		/**
+		 * @param kptr Pointer to set to point to next key
+		 * @param vptr Pointer to set to point to next value
+		 * @return True if kptr and vptr are set, false if no more entries
+		 */
+		inline bool next(K *&kptr,V *&vptr)
+		{
+			while (_idx < _ht->_cap) {
+				const unsigned long i = _idx++;
+				if (_ht->_ctrl[i] >= 0) {
+					kptr = &(_ht->_slots[i].k);
+					vptr = &(_ht->_slots[i].v);
+					return true;
+				}
+			}
+			return false;
+		}
+
+	private:
+		unsigned long _idx;
+		FlatHashtable *_ht;
+	};
+
+	/**
+	 * @param bc Initial capacity in entries (default: 64, rounded up to a power of two)
+	 */
+	FlatHashtable(unsigned long bc = 64) :
+		_ctrl((int8_t *)0),
+		_slots((_Slot *)0),
+		_cap(0),
+		_s(0),
+		_del(0)
+	{
+		_alloc(_capFor(bc));
+	}
+
+	FlatHashtable(const FlatHashtable<K,V> &ht) :
+		_ctrl((int8_t *)0),
+		_slots((_Slot *)0),
+		_cap(0),
+		_s(0),
+		_del(0)
+	{
+		_alloc(ht._cap);
+		for(unsigned long i=0;i<ht._cap;++i) {
+			if (ht._ctrl[i] >= 0) {
+				_insertNew(ht._slots[i].k,ht._slots[i].v,_hash(ht._slots[i].k));
+			}
+		}
+	}
+
+	~FlatHashtable()
+	{
+		this->clear();
+		::free(_ctrl);
+		::free(_slots);
+	}
+
+	inline FlatHashtable &operator=(const FlatHashtable<K,V> &ht)
+	{
+		if (this != &ht) {
+			this->clear();
+			for(unsigned long i=0;i<ht._cap;++i) {
+				if (ht._ctrl[i] >= 0) {
+					this->set(ht._slots[i].k,ht._slots[i].v);
+				}
+			}
+		}
+		return *this;
+	}
+
+	/**
+	 * Erase all entries
+	 */
+	inline void clear()
+	{
+		if ((_s)||(_del)) {
+			for(unsigned long i=0;i<_cap;++i) {
+				if (_ctrl[i] >= 0) {
+					_slots[i].~_Slot();
+				}
+			}
+			memset(_ctrl,(int)_EMPTY,_cap);
+			_s = 0;
+			_del = 0;
+		}
+	}
+
+	/**
+	 * @return Vector of all keys
+	 */
+	inline typename std::vector<K> keys() const
+	{
+		typename std::vector<K> k;
+		if (_s) {
+			k.reserve(_s);
+			for(unsigned long i=0;i<_cap;++i) {
+				if (_ctrl[i] >= 0) {
+					k.push_back(_slots[i].k);
+				}
+			}
+		}
+		return k;
+	}
+
+	/**
+	 * Append all keys (in unspecified order) to the supplied vector or list
+	 *
+	 * @param v Vector, list, or other compliant container
+	 * @tparam Type of V (generally inferred)
+	 */
+	template<typename C>
+	inline void appendKeys(C &v) const
+	{
+		if (_s) {
+			for(unsigned long i=0;i<_cap;++i) {
+				if (_ctrl[i] >= 0) {
+					v.push_back(_slots[i].k);
+				}
+			}
+		}
+	}
+
+	/**
+	 * @return Vector of all entries (pairs of K,V)
+	 */
+	inline typename std::vector< std::pair<K,V> > entries() const
+	{
+		typename std::vector< std::pair<K,V> > k;
+		if (_s) {
+			k.reserve(_s);
+			for(unsigned long i=0;i<_cap;++i) {
+				if (_ctrl[i] >= 0) {
+					k.push_back(std::pair<K,V>(_slots[i].k,_slots[i].v));
+				}
+			}
+		}
+		return k;
+	}
+
+	/**
+	 * @param k Key
+	 * @return Pointer to value or NULL if not found
+	 */
+	inline V *get(const K &k)
+	{
+		const unsigned long i = _find(k,_hash(k));
+		return (i < _cap) ? &(_slots[i].v) : (V *)0;
+	}
+	inline const V *get(const K &k) const { return const_cast<FlatHashtable *>(this)->get(k); }
+
+	/**
+	 * @param k Key
+	 * @param v Value to fill with result
+	 * @return True if value was found and set (if false, v is not modified)
+	 */
+	inline bool get(const K &k,V &v) const
+	{
+		const unsigned long i = _find(k,_hash(k));
+		if (i < _cap) {
+			v = _slots[i].v;
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * @param k Key to check
+	 * @return True if key is present
+	 */
+	inline bool contains(const K &k) const
+	{
+		return (_find(k,_hash(k)) < _cap);
+	}
+
+	/**
+	 * @param k Key
+	 * @return True if value was present
+	 */
+	inline bool erase(const K &k)
+	{
+		const unsigned long i = _find(k,_hash(k));
+		if (i < _cap) {
+			// If this slot's group still has an empty slot then no probe
+			// sequence ever continued past it, so the slot can go back to
+			// empty. Otherwise leave a tombstone so later keys stay reachable.
+			const unsigned long g = i & ~((unsigned long)ZT_FLATHASHTABLE_GROUP - 1);
+			const bool groupHasEmpty = (_matchEmpty(_ctrl + g) != 0);
+			_slots[i].~_Slot(); // note: k may point at this slot's key, so don't touch it after this
+			if (groupHasEmpty) {
+				_ctrl[i] = _EMPTY;
+			} else {
+				_ctrl[i] = _DELETED;
+				++_del;
+			}
+			--_s;
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * @param k Key
+	 * @param v Value
+	 * @return Reference to value in table
+	 */
+	inline V &set(const K &k,const V &v)
+	{
+		const uint64_t h = _hash(k);
+		const unsigned long i = _find(k,h);
+		if (i < _cap) {
+			_slots[i].v = v;
+			return _slots[i].v;
+		}
+		const unsigned long ni = _insertNew(k,v,h); // may rehash, so don't read _slots first
+		return _slots[ni].v;
+	}
+
+	/**
+	 * @param k Key
+	 * @return Value, possibly newly created
+	 */
+	inline V &operator[](const K &k)
+	{
+		const uint64_t h = _hash(k);
+		const unsigned long i = _find(k,h);
+		if (i < _cap) {
+			return _slots[i].v;
+		}
+		const unsigned long ni = _insertDefault(k,h);
+		return _slots[ni].v;
+	}
+
+	/**
+	 * @return Number of entries
+	 */
+	inline unsigned long size() const { return _s; }
+
+	/**
+	 * @return True if table is empty
+	 */
+	inline bool empty() const { return (_s == 0); }
+
+private:
+	template<typename O>
+	static inline unsigned long _hc(const O &obj)
+	{
+		return (unsigned long)obj.hashCode();
+	}
+	static inline unsigned long _hc(const uint64_t i)
+	{
+		return (unsigned long)(i ^ (i >> 32));
+	}
+	static inline unsigned long _hc(const uint32_t i)
+	{
+		return (unsigned long)i;
+	}
+	static inline unsigned long _hc(const uint16_t i)
+	{
+		return (unsigned long)i;
+	}
+	static inline unsigned long _hc(const int i)
+	{
+		return (unsigned long)i;
+	}
+
+	// Many of our hashCode() methods are just the raw key (e.g. addresses),
+	// which is fine for chaining but clusters badly with open addressing and
+	// leaves the low 7 bits used as the control tag poorly distributed.
+	static inline uint64_t _hash(const K &k)
+	{
+		uint64_t h = (uint64_t)_hc(k);
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+
+	static inline unsigned long _capFor(unsigned long n)
+	{
+		unsigned long c = ZT_FLATHASHTABLE_GROUP;
+		while (c < n) {
+			c <<= 1;
+		}
+		return c;
+	}
+
+	// Bit i of the result is set if control byte i of the group equals tag
+	static inline unsigned int _match(const int8_t *g,const int8_t tag)
+	{
+#ifdef ZT_ARCH_X64
+		return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag),_mm_loadu_si128(reinterpret_cast<const __m128i *>(g))));
+#else
+		unsigned int m = 0;
+		for(unsigned int i=0;i<ZT_FLATHASHTABLE_GROUP;++i) {
+			m |= ((unsigned int)(g[i] == tag)) << i;
+		}
+		return m;
+#endif
+	}
+	static inline unsigned int _matchEmpty(const int8_t *g) { return _match(g,_EMPTY); }
+
+	// Bit i of the result is set if control byte i is empty or deleted (high bit set)
+	static inline unsigned int _matchFree(const int8_t *g)
+	{
+#ifdef ZT_ARCH_X64
+		return (unsigned int)_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(g)));
+#else
+		unsigned int m = 0;
+		for(unsigned int i=0;i<ZT_FLATHASHTABLE_GROUP;++i) {
+			m |= ((unsigned int)(g[i] < 0)) << i;
+		}
+		return m;
+#endif
+	}
+
+	static inline unsigned int _ctz(unsigned int m)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return (unsigned int)__builtin_ctz(m);
+#else
+		unsigned int i = 0;
+		while (!(m & 1)) {
+			m >>= 1;
+			++i;
+		}
+		return i;
+#endif
+	}
+
+	// Returns slot index or _cap if not found
+	inline unsigned long _find(const K &k,const uint64_t h) const
+	{
+		const int8_t tag = (int8_t)(h & 0x7f);
+		const unsigned long gmask = (_cap / ZT_FLATHASHTABLE_GROUP) - 1;
+		unsigned long g = (unsigned long)(h >> 7) & gmask;
+		for(unsigned long step=1;step<=(gmask+1);++step) {
+			const int8_t *const gc = _ctrl + (g * ZT_FLATHASHTABLE_GROUP);
+			unsigned int m = _match(gc,tag);
+			while (m) {
+				const unsigned long i = (g * ZT_FLATHASHTABLE_GROUP) + _ctz(m);
+				if (_slots[i].k == k) {
+					return i;
+				}
+				m &= m - 1;
+			}
+			if (_matchEmpty(gc)) {
+				break;
+			}
+			g = (g + step) & gmask; // triangular probing visits every group exactly once
+		}
+		return _cap;
+	}
+
+	inline bool _full() const { return (((_s + _del + 1) * 8) > (_cap * 7)); }
+
+	// Grow if actually full, otherwise just rehash in place to drop tombstones
+	inline void _grow() { _rehash(((_s + 1) * 8 > (_cap * 7) / 2) ? (_cap * 2) : _cap); }
+
+	// Find a free slot for a key known not to be present (caller has checked _full())
+	inline unsigned long _claim(const uint64_t h)
+	{
+		const unsigned long gmask = (_cap / ZT_FLATHASHTABLE_GROUP) - 1;
+		unsigned long g = (unsigned long)(h >> 7) & gmask;
+		for(unsigned long step=1;;++step) {
+			const unsigned int m = _matchFree(_ctrl + (g * ZT_FLATHASHTABLE_GROUP));
+			if (m) {
+				const unsigned long i = (g * ZT_FLATHASHTABLE_GROUP) + _ctz(m);
+				if (_ctrl[i] == _DELETED) {
+					--_del;
+				}
+				_ctrl[i] = (int8_t)(h & 0x7f);
+				++_s;
+				return i;
+			}
+			g = (g + step) & gmask;
+		}
+	}
+
+	// The key can't alias a slot (it isn't present) but the value might be
+	// another entry's value, so copy it before a rehash moves it.
+	inline unsigned long _insertNew(const K &k,const V &v,const uint64_t h)
+	{
+		if (_full()) {
+			const V vc(v);
+			_grow();
+			const unsigned long i = _claim(h);
+			new (_slots + i) _Slot(k,vc);
+			return i;
+		}
+		const unsigned long i = _claim(h);
+		new (_slots + i) _Slot(k,v);
+		return i;
+	}
+
+	inline unsigned long _insertDefault(const K &k,const uint64_t h)
+	{
+		if (_full()) {
+			_grow();
+		}
+		const unsigned long i = _claim(h);
+		new (_slots + i) _Slot(k);
+		return i;
+	}
+
+	inline void _alloc(const unsigned long cap)
+	{
+		int8_t *const c = reinterpret_cast<int8_t *>(::malloc(cap));
+		_Slot *const s = reinterpret_cast<_Slot *>(::malloc(sizeof(_Slot) * cap));
+		if ((!c)||(!s)) {
+			::free(c);
+			::free(s);
+			throw ZT_EXCEPTION_OUT_OF_MEMORY;
+		}
+		memset(c,(int)_EMPTY,cap);
+		_ctrl = c;
+		_slots = s;
+		_cap = cap;
+	}
+
+	inline void _rehash(const unsigned long nc)
+	{
+		int8_t *const oc = _ctrl;
+		_Slot *const os = _slots;
+		const unsigned long ocap = _cap;
+		_alloc(nc);
+		_s = 0;
+		_del = 0;
+		for(unsigned long i=0;i<ocap;++i) {
+			if (oc[i] >= 0) {
+				_insertNew(os[i].k,os[i].v,_hash(os[i].k));
+				os[i].~_Slot();
+			}
+		}
+		::free(oc);
+		::free(os);
+	}
+
+	int8_t *_ctrl;
+	_Slot *_slots;
+	unsigned long _cap;
+	unsigned long _s;
+	unsigned long _del;
+};
+
+} // namespace ZeroTier
+
+#endif
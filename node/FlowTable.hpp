@@ -0,0 +1,260 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_FLOWTABLE_HPP
+#define ZT_FLOWTABLE_HPP
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "Constants.hpp"
+
+// Number of buckets a flow table can grow to (power of two)
+#ifndef ZT_FLOW_TABLE_BUCKETS
+#define ZT_FLOW_TABLE_BUCKETS 4096
+#endif
+
+// Number of buckets a flow table starts with (power of two, at most ZT_FLOW_TABLE_BUCKETS)
+#ifndef ZT_FLOW_TABLE_MIN_BUCKETS
+#define ZT_FLOW_TABLE_MIN_BUCKETS 16
+#endif
+
+// Flows per bucket (a bucket is 128 bytes)
+#define ZT_FLOW_TABLE_BUCKET_SLOTS 8
+
+namespace ZeroTier {
+
+// Number of levels it takes for a flow table to reach ZT_FLOW_TABLE_BUCKETS (see FlowTable)
+static constexpr unsigned int _flowTableLevels(const unsigned long total,const unsigned int l) { return (total >= ZT_FLOW_TABLE_BUCKETS) ? l : _flowTableLevels(total * 2,l + 1); }
+
+/**
+ * Lock-free flow to path table used by Bond
+ *
+ * Packet threads look up and add flows without taking a lock. The table is
+ * a series of levels, the first two of ZT_FLOW_TABLE_MIN_BUCKETS buckets
+ * and each one after that twice the size of the last, up to a total of
+ * ZT_FLOW_TABLE_BUCKETS. A flow ID hashes to one bucket of
+ * ZT_FLOW_TABLE_BUCKET_SLOTS slots per level and can only live in one of
+ * those, so there are no probe chains and a slot can be freed without
+ * hiding any other flow. Adding a flow claims an empty slot by swapping in
+ * its key, in the first level with room, and allocates the next level only
+ * when the flow's buckets in all the others are full. Levels are never
+ * moved or freed while the table exists, so growing needs no lock either.
+ * If two threads add the same flow at once the lower level or slot wins
+ * and the other is given back. If the flow's buckets are full in every
+ * level the flow isn't tracked and Bond steers it by hash instead, which
+ * is still stable per flow.
+ *
+ * Expiring flows and moving them between paths is done by one background
+ * thread at a time (Bond serializes it with _flows_m), which only ever
+ * changes a slot's path or frees it.
+ *
+ * Nothing is allocated until the first flow is added since most bonds never
+ * balance by flow, and a bond with a few flows only ever has the first level.
+ */
+class FlowTable
+{
+public:
+	struct Slot
+	{
+		std::atomic<uint32_t> key;         // flow ID or EMPTY
+		std::atomic<int32_t> path;         // index in Bond::_paths or ZT_MAX_PEER_NETWORK_PATHS if not assigned yet
+		std::atomic<int64_t> lastActivity; // 0 while being claimed
+	};
+
+	static const uint32_t EMPTY = 0xffffffff; // ZT_QOS_NO_FLOW, which is never added
+
+	FlowTable() :
+		_count(0)
+	{
+		for(unsigned int l=0;l<LEVELS;++l) {
+			_levels[l].store((Slot *)0,std::memory_order_relaxed);
+		}
+	}
+
+	~FlowTable()
+	{
+		for(unsigned int l=0;l<LEVELS;++l) {
+			delete [] _levels[l].load();
+		}
+	}
+
+	/**
+	 * Find a flow and mark it active
+	 *
+	 * @param flowId Flow ID
+	 * @param now Current time
+	 * @return Assigned path index or ZT_MAX_PEER_NETWORK_PATHS if flow is unknown or not yet assigned
+	 */
+	inline int get(const int32_t flowId,const int64_t now)
+	{
+		const uint32_t k = (uint32_t)flowId;
+		for(unsigned int l=0;l<LEVELS;++l) {
+			Slot *const s = _levels[l].load(std::memory_order_acquire);
+			if (!s) {
+				break;
+			}
+			Slot *const b = s + _bucketOf(k,l);
+			for(unsigned int i=0;i<ZT_FLOW_TABLE_BUCKET_SLOTS;++i) {
+				if (b[i].key.load(std::memory_order_acquire) == k) {
+					b[i].lastActivity.store(now,std::memory_order_relaxed);
+					return b[i].path.load(std::memory_order_acquire);
+				}
+			}
+		}
+		return ZT_MAX_PEER_NETWORK_PATHS;
+	}
+
+	/**
+	 * Find or add a flow and mark it active
+	 *
+	 * A slot returned here may not have a path yet. Whoever gets it that way
+	 * should assign one.
+	 *
+	 * @param flowId Flow ID (not ZT_QOS_NO_FLOW)
+	 * @param now Current time
+	 * @return Flow's slot or NULL if its bucket is full in every level
+	 */
+	inline Slot *add(const int32_t flowId,const int64_t now)
+	{
+		const uint32_t k = (uint32_t)flowId;
+		Slot *const f = _find(k,LEVELS,ZT_FLOW_TABLE_BUCKET_SLOTS);
+		if (f) {
+			f->lastActivity.store(now,std::memory_order_relaxed);
+			return f;
+		}
+		for(unsigned int l=0;l<LEVELS;++l) {
+			Slot *const b = _alloc(l) + _bucketOf(k,l);
+			for(unsigned int i=0;i<ZT_FLOW_TABLE_BUCKET_SLOTS;++i) {
+				uint32_t e = EMPTY;
+				if ((b[i].key.load(std::memory_order_relaxed) == EMPTY)&&(b[i].key.compare_exchange_strong(e,k,std::memory_order_acq_rel))) {
+					Slot *const first = _find(k,l,i);
+					if (first) {
+						b[i].key.store(EMPTY,std::memory_order_release);
+						first->lastActivity.store(now,std::memory_order_relaxed);
+						return first;
+					}
+					b[i].lastActivity.store(now,std::memory_order_relaxed);
+					_count.fetch_add(1,std::memory_order_relaxed);
+					return &(b[i]);
+				}
+			}
+		}
+		return (Slot *)0;
+	}
+
+	/**
+	 * Free a slot (background thread only)
+	 */
+	inline void remove(Slot &s)
+	{
+		s.path.store(ZT_MAX_PEER_NETWORK_PATHS,std::memory_order_relaxed);
+		s.lastActivity.store(0,std::memory_order_relaxed);
+		s.key.store(EMPTY,std::memory_order_release);
+		_count.fetch_sub(1,std::memory_order_relaxed);
+	}
+
+	/**
+	 * Buckets are numbered across levels in order, and levels are allocated
+	 * in order, so the first bucket this returns NULL for ends the table.
+	 *
+	 * @param b Bucket index in [0,ZT_FLOW_TABLE_BUCKETS)
+	 * @return Bucket's ZT_FLOW_TABLE_BUCKET_SLOTS slots or NULL if its level has not been allocated yet
+	 */
+	inline Slot *bucket(const unsigned long b) const
+	{
+		unsigned int l = 0;
+		unsigned long first = 0;
+		while ((l < (LEVELS - 1))&&(b >= (first + _levelBuckets(l)))) {
+			first += _levelBuckets(l++);
+		}
+		Slot *const s = _levels[l].load(std::memory_order_acquire);
+		return (s) ? (s + ((b - first) * ZT_FLOW_TABLE_BUCKET_SLOTS)) : (Slot *)0;
+	}
+
+	/**
+	 * @return Number of flows in table
+	 */
+	inline unsigned long size() const { return (unsigned long)_count.load(std::memory_order_relaxed); }
+
+	/**
+	 * Hash used to pick a bucket, also usable to steer untracked flows
+	 */
+	static inline uint32_t hash(const int32_t flowId)
+	{
+		// Flow IDs are XORed port numbers, so mix before using the low bits
+		uint32_t h = (uint32_t)flowId * 0x9e3779b1U;
+		return h ^ (h >> 16);
+	}
+
+private:
+	FlowTable(const FlowTable &);
+	FlowTable &operator=(const FlowTable &);
+
+	static constexpr unsigned int LEVELS = _flowTableLevels(ZT_FLOW_TABLE_MIN_BUCKETS,1);
+
+	static inline unsigned long _levelBuckets(const unsigned int l) { return (l) ? ((unsigned long)ZT_FLOW_TABLE_MIN_BUCKETS << (l - 1)) : (unsigned long)ZT_FLOW_TABLE_MIN_BUCKETS; }
+
+	// Each level hashes differently so flows that share a bucket in one are spread out in the next
+	static inline unsigned long _bucketOf(const uint32_t k,const unsigned int l) { return (unsigned long)(hash((int32_t)(k ^ (l * 0x85ebca6bU))) & (_levelBuckets(l) - 1)) * ZT_FLOW_TABLE_BUCKET_SLOTS; }
+
+	// Find a flow in the levels before l and in the slots before i of level l
+	inline Slot *_find(const uint32_t k,const unsigned int l,const unsigned int i) const
+	{
+		for(unsigned int m=0;m<=l;++m) {
+			if (m == LEVELS) {
+				break;
+			}
+			Slot *const s = _levels[m].load(std::memory_order_acquire);
+			if (!s) {
+				break;
+			}
+			Slot *const b = s + _bucketOf(k,m);
+			const unsigned int n = (m < l) ? ZT_FLOW_TABLE_BUCKET_SLOTS : i;
+			for(unsigned int j=0;j<n;++j) {
+				if (b[j].key.load(std::memory_order_acquire) == k) {
+					return &(b[j]);
+				}
+			}
+		}
+		return (Slot *)0;
+	}
+
+	inline Slot *_alloc(const unsigned int l)
+	{
+		Slot *s = _levels[l].load(std::memory_order_acquire);
+		if (!s) {
+			const unsigned long slots = _levelBuckets(l) * ZT_FLOW_TABLE_BUCKET_SLOTS;
+			Slot *const n = new Slot[slots];
+			for(unsigned long i=0;i<slots;++i) {
+				n[i].key.store(EMPTY,std::memory_order_relaxed);
+				n[i].path.store(ZT_MAX_PEER_NETWORK_PATHS,std::memory_order_relaxed);
+				n[i].lastActivity.store(0,std::memory_order_relaxed);
+			}
+			if (_levels[l].compare_exchange_strong(s,n,std::memory_order_acq_rel)) {
+				s = n;
+			} else {
+				delete [] n; // another thread got there first, s is now theirs
+			}
+		}
+		return s;
+	}
+
+	std::atomic<Slot *> _levels[LEVELS];
+	std::atomic<long> _count;
+};
+
+} // namespace ZeroTier
+
+#endif
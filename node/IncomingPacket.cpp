@@ -244,6 +244,17 @@ bool IncomingPacket::_doERROR(const RuntimeEnvironment *RR,void *tPtr,const Shar
 			Metrics::pkt_error_need_membership_cert_in++;
 		}	break;
 
+		case Packet::ERROR_CONTROLLER_BUSY: {
+			// Network controller: too many requests waiting, ask again later.
+			if (inReVerb == Packet::VERB_NETWORK_CONFIG_REQUEST) {
+				const SharedPtr<Network> network(RR->node->network(at<uint64_t>(ZT_PROTO_VERB_ERROR_IDX_PAYLOAD)));
+				if ((network)&&(network->controller() == peer->address())) {
+					network->setControllerBusy(RR->node->now());
+				}
+			}
+			Metrics::pkt_error_controller_busy_in++;
+		}	break;
+
 		case Packet::ERROR_NETWORK_ACCESS_DENIED_: {
 			// Network controller: network access denied.
 			const SharedPtr<Network> network(RR->node->network(at<uint64_t>(ZT_PROTO_VERB_ERROR_IDX_PAYLOAD)));
@@ -650,6 +661,9 @@ bool IncomingPacket::_doOK(const RuntimeEnvironment *RR,void *tPtr,const SharedP
 
 			if (!hops()) {
 				_path->updateLatency((unsigned int)latency,RR->node->now());
+#ifndef ZT_NO_PEER_METRICS
+				peer->recordLatencySample((unsigned int)latency);
+#endif
 			}
 
 			peer->setRemoteVersion(vProto,vMajor,vMinor,vRevision);
@@ -21,6 +21,7 @@
 #include "Utils.hpp"
 #include "MulticastGroup.hpp"
 #include "Peer.hpp"
+#include "Borrowed.hpp"
 
 /*
  * The big picture:
@@ -74,6 +75,23 @@ public:
 	{
 	}
 
+	/**
+	 * Create a new packet-in-decode from a borrowed path
+	 *
+	 * @param data Packet data
+	 * @param len Packet length
+	 * @param path Path over which packet arrived (must not be NULL)
+	 * @param now Current time
+	 * @throws std::out_of_range Range error processing packet
+	 */
+	IncomingPacket(const void *data,unsigned int len,const Borrowed<Path> &path,int64_t now) :
+		Packet(data,len),
+		_receiveTime(now),
+		_path(path.ptr()),
+		_authenticated(false)
+	{
+	}
+
 	/**
 	 * Init packet-in-decode in place
 	 *
@@ -91,6 +109,28 @@ public:
 		_authenticated = false;
 	}
 
+	/**
+	 * Init packet-in-decode in place from a borrowed path
+	 *
+	 * This takes one reference to the path, or none if this packet already
+	 * holds it (e.g. a reused RX queue entry for the same path).
+	 *
+	 * @param data Packet data
+	 * @param len Packet length
+	 * @param path Path over which packet arrived
+	 * @param now Current time
+	 * @throws std::out_of_range Range error processing packet
+	 */
+	inline void init(const void *data,unsigned int len,const Borrowed<Path> &path,int64_t now)
+	{
+		copyFrom(data,len);
+		_receiveTime = now;
+		if (_path.ptr() != path.ptr()) {
+			_path.set(path.ptr());
+		}
+		_authenticated = false;
+	}
+
 	/**
 	 * Attempt to decode this packet
 	 *
@@ -13,6 +13,8 @@
 #include <prometheus/simpleapi.h>
 #include <prometheus/histogram.h>
 
+#include "ShardedCounter.hpp"
+
 namespace prometheus {
     namespace simpleapi {
         std::shared_ptr<Registry> registry_ptr = std::make_shared<Registry>();
@@ -24,95 +26,95 @@ namespace prometheus {
 namespace ZeroTier {
     namespace Metrics {
         // Packet Type Counts
-        prometheus::simpleapi::counter_family_t packets
+        sharded_counter_family_t packets
         { "zt_packet", "ZeroTier packet type counts"};
 
         // Incoming packets
-        prometheus::simpleapi::counter_metric_t pkt_nop_in
+        sharded_counter_metric_t pkt_nop_in
         { packets.Add({{"packet_type", "nop"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_error_in
+        sharded_counter_metric_t pkt_error_in
         { packets.Add({{"packet_type", "error"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_ack_in
+        sharded_counter_metric_t pkt_ack_in
         { packets.Add({{"packet_type", "ack"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_qos_in
+        sharded_counter_metric_t pkt_qos_in
         { packets.Add({{"packet_type", "qos"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_hello_in
+        sharded_counter_metric_t pkt_hello_in
         { packets.Add({{"packet_type", "hello"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_ok_in
+        sharded_counter_metric_t pkt_ok_in
         { packets.Add({{"packet_type", "ok"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_whois_in
+        sharded_counter_metric_t pkt_whois_in
         { packets.Add({{"packet_type", "whois"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_rendezvous_in
+        sharded_counter_metric_t pkt_rendezvous_in
         { packets.Add({{"packet_type", "rendezvous"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_frame_in
+        sharded_counter_metric_t pkt_frame_in
         { packets.Add({{"packet_type", "frame"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_ext_frame_in
+        sharded_counter_metric_t pkt_ext_frame_in
         { packets.Add({{"packet_type", "ext_frame"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_echo_in
+        sharded_counter_metric_t pkt_echo_in
         { packets.Add({{"packet_type", "echo"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_multicast_like_in
+        sharded_counter_metric_t pkt_multicast_like_in
         { packets.Add({{"packet_type", "multicast_like"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_network_credentials_in
+        sharded_counter_metric_t pkt_network_credentials_in
         { packets.Add({{"packet_type", "network_credentials"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_network_config_request_in
+        sharded_counter_metric_t pkt_network_config_request_in
         { packets.Add({{"packet_type", "network_config_request"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_network_config_in
+        sharded_counter_metric_t pkt_network_config_in
         { packets.Add({{"packet_type", "network_config"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_multicast_gather_in
+        sharded_counter_metric_t pkt_multicast_gather_in
         { packets.Add({{"packet_type", "multicast_gather"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_multicast_frame_in
+        sharded_counter_metric_t pkt_multicast_frame_in
         { packets.Add({{"packet_type", "multicast_frame"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_push_direct_paths_in
+        sharded_counter_metric_t pkt_push_direct_paths_in
         { packets.Add({{"packet_type", "push_direct_paths"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_user_message_in
+        sharded_counter_metric_t pkt_user_message_in
         { packets.Add({{"packet_type", "user_message"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_remote_trace_in
+        sharded_counter_metric_t pkt_remote_trace_in
         { packets.Add({{"packet_type", "remote_trace"}, {"direction", "rx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_path_negotiation_request_in
+        sharded_counter_metric_t pkt_path_negotiation_request_in
         { packets.Add({{"packet_type", "path_negotiation_request"}, {"direction", "rx"}}) };
 
         // Outgoing packets
-        prometheus::simpleapi::counter_metric_t pkt_nop_out
+        sharded_counter_metric_t pkt_nop_out
         { packets.Add({{"packet_type", "nop"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_error_out
+        sharded_counter_metric_t pkt_error_out
         { packets.Add({{"packet_type", "error"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_ack_out
+        sharded_counter_metric_t pkt_ack_out
         { packets.Add({{"packet_type", "ack"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_qos_out
+        sharded_counter_metric_t pkt_qos_out
         { packets.Add({{"packet_type", "qos"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_hello_out
+        sharded_counter_metric_t pkt_hello_out
         { packets.Add({{"packet_type", "hello"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_ok_out
+        sharded_counter_metric_t pkt_ok_out
         { packets.Add({{"packet_type", "ok"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_whois_out
+        sharded_counter_metric_t pkt_whois_out
         { packets.Add({{"packet_type", "whois"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_rendezvous_out
+        sharded_counter_metric_t pkt_rendezvous_out
         { packets.Add({{"packet_type", "rendezvous"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_frame_out
+        sharded_counter_metric_t pkt_frame_out
         { packets.Add({{"packet_type", "frame"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_ext_frame_out
+        sharded_counter_metric_t pkt_ext_frame_out
         { packets.Add({{"packet_type", "ext_frame"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_echo_out
+        sharded_counter_metric_t pkt_echo_out
         { packets.Add({{"packet_type", "echo"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_multicast_like_out
+        sharded_counter_metric_t pkt_multicast_like_out
         { packets.Add({{"packet_type", "multicast_like"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_network_credentials_out
+        sharded_counter_metric_t pkt_network_credentials_out
         { packets.Add({{"packet_type", "network_credentials"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_network_config_request_out
+        sharded_counter_metric_t pkt_network_config_request_out
         { packets.Add({{"packet_type", "network_config_request"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_network_config_out
+        sharded_counter_metric_t pkt_network_config_out
         { packets.Add({{"packet_type", "network_config"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_multicast_gather_out
+        sharded_counter_metric_t pkt_multicast_gather_out
         { packets.Add({{"packet_type", "multicast_gather"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_multicast_frame_out
+        sharded_counter_metric_t pkt_multicast_frame_out
         { packets.Add({{"packet_type", "multicast_frame"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_push_direct_paths_out
+        sharded_counter_metric_t pkt_push_direct_paths_out
         { packets.Add({{"packet_type", "push_direct_paths"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_user_message_out
+        sharded_counter_metric_t pkt_user_message_out
         { packets.Add({{"packet_type", "user_message"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_remote_trace_out
+        sharded_counter_metric_t pkt_remote_trace_out
         { packets.Add({{"packet_type", "remote_trace"}, {"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t pkt_path_negotiation_request_out
+        sharded_counter_metric_t pkt_path_negotiation_request_out
         { packets.Add({{"packet_type", "path_negotiation_request"}, {"direction", "tx"}}) };
 
 
@@ -137,6 +139,8 @@ namespace ZeroTier {
         { packet_errors.Add({{"error_type", "authentication_required"}, {"direction", "rx"}}) };
         prometheus::simpleapi::counter_metric_t pkt_error_internal_server_error_in
         { packet_errors.Add({{"error_type", "internal_server_error"}, {"direction", "rx"}}) };
+        prometheus::simpleapi::counter_metric_t pkt_error_controller_busy_in
+        { packet_errors.Add({{"error_type", "controller_busy"}, {"direction", "rx"}}) };
 
         // Outgoing Error Counts
         prometheus::simpleapi::counter_metric_t pkt_error_obj_not_found_out
@@ -155,26 +159,58 @@ namespace ZeroTier {
         { packet_errors.Add({{"error_type", "authentication_required"}, {"direction", "tx"}}) };
         prometheus::simpleapi::counter_metric_t pkt_error_internal_server_error_out
         { packet_errors.Add({{"error_type", "internal_server_error"}, {"direction", "tx"}}) };
+        prometheus::simpleapi::counter_metric_t pkt_error_controller_busy_out
+        { packet_errors.Add({{"error_type", "controller_busy"}, {"direction", "tx"}}) };
 
         // Data Sent/Received Metrics
-        prometheus::simpleapi::counter_family_t data
+        sharded_counter_family_t data
         { "zt_data", "number of bytes ZeroTier has transmitted or received" };
-        prometheus::simpleapi::counter_metric_t udp_recv
+        sharded_counter_metric_t udp_recv
         { data.Add({{"protocol","udp"},{"direction","rx"}}) };
-        prometheus::simpleapi::counter_metric_t udp_send
+        sharded_counter_metric_t udp_send
         { data.Add({{"protocol","udp"},{"direction","tx"}}) };
-        prometheus::simpleapi::counter_metric_t tcp_send
+        sharded_counter_metric_t tcp_send
         { data.Add({{"protocol","tcp"},{"direction", "tx"}}) };
-        prometheus::simpleapi::counter_metric_t tcp_recv
+        sharded_counter_metric_t tcp_recv
         { data.Add({{"protocol","tcp"},{"direction", "rx"}}) };
 
+        // Background Task Metrics
+        prometheus::CustomFamily<prometheus::Histogram<uint64_t>> &background_task_latency =
+        prometheus::Builder<prometheus::Histogram<uint64_t>>()
+            .Name("zt_background_task_latency")
+            .Help("time spent in periodic background tasks (us)")
+            .Register(prometheus::simpleapi::registry);
+
+        // State Write Queue Metrics
+        prometheus::simpleapi::gauge_metric_t state_write_queue_depth
+        { "zt_state_write_queue", "number of state objects waiting to be written" };
+        prometheus::simpleapi::counter_metric_t state_write_coalesced
+        { "zt_state_write_coalesced", "number of state saves that replaced a copy still waiting to be written" };
+        prometheus::CustomFamily<prometheus::Histogram<uint64_t>> &state_write_latency =
+        prometheus::Builder<prometheus::Histogram<uint64_t>>()
+            .Name("zt_state_write_latency")
+            .Help("time taken to write a state object (us)")
+            .Register(prometheus::simpleapi::registry);
+        prometheus::Histogram<uint64_t> &state_write_latency_all =
+            state_write_latency.Add({},std::vector<uint64_t>{10,50,100,500,1000,5000,10000,50000,100000,500000});
+
         // Network Metrics
         prometheus::simpleapi::gauge_metric_t network_num_joined
         { "zt_num_networks", "number of networks this instance is joined to" };
         prometheus::simpleapi::gauge_family_t network_num_multicast_groups
         { "zt_network_multicast_groups_subscribed", "number of multicast groups networks are subscribed to" };
-        prometheus::simpleapi::counter_family_t network_packets
+        sharded_counter_family_t network_packets
         { "zt_network_packets", "number of incoming/outgoing packets per network" };
+        prometheus::simpleapi::counter_family_t address_resolution
+        { "zt_address_resolution", "number of ARP/ND queries answered locally or sent on as multicast" };
+        prometheus::simpleapi::counter_metric_t address_resolution_arp_answered
+        { address_resolution.Add({{"protocol","arp"},{"result","answered"}}) };
+        prometheus::simpleapi::counter_metric_t address_resolution_arp_miss
+        { address_resolution.Add({{"protocol","arp"},{"result","miss"}}) };
+        prometheus::simpleapi::counter_metric_t address_resolution_nd_answered
+        { address_resolution.Add({{"protocol","nd"},{"result","answered"}}) };
+        prometheus::simpleapi::counter_metric_t address_resolution_nd_miss
+        { address_resolution.Add({{"protocol","nd"},{"result","miss"}}) };
         
 #ifndef ZT_NO_PEER_METRICS
         // PeerMetrics
@@ -184,12 +220,21 @@ namespace ZeroTier {
             .Help("peer latency (ms)")
             .Register(prometheus::simpleapi::registry);
     
-        prometheus::simpleapi::gauge_family_t peer_path_count
-        { "zt_peer_path_count", "number of paths to peer" };
-        prometheus::simpleapi::counter_family_t peer_packets
-        { "zt_peer_packets", "number of packets to/from a peer" };
-        prometheus::simpleapi::counter_family_t peer_packet_errors
-        { "zt_peer_packet_errors" , "number of incoming packet errors from a peer" };
+        prometheus::CustomFamily<prometheus::Gauge<int64_t>> &peer_path_count =
+        prometheus::Builder<prometheus::Gauge<int64_t>>()
+            .Name("zt_peer_path_count")
+            .Help("number of paths to peer")
+            .Register(prometheus::simpleapi::registry);
+        prometheus::CustomFamily<prometheus::Counter<uint64_t>> &peer_packets =
+        prometheus::Builder<prometheus::Counter<uint64_t>>()
+            .Name("zt_peer_packets")
+            .Help("number of packets to/from a peer")
+            .Register(prometheus::simpleapi::registry);
+        prometheus::CustomFamily<prometheus::Counter<uint64_t>> &peer_packet_errors =
+        prometheus::Builder<prometheus::Counter<uint64_t>>()
+            .Name("zt_peer_packet_errors")
+            .Help("number of incoming packet errors from a peer")
+            .Register(prometheus::simpleapi::registry);
 #endif
 
         // General Controller Metrics
@@ -208,6 +253,30 @@ namespace ZeroTier {
 
         prometheus::simpleapi::gauge_metric_t network_config_request_queue_size
         { "controller_network_config_request_queue", "number of entries in the request queue for network configurations" };
+        prometheus::simpleapi::counter_family_t network_config_request_queue_result
+        { "controller_network_config_request_queue_result", "number of network config requests queued, coalesced with a waiting request or rejected" };
+        prometheus::simpleapi::counter_metric_t network_config_request_queued
+        { network_config_request_queue_result.Add({{"result","queued"}}) };
+        prometheus::simpleapi::counter_metric_t network_config_request_coalesced
+        { network_config_request_queue_result.Add({{"result","coalesced"}}) };
+        prometheus::simpleapi::counter_metric_t network_config_request_rejected
+        { network_config_request_queue_result.Add({{"result","rejected"}}) };
+        prometheus::CustomFamily<prometheus::Histogram<uint64_t>> &network_config_request_queue_wait =
+        prometheus::Builder<prometheus::Histogram<uint64_t>>()
+            .Name("controller_network_config_request_queue_wait")
+            .Help("time network config requests waited in the request queue (ms)")
+            .Register(prometheus::simpleapi::registry);
+        prometheus::Histogram<uint64_t> &network_config_request_queue_wait_join =
+            network_config_request_queue_wait.Add({{"priority","join"}},std::vector<uint64_t>{1,5,10,50,100,500,1000,5000,10000,30000});
+        prometheus::Histogram<uint64_t> &network_config_request_queue_wait_refresh =
+            network_config_request_queue_wait.Add({{"priority","refresh"}},std::vector<uint64_t>{1,5,10,50,100,500,1000,5000,10000,30000});
+        prometheus::CustomFamily<prometheus::Histogram<uint64_t>> &network_config_request_service_time =
+        prometheus::Builder<prometheus::Histogram<uint64_t>>()
+            .Name("controller_network_config_request_service_time")
+            .Help("time spent handling a network config request once dequeued (us)")
+            .Register(prometheus::simpleapi::registry);
+        prometheus::Histogram<uint64_t> &network_config_request_service_time_all =
+            network_config_request_service_time.Add({},std::vector<uint64_t>{10,50,100,500,1000,5000,10000,50000,100000,500000});
         
         prometheus::simpleapi::counter_metric_t sso_expiration_checks
         { "controller_sso_expiration_checks", "number of sso expiration checks done" };
@@ -219,6 +288,21 @@ namespace ZeroTier {
         { "controller_network_config_request", "count of config requests handled" };
         prometheus::simpleapi::gauge_metric_t network_config_request_threads
         { "controller_network_config_request_threads", "number of active network config handling threads" };
+        prometheus::simpleapi::counter_family_t network_config_cache
+        { "controller_network_config_cache", "number of network configs served from cache or built" };
+        prometheus::simpleapi::counter_metric_t network_config_cache_hit
+        { network_config_cache.Add({{"result","hit"}}) };
+        prometheus::simpleapi::counter_metric_t network_config_cache_miss
+        { network_config_cache.Add({{"result","miss"}}) };
+        prometheus::CustomFamily<prometheus::Histogram<uint64_t>> &network_config_build_time =
+        prometheus::Builder<prometheus::Histogram<uint64_t>>()
+            .Name("controller_network_config_build_time")
+            .Help("time to produce a serialized network config (us)")
+            .Register(prometheus::simpleapi::registry);
+        prometheus::Histogram<uint64_t> &network_config_build_time_hit =
+            network_config_build_time.Add({{"result","hit"}},std::vector<uint64_t>{10,50,100,500,1000,5000,10000,50000,100000,500000});
+        prometheus::Histogram<uint64_t> &network_config_build_time_miss =
+            network_config_build_time.Add({{"result","miss"}},std::vector<uint64_t>{10,50,100,500,1000,5000,10000,50000,100000,500000});
         prometheus::simpleapi::counter_metric_t db_get_network
         { "controller_db_get_network", "counter" };
         prometheus::simpleapi::counter_metric_t db_get_network_and_member
@@ -233,6 +317,18 @@ namespace ZeroTier {
         { "controller_db_member_change", "counter" };
         prometheus::simpleapi::counter_metric_t db_network_change
         { "controller_db_network_change", "counter" };
+        prometheus::simpleapi::counter_family_t db_mirror_sync_diffed
+        { "controller_db_mirror_sync_diffed", "number of networks and members found to differ between mirrored databases" };
+        prometheus::simpleapi::counter_metric_t db_mirror_sync_networks_diffed
+        { db_mirror_sync_diffed.Add({{"object","network"}}) };
+        prometheus::simpleapi::counter_metric_t db_mirror_sync_members_diffed
+        { db_mirror_sync_diffed.Add({{"object","member"}}) };
+        prometheus::simpleapi::counter_family_t db_mirror_sync_repaired
+        { "controller_db_mirror_sync_repaired", "number of network and member records copied to a mirrored database that lacked them or was behind" };
+        prometheus::simpleapi::counter_metric_t db_mirror_sync_networks_repaired
+        { db_mirror_sync_repaired.Add({{"object","network"}}) };
+        prometheus::simpleapi::counter_metric_t db_mirror_sync_members_repaired
+        { db_mirror_sync_repaired.Add({{"object","member"}}) };
 
 #ifdef ZT_CONTROLLER_USE_LIBPQ
         // Central Controller Metrics
@@ -244,6 +340,13 @@ namespace ZeroTier {
         { "controller_pgsql_node_checkin_count", "number of node check-ins (pgsql)" };
         prometheus::simpleapi::counter_metric_t pgsql_commit_ticks
         { "controller_pgsql_commit_ticks", "number of commit ticks run (pgsql)" };
+        prometheus::CustomFamily<prometheus::Histogram<uint64_t>> &pgsql_commit_batch_size =
+        prometheus::Builder<prometheus::Histogram<uint64_t>>()
+            .Name("controller_pgsql_commit_batch_size")
+            .Help("number of queued changes taken together by a commit thread (pgsql)")
+            .Register(prometheus::simpleapi::registry);
+        prometheus::Histogram<uint64_t> &pgsql_commit_batch_size_all =
+            pgsql_commit_batch_size.Add({},std::vector<uint64_t>{1,2,5,10,50,100,500,1000});
         prometheus::simpleapi::counter_metric_t db_get_sso_info
         { "controller_db_get_sso_info", "counter" };
 
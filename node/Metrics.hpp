@@ -15,6 +15,8 @@
 #include <prometheus/simpleapi.h>
 #include <prometheus/histogram.h>
 
+#include "ShardedCounter.hpp"
+
 namespace prometheus {
     namespace simpleapi {
         extern std::shared_ptr<Registry> registry_ptr;
@@ -30,53 +32,54 @@ namespace ZeroTier {
         // Tracks ZeroTier protocol packet types (HELLO, OK, FRAME, etc.) by direction
         // Labels: packet_type={nop,error,ack,qos,hello,ok,whois,etc}, direction={rx,tx}
         // Purpose: Monitor which ZeroTier protocol messages are being exchanged
-        extern prometheus::simpleapi::counter_family_t packets;
+        // NOTE: Sharded per thread since these are bumped for every packet
+        extern sharded_counter_family_t packets;
 
         // Incoming ZeroTier protocol packets by type
-        extern prometheus::simpleapi::counter_metric_t pkt_nop_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_error_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_ack_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_qos_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_hello_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_ok_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_whois_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_rendezvous_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_frame_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_ext_frame_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_echo_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_multicast_like_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_network_credentials_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_network_config_request_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_network_config_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_multicast_gather_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_multicast_frame_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_push_direct_paths_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_user_message_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_remote_trace_in;
-        extern prometheus::simpleapi::counter_metric_t pkt_path_negotiation_request_in;
+        extern sharded_counter_metric_t pkt_nop_in;
+        extern sharded_counter_metric_t pkt_error_in;
+        extern sharded_counter_metric_t pkt_ack_in;
+        extern sharded_counter_metric_t pkt_qos_in;
+        extern sharded_counter_metric_t pkt_hello_in;
+        extern sharded_counter_metric_t pkt_ok_in;
+        extern sharded_counter_metric_t pkt_whois_in;
+        extern sharded_counter_metric_t pkt_rendezvous_in;
+        extern sharded_counter_metric_t pkt_frame_in;
+        extern sharded_counter_metric_t pkt_ext_frame_in;
+        extern sharded_counter_metric_t pkt_echo_in;
+        extern sharded_counter_metric_t pkt_multicast_like_in;
+        extern sharded_counter_metric_t pkt_network_credentials_in;
+        extern sharded_counter_metric_t pkt_network_config_request_in;
+        extern sharded_counter_metric_t pkt_network_config_in;
+        extern sharded_counter_metric_t pkt_multicast_gather_in;
+        extern sharded_counter_metric_t pkt_multicast_frame_in;
+        extern sharded_counter_metric_t pkt_push_direct_paths_in;
+        extern sharded_counter_metric_t pkt_user_message_in;
+        extern sharded_counter_metric_t pkt_remote_trace_in;
+        extern sharded_counter_metric_t pkt_path_negotiation_request_in;
 
         // Outgoing ZeroTier protocol packets by type
-        extern prometheus::simpleapi::counter_metric_t pkt_nop_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_error_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_ack_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_qos_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_hello_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_ok_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_whois_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_rendezvous_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_frame_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_ext_frame_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_echo_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_multicast_like_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_network_credentials_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_network_config_request_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_network_config_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_multicast_gather_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_multicast_frame_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_push_direct_paths_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_user_message_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_remote_trace_out;
-        extern prometheus::simpleapi::counter_metric_t pkt_path_negotiation_request_out;
+        extern sharded_counter_metric_t pkt_nop_out;
+        extern sharded_counter_metric_t pkt_error_out;
+        extern sharded_counter_metric_t pkt_ack_out;
+        extern sharded_counter_metric_t pkt_qos_out;
+        extern sharded_counter_metric_t pkt_hello_out;
+        extern sharded_counter_metric_t pkt_ok_out;
+        extern sharded_counter_metric_t pkt_whois_out;
+        extern sharded_counter_metric_t pkt_rendezvous_out;
+        extern sharded_counter_metric_t pkt_frame_out;
+        extern sharded_counter_metric_t pkt_ext_frame_out;
+        extern sharded_counter_metric_t pkt_echo_out;
+        extern sharded_counter_metric_t pkt_multicast_like_out;
+        extern sharded_counter_metric_t pkt_network_credentials_out;
+        extern sharded_counter_metric_t pkt_network_config_request_out;
+        extern sharded_counter_metric_t pkt_network_config_out;
+        extern sharded_counter_metric_t pkt_multicast_gather_out;
+        extern sharded_counter_metric_t pkt_multicast_frame_out;
+        extern sharded_counter_metric_t pkt_push_direct_paths_out;
+        extern sharded_counter_metric_t pkt_user_message_out;
+        extern sharded_counter_metric_t pkt_remote_trace_out;
+        extern sharded_counter_metric_t pkt_path_negotiation_request_out;
 
         // ========================================================================
         // PROTOCOL ERROR METRICS
@@ -95,6 +98,7 @@ namespace ZeroTier {
         extern prometheus::simpleapi::counter_metric_t pkt_error_unwanted_multicast_in;
         extern prometheus::simpleapi::counter_metric_t pkt_error_authentication_required_in;
         extern prometheus::simpleapi::counter_metric_t pkt_error_internal_server_error_in;
+        extern prometheus::simpleapi::counter_metric_t pkt_error_controller_busy_in;
 
         // Outgoing protocol errors
         extern prometheus::simpleapi::counter_metric_t pkt_error_obj_not_found_out;
@@ -105,6 +109,7 @@ namespace ZeroTier {
         extern prometheus::simpleapi::counter_metric_t pkt_error_unwanted_multicast_out;
         extern prometheus::simpleapi::counter_metric_t pkt_error_authentication_required_out;
         extern prometheus::simpleapi::counter_metric_t pkt_error_internal_server_error_out;
+        extern prometheus::simpleapi::counter_metric_t pkt_error_controller_busy_out;
 
         // ========================================================================
         // PHYSICAL TRANSPORT METRICS
@@ -113,11 +118,30 @@ namespace ZeroTier {
         // Labels: protocol={udp,tcp}, direction={rx,tx}
         // Purpose: Monitor total bandwidth usage by transport protocol
         // NOTE: This tracks actual bytes on the wire, not ZeroTier packet content
-        extern prometheus::simpleapi::counter_family_t data;
-        extern prometheus::simpleapi::counter_metric_t udp_send;
-        extern prometheus::simpleapi::counter_metric_t udp_recv;
-        extern prometheus::simpleapi::counter_metric_t tcp_send;
-        extern prometheus::simpleapi::counter_metric_t tcp_recv;
+        // NOTE: Sharded per thread since these are bumped for every packet
+        extern sharded_counter_family_t data;
+        extern sharded_counter_metric_t udp_send;
+        extern sharded_counter_metric_t udp_recv;
+        extern sharded_counter_metric_t tcp_send;
+        extern sharded_counter_metric_t tcp_recv;
+
+        // ========================================================================
+        // BACKGROUND TASK METRICS
+        // ========================================================================
+        // Wall time spent in each part of Node::processBackgroundTasks()
+        // Labels: task={peer_timers,topology_timers,ping_check,housekeeping}
+        // Purpose: Spot latency spikes from periodic work on large nodes
+        extern prometheus::CustomFamily<prometheus::Histogram<uint64_t>> &background_task_latency;
+
+        // ========================================================================
+        // STATE WRITE QUEUE METRICS
+        // ========================================================================
+        // State objects other than the identity and cached peers are written by a
+        // background thread (see osdep/StateWriteQueue.hpp)
+        extern prometheus::simpleapi::gauge_metric_t   state_write_queue_depth;     // Objects waiting to be written
+        extern prometheus::simpleapi::counter_metric_t state_write_coalesced;       // Saves that replaced a waiting copy
+        extern prometheus::CustomFamily<prometheus::Histogram<uint64_t>> &state_write_latency;
+        extern prometheus::Histogram<uint64_t> &state_write_latency_all;            // Time per write (us)
 
         // ========================================================================
         // NETWORK METRICS
@@ -125,13 +149,26 @@ namespace ZeroTier {
         // Tracks network-level statistics and multicast subscriptions
         extern prometheus::simpleapi::gauge_metric_t   network_num_joined;          // Number of networks joined
         extern prometheus::simpleapi::gauge_family_t   network_num_multicast_groups; // Multicast groups per network
-        extern prometheus::simpleapi::counter_family_t network_packets;             // Packets per network
+        extern sharded_counter_family_t network_packets;             // Packets per network
+
+        // ARP requests and IPv6 neighbor solicitations from the local tap when
+        // localAddressResolution is enabled: answered locally from certificates
+        // of ownership, or missed and sent on as multicast
+        // Labels: protocol={arp,nd}, result={answered,miss}
+        extern prometheus::simpleapi::counter_family_t address_resolution;
+        extern prometheus::simpleapi::counter_metric_t address_resolution_arp_answered;
+        extern prometheus::simpleapi::counter_metric_t address_resolution_arp_miss;
+        extern prometheus::simpleapi::counter_metric_t address_resolution_nd_answered;
+        extern prometheus::simpleapi::counter_metric_t address_resolution_nd_miss;
 
 #ifndef ZT_NO_PEER_METRICS
         // ========================================================================
         // PER-PEER METRICS
         // ========================================================================
         // Tracks statistics for individual peers in the network
+        // NOTE: Peers count internally and PeerMetrics exports series only for
+        // the top-K peers by recent traffic plus an allow-list, removing them
+        // when a peer falls out of that set or is evicted from Topology
 
         // Peer latency histogram - tracks round-trip times to peers
         // Labels: node_id={peer_zt_address}
@@ -141,19 +178,19 @@ namespace ZeroTier {
         // Number of active/dead paths to each peer
         // Labels: node_id={peer_zt_address}, status={alive,dead}
         // Purpose: Monitor path redundancy and connectivity health
-        extern prometheus::simpleapi::gauge_family_t   peer_path_count;
+        extern prometheus::CustomFamily<prometheus::Gauge<int64_t>> &peer_path_count;
 
         // Successful packet exchanges with peers (after processing)
         // Labels: direction={rx,tx}, node_id={peer_zt_address}
         // Purpose: Monitor successful communication with specific peers
-        // NOTE: This counts successful ZeroTier protocol exchanges, incremented
+        // NOTE: This counts successful ZeroTier protocol exchanges, counted
         // in Peer::received() and Peer::recordOutgoingPacket() after processing
-        extern prometheus::simpleapi::counter_family_t peer_packets;
+        extern prometheus::CustomFamily<prometheus::Counter<uint64_t>> &peer_packets;
 
         // Packet processing errors from peers
         // Labels: node_id={peer_zt_address}
         // Purpose: Monitor peers sending malformed or invalid packets
-        extern prometheus::simpleapi::counter_family_t peer_packet_errors;
+        extern prometheus::CustomFamily<prometheus::Counter<uint64_t>> &peer_packet_errors;
 #endif
 
         // ========================================================================
@@ -168,11 +205,43 @@ namespace ZeroTier {
         extern prometheus::simpleapi::counter_metric_t member_deauths;
 
         extern prometheus::simpleapi::gauge_metric_t network_config_request_queue_size;
+
+        // Config requests added to the queue, merged into one already waiting
+        // from the same member, or refused because the queue was full
+        // Labels: result={queued,coalesced,rejected}
+        extern prometheus::simpleapi::counter_family_t network_config_request_queue_result;
+        extern prometheus::simpleapi::counter_metric_t network_config_request_queued;
+        extern prometheus::simpleapi::counter_metric_t network_config_request_coalesced;
+        extern prometheus::simpleapi::counter_metric_t network_config_request_rejected;
+
+        // Time config requests waited in the queue (ms)
+        // Labels: priority={join,refresh}
+        extern prometheus::CustomFamily<prometheus::Histogram<uint64_t>> &network_config_request_queue_wait;
+        extern prometheus::Histogram<uint64_t> &network_config_request_queue_wait_join;
+        extern prometheus::Histogram<uint64_t> &network_config_request_queue_wait_refresh;
+
+        // Time spent handling a config request once dequeued (us)
+        extern prometheus::CustomFamily<prometheus::Histogram<uint64_t>> &network_config_request_service_time;
+        extern prometheus::Histogram<uint64_t> &network_config_request_service_time_all;
         extern prometheus::simpleapi::counter_metric_t sso_expiration_checks;
         extern prometheus::simpleapi::counter_metric_t sso_member_deauth;
         extern prometheus::simpleapi::counter_metric_t network_config_request;
         extern prometheus::simpleapi::gauge_metric_t network_config_request_threads;
 
+        // Network configs served from the controller's cache of serialized
+        // configs (hit) or built from the database (miss)
+        // Labels: result={hit,miss}
+        extern prometheus::simpleapi::counter_family_t network_config_cache;
+        extern prometheus::simpleapi::counter_metric_t network_config_cache_hit;
+        extern prometheus::simpleapi::counter_metric_t network_config_cache_miss;
+
+        // Time to produce a serialized network config (us), from the cache or
+        // by building and signing it
+        // Labels: result={hit,miss}
+        extern prometheus::CustomFamily<prometheus::Histogram<uint64_t>> &network_config_build_time;
+        extern prometheus::Histogram<uint64_t> &network_config_build_time_hit;
+        extern prometheus::Histogram<uint64_t> &network_config_build_time_miss;
+
         extern prometheus::simpleapi::counter_metric_t db_get_network;
         extern prometheus::simpleapi::counter_metric_t db_get_network_and_member;
         extern prometheus::simpleapi::counter_metric_t db_get_network_and_member_and_summary;
@@ -181,6 +250,15 @@ namespace ZeroTier {
         extern prometheus::simpleapi::counter_metric_t db_member_change;
         extern prometheus::simpleapi::counter_metric_t db_network_change;
 
+        // Mirrored database sync
+        // Labels: object={network,member}
+        extern prometheus::simpleapi::counter_family_t db_mirror_sync_diffed;
+        extern prometheus::simpleapi::counter_metric_t db_mirror_sync_networks_diffed;
+        extern prometheus::simpleapi::counter_metric_t db_mirror_sync_members_diffed;
+        extern prometheus::simpleapi::counter_family_t db_mirror_sync_repaired;
+        extern prometheus::simpleapi::counter_metric_t db_mirror_sync_networks_repaired;
+        extern prometheus::simpleapi::counter_metric_t db_mirror_sync_members_repaired;
+
 
 #ifdef ZT_CONTROLLER_USE_LIBPQ
         // Central Controller Database Metrics
@@ -188,6 +266,8 @@ namespace ZeroTier {
         extern prometheus::simpleapi::counter_metric_t pgsql_net_notification;
         extern prometheus::simpleapi::counter_metric_t pgsql_node_checkin;
         extern prometheus::simpleapi::counter_metric_t pgsql_commit_ticks;
+        extern prometheus::CustomFamily<prometheus::Histogram<uint64_t>> &pgsql_commit_batch_size;
+        extern prometheus::Histogram<uint64_t> &pgsql_commit_batch_size_all;
         extern prometheus::simpleapi::counter_metric_t db_get_sso_info;
 
         extern prometheus::simpleapi::counter_metric_t redis_mem_notification;
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_MULTICASTFANOUT_HPP
+#define ZT_MULTICASTFANOUT_HPP
+
+#include <stdint.h>
+
+#include "FlatHashtable.hpp"
+
+// Groups up to this size are permuted in a flat array, larger ones sparsely
+#ifndef ZT_MULTICAST_FANOUT_DENSE_MAX
+#define ZT_MULTICAST_FANOUT_DENSE_MAX 1024
+#endif
+
+namespace ZeroTier {
+
+/**
+ * Lazy random permutation of multicast group member indexes
+ *
+ * A multicast only goes to multicastLimit recipients (32 by default) but
+ * groups can have thousands of members, so shuffling every member index up
+ * front costs a PRNG call and a swap per member for nothing. This runs
+ * Fisher-Yates one step per draw instead, making k draws out of n members
+ * O(k). Small groups use a flat index array. Large groups only remember the
+ * positions that have been swapped so far, so nothing proportional to the
+ * group size is allocated.
+ *
+ * Every index comes out exactly once, so callers can keep drawing past
+ * members they skip (bridges, the origin) until the group is exhausted.
+ *
+ * Not copyable. Used on the stack by a single thread.
+ */
+class MulticastFanout
+{
+public:
+	/**
+	 * @param n Number of indexes to permute
+	 * @param expected Expected number of draws (sizes the sparse map for large n, which grows if more are drawn)
+	 */
+	MulticastFanout(const unsigned long n,const unsigned long expected) :
+		_n(n),
+		_i(0),
+		_swapped((n > ZT_MULTICAST_FANOUT_DENSE_MAX) ? new FlatHashtable<uint64_t,uint64_t>(((expected < n) ? expected : n) * 2) : (FlatHashtable<uint64_t,uint64_t> *)0)
+	{
+		if (!_swapped) {
+			for(unsigned long i=0;i<n;++i) {
+				_dense[i] = i;
+			}
+		}
+	}
+
+	~MulticastFanout() { delete _swapped; }
+
+	/**
+	 * Draw the next index
+	 *
+	 * @param r Random value from the caller's PRNG
+	 * @param idx Set to next index in [0,n)
+	 * @return False if all n indexes have been drawn
+	 */
+	inline bool next(const uint64_t r,unsigned long &idx)
+	{
+		if (_i >= _n) {
+			return false;
+		}
+		const unsigned long j = _i + (unsigned long)(r % (uint64_t)(_n - _i));
+		if (_swapped) {
+			uint64_t atI = _i,atJ = j;
+			_swapped->get(_i,atI);
+			_swapped->get(j,atJ);
+			_swapped->set(j,atI);
+			idx = (unsigned long)atJ;
+		} else {
+			idx = _dense[j];
+			_dense[j] = _dense[_i];
+		}
+		++_i;
+		return true;
+	}
+
+	/**
+	 * @return Number of indexes drawn so far
+	 */
+	inline unsigned long drawn() const { return _i; }
+
+private:
+	MulticastFanout(const MulticastFanout &);
+	MulticastFanout &operator=(const MulticastFanout &);
+
+	const unsigned long _n;
+	unsigned long _i;
+	FlatHashtable<uint64_t,uint64_t> *const _swapped;
+	unsigned long _dense[ZT_MULTICAST_FANOUT_DENSE_MAX];
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -16,6 +16,7 @@
 #include "Constants.hpp"
 #include "RuntimeEnvironment.hpp"
 #include "Multicaster.hpp"
+#include "MulticastFanout.hpp"
 #include "Topology.hpp"
 #include "Switch.hpp"
 #include "Packet.hpp"
@@ -54,11 +55,9 @@ void Multicaster::remove(uint64_t nwid,const MulticastGroup &mg,const Address &m
 	Mutex::Lock _l(_groups_m);
 	MulticastGroupStatus *s = _groups.get(Multicaster::Key(nwid,mg));
 	if (s) {
-		for(std::vector<MulticastGroupMember>::iterator m(s->members.begin());m!=s->members.end();++m) {
-			if (m->address == member) {
-				s->members.erase(m);
-				break;
-			}
+		std::vector<MulticastGroupMember>::iterator m(std::lower_bound(s->members.begin(),s->members.end(),member));
+		if ((m != s->members.end())&&(m->address == member)) {
+			s->members.erase(m);
 		}
 	}
 }
@@ -66,8 +65,9 @@ void Multicaster::remove(uint64_t nwid,const MulticastGroup &mg,const Address &m
 unsigned int Multicaster::gather(const Address &queryingPeer,uint64_t nwid,const MulticastGroup &mg,Buffer<ZT_PROTO_MAX_PACKET_LENGTH> &appendTo,unsigned int limit) const
 {
 	unsigned char *p;
-	unsigned int added = 0,i,k,rptr,totalKnown = 0;
-	uint64_t a,picked[(ZT_PROTO_MAX_PACKET_LENGTH / 5) + 2];
+	unsigned int added = 0,totalKnown = 0;
+	unsigned long idx;
+	uint64_t a;
 
 	if (!limit) {
 		return 0;
@@ -96,20 +96,13 @@ unsigned int Multicaster::gather(const Address &queryingPeer,uint64_t nwid,const
 		totalKnown += (unsigned int)s->members.size();
 
 		// Members are returned in random order so that repeated gather queries
-		// will return different subsets of a large multicast group.
-		k = 0;
-		while ((added < limit)&&(k < s->members.size())&&((appendTo.size() + ZT_ADDRESS_LENGTH) <= ZT_PROTO_MAX_PACKET_LENGTH)) {
-			rptr = (unsigned int)RR->node->prng();
-
-restart_member_scan:
-			a = s->members[rptr % (unsigned int)s->members.size()].address.toInt();
-			for(i=0;i<k;++i) {
-				if (picked[i] == a) {
-					++rptr;
-					goto restart_member_scan;
-				}
-			}
-			picked[k++] = a;
+		// will return different subsets of a large multicast group. The limit
+		// comes from the querying peer, so the fanout is sized for no more than
+		// what fits in this packet.
+		const unsigned int fits = (appendTo.size() < ZT_PROTO_MAX_PACKET_LENGTH) ? ((ZT_PROTO_MAX_PACKET_LENGTH - appendTo.size()) / ZT_ADDRESS_LENGTH) : 0;
+		MulticastFanout fanout(s->members.size(),std::min(limit,fits) + 1);
+		while ((added < limit)&&((appendTo.size() + ZT_ADDRESS_LENGTH) <= ZT_PROTO_MAX_PACKET_LENGTH)&&(fanout.next(RR->node->prng(),idx))) {
+			a = s->members[idx].address.toInt();
 
 			if (queryingPeer.toInt() != a) { // do not return the peer that is making the request as a result
 				p = (unsigned char *)appendTo.appendField(ZT_ADDRESS_LENGTH);
@@ -157,9 +150,6 @@ void Multicaster::send(
 	const void *data,
 	unsigned int len)
 {
-	unsigned long idxbuf[4096];
-	unsigned long *indexes = idxbuf;
-
 	// If we're in hub-and-spoke designated multicast replication mode, see if we
 	// have a multicast replicator active. If so, pick the best and send it
 	// there. If we are a multicast replicator or if none are alive, fall back
@@ -212,28 +202,15 @@ void Multicaster::send(
 		Mutex::Lock _l(_groups_m);
 		MulticastGroupStatus &gs = _groups[Multicaster::Key(network->id(),mg)];
 
-		if (!gs.members.empty()) {
-			// Allocate a memory buffer if group is monstrous
-			if (gs.members.size() > (sizeof(idxbuf) / sizeof(unsigned long))) {
-				indexes = new unsigned long[gs.members.size()];
-			}
-
-			// Generate a random permutation of member indexes
-			for(unsigned long i=0;i<gs.members.size();++i) {
-				indexes[i] = i;
-			}
-			for(unsigned long i=(unsigned long)gs.members.size()-1;i>0;--i) {
-				unsigned long j = (unsigned long)RR->node->prng() % (i + 1);
-				unsigned long tmp = indexes[j];
-				indexes[j] = indexes[i];
-				indexes[i] = tmp;
-			}
-		}
-
 		Address activeBridges[ZT_MAX_NETWORK_SPECIALISTS];
 		const unsigned int activeBridgeCount = network->config().activeBridges(activeBridges);
 		const unsigned int limit = network->config().multicastLimit;
 
+		// Members are drawn in random order only as far as needed to reach the
+		// limit, which is usually far fewer than the group has
+		MulticastFanout fanout(gs.members.size(),limit + activeBridgeCount + 1);
+		unsigned long idx = 0;
+
 		if (gs.members.size() >= limit) {
 			// Skip queue if we already have enough members to complete the send operation
 			OutboundMulticast out;
@@ -255,18 +232,17 @@ void Multicaster::send(
 
 			for(unsigned int i=0;i<activeBridgeCount;++i) {
 				if ((activeBridges[i] != RR->identity.address())&&(activeBridges[i] != origin)) {
-					out.sendOnly(RR,tPtr,activeBridges[i]); // optimization: don't use dedup log if it's a one-pass send
+					out.sendOnly(RR,tPtr,network,activeBridges[i]); // optimization: don't use dedup log if it's a one-pass send
 					if (++count >= limit) {
 						break;
 					}
 				}
 			}
 
-			unsigned long idx = 0;
-			while ((count < limit)&&(idx < gs.members.size())) {
-				const Address ma(gs.members[indexes[idx++]].address);
+			while ((count < limit)&&(fanout.next(RR->node->prng(),idx))) {
+				const Address ma(gs.members[idx].address);
 				if ((std::find(activeBridges,activeBridges + activeBridgeCount,ma) == (activeBridges + activeBridgeCount))&&(ma != origin)) {
-					out.sendOnly(RR,tPtr,ma); // optimization: don't use dedup log if it's a one-pass send
+					out.sendOnly(RR,tPtr,network,ma); // optimization: don't use dedup log if it's a one-pass send
 					++count;
 				}
 			}
@@ -363,28 +339,22 @@ void Multicaster::send(
 
 			for(unsigned int i=0;i<activeBridgeCount;++i) {
 				if (activeBridges[i] != RR->identity.address()) {
-					out.sendAndLog(RR,tPtr,activeBridges[i]);
+					out.sendAndLog(RR,tPtr,network,activeBridges[i]);
 					if (++count >= limit) {
 						break;
 					}
 				}
 			}
 
-			unsigned long idx = 0;
-			while ((count < limit)&&(idx < gs.members.size())) {
-				Address ma(gs.members[indexes[idx++]].address);
+			while ((count < limit)&&(fanout.next(RR->node->prng(),idx))) {
+				Address ma(gs.members[idx].address);
 				if (std::find(activeBridges,activeBridges + activeBridgeCount,ma) == (activeBridges + activeBridgeCount)) {
-					out.sendAndLog(RR,tPtr,ma);
+					out.sendAndLog(RR,tPtr,network,ma);
 					++count;
 				}
 			}
 		}
-	} catch ( ... ) {} // this is a sanity check to catch any failures and make sure indexes[] still gets deleted
-
-	// Free allocated memory buffer if any
-	if (indexes != idxbuf) {
-		delete [] indexes;
-	}
+	} catch ( ... ) {} // this is a sanity check to catch any failures
 }
 
 void Multicaster::clean(int64_t now)
@@ -392,7 +362,7 @@ void Multicaster::clean(int64_t now)
 	Mutex::Lock _l(_groups_m);
 	Multicaster::Key *k = (Multicaster::Key *)0;
 	MulticastGroupStatus *s = (MulticastGroupStatus *)0;
-	Hashtable<Multicaster::Key,MulticastGroupStatus>::Iterator mm(_groups);
+	FlatHashtable<Multicaster::Key,MulticastGroupStatus>::Iterator mm(_groups);
 	while (mm.next(k,s)) {
 		for(std::list<OutboundMulticast>::iterator tx(s->txQueue.begin());tx!=s->txQueue.end();) {
 			if ((tx->expired(now))||(tx->atLimit())) {
@@ -446,11 +416,15 @@ void Multicaster::_add(void *tPtr,int64_t now,uint64_t nwid,const MulticastGroup
 		gs.members.push_back(MulticastGroupMember(member,now));
 	}
 
+	if (gs.txQueue.empty()) {
+		return;
+	}
+	const SharedPtr<Network> network(RR->node->network(nwid));
 	for(std::list<OutboundMulticast>::iterator tx(gs.txQueue.begin());tx!=gs.txQueue.end();) {
 		if (tx->atLimit()) {
 			gs.txQueue.erase(tx++);
 		} else {
-			tx->sendIfNew(RR,tPtr,member);
+			tx->sendIfNew(RR,tPtr,network,member);
 			if (tx->atLimit()) {
 				gs.txQueue.erase(tx++);
 			} else {
@@ -23,6 +23,7 @@
 
 #include "Constants.hpp"
 #include "Hashtable.hpp"
+#include "FlatHashtable.hpp"
 #include "Address.hpp"
 #include "MAC.hpp"
 #include "MulticastGroup.hpp"
@@ -188,7 +189,7 @@ private:
 
 	const RuntimeEnvironment *const RR;
 
-	Hashtable<Multicaster::Key,MulticastGroupStatus> _groups;
+	FlatHashtable<Multicaster::Key,MulticastGroupStatus> _groups;
 	Mutex _groups_m;
 };
 
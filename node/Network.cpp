@@ -619,6 +619,7 @@ Network::Network(const RuntimeEnvironment *renv,void *tPtr,uint64_t nwid,void *u
 	_mac(renv->identity.address(),nwid),
 	_portInitialized(false),
 	_lastConfigUpdate(0),
+	_controllerBusyUntil(0),
 	_destroyed(false),
 	_netconfFailure(NETCONF_FAILURE_NONE),
 	_portError(0),
@@ -1298,6 +1299,13 @@ void Network::requestConfiguration(void *tPtr)
 		return;
 	}
 
+	{
+		Mutex::Lock _l(_lock);
+		if (RR->node->now() < _controllerBusyUntil) {
+			return;
+		}
+	}
+
 	const Address ctrl(controller());
 
 	Dictionary<ZT_NETWORKCONFIG_METADATA_DICT_CAPACITY> rmd;
@@ -1342,6 +1350,12 @@ void Network::requestConfiguration(void *tPtr)
 	RR->sw->send(tPtr,outp,true);
 }
 
+void Network::setControllerBusy(const int64_t now)
+{
+	Mutex::Lock _l(_lock);
+	_controllerBusyUntil = now + ZT_NETWORK_CONTROLLER_BUSY_DELAY + (int64_t)(RR->node->prng() % ZT_NETWORK_CONTROLLER_BUSY_DELAY);
+}
+
 bool Network::gate(void *tPtr,const SharedPtr<Peer> &peer)
 {
 	const int64_t now = RR->node->now();
@@ -1378,6 +1392,22 @@ bool Network::recentlyAssociatedWith(const Address &addr)
 	return ((m)&&(m->recentlyAssociated(RR->node->now())));
 }
 
+Address Network::managedIpOwner(const InetAddress &ip)
+{
+	const InetAddress k(ip.rawIpData(),(ip.ss_family == AF_INET6) ? 16 : 4,0);
+	Mutex::Lock _l(_lock);
+	const Address *const owner = _managedIpOwners.get(k);
+	if ((owner)&&(*owner != RR->identity.address())) {
+		// Credentials expire or get replaced, so recheck before vouching for it
+		const Membership *const m = _memberships.get(*owner);
+		if ((m)&&(m->hasCertificateOfOwnershipFor(_config,k))) {
+			return *owner;
+		}
+		_managedIpOwners.erase(k);
+	}
+	return Address();
+}
+
 void Network::clean()
 {
 	const int64_t now = RR->node->now();
@@ -1410,6 +1440,17 @@ void Network::clean()
 			}
 		}
 	}
+
+	{
+		Hashtable<InetAddress,Address>::Iterator i(_managedIpOwners);
+		InetAddress *ip = (InetAddress *)0;
+		Address *a = (Address *)0;
+		while (i.next(ip,a)) {
+			if (!_memberships.contains(*a)) {
+				_managedIpOwners.erase(*ip);
+			}
+		}
+	}
 }
 
 void Network::learnBridgeRoute(const MAC &mac,const Address &addr)
@@ -225,6 +225,11 @@ public:
 		_sendUpdateEvent(tPtr);
 	}
 
+	/**
+	 * Hold off on config requests for a while -- called by IncomingPacket when controller is busy
+	 */
+	void setControllerBusy(const int64_t now);
+
 	/**
 	 * Set netconf failure to 'authentication required' possibly with an authorization URL
 	 */
@@ -272,6 +277,18 @@ public:
 	 */
 	bool recentlyAssociatedWith(const Address &addr);
 
+	/**
+	 * Find the member that owns a managed IP
+	 *
+	 * Only members we currently hold a valid certificate of ownership for
+	 * are returned, so this is as authoritative as the controller. Used to
+	 * answer ARP and neighbor solicitations without multicasting them.
+	 *
+	 * @param ip IP address (port ignored)
+	 * @return Owning member, or null address if not known or if it's this node
+	 */
+	Address managedIpOwner(const InetAddress &ip);
+
 	/**
 	 * Do periodic cleanup and housekeeping tasks
 	 */
@@ -366,7 +383,17 @@ public:
 			return Membership::ADD_REJECTED;
 		}
 		Mutex::Lock _l(_lock);
-		return _membership(coo.issuedTo()).addCredential(RR,tPtr,_config,coo);
+		const Membership::AddCredentialResult r = _membership(coo.issuedTo()).addCredential(RR,tPtr,_config,coo);
+		if ((r == Membership::ADD_ACCEPTED_NEW)||(r == Membership::ADD_ACCEPTED_REDUNDANT)) {
+			for(unsigned int i=0;i<coo.thingCount();++i) {
+				if (coo.thingType(i) == CertificateOfOwnership::THING_IPV4_ADDRESS) {
+					_managedIpOwners[InetAddress(coo.thingValue(i),4,0)] = coo.issuedTo();
+				} else if (coo.thingType(i) == CertificateOfOwnership::THING_IPV6_ADDRESS) {
+					_managedIpOwners[InetAddress(coo.thingValue(i),16,0)] = coo.issuedTo();
+				}
+			}
+		}
+		return r;
 	}
 
 	/**
@@ -451,6 +478,7 @@ private:
 
 	NetworkConfig _config;
 	int64_t _lastConfigUpdate;
+	int64_t _controllerBusyUntil;
 
 	struct _IncomingConfigChunk
 	{
@@ -477,16 +505,17 @@ private:
 	std::string _authenticationURL;
 
 	Hashtable<Address,Membership> _memberships;
+	Hashtable<InetAddress,Address> _managedIpOwners; // IPs from members' certificates of ownership (checked again on use)
 
 	Mutex _lock;
 
 	AtomicCounter __refCount;
 
 	prometheus::simpleapi::gauge_metric_t _num_multicast_groups;
-	prometheus::simpleapi::counter_metric_t _incoming_packets_accepted;
-	prometheus::simpleapi::counter_metric_t _incoming_packets_dropped;
-	prometheus::simpleapi::counter_metric_t _outgoing_packets_accepted;
-	prometheus::simpleapi::counter_metric_t _outgoing_packets_dropped;
+	Metrics::sharded_counter_metric_t _incoming_packets_accepted;
+	Metrics::sharded_counter_metric_t _incoming_packets_dropped;
+	Metrics::sharded_counter_metric_t _outgoing_packets_accepted;
+	Metrics::sharded_counter_metric_t _outgoing_packets_dropped;
 };
 
 }	// namespace ZeroTier
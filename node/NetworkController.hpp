@@ -39,7 +39,8 @@ public:
 		NC_ERROR_OBJECT_NOT_FOUND = 1,
 		NC_ERROR_ACCESS_DENIED = 2,
 		NC_ERROR_INTERNAL_SERVER_ERROR = 3,
-		NC_ERROR_AUTHENTICATION_REQUIRED = 4
+		NC_ERROR_AUTHENTICATION_REQUIRED = 4,
+		NC_ERROR_BUSY = 5
 	};
 
 	/**
@@ -59,6 +60,20 @@ public:
 		 */
 		virtual void ncSendConfig(uint64_t nwid,uint64_t requestPacketId,const Address &destination,const NetworkConfig &nc,bool sendLegacyFormatConfig) = 0;
 
+		/**
+		 * Send a configuration that has already been serialized to a Dictionary
+		 *
+		 * This lets a controller reuse the serialized form of a config it has
+		 * sent before. Chunks are still signed per send.
+		 *
+		 * @param nwid Network ID
+		 * @param requestPacketId Request packet ID to send OK(NETWORK_CONFIG_REQUEST) or 0 to send NETWORK_CONFIG (push)
+		 * @param destination Destination peer Address
+		 * @param dict Serialized Dictionary (from NetworkConfig::toDictionary())
+		 * @param dictSize Size of dict in bytes
+		 */
+		virtual void ncSendSerializedConfig(uint64_t nwid,uint64_t requestPacketId,const Address &destination,const void *dict,unsigned int dictSize) = 0;
+
 		/**
 		 * Send revocation to a node
 		 *
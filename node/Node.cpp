@@ -17,6 +17,8 @@
 #include <string.h>
 #include <stdint.h>
 
+#include <chrono>
+
 #include "../version.h"
 
 #include "Constants.hpp"
@@ -54,12 +56,18 @@ Node::Node(void *uptr,void *tptr,const struct ZT_Node_Callbacks *callbacks,int64
 	RR(&_RR),
 	_uPtr(uptr),
 	_networks(8),
+	_peerTimers(ZT_CORE_TIMER_TASK_GRANULARITY,now),
+	_peerTimersLatency(Metrics::background_task_latency.Add({{"task","peer_timers"}},std::vector<uint64_t>{10,50,100,500,1000,5000,10000,50000,100000,500000})),
+	_topologyTimersLatency(Metrics::background_task_latency.Add({{"task","topology_timers"}},std::vector<uint64_t>{10,50,100,500,1000,5000,10000,50000,100000,500000})),
+	_pingCheckLatency(Metrics::background_task_latency.Add({{"task","ping_check"}},std::vector<uint64_t>{10,50,100,500,1000,5000,10000,50000,100000,500000})),
+	_housekeepingLatency(Metrics::background_task_latency.Add({{"task","housekeeping"}},std::vector<uint64_t>{10,50,100,500,1000,5000,10000,50000,100000,500000})),
 	_now(now),
 	_lastPingCheck(0),
 	_lastGratuitousPingCheck(0),
 	_lastHousekeepingRun(0),
 	_lastMemoizedTraceSettings(0),
-	_lowBandwidthMode(false)
+	_lowBandwidthMode(false),
+	_localAddressResolution(false)
 {
 	if (callbacks->version != 0) {
 		throw ZT_EXCEPTION_INVALID_ARGUMENT;
@@ -187,6 +195,10 @@ Node::~Node()
 		Mutex::Lock _l(_networks_m);
 		_networks.clear(); // destroy all networks before shutdown
 	}
+	{
+		Mutex::Lock _l(_peerTimers_m);
+		_peerTimers.clear(); // release peers before topology is torn down
+	}
 	if (RR->sa) {
 		RR->sa->~SelfAwareness();
 	}
@@ -271,7 +283,8 @@ void Node::initMultithreading(unsigned int concurrency, bool cpuPinningEnabled)
 	RR->pm->setUpPostDecodeReceiveThreads(concurrency, cpuPinningEnabled);
 }
 
-// Closure used to ping upstream and active/online peers
+// Closure used to ping upstreams and other peers we should always contact
+// (other active peers are pinged from their own timers)
 class _PingPeersThatNeedPing
 {
 public:
@@ -335,8 +348,6 @@ public:
 			}
 
 			_alwaysContact.erase(p->address()); // after this we'll WHOIS all upstreams that remain
-		} else if (p->isActive(_now)) {
-			p->doPingAndKeepalive(_tPtr,_now);
 		}
 	}
 
@@ -348,6 +359,18 @@ private:
 	const SharedPtr<Peer> _bestCurrentUpstream;
 };
 
+// Microseconds elapsed since a start time, for background task latency histograms
+static inline uint64_t _usSince(const std::chrono::steady_clock::time_point &start)
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Node::schedulePeerTimer(const int64_t deadline,const SharedPtr<Peer> &peer)
+{
+	Mutex::Lock _l(_peerTimers_m);
+	_peerTimers.schedule(deadline,peer);
+}
+
 ZT_ResultCode Node::processBackgroundTasks(void *tptr,int64_t now,volatile int64_t *nextBackgroundTaskDeadline)
 {
 	_now = now;
@@ -363,9 +386,61 @@ ZT_ResultCode Node::processBackgroundTasks(void *tptr,int64_t now,volatile int64
 		}
 	}
 
-	unsigned long timeUntilNextPingCheck = _lowBandwidthMode ? (ZT_PING_CHECK_INTERVAL * 5) : ZT_PING_CHECK_INTERVAL;
+	// Ping active peers whose timers are due. Each active peer re-arms its own
+	// timer, so this is proportional to the number due rather than the number
+	// of peers.
+	{
+		const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+		try {
+			std::vector< SharedPtr<Peer> > due;
+			{
+				Mutex::Lock _l(_peerTimers_m);
+				_peerTimers.advance(now,due);
+			}
+			if (!due.empty()) {
+				const int64_t nextPing = now + pingCheckInterval();
+				std::vector< SharedPtr<Peer> > rearm;
+				for(std::vector< SharedPtr<Peer> >::iterator p(due.begin());p!=due.end();++p) {
+					if ((*p)->isActive(now)) {
+						// Upstreams and other always-contact peers are handled by the ping check below
+						if (!std::binary_search(_alwaysContactAddresses.begin(),_alwaysContactAddresses.end(),(*p)->address())) {
+							(*p)->doPingAndKeepalive(tptr,now);
+						}
+						rearm.push_back(*p);
+					} else {
+						// Disarm, then re-check in case a frame arrived in between
+						(*p)->disarmPeerTimer();
+						if (((*p)->isActive(now))&&((*p)->armPeerTimer())) {
+							rearm.push_back(*p);
+						}
+					}
+				}
+				Mutex::Lock _l(_peerTimers_m);
+				for(std::vector< SharedPtr<Peer> >::iterator p(rearm.begin());p!=rearm.end();++p) {
+					_peerTimers.schedule(nextPing,*p);
+				}
+			}
+		} catch ( ... ) {
+			return ZT_RESULT_FATAL_ERROR_INTERNAL;
+		}
+		_peerTimersLatency.Observe(_usSince(start));
+	}
+
+	// Expire dead peers and unused paths whose timers are due
+	{
+		const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
+		try {
+			RR->topology->doPeriodicTasks(tptr,now);
+		} catch ( ... ) {
+			return ZT_RESULT_FATAL_ERROR_INTERNAL;
+		}
+		_topologyTimersLatency.Observe(_usSince(start));
+	}
+
+	unsigned long timeUntilNextPingCheck = (unsigned long)pingCheckInterval();
 	const int64_t timeSinceLastPingCheck = now - _lastPingCheck;
 	if (timeSinceLastPingCheck >= timeUntilNextPingCheck) {
+		const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
 		try {
 			_lastPingCheck = now;
 
@@ -416,7 +491,7 @@ ZT_ResultCode Node::processBackgroundTasks(void *tptr,int64_t now,volatile int64
 			std::vector< std::pair< SharedPtr<Network>,bool > > networkConfigNeeded;
 			{
 				Mutex::Lock l(_networks_m);
-				Hashtable< uint64_t,SharedPtr<Network> >::Iterator i(_networks);
+				FlatHashtable< uint64_t,SharedPtr<Network> >::Iterator i(_networks);
 				uint64_t *nwid = (uint64_t *)0;
 				SharedPtr<Network> *network = (SharedPtr<Network> *)0;
 				while (i.next(nwid,network)) {
@@ -425,9 +500,18 @@ ZT_ResultCode Node::processBackgroundTasks(void *tptr,int64_t now,volatile int64
 				}
 			}
 
-			// Ping active peers, upstreams, and others that we should always contact
-			_PingPeersThatNeedPing pfunc(RR,tptr,alwaysContact,now);
-			RR->topology->eachPeer<_PingPeersThatNeedPing &>(pfunc);
+			// Ping upstreams and others that we should always contact
+			{
+				_alwaysContactAddresses = alwaysContact.keys();
+				std::sort(_alwaysContactAddresses.begin(),_alwaysContactAddresses.end());
+				_PingPeersThatNeedPing pfunc(RR,tptr,alwaysContact,now);
+				for(std::vector<Address>::const_iterator a(_alwaysContactAddresses.begin());a!=_alwaysContactAddresses.end();++a) {
+					const SharedPtr<Peer> p(RR->topology->getPeerNoCache(*a));
+					if (p) {
+						pfunc(*RR->topology,p);
+					}
+				}
+			}
 
 			// Run security monitor maintenance
 			if (RR->sm) {
@@ -463,6 +547,7 @@ ZT_ResultCode Node::processBackgroundTasks(void *tptr,int64_t now,volatile int64
 		} catch ( ... ) {
 			return ZT_RESULT_FATAL_ERROR_INTERNAL;
 		}
+		_pingCheckLatency.Observe(_usSince(start));
 	} else {
 		timeUntilNextPingCheck -= (unsigned long)timeSinceLastPingCheck;
 	}
@@ -474,13 +559,14 @@ ZT_ResultCode Node::processBackgroundTasks(void *tptr,int64_t now,volatile int64
 
 	if ((now - _lastHousekeepingRun) >= ZT_HOUSEKEEPING_PERIOD) {
 		_lastHousekeepingRun = now;
+		const std::chrono::steady_clock::time_point start(std::chrono::steady_clock::now());
 		try {
-			RR->topology->doPeriodicTasks(tptr,now);
 			RR->sa->clean(now);
 			RR->mc->clean(now);
 		} catch ( ... ) {
 			return ZT_RESULT_FATAL_ERROR_INTERNAL;
 		}
+		_housekeepingLatency.Observe(_usSince(start));
 	}
 
 	try {
@@ -683,7 +769,7 @@ ZT_VirtualNetworkList *Node::networks() const
 	nl->networks = (ZT_VirtualNetworkConfig *)(buf + sizeof(ZT_VirtualNetworkList));
 
 	nl->networkCount = 0;
-	Hashtable< uint64_t,SharedPtr<Network> >::Iterator i(*const_cast< Hashtable< uint64_t,SharedPtr<Network> > *>(&_networks));
+	FlatHashtable< uint64_t,SharedPtr<Network> >::Iterator i(*const_cast< FlatHashtable< uint64_t,SharedPtr<Network> > *>(&_networks));
 	uint64_t *k = (uint64_t *)0;
 	SharedPtr<Network> *v = (SharedPtr<Network> *)0;
 	while (i.next(k,v)) {
@@ -741,6 +827,13 @@ void Node::setNetconfMaster(void *networkControllerInstance)
 	}
 }
 
+void Node::setPeerMetricsExport(const unsigned int topK,const std::vector<Address> &allow)
+{
+#ifndef ZT_NO_PEER_METRICS
+	RR->topology->peerMetrics().setExport(topK,allow);
+#endif
+}
+
 /****************************************************************************/
 /* Node methods used only within node/                                      */
 /****************************************************************************/
@@ -757,7 +850,7 @@ bool Node::shouldUsePathForZeroTierTraffic(void *tPtr,const Address &ztaddr,cons
 
 	{
 		Mutex::Lock _l(_networks_m);
-		Hashtable< uint64_t,SharedPtr<Network> >::Iterator i(_networks);
+		FlatHashtable< uint64_t,SharedPtr<Network> >::Iterator i(_networks);
 		uint64_t *k = (uint64_t *)0;
 		SharedPtr<Network> *v = (SharedPtr<Network> *)0;
 		while (i.next(k,v)) {
@@ -804,11 +897,11 @@ std::vector<World> Node::moons() const
 
 void Node::ncSendConfig(uint64_t nwid,uint64_t requestPacketId,const Address &destination,const NetworkConfig &nc,bool sendLegacyFormatConfig)
 {
-	_localControllerAuthorizations_m.lock();
-	_localControllerAuthorizations[_LocalControllerAuth(nwid,destination)] = now();
-	_localControllerAuthorizations_m.unlock();
-
 	if (destination == RR->identity.address()) {
+		_localControllerAuthorizations_m.lock();
+		_localControllerAuthorizations[_LocalControllerAuth(nwid,destination)] = now();
+		_localControllerAuthorizations_m.unlock();
+
 		SharedPtr<Network> n(network(nwid));
 		if (!n) {
 			return;
@@ -818,46 +911,75 @@ void Node::ncSendConfig(uint64_t nwid,uint64_t requestPacketId,const Address &de
 		Dictionary<ZT_NETWORKCONFIG_DICT_CAPACITY> *dconf = new Dictionary<ZT_NETWORKCONFIG_DICT_CAPACITY>();
 		try {
 			if (nc.toDictionary(*dconf,sendLegacyFormatConfig)) {
-				uint64_t configUpdateId = prng();
-				if (!configUpdateId) {
-					++configUpdateId;
-				}
-
-				const unsigned int totalSize = dconf->sizeBytes();
-				unsigned int chunkIndex = 0;
-				while (chunkIndex < totalSize) {
-					const unsigned int chunkLen = std::min(totalSize - chunkIndex,(unsigned int)(ZT_PROTO_MAX_PACKET_LENGTH - (ZT_PACKET_IDX_PAYLOAD + 256)));
-					Packet outp(destination,RR->identity.address(),(requestPacketId) ? Packet::VERB_OK : Packet::VERB_NETWORK_CONFIG);
-					if (requestPacketId) {
-						outp.append((unsigned char)Packet::VERB_NETWORK_CONFIG_REQUEST);
-						outp.append(requestPacketId);
-					}
-
-					const unsigned int sigStart = outp.size();
-					outp.append(nwid);
-					outp.append((uint16_t)chunkLen);
-					outp.append((const void *)(dconf->data() + chunkIndex),chunkLen);
-
-					outp.append((uint8_t)0); // no flags
-					outp.append((uint64_t)configUpdateId);
-					outp.append((uint32_t)totalSize);
-					outp.append((uint32_t)chunkIndex);
+				ncSendSerializedConfig(nwid,requestPacketId,destination,dconf->data(),dconf->sizeBytes());
+			}
+			delete dconf;
+		} catch ( ... ) {
+			delete dconf;
+			throw;
+		}
+	}
+}
 
-					C25519::Signature sig(RR->identity.sign(reinterpret_cast<const uint8_t *>(outp.data()) + sigStart,outp.size() - sigStart));
-					outp.append((uint8_t)1);
-					outp.append((uint16_t)ZT_C25519_SIGNATURE_LEN);
-					outp.append(sig.data,ZT_C25519_SIGNATURE_LEN);
+void Node::ncSendSerializedConfig(uint64_t nwid,uint64_t requestPacketId,const Address &destination,const void *dict,unsigned int dictSize)
+{
+	_localControllerAuthorizations_m.lock();
+	_localControllerAuthorizations[_LocalControllerAuth(nwid,destination)] = now();
+	_localControllerAuthorizations_m.unlock();
 
-					outp.compress();
-					RR->sw->send((void *)0,outp,true);
-					chunkIndex += chunkLen;
-				}
+	if (destination == RR->identity.address()) {
+		SharedPtr<Network> n(network(nwid));
+		if (!n) {
+			return;
+		}
+		Dictionary<ZT_NETWORKCONFIG_DICT_CAPACITY> *dconf = new Dictionary<ZT_NETWORKCONFIG_DICT_CAPACITY>(reinterpret_cast<const char *>(dict),dictSize);
+		NetworkConfig *nc = new NetworkConfig();
+		try {
+			if (nc->fromDictionary(*dconf)) {
+				n->setConfiguration((void *)0,*nc,true);
 			}
+			delete nc;
 			delete dconf;
 		} catch ( ... ) {
+			delete nc;
 			delete dconf;
 			throw;
 		}
+	} else {
+		uint64_t configUpdateId = prng();
+		if (!configUpdateId) {
+			++configUpdateId;
+		}
+
+		const unsigned int totalSize = dictSize;
+		unsigned int chunkIndex = 0;
+		while (chunkIndex < totalSize) {
+			const unsigned int chunkLen = std::min(totalSize - chunkIndex,(unsigned int)(ZT_PROTO_MAX_PACKET_LENGTH - (ZT_PACKET_IDX_PAYLOAD + 256)));
+			Packet outp(destination,RR->identity.address(),(requestPacketId) ? Packet::VERB_OK : Packet::VERB_NETWORK_CONFIG);
+			if (requestPacketId) {
+				outp.append((unsigned char)Packet::VERB_NETWORK_CONFIG_REQUEST);
+				outp.append(requestPacketId);
+			}
+
+			const unsigned int sigStart = outp.size();
+			outp.append(nwid);
+			outp.append((uint16_t)chunkLen);
+			outp.append(reinterpret_cast<const uint8_t *>(dict) + chunkIndex,chunkLen);
+
+			outp.append((uint8_t)0); // no flags
+			outp.append((uint64_t)configUpdateId);
+			outp.append((uint32_t)totalSize);
+			outp.append((uint32_t)chunkIndex);
+
+			C25519::Signature sig(RR->identity.sign(reinterpret_cast<const uint8_t *>(outp.data()) + sigStart,outp.size() - sigStart));
+			outp.append((uint8_t)1);
+			outp.append((uint16_t)ZT_C25519_SIGNATURE_LEN);
+			outp.append(sig.data,ZT_C25519_SIGNATURE_LEN);
+
+			outp.compress();
+			RR->sw->send((void *)0,outp,true);
+			chunkIndex += chunkLen;
+		}
 	}
 }
 
@@ -923,6 +1045,10 @@ void Node::ncSendError(uint64_t nwid,uint64_t requestPacketId,const Address &des
 				outp.append((unsigned char)Packet::ERROR_NETWORK_AUTHENTICATION_REQUIRED);
 				Metrics::pkt_error_authentication_required_out++;
 				break;
+			case NetworkController::NC_ERROR_BUSY:
+				outp.append((unsigned char)Packet::ERROR_CONTROLLER_BUSY);
+				Metrics::pkt_error_controller_busy_out++;
+				break;
 		}
 
 		outp.append(nwid);
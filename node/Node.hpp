@@ -34,8 +34,11 @@
 #include "Salsa20.hpp"
 #include "NetworkController.hpp"
 #include "Hashtable.hpp"
+#include "FlatHashtable.hpp"
+#include "TimerWheel.hpp"
 #include "Bond.hpp"
 #include "SelfAwareness.hpp"
+#include "Metrics.hpp"
 
 // Bit mask for "expecting reply" hash
 #define ZT_EXPECTING_REPLIES_BUCKET_MASK1 255
@@ -44,6 +47,7 @@
 namespace ZeroTier {
 
 class World;
+class Peer;
 
 /**
  * Implementation of Node object as defined in CAPI
@@ -156,7 +160,7 @@ public:
 	{
 		std::vector< SharedPtr<Network> > nw;
 		Mutex::Lock _l(_networks_m);
-		Hashtable< uint64_t,SharedPtr<Network> >::Iterator i(*const_cast< Hashtable< uint64_t,SharedPtr<Network> > * >(&_networks));
+		FlatHashtable< uint64_t,SharedPtr<Network> >::Iterator i(*const_cast< FlatHashtable< uint64_t,SharedPtr<Network> > * >(&_networks));
 		uint64_t *k = (uint64_t *)0;
 		SharedPtr<Network> *v = (SharedPtr<Network> *)0;
 		while (i.next(k,v)) {
@@ -252,6 +256,7 @@ public:
 	}
 
 	virtual void ncSendConfig(uint64_t nwid,uint64_t requestPacketId,const Address &destination,const NetworkConfig &nc,bool sendLegacyFormatConfig);
+	virtual void ncSendSerializedConfig(uint64_t nwid,uint64_t requestPacketId,const Address &destination,const void *dict,unsigned int dictSize);
 	virtual void ncSendRevocation(const Address &destination,const Revocation &rev);
 	virtual void ncSendError(uint64_t nwid,uint64_t requestPacketId,const Address &destination,NetworkController::ErrorCode errorCode, const void *errorData, unsigned int errorDataSize);
 
@@ -285,6 +290,53 @@ public:
 		return _lowBandwidthMode;
 	}
 
+	/**
+	 * Answer ARP and IPv6 neighbor solicitations from the tap locally
+	 *
+	 * When enabled, queries for IPs that a member holds a certificate of
+	 * ownership for are answered with that member's MAC instead of being
+	 * multicast to the network. Anything else is still multicast.
+	 */
+	inline void setLocalAddressResolution(bool isEnabled)
+	{
+		_localAddressResolution = isEnabled;
+	}
+
+	inline bool localAddressResolutionEnabled() const
+	{
+		return _localAddressResolution;
+	}
+
+	/**
+	 * Set which peers per-peer metrics are exported for
+	 *
+	 * Does nothing if built with ZT_NO_PEER_METRICS.
+	 *
+	 * @param topK Number of busiest peers to export
+	 * @param allow Peers to always export
+	 */
+	void setPeerMetricsExport(const unsigned int topK,const std::vector<Address> &allow);
+
+	/**
+	 * @return Interval at which active peers are pinged
+	 */
+	inline int64_t pingCheckInterval() const
+	{
+		return _lowBandwidthMode ? (ZT_PING_CHECK_INTERVAL * 5) : ZT_PING_CHECK_INTERVAL;
+	}
+
+	/**
+	 * Schedule a peer's next ping/keepalive check
+	 *
+	 * This is called by Peer when it becomes active and from the background
+	 * task loop to re-arm it. Peers are only pinged when their timer fires
+	 * rather than by scanning all peers every ping check interval.
+	 *
+	 * @param deadline Time of next check
+	 * @param peer Peer to check
+	 */
+	void schedulePeerTimer(const int64_t deadline,const SharedPtr<Peer> &peer);
+
 	void initMultithreading(unsigned int concurrency, bool cpuPinningEnabled);
 
 	/**
@@ -328,7 +380,7 @@ public:
 	Hashtable< _LocalControllerAuth,int64_t > _localControllerAuthorizations;
 	Mutex _localControllerAuthorizations_m;
 
-	Hashtable< uint64_t,SharedPtr<Network> > _networks;
+	FlatHashtable< uint64_t,SharedPtr<Network> > _networks;
 	Mutex _networks_m;
 
 	std::vector<InetAddress> _directPaths;
@@ -336,6 +388,17 @@ public:
 
 	Mutex _backgroundTasksLock;
 
+	TimerWheel< SharedPtr<Peer> > _peerTimers;
+	Mutex _peerTimers_m;
+
+	// Sorted addresses contacted by the ping check itself, guarded by _backgroundTasksLock
+	std::vector<Address> _alwaysContactAddresses;
+
+	prometheus::Histogram<uint64_t> &_peerTimersLatency;
+	prometheus::Histogram<uint64_t> &_topologyTimersLatency;
+	prometheus::Histogram<uint64_t> &_pingCheckLatency;
+	prometheus::Histogram<uint64_t> &_housekeepingLatency;
+
 	Address _remoteTraceTarget;
 	enum Trace::Level _remoteTraceLevel;
 
@@ -347,6 +410,7 @@ public:
 	volatile int64_t _prngState[2];
 	bool _online;
 	bool _lowBandwidthMode;
+	bool _localAddressResolution;
 };
 
 } // namespace ZeroTier
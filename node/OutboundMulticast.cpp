@@ -75,16 +75,15 @@ void OutboundMulticast::init(
 	memcpy(_frameData,payload,_frameLen);
 }
 
-void OutboundMulticast::sendOnly(const RuntimeEnvironment *RR,void *tPtr,const Address &toAddr)
+void OutboundMulticast::sendOnly(const RuntimeEnvironment *RR,void *tPtr,const SharedPtr<Network> &nw,const Address &toAddr)
 {
-	const SharedPtr<Network> nw(RR->node->network(_nwid));
 	uint8_t QoSBucket = 255; // Dummy value
 	if ((nw)&&(nw->filterOutgoingPacket(tPtr,true,RR->identity.address(),toAddr,_macSrc,_macDest,_frameData,_frameLen,_etherType,0,QoSBucket))) {
 		nw->pushCredentialsIfNeeded(tPtr,toAddr,RR->node->now());
 		_packet.newInitializationVector();
 		_packet.setDestination(toAddr);
 		RR->node->expectReplyTo(_packet.packetId());
-		_tmp = _packet;
+		_tmp.copyFrom(_packet.data(),_packet.size()); // not operator=, which copies the whole buffer
 		RR->sw->send(tPtr,_tmp,true);
 	}
 }
@@ -16,19 +16,19 @@
 
 #include <stdint.h>
 
-#include <vector>
-#include <algorithm>
-
 #include "Constants.hpp"
 #include "MAC.hpp"
 #include "MulticastGroup.hpp"
 #include "Address.hpp"
 #include "Packet.hpp"
+#include "FlatHashtable.hpp"
+#include "SharedPtr.hpp"
 
 namespace ZeroTier {
 
 class CertificateOfMembership;
 class RuntimeEnvironment;
+class Network;
 
 /**
  * An outbound multicast packet
@@ -43,7 +43,35 @@ public:
 	 *
 	 * It must be initialized with init().
 	 */
-	OutboundMulticast() {}
+	OutboundMulticast() :
+		_timestamp(0),
+		_nwid(0),
+		_limit(0),
+		_frameLen(0),
+		_etherType(0),
+		_alreadySentTo((FlatHashtable<uint64_t,bool> *)0) {}
+
+	OutboundMulticast(const OutboundMulticast &om) : _alreadySentTo((FlatHashtable<uint64_t,bool> *)0) { *this = om; }
+
+	~OutboundMulticast() { delete _alreadySentTo; }
+
+	inline OutboundMulticast &operator=(const OutboundMulticast &om)
+	{
+		if (this != &om) {
+			_timestamp = om._timestamp;
+			_nwid = om._nwid;
+			_macSrc = om._macSrc;
+			_macDest = om._macDest;
+			_limit = om._limit;
+			_frameLen = om._frameLen;
+			_etherType = om._etherType;
+			_packet = om._packet;
+			delete _alreadySentTo;
+			_alreadySentTo = (om._alreadySentTo) ? new FlatHashtable<uint64_t,bool>(*om._alreadySentTo) : (FlatHashtable<uint64_t,bool> *)0;
+			memcpy(_frameData,om._frameData,om._frameLen);
+		}
+		return *this;
+	}
 
 	/**
 	 * Initialize outbound multicast
@@ -88,28 +116,34 @@ public:
 	/**
 	 * @return True if this outbound multicast has been sent to enough peers
 	 */
-	inline bool atLimit() const { return (_alreadySentTo.size() >= _limit); }
+	inline bool atLimit() const { return (((_alreadySentTo) ? _alreadySentTo->size() : 0) >= _limit); }
 
 	/**
 	 * Just send without checking log
 	 *
+	 * The frame body is built once in init(); each recipient only gets a new
+	 * IV and destination on a copy of the used part of the packet before it
+	 * is armored.
+	 *
 	 * @param RR Runtime environment
 	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param nw Network this multicast belongs to (looked up once by the caller)
 	 * @param toAddr Destination address
 	 */
-	void sendOnly(const RuntimeEnvironment *RR,void *tPtr,const Address &toAddr);
+	void sendOnly(const RuntimeEnvironment *RR,void *tPtr,const SharedPtr<Network> &nw,const Address &toAddr);
 
 	/**
 	 * Just send and log but do not check sent log
 	 *
 	 * @param RR Runtime environment
 	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param nw Network this multicast belongs to
 	 * @param toAddr Destination address
 	 */
-	inline void sendAndLog(const RuntimeEnvironment *RR,void *tPtr,const Address &toAddr)
+	inline void sendAndLog(const RuntimeEnvironment *RR,void *tPtr,const SharedPtr<Network> &nw,const Address &toAddr)
 	{
-		_alreadySentTo.push_back(toAddr);
-		sendOnly(RR,tPtr,toAddr);
+		logAsSent(toAddr);
+		sendOnly(RR,tPtr,nw,toAddr);
 	}
 
 	/**
@@ -119,7 +153,10 @@ public:
 	 */
 	inline void logAsSent(const Address &toAddr)
 	{
-		_alreadySentTo.push_back(toAddr);
+		if (!_alreadySentTo) {
+			_alreadySentTo = new FlatHashtable<uint64_t,bool>((_limit < 512) ? (_limit * 2) : 1024); // grows if a larger limit is reached
+		}
+		_alreadySentTo->set(toAddr.toInt(),true);
 	}
 
 	/**
@@ -127,13 +164,14 @@ public:
 	 *
 	 * @param RR Runtime environment
 	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param nw Network this multicast belongs to
 	 * @param toAddr Destination address
 	 * @return True if address is new and packet was sent to switch, false if duplicate
 	 */
-	inline bool sendIfNew(const RuntimeEnvironment *RR,void *tPtr,const Address &toAddr)
+	inline bool sendIfNew(const RuntimeEnvironment *RR,void *tPtr,const SharedPtr<Network> &nw,const Address &toAddr)
 	{
-		if (std::find(_alreadySentTo.begin(),_alreadySentTo.end(),toAddr) == _alreadySentTo.end()) {
-			sendAndLog(RR,tPtr,toAddr);
+		if ((!_alreadySentTo)||(!_alreadySentTo->contains(toAddr.toInt()))) {
+			sendAndLog(RR,tPtr,nw,toAddr);
 			return true;
 		} else {
 			return false;
@@ -149,7 +187,7 @@ private:
 	unsigned int _frameLen;
 	unsigned int _etherType;
 	Packet _packet,_tmp;
-	std::vector<Address> _alreadySentTo;
+	FlatHashtable<uint64_t,bool> *_alreadySentTo; // set of addresses (value unused), allocated on first use and sized from _limit
 	uint8_t _frameData[ZT_MAX_MTU];
 };
 
@@ -1086,7 +1086,10 @@ public:
 		ERROR_UNWANTED_MULTICAST = 0x08,
 
     /* Network requires external or 2FA authentication (e.g. SSO). */
-    ERROR_NETWORK_AUTHENTICATION_REQUIRED = 0x09
+    ERROR_NETWORK_AUTHENTICATION_REQUIRED = 0x09,
+
+		/* Controller has too many config requests waiting, ask again later */
+		ERROR_CONTROLLER_BUSY = 0x0a
 	};
 
 	template<unsigned int C2>
@@ -41,6 +41,7 @@ Peer::Peer(const RuntimeEnvironment *renv,const Identity &myIdentity,const Ident
 	, _lastTrustEstablishedPacketReceived(0)
 	, _lastSentFullHello(0)
 	, _lastEchoCheck(0)
+	, _peerTimerArmed(false)
 	, _freeRandomByte((unsigned char)((uintptr_t)this >> 4) ^ ++s_freeRandomByteCounter)
 	, _vProto(0)
 	, _vMajor(0)
@@ -52,12 +53,10 @@ Peer::Peer(const RuntimeEnvironment *renv,const Identity &myIdentity,const Ident
 	, _localMultipathSupported(false)
 	, _lastComputedAggregateMeanLatency(0)
 #ifndef ZT_NO_PEER_METRICS
-	, _peer_latency{Metrics::peer_latency.Add({{"node_id", OSUtils::nodeIDStr(peerIdentity.address().toInt())}}, std::vector<uint64_t>{1,3,6,10,30,60,100,300,600,1000})}
-	, _alive_path_count{Metrics::peer_path_count.Add({{"node_id", OSUtils::nodeIDStr(peerIdentity.address().toInt())},{"status","alive"}})}
-	, _dead_path_count{Metrics::peer_path_count.Add({{"node_id", OSUtils::nodeIDStr(peerIdentity.address().toInt())},{"status","dead"}})}
-	, _incoming_packet{Metrics::peer_packets.Add({{"direction", "rx"},{"node_id", OSUtils::nodeIDStr(peerIdentity.address().toInt())}})}
-	, _outgoing_packet{Metrics::peer_packets.Add({{"direction", "tx"},{"node_id", OSUtils::nodeIDStr(peerIdentity.address().toInt())}})}
-	, _packet_errors{Metrics::peer_packet_errors.Add({{"node_id", OSUtils::nodeIDStr(peerIdentity.address().toInt())}})}
+	, _packetsIn(0)
+	, _packetsOut(0)
+	, _packetErrors(0)
+	, _latencySampleCount(0)
 #endif
 {
 	if (!myIdentity.agree(peerIdentity,_key)) {
@@ -95,12 +94,16 @@ void Peer::received(
 		case Packet::VERB_NETWORK_CONFIG:
 		case Packet::VERB_MULTICAST_FRAME:
 			_lastNontrivialReceive = now;
+			// Active peers get pinged from a timer in Node, armed on first activity
+			if ((!_peerTimerArmed.load(std::memory_order_relaxed))&&(armPeerTimer())) {
+				RR->node->schedulePeerTimer(now + RR->node->pingCheckInterval(),SharedPtr<Peer>(this));
+			}
 			break;
 		default:
 			break;
 	}
 #ifndef ZT_NO_PEER_METRICS
-	_incoming_packet++;
+	_packetsIn.fetch_add(1,std::memory_order_relaxed);
 #endif
 	recordIncomingPacket(path, packetId, payloadLength, verb, flowId, now);
 
@@ -606,25 +609,7 @@ unsigned int Peer::doPingAndKeepalive(void *tPtr,int64_t now)
 				deletionOccurred = false;
 			}
 		}
-#ifndef ZT_NO_PEER_METRICS
-		uint16_t alive_path_count_tmp = 0, dead_path_count_tmp = 0;
-		for(unsigned int i=0;i<ZT_MAX_PEER_NETWORK_PATHS;++i) {
-			if (_paths[i].p) {
-				if (_paths[i].p->alive(now)) {
-					alive_path_count_tmp++;
-				}
-				else {
-					dead_path_count_tmp++;
-				}
-			}
-		}
-		_alive_path_count = alive_path_count_tmp;
-		_dead_path_count = dead_path_count_tmp;
-#endif
 	}
-#ifndef ZT_NO_PEER_METRICS
-	_peer_latency.Observe(latency(now));
-#endif
 	return sent;
 }
 
@@ -700,7 +685,7 @@ void Peer::recordOutgoingPacket(const SharedPtr<Path> &path, const uint64_t pack
 	uint16_t payloadLength, const Packet::Verb verb, const int32_t flowId, int64_t now)
 {
 #ifndef ZT_NO_PEER_METRICS
-	_outgoing_packet++;
+	_packetsOut.fetch_add(1,std::memory_order_relaxed);
 #endif
 	if (_localMultipathSupported && _bond) { // TODO - what is multipath support? when is it useful? Is it like onecast?
 		_bond->recordOutgoingPacket(path, packetId, payloadLength, verb, flowId, now);
@@ -717,7 +702,7 @@ void Peer::recordOutgoingPacket(const SharedPtr<Path> &path, const uint64_t pack
 void Peer::recordIncomingInvalidPacket(const SharedPtr<Path>& path)
 {
 #ifndef ZT_NO_PEER_METRICS
-	_packet_errors++;
+	_packetErrors.fetch_add(1,std::memory_order_relaxed);
 #endif
 	if (_localMultipathSupported && _bond) {
 		_bond->recordIncomingInvalidPacket(path);
@@ -308,8 +308,87 @@ public:
 	 */
 	inline int64_t isActive(int64_t now) const { return ((now - _lastNontrivialReceive) < ZT_PEER_ACTIVITY_TIMEOUT); }
 
+	/**
+	 * Mark this peer's ping timer as pending in Node
+	 *
+	 * @return True if it was not already armed (caller must schedule it)
+	 */
+	inline bool armPeerTimer() { return !_peerTimerArmed.exchange(true); }
+
+	/**
+	 * Mark this peer's ping timer as no longer pending
+	 */
+	inline void disarmPeerTimer() { _peerTimerArmed.store(false); }
+
 	inline int64_t lastSentFullHello() { return _lastSentFullHello; }
 
+#ifndef ZT_NO_PEER_METRICS
+	/**
+	 * @return Packets received from this peer
+	 */
+	inline uint64_t packetsIn() const { return _packetsIn.load(std::memory_order_relaxed); }
+
+	/**
+	 * @return Packets sent to this peer
+	 */
+	inline uint64_t packetsOut() const { return _packetsOut.load(std::memory_order_relaxed); }
+
+	/**
+	 * @return Invalid packets received from this peer
+	 */
+	inline uint64_t packetErrors() const { return _packetErrors.load(std::memory_order_relaxed); }
+
+	/**
+	 * Keep a measured latency sample for PeerMetrics
+	 *
+	 * @param l Latency in milliseconds
+	 */
+	inline void recordLatencySample(const unsigned int l)
+	{
+		Mutex::Lock _l(_latencySamples_m);
+		_latencySamples[_latencySampleCount++ % ZT_PEER_METRICS_LATENCY_SAMPLES] = l;
+	}
+
+	/**
+	 * Take the latency samples kept since the last call
+	 *
+	 * @param samples Buffer for at least ZT_PEER_METRICS_LATENCY_SAMPLES samples
+	 * @return Number of samples, the most recent if more were recorded
+	 */
+	inline unsigned int takeLatencySamples(unsigned int *const samples)
+	{
+		Mutex::Lock _l(_latencySamples_m);
+		const unsigned int n = std::min(_latencySampleCount,(unsigned int)ZT_PEER_METRICS_LATENCY_SAMPLES);
+		for(unsigned int i=0;i<n;++i)
+			samples[i] = _latencySamples[(_latencySampleCount - n + i) % ZT_PEER_METRICS_LATENCY_SAMPLES];
+		_latencySampleCount = 0;
+		return n;
+	}
+#endif
+
+	/**
+	 * Count paths by whether they are alive
+	 *
+	 * @param now Current time
+	 * @param alive Set to number of alive paths
+	 * @param dead Set to number of dead paths
+	 */
+	inline void pathCounts(const int64_t now,unsigned int &alive,unsigned int &dead)
+	{
+		alive = 0;
+		dead = 0;
+		Mutex::Lock _l(_paths_m);
+		for(unsigned int i=0;i<ZT_MAX_PEER_NETWORK_PATHS;++i) {
+			if (_paths[i].p) {
+				if (_paths[i].p->alive(now)) {
+					++alive;
+				} else {
+					++dead;
+				}
+			}
+		}
+	}
+
 	/**
 	 * @return Latency in milliseconds of best/aggregate path or 0xffff if unknown / no paths
 	 */
@@ -647,6 +726,8 @@ private:
 	int64_t _lastSentFullHello;
 	int64_t _lastEchoCheck;
 
+	std::atomic<bool> _peerTimerArmed; // true while a ping timer for this peer is pending in Node
+
 	unsigned char _freeRandomByte;
 
 	uint16_t _vProto;
@@ -679,12 +760,13 @@ private:
 	SharedPtr<Bond> _bond;
 
 #ifndef ZT_NO_PEER_METRICS
-	prometheus::Histogram<uint64_t> &_peer_latency;
-	prometheus::simpleapi::gauge_metric_t _alive_path_count;
-	prometheus::simpleapi::gauge_metric_t _dead_path_count;
-	prometheus::simpleapi::counter_metric_t _incoming_packet;
-	prometheus::simpleapi::counter_metric_t _outgoing_packet;
-	prometheus::simpleapi::counter_metric_t _packet_errors;
+	// Exported (for some peers) by PeerMetrics
+	std::atomic<uint64_t> _packetsIn;
+	std::atomic<uint64_t> _packetsOut;
+	std::atomic<uint64_t> _packetErrors;
+	unsigned int _latencySamples[ZT_PEER_METRICS_LATENCY_SAMPLES];
+	unsigned int _latencySampleCount;
+	Mutex _latencySamples_m;
 #endif
 };
 
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#include "PeerMetrics.hpp"
+
+#ifndef ZT_NO_PEER_METRICS
+
+#include "Peer.hpp"
+#include "../osdep/OSUtils.hpp"
+
+#include <algorithm>
+
+namespace ZeroTier {
+
+PeerMetrics::PeerMetrics() :
+	_topK(ZT_PEER_METRICS_DEFAULT_TOP_K),
+	_generation(0)
+{
+}
+
+PeerMetrics::~PeerMetrics()
+{
+	Mutex::Lock _l(_lock);
+	uint64_t *a = (uint64_t *)0;
+	_Series *s = (_Series *)0;
+	Hashtable< uint64_t,_Series >::Iterator i(_series);
+	while (i.next(a,s)) {
+		_removeSeries(*s);
+	}
+}
+
+void PeerMetrics::setExport(const unsigned int topK,const std::vector<Address> &allow)
+{
+	Mutex::Lock _l(_lock);
+	_topK = topK;
+	_allow.clear();
+	for(std::vector<Address>::const_iterator a(allow.begin());a!=allow.end();++a) {
+		_allow.push_back(a->toInt());
+	}
+	std::sort(_allow.begin(),_allow.end());
+}
+
+void PeerMetrics::refresh(const int64_t now,const std::vector< std::pair< Address,SharedPtr<Peer> > > &peers)
+{
+	Mutex::Lock _l(_lock);
+	const uint64_t gen = ++_generation;
+
+	// Rank by packets moved since the last refresh so the export follows
+	// current heavy hitters rather than whoever has been up the longest
+	std::vector< std::pair< uint64_t,const SharedPtr<Peer> * > > ranked;
+	ranked.reserve(peers.size());
+	Hashtable< uint64_t,uint64_t > baseline;
+	for(std::vector< std::pair< Address,SharedPtr<Peer> > >::const_iterator p(peers.begin());p!=peers.end();++p) {
+		const uint64_t a = p->first.toInt();
+		const uint64_t total = p->second->packetsIn() + p->second->packetsOut();
+		const uint64_t *const last = _baseline.get(a);
+		baseline.set(a,total);
+		if (std::binary_search(_allow.begin(),_allow.end(),a)) {
+			_update(now,p->second);
+			_series[a].generation = gen;
+		} else {
+			ranked.push_back(std::pair< uint64_t,const SharedPtr<Peer> * >(((last)&&(*last <= total)) ? (total - *last) : total,&(p->second)));
+		}
+	}
+	_baseline = baseline;
+
+	if (ranked.size() > _topK) {
+		std::nth_element(ranked.begin(),ranked.begin() + _topK,ranked.end(),[](const std::pair< uint64_t,const SharedPtr<Peer> * > &a,const std::pair< uint64_t,const SharedPtr<Peer> * > &b) {
+			return (a.first > b.first);
+		});
+		ranked.resize(_topK);
+	}
+	for(std::vector< std::pair< uint64_t,const SharedPtr<Peer> * > >::const_iterator p(ranked.begin());p!=ranked.end();++p) {
+		_update(now,*(p->second));
+		_series[(*(p->second))->address().toInt()].generation = gen;
+	}
+
+	// Anything not touched this round fell out of the top-K or went away
+	std::vector<uint64_t> stale;
+	uint64_t *a = (uint64_t *)0;
+	_Series *s = (_Series *)0;
+	Hashtable< uint64_t,_Series >::Iterator i(_series);
+	while (i.next(a,s)) {
+		if (s->generation != gen) {
+			_removeSeries(*s);
+			stale.push_back(*a);
+		}
+	}
+	for(std::vector<uint64_t>::const_iterator k(stale.begin());k!=stale.end();++k) {
+		_series.erase(*k);
+	}
+}
+
+void PeerMetrics::remove(const Address &a)
+{
+	Mutex::Lock _l(_lock);
+	_Series *const s = _series.get(a.toInt());
+	if (s) {
+		_removeSeries(*s);
+		_series.erase(a.toInt());
+	}
+	_baseline.erase(a.toInt());
+}
+
+unsigned long PeerMetrics::exported() const
+{
+	Mutex::Lock _l(_lock);
+	return _series.size();
+}
+
+void PeerMetrics::_update(const int64_t now,const SharedPtr<Peer> &p)
+{
+	_Series &s = _series[p->address().toInt()];
+	if (!s.rx) {
+		const std::string id(OSUtils::nodeIDStr(p->address().toInt()));
+		s.latency = &(Metrics::peer_latency.Add({{"node_id",id}},std::vector<uint64_t>{1,3,6,10,30,60,100,300,600,1000}));
+		s.alive = &(Metrics::peer_path_count.Add({{"node_id",id},{"status","alive"}}));
+		s.dead = &(Metrics::peer_path_count.Add({{"node_id",id},{"status","dead"}}));
+		s.rx = &(Metrics::peer_packets.Add({{"direction","rx"},{"node_id",id}}));
+		s.tx = &(Metrics::peer_packets.Add({{"direction","tx"},{"node_id",id}}));
+		s.errors = &(Metrics::peer_packet_errors.Add({{"node_id",id}}));
+	}
+
+	const uint64_t rx = p->packetsIn();
+	const uint64_t tx = p->packetsOut();
+	const uint64_t errors = p->packetErrors();
+	if (rx > s.rxExported) {
+		s.rx->Increment(rx - s.rxExported);
+		s.rxExported = rx;
+	}
+	if (tx > s.txExported) {
+		s.tx->Increment(tx - s.txExported);
+		s.txExported = tx;
+	}
+	if (errors > s.errorsExported) {
+		s.errors->Increment(errors - s.errorsExported);
+		s.errorsExported = errors;
+	}
+
+	unsigned int alive = 0,dead = 0;
+	p->pathCounts(now,alive,dead);
+	s.alive->Set((int64_t)alive);
+	s.dead->Set((int64_t)dead);
+
+	unsigned int samples[ZT_PEER_METRICS_LATENCY_SAMPLES];
+	const unsigned int n = p->takeLatencySamples(samples);
+	for(unsigned int i=0;i<n;++i)
+		s.latency->Observe(samples[i]);
+}
+
+void PeerMetrics::_removeSeries(_Series &s)
+{
+	if (s.rx) {
+		Metrics::peer_latency.Remove(s.latency);
+		Metrics::peer_path_count.Remove(s.alive);
+		Metrics::peer_path_count.Remove(s.dead);
+		Metrics::peer_packets.Remove(s.rx);
+		Metrics::peer_packets.Remove(s.tx);
+		Metrics::peer_packet_errors.Remove(s.errors);
+		s = _Series();
+	}
+}
+
+} // namespace ZeroTier
+
+#endif // ZT_NO_PEER_METRICS
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_PEERMETRICS_HPP
+#define ZT_PEERMETRICS_HPP
+
+#include "Constants.hpp"
+
+#ifndef ZT_NO_PEER_METRICS
+
+#include "Address.hpp"
+#include "SharedPtr.hpp"
+#include "Hashtable.hpp"
+#include "Mutex.hpp"
+#include "Metrics.hpp"
+
+#include <stdint.h>
+
+#include <vector>
+#include <utility>
+
+namespace ZeroTier {
+
+class Peer;
+
+/**
+ * Exports per-peer Prometheus series for a bounded set of peers
+ *
+ * Peers count their own traffic in plain atomics. Every refresh this picks
+ * the peers that moved the most packets since the last refresh, plus any
+ * allow-listed peers, and creates, updates, or removes labeled series so
+ * only those are exported. Counters are cumulative, so a peer that drops
+ * out of the top-K and comes back later resumes at its real total. The
+ * latency histogram gets each latency sample the peer measured since the
+ * last refresh.
+ *
+ * Roots and moons can see hundreds of thousands of peers and per-peer
+ * series are never aggregated, so exporting all of them makes memory and
+ * scrape time grow without bound.
+ */
+class PeerMetrics
+{
+public:
+	PeerMetrics();
+	~PeerMetrics();
+
+	/**
+	 * Set which peers are exported
+	 *
+	 * Takes effect at the next refresh.
+	 *
+	 * @param topK Maximum number of peers (not counting the allow-list) to export
+	 * @param allow Peers to always export if present
+	 */
+	void setExport(const unsigned int topK,const std::vector<Address> &allow);
+
+	/**
+	 * Rank peers and update exported series
+	 *
+	 * @param now Current time
+	 * @param peers All current peers
+	 */
+	void refresh(const int64_t now,const std::vector< std::pair< Address,SharedPtr<Peer> > > &peers);
+
+	/**
+	 * Remove any exported series for a peer that is going away
+	 *
+	 * @param a Peer address
+	 */
+	void remove(const Address &a);
+
+	/**
+	 * @return Number of peers currently exported
+	 */
+	unsigned long exported() const;
+
+private:
+	struct _Series
+	{
+		_Series() : latency((prometheus::Histogram<uint64_t> *)0),alive((prometheus::Gauge<int64_t> *)0),dead((prometheus::Gauge<int64_t> *)0),rx((prometheus::Counter<uint64_t> *)0),tx((prometheus::Counter<uint64_t> *)0),errors((prometheus::Counter<uint64_t> *)0),rxExported(0),txExported(0),errorsExported(0),generation(0) {}
+		prometheus::Histogram<uint64_t> *latency;
+		prometheus::Gauge<int64_t> *alive;
+		prometheus::Gauge<int64_t> *dead;
+		prometheus::Counter<uint64_t> *rx;
+		prometheus::Counter<uint64_t> *tx;
+		prometheus::Counter<uint64_t> *errors;
+		uint64_t rxExported;
+		uint64_t txExported;
+		uint64_t errorsExported;
+		uint64_t generation;
+	};
+
+	void _update(const int64_t now,const SharedPtr<Peer> &p);
+	void _removeSeries(_Series &s);
+
+	unsigned int _topK;
+	std::vector<uint64_t> _allow; // sorted
+	Hashtable< uint64_t,_Series > _series;
+	Hashtable< uint64_t,uint64_t > _baseline; // packets in + out at last refresh
+	uint64_t _generation;
+	Mutex _lock;
+};
+
+} // namespace ZeroTier
+
+#endif // ZT_NO_PEER_METRICS
+
+#endif
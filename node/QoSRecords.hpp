@@ -0,0 +1,315 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_QOSRECORDS_HPP
+#define ZT_QOSRECORDS_HPP
+
+#include <stdint.h>
+#include <math.h>
+
+#include "Constants.hpp"
+
+// Log2 of slots in a table of sent QoS records, kept at most half full by ZT_QOS_MAX_PENDING_RECORDS
+#define ZT_QOS_PENDING_TABLE_BITS 10
+
+// Slots in a table of sent QoS records
+#define ZT_QOS_PENDING_TABLE_SIZE (1 << ZT_QOS_PENDING_TABLE_BITS)
+
+namespace ZeroTier {
+
+/**
+ * FIFO of received QoS records (packet ID and arrival time) waiting to be
+ * reported back to the sender in a VERB_QOS_MEASUREMENT
+ *
+ * Holds at most ZT_QOS_MAX_PENDING_RECORDS. Records arrive in time order so
+ * the oldest are always at the head, which is where both reporting and
+ * expiration take them from. Storage is allocated on first use since most
+ * paths never carry bonded traffic.
+ */
+class QoSRecordQueue
+{
+public:
+	QoSRecordQueue() : _r((_Record *)0),_head(0),_count(0) {}
+	QoSRecordQueue(const QoSRecordQueue &q) : _r((_Record *)0),_head(0),_count(0) { *this = q; }
+	~QoSRecordQueue() { delete [] _r; }
+
+	inline QoSRecordQueue &operator=(const QoSRecordQueue &q)
+	{
+		if (this != &q) {
+			_head = 0;
+			_count = 0;
+			for(unsigned int i=0;i<q._count;++i) {
+				const _Record &r = q._r[(q._head + i) % ZT_QOS_MAX_PENDING_RECORDS];
+				push(r.id,r.ts);
+			}
+		}
+		return *this;
+	}
+
+	/**
+	 * @param id Packet ID
+	 * @param ts Time packet was received
+	 * @return False if queue is full and record was dropped
+	 */
+	inline bool push(const uint64_t id,const int64_t ts)
+	{
+		if (_count >= ZT_QOS_MAX_PENDING_RECORDS) {
+			return false;
+		}
+		if (!_r) {
+			_r = new _Record[ZT_QOS_MAX_PENDING_RECORDS];
+		}
+		_Record &r = _r[(_head + _count) % ZT_QOS_MAX_PENDING_RECORDS];
+		r.id = id;
+		r.ts = ts;
+		++_count;
+		return true;
+	}
+
+	/**
+	 * @param id Set to oldest record's packet ID
+	 * @param ts Set to oldest record's receive time
+	 * @return False if queue is empty
+	 */
+	inline bool pop(uint64_t &id,int64_t &ts)
+	{
+		if (!_count) {
+			return false;
+		}
+		id = _r[_head].id;
+		ts = _r[_head].ts;
+		_head = (_head + 1) % ZT_QOS_MAX_PENDING_RECORDS;
+		--_count;
+		return true;
+	}
+
+	/**
+	 * Drop records received timeout or more ago
+	 *
+	 * @return Number of records dropped
+	 */
+	inline unsigned int expire(const int64_t now,const int64_t timeout)
+	{
+		unsigned int n = 0;
+		while ((_count)&&((now - _r[_head].ts) >= timeout)) {
+			_head = (_head + 1) % ZT_QOS_MAX_PENDING_RECORDS;
+			--_count;
+			++n;
+		}
+		return n;
+	}
+
+	inline unsigned int size() const { return _count; }
+
+private:
+	struct _Record
+	{
+		uint64_t id;
+		int64_t ts;
+	};
+
+	_Record *_r;
+	unsigned int _head;
+	unsigned int _count;
+};
+
+/**
+ * Table of sent QoS records (packet ID to send time) awaiting a report
+ *
+ * Open addressed with linear probing and backward shift deletion, so records
+ * can be looked up and removed as reports come in without tombstones and
+ * without allocating per record. Holds at most ZT_QOS_MAX_PENDING_RECORDS
+ * in ZT_QOS_PENDING_TABLE_SIZE slots. Storage is allocated on first use.
+ */
+class QoSPendingTable
+{
+public:
+	QoSPendingTable() : _r((_Record *)0),_count(0) {}
+	QoSPendingTable(const QoSPendingTable &t) : _r((_Record *)0),_count(0) { *this = t; }
+	~QoSPendingTable() { delete [] _r; }
+
+	inline QoSPendingTable &operator=(const QoSPendingTable &t)
+	{
+		if (this != &t) {
+			if (t._count) {
+				_alloc();
+				for(unsigned int i=0;i<ZT_QOS_PENDING_TABLE_SIZE;++i) {
+					_r[i] = t._r[i];
+				}
+			} else if (_r) {
+				for(unsigned int i=0;i<ZT_QOS_PENDING_TABLE_SIZE;++i) {
+					_r[i].ts = 0;
+				}
+			}
+			_count = t._count;
+		}
+		return *this;
+	}
+
+	/**
+	 * @param id Packet ID
+	 * @param ts Time packet was sent (nonzero)
+	 * @return False if table is full and record was dropped
+	 */
+	inline bool set(const uint64_t id,const int64_t ts)
+	{
+		_alloc();
+		unsigned int i = _slot(id);
+		while (_r[i].ts) {
+			if (_r[i].id == id) {
+				_r[i].ts = ts;
+				return true;
+			}
+			i = (i + 1) & (ZT_QOS_PENDING_TABLE_SIZE - 1);
+		}
+		if (_count >= ZT_QOS_MAX_PENDING_RECORDS) {
+			return false;
+		}
+		_r[i].id = id;
+		_r[i].ts = ts;
+		++_count;
+		return true;
+	}
+
+	/**
+	 * Look up and remove a record
+	 *
+	 * @param id Packet ID
+	 * @param ts Set to time packet was sent if found
+	 * @return True if found
+	 */
+	inline bool take(const uint64_t id,int64_t &ts)
+	{
+		if (!_count) {
+			return false;
+		}
+		unsigned int i = _slot(id);
+		while (_r[i].ts) {
+			if (_r[i].id == id) {
+				ts = _r[i].ts;
+				_erase(i);
+				return true;
+			}
+			i = (i + 1) & (ZT_QOS_PENDING_TABLE_SIZE - 1);
+		}
+		return false;
+	}
+
+	/**
+	 * Drop records sent timeout or more ago
+	 *
+	 * @return Number of records dropped
+	 */
+	inline unsigned int expire(const int64_t now,const int64_t timeout)
+	{
+		unsigned int n = 0;
+		if (_count) {
+			// Erasing shifts a later record into slot i, so look at i again
+			for(unsigned int i=0;i<ZT_QOS_PENDING_TABLE_SIZE;) {
+				if ((_r[i].ts)&&((now - _r[i].ts) >= timeout)) {
+					_erase(i);
+					++n;
+				} else {
+					++i;
+				}
+			}
+		}
+		return n;
+	}
+
+	inline unsigned int size() const { return _count; }
+
+private:
+	struct _Record
+	{
+		uint64_t id;
+		int64_t ts; // 0 if slot is empty
+	};
+
+	// Packet IDs are sequential, so mix before taking the high bits
+	static inline unsigned int _slot(const uint64_t id) { return (unsigned int)((id * 0x9e3779b97f4a7c15ULL) >> (64 - ZT_QOS_PENDING_TABLE_BITS)) & (ZT_QOS_PENDING_TABLE_SIZE - 1); }
+
+	inline void _alloc()
+	{
+		if (!_r) {
+			_r = new _Record[ZT_QOS_PENDING_TABLE_SIZE];
+			for(unsigned int i=0;i<ZT_QOS_PENDING_TABLE_SIZE;++i) {
+				_r[i].ts = 0;
+			}
+		}
+	}
+
+	inline void _erase(unsigned int i)
+	{
+		unsigned int j = i;
+		for(;;) {
+			j = (j + 1) & (ZT_QOS_PENDING_TABLE_SIZE - 1);
+			if (!_r[j].ts) {
+				break;
+			}
+			// A record can fill the hole unless its home slot lies cyclically in (i,j]
+			const unsigned int k = _slot(_r[j].id);
+			if ((i <= j) ? ((i < k)&&(k <= j)) : ((i < k)||(k <= j))) {
+				continue;
+			}
+			_r[i] = _r[j];
+			i = j;
+		}
+		_r[i].ts = 0;
+		--_count;
+	}
+
+	_Record *_r;
+	unsigned int _count;
+};
+
+/**
+ * Exponentially weighted moving mean and standard deviation
+ *
+ * Updated per sample in O(1) instead of rescanning a window. The weight is
+ * chosen so recent samples count about as much as they did in a window of
+ * ZT_QOS_SHORTTERM_SAMPLE_WIN_SIZE samples.
+ */
+class QoSEstimator
+{
+public:
+	QoSEstimator() : _mean(0.0f),_var(0.0f),_count(0) {}
+
+	inline void update(const float x)
+	{
+		if (!_count) {
+			_mean = x;
+			_var = 0.0f;
+		} else {
+			const float alpha = 2.0f / (float)(ZT_QOS_SHORTTERM_SAMPLE_WIN_SIZE + 1);
+			const float d = x - _mean;
+			const float inc = alpha * d;
+			_mean += inc;
+			_var = (1.0f - alpha) * (_var + (d * inc));
+		}
+		++_count;
+	}
+
+	inline float mean() const { return _mean; }
+	inline float stddev() const { return sqrtf(_var); }
+	inline uint64_t count() const { return _count; }
+
+private:
+	float _mean;
+	float _var;
+	uint64_t _count;
+};
+
+} // namespace ZeroTier
+
+#endif
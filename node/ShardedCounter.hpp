@@ -0,0 +1,136 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_SHARDEDCOUNTER_HPP
+#define ZT_SHARDEDCOUNTER_HPP
+
+#include <prometheus/simpleapi.h>
+
+#include <stdint.h>
+
+#include <atomic>
+
+// Number of shards per counter (power of two)
+#ifndef ZT_SHARDED_COUNTER_SHARDS
+#define ZT_SHARDED_COUNTER_SHARDS 16
+#endif
+
+namespace ZeroTier {
+
+/**
+ * Prometheus counter split into per-thread cache line sized shards
+ *
+ * A plain prometheus::Counter is one atomic that every thread incrementing
+ * it writes, so on a busy multi-threaded node each increment pulls the
+ * cache line away from whichever core touched it last. Here each thread is
+ * assigned a shard the first time it increments any ShardedCounter and
+ * only ever writes that shard. Shards are summed when the registry is
+ * scraped, which is rare compared to increments.
+ *
+ * With more threads than shards some threads share a shard. That's still
+ * correct since shards are atomic, just not contention free.
+ */
+class ShardedCounter : public prometheus::Metric
+{
+public:
+	typedef uint64_t Value;
+	typedef prometheus::CustomFamily<ShardedCounter> Family;
+
+	static const prometheus::Metric::Type static_type = prometheus::Metric::Type::Counter;
+
+	ShardedCounter() :
+		prometheus::Metric(prometheus::Metric::Type::Counter)
+	{
+		for(unsigned int i=0;i<ZT_SHARDED_COUNTER_SHARDS;++i) {
+			_s[i].v.store(0,std::memory_order_relaxed);
+		}
+	}
+
+	inline void Increment() { _s[_shard()].v.fetch_add(1,std::memory_order_relaxed); }
+	inline void Increment(const Value n) { _s[_shard()].v.fetch_add(n,std::memory_order_relaxed); }
+
+	/**
+	 * @return Sum of all shards
+	 */
+	inline Value Get() const
+	{
+		Value t = 0;
+		for(unsigned int i=0;i<ZT_SHARDED_COUNTER_SHARDS;++i) {
+			t += _s[i].v.load(std::memory_order_relaxed);
+		}
+		return t;
+	}
+
+	virtual prometheus::ClientMetric Collect() const
+	{
+		prometheus::ClientMetric m;
+		m.counter.value = static_cast<double>(Get());
+		return m;
+	}
+
+private:
+	struct alignas(64) _Shard
+	{
+		std::atomic<Value> v;
+	};
+
+	// Threads get shards round-robin in the order they first count something
+	static inline unsigned int _shard()
+	{
+		static std::atomic<unsigned int> next(0);
+		static thread_local const unsigned int s = next.fetch_add(1,std::memory_order_relaxed) & (ZT_SHARDED_COUNTER_SHARDS - 1);
+		return s;
+	}
+
+	_Shard _s[ZT_SHARDED_COUNTER_SHARDS];
+};
+
+namespace Metrics {
+
+/**
+ * Drop-in replacement for prometheus::simpleapi::counter_metric_t backed by a ShardedCounter
+ */
+class sharded_counter_metric_t
+{
+public:
+	typedef ShardedCounter Metric;
+	typedef ShardedCounter::Family Family;
+
+	// fake empty metric
+	sharded_counter_metric_t() : _family((Family *)0),_metric((Metric *)0) {}
+
+	sharded_counter_metric_t(const std::string &name,const std::string &description) :
+		_family(&Family::Build(prometheus::simpleapi::registry,name,description)),
+		_metric(&_family->Add({})) {}
+
+	inline void operator++() { _metric->Increment(); }
+	inline void operator++(int) { _metric->Increment(); }
+	inline void operator+=(const Metric::Value n) { _metric->Increment(n); }
+
+	inline uint64_t value() const { return _metric->Get(); }
+
+private:
+	friend class prometheus::simpleapi::family_wrapper_t<sharded_counter_metric_t>;
+	sharded_counter_metric_t(Family *family,Metric &metric) : _family(family),_metric(&metric) {}
+
+	Family *_family;
+	Metric *_metric;
+};
+
+typedef prometheus::simpleapi::family_wrapper_t<sharded_counter_metric_t> sharded_counter_family_t;
+
+} // namespace Metrics
+
+} // namespace ZeroTier
+
+#endif
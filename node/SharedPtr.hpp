@@ -109,7 +109,7 @@ public:
 	/**
 	 * @return Number of references according to this object's ref count or 0 if NULL
 	 */
-	inline int references()
+	inline int references() const
 	{
 		if (_ptr) {
 			return _ptr->__refCount.load();
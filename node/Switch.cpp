@@ -74,13 +74,92 @@ static bool _ipv6GetPayload(const uint8_t *frameData,unsigned int frameLen,unsig
 	return false; // overflow == invalid
 }
 
+void Switch::forgeArpReply(uint8_t reply[28],const uint8_t *query,const MAC &mac)
+{
+	memcpy(reply,query,8); // hardware/protocol types and lengths
+	reply[6] = 0x00;
+	reply[7] = 0x02; // reply
+	mac.copyTo(reply + 8,6); // sender hardware address
+	memcpy(reply + 14,query + 24,4); // sender protocol address is the IP that was asked about
+	memcpy(reply + 18,query + 8,10); // target is whoever asked
+}
+
+void Switch::forgeNeighborAdvertisement(uint8_t adv[72],const uint8_t *target,const uint8_t *dest,const MAC &mac)
+{
+	adv[0] = 0x60;
+	adv[1] = 0x00;
+	adv[2] = 0x00;
+	adv[3] = 0x00;
+	adv[4] = 0x00;
+	adv[5] = 0x20;
+	adv[6] = 0x3a;
+	adv[7] = 0xff;
+	for(int i=0;i<16;++i) {
+		adv[8 + i] = target[i];
+	}
+	for(int i=0;i<16;++i) {
+		adv[24 + i] = dest[i];
+	}
+	adv[40] = 0x88;
+	adv[41] = 0x00;
+	adv[42] = 0x00;
+	adv[43] = 0x00; // future home of checksum
+	adv[44] = 0x60;
+	adv[45] = 0x00;
+	adv[46] = 0x00;
+	adv[47] = 0x00;
+	for(int i=0;i<16;++i) {
+		adv[48 + i] = target[i];
+	}
+	adv[64] = 0x02;
+	adv[65] = 0x01;
+	adv[66] = mac[0];
+	adv[67] = mac[1];
+	adv[68] = mac[2];
+	adv[69] = mac[3];
+	adv[70] = mac[4];
+	adv[71] = mac[5];
+
+	uint16_t pseudo_[36];
+	uint8_t *const pseudo = reinterpret_cast<uint8_t *>(pseudo_);
+	for(int i=0;i<32;++i) {
+		pseudo[i] = adv[8 + i];
+	}
+	pseudo[32] = 0x00;
+	pseudo[33] = 0x00;
+	pseudo[34] = 0x00;
+	pseudo[35] = 0x20;
+	pseudo[36] = 0x00;
+	pseudo[37] = 0x00;
+	pseudo[38] = 0x00;
+	pseudo[39] = 0x3a;
+	for(int i=0;i<32;++i) {
+		pseudo[40 + i] = adv[40 + i];
+	}
+	uint32_t checksum = 0;
+	for(int i=0;i<36;++i) {
+		checksum += Utils::hton(pseudo_[i]);
+	}
+	while ((checksum >> 16)) {
+		checksum = (checksum & 0xffff) + (checksum >> 16);
+	}
+	checksum = ~checksum;
+	adv[42] = (checksum >> 8) & 0xff;
+	adv[43] = checksum & 0xff;
+}
+
 void Switch::onRemotePacket(void *tPtr,const int64_t localSocket,const InetAddress &fromAddr,const void *data,unsigned int len,unsigned int localPort, Address *authenticatedPeerAddr)
 {
 	int32_t flowId = ZT_QOS_NO_FLOW;
 	try {
 		const int64_t now = RR->node->now();
 
-		const SharedPtr<Path> path(RR->topology->getPath(localSocket,fromAddr));
+		// Peers and paths below are borrowed rather than copied so the packet
+		// path doesn't bounce their reference counts between cores. They are
+		// only valid until this guard is released at return.
+		Epoch::Guard _g;
+
+		const Borrowed<Path> path(RR->topology->borrowPath(localSocket,fromAddr));
 		path->received(now);
 		// Store the local port in the path for use in Peer::received callback
 		path->setLocalPort(localPort);
@@ -98,7 +177,7 @@ void Switch::onRemotePacket(void *tPtr,const int64_t localSocket,const InetAddre
 			if (!RR->node->shouldUsePathForZeroTierTraffic(tPtr,beaconAddr,localSocket,fromAddr)) {
 				return;
 			}
-			const SharedPtr<Peer> peer(RR->topology->getPeer(tPtr,beaconAddr));
+			const Borrowed<Peer> peer(RR->topology->borrowPeer(tPtr,beaconAddr));
 			if (peer) { // we'll only respond to beacons from known peers
 				if ((now - _lastBeaconResponse) >= 2500) { // limit rate of responses
 					_lastBeaconResponse = now;
@@ -126,12 +205,12 @@ void Switch::onRemotePacket(void *tPtr,const int64_t localSocket,const InetAddre
 
 						// Note: we don't bother initiating NAT-t for fragments, since heads will set that off.
 						// It wouldn't hurt anything, just redundant and unnecessary.
-						SharedPtr<Peer> relayTo = RR->topology->getPeer(tPtr,destination);
+						const Borrowed<Peer> relayTo(RR->topology->borrowPeer(tPtr,destination));
 						if ((!relayTo)||(!relayTo->sendDirect(tPtr,fragment.data(),fragment.size(),now,false))) {
 							// Don't know peer or no direct path -- so relay via someone upstream
-							relayTo = RR->topology->getUpstreamPeer();
-							if (relayTo) {
-								relayTo->sendDirect(tPtr,fragment.data(),fragment.size(),now,true);
+							const SharedPtr<Peer> upstream(RR->topology->getUpstreamPeer());
+							if (upstream) {
+								upstream->sendDirect(tPtr,fragment.data(),fragment.size(),now,true);
 							}
 						}
 					}
@@ -206,7 +285,7 @@ void Switch::onRemotePacket(void *tPtr,const int64_t localSocket,const InetAddre
 
 					if (packet.hops() < ZT_RELAY_MAX_HOPS) {
 						packet.incrementHops();
-						SharedPtr<Peer> relayTo = RR->topology->getPeer(tPtr,destination);
+						const Borrowed<Peer> relayTo(RR->topology->borrowPeer(tPtr,destination));
 						if ((relayTo)&&(relayTo->sendDirect(tPtr,packet.data(),packet.size(),now,false))) {
 							if ((source != RR->identity.address())&&(_shouldUnite(now,source,destination))) {
 								const SharedPtr<Peer> sourcePeer(RR->topology->getPeer(tPtr,source));
@@ -215,12 +294,12 @@ void Switch::onRemotePacket(void *tPtr,const int64_t localSocket,const InetAddre
 								}
 							}
 						} else {
-							relayTo = RR->topology->getUpstreamPeer();
-							if ((relayTo)&&(relayTo->address() != source)) {
-								if (relayTo->sendDirect(tPtr,packet.data(),packet.size(),now,true)) {
+							const SharedPtr<Peer> upstream(RR->topology->getUpstreamPeer());
+							if ((upstream)&&(upstream->address() != source)) {
+								if (upstream->sendDirect(tPtr,packet.data(),packet.size(),now,true)) {
 									const SharedPtr<Peer> sourcePeer(RR->topology->getPeer(tPtr,source));
 									if (sourcePeer) {
-										relayTo->introduce(tPtr,now,sourcePeer);
+										upstream->introduce(tPtr,now,sourcePeer);
 									}
 								}
 							}
@@ -403,7 +482,28 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 				 * them into multicasts by stuffing the IP address being queried into
 				 * the 32-bit ADI field. In practice this uses our multicast pub/sub
 				 * system to implement a kind of extended/distributed ARP table. */
-				multicastGroup = MulticastGroup::deriveMulticastGroupForAddressResolution(InetAddress(((const unsigned char *)data) + 24,4,0));
+				const InetAddress queriedIp(((const unsigned char *)data) + 24,4,0);
+
+				// If enabled, answer from certificates of ownership instead of asking the network
+				if (RR->node->localAddressResolutionEnabled()) {
+					const Address owner(network->managedIpOwner(queriedIp));
+					if (owner) {
+						const MAC ownerMac(owner,network->id());
+						uint8_t reply[28];
+						forgeArpReply(reply,reinterpret_cast<const uint8_t *>(data),ownerMac);
+						Metrics::address_resolution_arp_answered++;
+
+						// same pattern as the NDP emulation reply below
+						std::thread([=]() {
+							RR->node->putFrame(tPtr, network->id(), network->userPtr(), ownerMac, from, ZT_ETHERTYPE_ARP, 0, reply, 28);
+						}).detach();
+
+						return;
+					}
+					Metrics::address_resolution_arp_miss++;
+				}
+
+				multicastGroup = MulticastGroup::deriveMulticastGroupForAddressResolution(queriedIp);
 			} else if (!network->config().enableBroadcast()) {
 				// Don't transmit broadcasts if this network doesn't want them
 				RR->t->outgoingNetworkFrameDropped(tPtr,network,from,to,etherType,vlanId,len,"broadcast disabled");
@@ -463,66 +563,7 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 					const MAC peerMac(v6EmbeddedAddress,network->id());
 
 					uint8_t adv[72];
-					adv[0] = 0x60;
-					adv[1] = 0x00;
-					adv[2] = 0x00;
-					adv[3] = 0x00;
-					adv[4] = 0x00;
-					adv[5] = 0x20;
-					adv[6] = 0x3a;
-					adv[7] = 0xff;
-					for(int i=0;i<16;++i) {
-						adv[8 + i] = pkt6[i];
-					}
-					for(int i=0;i<16;++i) {
-						adv[24 + i] = my6[i];
-					}
-					adv[40] = 0x88;
-					adv[41] = 0x00;
-					adv[42] = 0x00;
-					adv[43] = 0x00; // future home of checksum
-					adv[44] = 0x60;
-					adv[45] = 0x00;
-					adv[46] = 0x00;
-					adv[47] = 0x00;
-					for(int i=0;i<16;++i) {
-						adv[48 + i] = pkt6[i];
-					}
-					adv[64] = 0x02;
-					adv[65] = 0x01;
-					adv[66] = peerMac[0];
-					adv[67] = peerMac[1];
-					adv[68] = peerMac[2];
-					adv[69] = peerMac[3];
-					adv[70] = peerMac[4];
-					adv[71] = peerMac[5];
-
-					uint16_t pseudo_[36];
-					uint8_t *const pseudo = reinterpret_cast<uint8_t *>(pseudo_);
-					for(int i=0;i<32;++i) {
-						pseudo[i] = adv[8 + i];
-					}
-					pseudo[32] = 0x00;
-					pseudo[33] = 0x00;
-					pseudo[34] = 0x00;
-					pseudo[35] = 0x20;
-					pseudo[36] = 0x00;
-					pseudo[37] = 0x00;
-					pseudo[38] = 0x00;
-					pseudo[39] = 0x3a;
-					for(int i=0;i<32;++i) {
-						pseudo[40 + i] = adv[40 + i];
-					}
-					uint32_t checksum = 0;
-					for(int i=0;i<36;++i) {
-						checksum += Utils::hton(pseudo_[i]);
-					}
-					while ((checksum >> 16)) {
-						checksum = (checksum & 0xffff) + (checksum >> 16);
-					}
-					checksum = ~checksum;
-					adv[42] = (checksum >> 8) & 0xff;
-					adv[43] = checksum & 0xff;
+					forgeNeighborAdvertisement(adv,pkt6,my6,peerMac);
 
 					//
 					// call on separate background thread
@@ -538,6 +579,36 @@ void Switch::onLocalEthernet(void *tPtr,const SharedPtr<Network> &network,const
 					return; // NDP emulation done. We have forged a "fake" reply, so no need to send actual NDP query.
 				} // else no NDP emulation
 			} // else no NDP emulation
+
+			// Answer other neighbor solicitations from certificates of ownership if enabled. Solicitations
+			// from the unspecified address are duplicate address detection and must go to the network.
+			if ((RR->node->localAddressResolutionEnabled())&&(reinterpret_cast<const uint8_t *>(data)[6] == 0x3a)&&(reinterpret_cast<const uint8_t *>(data)[40] == 0x87)) {
+				const uint8_t *const src6 = reinterpret_cast<const uint8_t *>(data) + 8;
+				const uint8_t *const target6 = reinterpret_cast<const uint8_t *>(data) + 40 + 8;
+				bool fromUnspecified = true;
+				for(int i=0;i<16;++i) {
+					if (src6[i]) {
+						fromUnspecified = false;
+						break;
+					}
+				}
+				if (!fromUnspecified) {
+					const Address owner(network->managedIpOwner(InetAddress(target6,16,0)));
+					if (owner) {
+						const MAC ownerMac(owner,network->id());
+						uint8_t adv[72];
+						forgeNeighborAdvertisement(adv,target6,src6,ownerMac);
+						Metrics::address_resolution_nd_answered++;
+
+						std::thread([=]() {
+							RR->node->putFrame(tPtr, network->id(), network->userPtr(), ownerMac, from, ZT_ETHERTYPE_IPV6, 0, adv, 72);
+						}).detach();
+
+						return;
+					}
+					Metrics::address_resolution_nd_miss++;
+				}
+			}
 		}
 
 		// Check this after NDP emulation, since that has to be allowed in exactly this case
@@ -1066,7 +1137,7 @@ unsigned long Switch::doTimerTasks(void *tPtr,int64_t now)
 
 	{
 		Mutex::Lock _l(_lastUniteAttempt_m);
-		Hashtable< _LastUniteKey,uint64_t >::Iterator i(_lastUniteAttempt);
+		FlatHashtable< _LastUniteKey,uint64_t >::Iterator i(_lastUniteAttempt);
 		_LastUniteKey *k = (_LastUniteKey *)0;
 		uint64_t *v = (uint64_t *)0;
 		while (i.next(k,v)) {
@@ -1078,7 +1149,7 @@ unsigned long Switch::doTimerTasks(void *tPtr,int64_t now)
 
 	{
 		Mutex::Lock _l(_lastSentWhoisRequest_m);
-		Hashtable< Address,int64_t >::Iterator i(_lastSentWhoisRequest);
+		FlatHashtable< Address,int64_t >::Iterator i(_lastSentWhoisRequest);
 		Address *a = (Address *)0;
 		int64_t *ts = (int64_t *)0;
 		while (i.next(a,ts)) {
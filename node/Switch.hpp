@@ -30,6 +30,7 @@
 #include "SharedPtr.hpp"
 #include "IncomingPacket.hpp"
 #include "Hashtable.hpp"
+#include "FlatHashtable.hpp"
 
 /* Ethernet frame types that might be relevant to us */
 #define ZT_ETHERTYPE_IPV4 0x0800
@@ -87,6 +88,25 @@ public:
 	 */
 	bool isFlowAware();
 
+	/**
+	 * Forge an ARP reply saying mac has the IP an ARP request asked about
+	 *
+	 * @param reply Buffer for 28 byte reply
+	 * @param query 28 byte IPv4 ARP request
+	 * @param mac MAC of the IP's owner
+	 */
+	static void forgeArpReply(uint8_t reply[28],const uint8_t *query,const MAC &mac);
+
+	/**
+	 * Forge an IPv6 neighbor advertisement from target to dest saying mac has target
+	 *
+	 * @param adv Buffer for 72 byte IPv6 packet (header, ICMPv6 and target link-layer address option)
+	 * @param target 16 byte IPv6 address being advertised, also the source
+	 * @param dest 16 byte IPv6 destination
+	 * @param mac MAC of target's owner
+	 */
+	static void forgeNeighborAdvertisement(uint8_t adv[72],const uint8_t *target,const uint8_t *dest,const MAC &mac);
+
 	/**
 	 * Called when a packet comes from a local Ethernet tap
 	 *
@@ -217,7 +237,7 @@ private:
 	volatile int64_t _lastCheckedQueues;
 
 	// Time we last sent a WHOIS request for each address
-	Hashtable< Address,int64_t > _lastSentWhoisRequest;
+	FlatHashtable< Address,int64_t > _lastSentWhoisRequest;
 	Mutex _lastSentWhoisRequest_m;
 
 	// Packets waiting for WHOIS replies or other decode info or missing fragments
@@ -296,7 +316,7 @@ private:
 		inline bool operator==(const _LastUniteKey &k) const { return ((x == k.x)&&(y == k.y)); }
 		uint64_t x,y;
 	};
-	Hashtable< _LastUniteKey,uint64_t > _lastUniteAttempt; // key is always sorted in ascending order, for set-like behavior
+	FlatHashtable< _LastUniteKey,uint64_t > _lastUniteAttempt; // key is always sorted in ascending order, for set-like behavior
 	Mutex _lastUniteAttempt_m;
 
 	// Queue with additional flow state variables
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_TIMERWHEEL_HPP
+#define ZT_TIMERWHEEL_HPP
+
+#include "Constants.hpp"
+
+#include <stdint.h>
+
+#include <vector>
+
+// Slots per level is 2^ZT_TIMERWHEEL_LEVEL_BITS
+#define ZT_TIMERWHEEL_LEVEL_BITS 6
+#define ZT_TIMERWHEEL_LEVELS 4
+
+namespace ZeroTier {
+
+/**
+ * Hierarchical timer wheel
+ *
+ * Schedules values of type T for deadlines in milliseconds. Scheduling is
+ * O(1) and advance() is O(ticks elapsed + timers expired), so periodic
+ * background work only touches things that are actually due instead of
+ * rescanning everything.
+ *
+ * Each level has 64 slots. Level 0 slots are one tick wide, level 1 slots
+ * are 64 ticks wide, and so on. Timers further out than the top level
+ * covers are parked in its last slot and re-filed when they get there.
+ * Timers fire no earlier than their deadline and no later than the end of
+ * the tick containing it.
+ *
+ * There is no cancel. Callers re-validate whatever a timer refers to when
+ * it fires and just drop it if it is stale, which is cheaper than tracking
+ * handles for timers that almost always fire anyway.
+ *
+ * This class is not thread safe.
+ *
+ * @tparam T Value type (copyable)
+ */
+template<typename T>
+class TimerWheel
+{
+private:
+	struct _E
+	{
+		_E(const int64_t d,const T &vv) : deadline(d),v(vv) {}
+		int64_t deadline;
+		T v;
+	};
+
+	static const unsigned int _SLOTS = (1U << ZT_TIMERWHEEL_LEVEL_BITS);
+	static const unsigned int _MASK = _SLOTS - 1;
+
+public:
+	/**
+	 * @param tick Tick length in milliseconds
+	 * @param now Current time
+	 */
+	TimerWheel(const int64_t tick,const int64_t now) :
+		_tick((tick > 0) ? tick : 1),
+		_cur(now / ((tick > 0) ? tick : 1)),
+		_s(0)
+	{
+	}
+
+	/**
+	 * Schedule a value
+	 *
+	 * @param deadline Time at or after which v should be returned by advance()
+	 * @param v Value
+	 */
+	inline void schedule(const int64_t deadline,const T &v)
+	{
+		_file(_E(deadline,v),_cur + 1);
+		++_s;
+	}
+
+	/**
+	 * Advance to the current time and collect expired timers
+	 *
+	 * @param now Current time
+	 * @param expired Vector to which expired values are appended in deadline tick order
+	 * @return Number of values appended
+	 */
+	inline unsigned long advance(const int64_t now,std::vector<T> &expired)
+	{
+		const uint64_t target = (uint64_t)(now / _tick);
+		const unsigned long before = (unsigned long)expired.size();
+		while (_cur < target) {
+			++_cur;
+
+			// Cascade from the top down so an entry can fall more than one
+			// level in a single tick if the lower levels also just wrapped
+			for(unsigned int l=ZT_TIMERWHEEL_LEVELS-1;l>0;--l) {
+				if ((_cur & ((1ULL << (ZT_TIMERWHEEL_LEVEL_BITS * l)) - 1)) == 0) {
+					std::vector<_E> &slot = _wheel[l][(_cur >> (ZT_TIMERWHEEL_LEVEL_BITS * l)) & _MASK];
+					if (!slot.empty()) {
+						std::vector<_E> tmp;
+						tmp.swap(slot);
+						for(typename std::vector<_E>::const_iterator e(tmp.begin());e!=tmp.end();++e) {
+							_file(*e,_cur);
+						}
+					}
+				}
+			}
+
+			std::vector<_E> &slot = _wheel[0][_cur & _MASK];
+			if (!slot.empty()) {
+				std::vector<_E> tmp;
+				tmp.swap(slot);
+				for(typename std::vector<_E>::const_iterator e(tmp.begin());e!=tmp.end();++e) {
+					if (_tickOf(e->deadline) <= _cur) {
+						expired.push_back(e->v);
+						--_s;
+					} else {
+						_file(*e,_cur + 1); // parked beyond the top level's range
+					}
+				}
+			}
+		}
+		return ((unsigned long)expired.size() - before);
+	}
+
+	/**
+	 * Drop all pending timers
+	 */
+	inline void clear()
+	{
+		for(unsigned int l=0;l<ZT_TIMERWHEEL_LEVELS;++l) {
+			for(unsigned int i=0;i<_SLOTS;++i) {
+				_wheel[l][i].clear();
+			}
+		}
+		_s = 0;
+	}
+
+	/**
+	 * @return Number of pending timers
+	 */
+	inline unsigned long size() const { return _s; }
+
+	/**
+	 * @return True if no timers are pending
+	 */
+	inline bool empty() const { return (_s == 0); }
+
+private:
+	inline uint64_t _tickOf(const int64_t t) const
+	{
+		// Round up so nothing fires before its deadline
+		return (t <= 0) ? 0 : (uint64_t)((t + _tick - 1) / _tick);
+	}
+
+	// Entries due before minTick are filed at minTick, which is the current
+	// tick while cascading (its level 0 slot is processed right after) and
+	// the next tick otherwise
+	inline void _file(const _E &e,const uint64_t minTick)
+	{
+		uint64_t d = _tickOf(e.deadline);
+		if (d < minTick) {
+			d = minTick;
+		}
+		const uint64_t delta = d - _cur;
+		for(unsigned int l=0;l<ZT_TIMERWHEEL_LEVELS;++l) {
+			if (delta < (1ULL << (ZT_TIMERWHEEL_LEVEL_BITS * (l + 1)))) {
+				_wheel[l][(d >> (ZT_TIMERWHEEL_LEVEL_BITS * l)) & _MASK].push_back(e);
+				return;
+			}
+		}
+		// Beyond range: park in the furthest top level slot
+		const unsigned int top = ZT_TIMERWHEEL_LEVELS - 1;
+		_wheel[top][((_cur >> (ZT_TIMERWHEEL_LEVEL_BITS * top)) - 1) & _MASK].push_back(e);
+	}
+
+	const int64_t _tick;
+	uint64_t _cur;
+	unsigned long _s;
+	std::vector<_E> _wheel[ZT_TIMERWHEEL_LEVELS][_SLOTS];
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -28,6 +28,11 @@ static const unsigned char ZT_DEFAULT_WORLD[ZT_DEFAULT_WORLD_LENGTH] = {0x01,0x0
 Topology::Topology(const RuntimeEnvironment *renv,void *tPtr) :
 	RR(renv),
 	_numConfiguredPhysicalPaths(0),
+	_peerTimers(ZT_CORE_TIMER_TASK_GRANULARITY,renv->node->now()),
+	_pathTimers(ZT_CORE_TIMER_TASK_GRANULARITY,renv->node->now()),
+#ifndef ZT_NO_PEER_METRICS
+	_lastPeerMetricsRefresh(0),
+#endif
 	_amUpstream(false)
 {
 	uint8_t tmp[ZT_WORLD_MAX_SERIALIZED_LENGTH];
@@ -53,26 +58,26 @@ Topology::Topology(const RuntimeEnvironment *renv,void *tPtr) :
 
 Topology::~Topology()
 {
-	Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
-	Address *a = (Address *)0;
-	SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
-	while (i.next(a,p)) {
-		_savePeer((void *)0,*p);
+	_peers.each([this](const Address &a,const SharedPtr<Peer> &p) {
+		_savePeer((void *)0,p);
+	});
+	{
+		Mutex::Lock _l(_timers_m);
+		_peerTimers.clear();
+		_pathTimers.clear();
 	}
+	_peers.clear();
+	_paths.clear();
+	Epoch::synchronize();
 }
 
 SharedPtr<Peer> Topology::addPeer(void *tPtr,const SharedPtr<Peer> &peer)
 {
-	SharedPtr<Peer> np;
-	{
-		Mutex::Lock _l(_peers_m);
-		SharedPtr<Peer> &hp = _peers[peer->address()];
-		if (!hp) {
-			hp = peer;
-		}
-		np = hp;
+	const SharedPtr<Peer> hp(_peers.get(peer->address()));
+	if (hp) {
+		return hp;
 	}
-	return np;
+	return _insertPeer(peer);
 }
 
 SharedPtr<Peer> Topology::getPeer(void *tPtr,const Address &zta)
@@ -82,10 +87,9 @@ SharedPtr<Peer> Topology::getPeer(void *tPtr,const Address &zta)
 	}
 
 	{
-		Mutex::Lock _l(_peers_m);
-		const SharedPtr<Peer> *const ap = _peers.get(zta);
+		const SharedPtr<Peer> ap(_peers.get(zta));
 		if (ap) {
-			return *ap;
+			return ap;
 		}
 	}
 
@@ -97,14 +101,13 @@ SharedPtr<Peer> Topology::getPeer(void *tPtr,const Address &zta)
 		int len = RR->node->stateObjectGet(tPtr,ZT_STATE_OBJECT_PEER,idbuf,buf.unsafeData(),ZT_PEER_MAX_SERIALIZED_STATE_SIZE);
 		if (len > 0) {
 			buf.setSize(len);
-			Mutex::Lock _l(_peers_m);
-			SharedPtr<Peer> &ap = _peers[zta];
+			const SharedPtr<Peer> ap(_peers.get(zta));
 			if (ap) {
 				return ap;
 			}
-			ap = Peer::deserializeFromCache(RR->node->now(),tPtr,buf,RR);
-			if (!ap) {
-				_peers.erase(zta);
+			const SharedPtr<Peer> np(Peer::deserializeFromCache(RR->node->now(),tPtr,buf,RR));
+			if (np) {
+				_insertPeer(np);
 			}
 			return SharedPtr<Peer>();
 		}
@@ -118,10 +121,9 @@ Identity Topology::getIdentity(void *tPtr,const Address &zta)
 	if (zta == RR->identity.address()) {
 		return RR->identity;
 	} else {
-		Mutex::Lock _l(_peers_m);
-		const SharedPtr<Peer> *const ap = _peers.get(zta);
+		const SharedPtr<Peer> ap(_peers.get(zta));
 		if (ap) {
-			return (*ap)->identity();
+			return ap->identity();
 		}
 	}
 	return Identity();
@@ -131,15 +133,14 @@ SharedPtr<Peer> Topology::getUpstreamPeer()
 {
 	const int64_t now = RR->node->now();
 	unsigned int bestq = ~((unsigned int)0);
-	const SharedPtr<Peer> *best = (const SharedPtr<Peer> *)0;
+	SharedPtr<Peer> best;
 
-	Mutex::Lock _l2(_peers_m);
 	Mutex::Lock _l1(_upstreams_m);
 
 	for(std::vector<Address>::const_iterator a(_upstreamAddresses.begin());a!=_upstreamAddresses.end();++a) {
-		const SharedPtr<Peer> *p = _peers.get(*a);
+		const SharedPtr<Peer> p(_peers.get(*a));
 		if (p) {
-			const unsigned int q = (*p)->relayQuality(now);
+			const unsigned int q = p->relayQuality(now);
 			if (q <= bestq) {
 				bestq = q;
 				best = p;
@@ -147,10 +148,7 @@ SharedPtr<Peer> Topology::getUpstreamPeer()
 		}
 	}
 
-	if (!best) {
-		return SharedPtr<Peer>();
-	}
-	return *best;
+	return best;
 }
 
 bool Topology::isUpstream(const Identity &id) const
@@ -232,7 +230,6 @@ bool Topology::addWorld(void *tPtr,const World &newWorld,bool alwaysAcceptNew)
 		return false;
 	}
 
-	Mutex::Lock _l2(_peers_m);
 	Mutex::Lock _l1(_upstreams_m);
 
 	World *existing = (World *)0;
@@ -328,7 +325,6 @@ void Topology::addMoon(void *tPtr,const uint64_t id,const Address &seed)
 
 void Topology::removeMoon(void *tPtr,const uint64_t id)
 {
-	Mutex::Lock _l2(_peers_m);
 	Mutex::Lock _l1(_upstreams_m);
 
 	std::vector<World> nm;
@@ -357,48 +353,103 @@ void Topology::removeMoon(void *tPtr,const uint64_t id)
 
 void Topology::doPeriodicTasks(void *tPtr,int64_t now)
 {
+	std::vector< SharedPtr<Peer> > duePeers;
+	std::vector< Path::HashKey > duePaths;
 	{
-		Mutex::Lock _l1(_peers_m);
-		Mutex::Lock _l2(_upstreams_m);
-		Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
-		Address *a = (Address *)0;
-		SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
-		while (i.next(a,p)) {
-			if ( (!(*p)->isAlive(now)) && (std::find(_upstreamAddresses.begin(),_upstreamAddresses.end(),*a) == _upstreamAddresses.end()) ) {
-				// Notify service about peer removal (iptables integration)
-				// This triggers when the peer is actually removed from topology,
-				// ensuring iptables ipset entries are removed at the right time
-				if (RR->peerEventCallback) {
-					// Remove all paths for this peer from iptables
-					std::vector< SharedPtr<Path> > paths((*p)->paths(now));
-					for(std::vector< SharedPtr<Path> >::iterator path(paths.begin());path!=paths.end();++path) {
-						if ((*path)->address().ipScope() == InetAddress::IP_SCOPE_GLOBAL) {
-							RR->peerEventCallback(RR->peerEventCallbackUserPtr, RuntimeEnvironment::PEER_EVENT_PATH_REMOVE, (*path)->address(), (*p)->address(), Address(), false, 0);
+		Mutex::Lock _l(_timers_m);
+		_peerTimers.advance(now,duePeers);
+		_pathTimers.advance(now,duePaths);
+	}
+
+	std::vector< std::pair< int64_t,SharedPtr<Peer> > > rearmPeers;
+	if (!duePeers.empty()) {
+		// Copy upstreams first since _memoizeUpstreams() inserts into _peers
+		// with _upstreams_m held, so holding it here would invert lock order
+		std::vector<Address> upstreams;
+		{
+			Mutex::Lock _l(_upstreams_m);
+			upstreams = _upstreamAddresses;
+		}
+		for(std::vector< SharedPtr<Peer> >::const_iterator dp(duePeers.begin());dp!=duePeers.end();++dp) {
+			const SharedPtr<Peer> &p = *dp;
+			bool current = false,evicted = false;
+			_peers.eraseIf(p->address(),[this,tPtr,now,&upstreams,&p,&current,&evicted](const SharedPtr<Peer> &cp) -> bool {
+				if (cp != p) {
+					return false; // stale timer for a peer that was removed and re-added
+				}
+				current = true;
+				if ( (!p->isAlive(now)) && (!std::binary_search(upstreams.begin(),upstreams.end(),p->address())) ) {
+					// Notify service about peer removal (iptables integration)
+					// This triggers when the peer is actually removed from topology,
+					// ensuring iptables ipset entries are removed at the right time
+					if (RR->peerEventCallback) {
+						// Remove all paths for this peer from iptables
+						std::vector< SharedPtr<Path> > paths(p->paths(now));
+						for(std::vector< SharedPtr<Path> >::iterator path(paths.begin());path!=paths.end();++path) {
+							if ((*path)->address().ipScope() == InetAddress::IP_SCOPE_GLOBAL) {
+								RR->peerEventCallback(RR->peerEventCallbackUserPtr, RuntimeEnvironment::PEER_EVENT_PATH_REMOVE, (*path)->address(), p->address(), Address(), false, 0);
+							}
 						}
 					}
+					_savePeer(tPtr,p);
+					current = false;
+					evicted = true;
+					return true;
 				}
-				_savePeer(tPtr,*p);
-				_peers.erase(*a);
+				return false;
+			});
+#ifndef ZT_NO_PEER_METRICS
+			if (evicted) {
+				_peerMetrics.remove(p->address());
+			}
+#endif
+			if (current) {
+				rearmPeers.push_back(std::pair< int64_t,SharedPtr<Peer> >(std::max(p->lastReceive() + ZT_PEER_ACTIVITY_TIMEOUT,now + ZT_HOUSEKEEPING_PERIOD),p));
 			}
 		}
 	}
 
-	{
-		Mutex::Lock _l(_paths_m);
-		Hashtable< Path::HashKey,SharedPtr<Path> >::Iterator i(_paths);
-		Path::HashKey *k = (Path::HashKey *)0;
-		SharedPtr<Path> *p = (SharedPtr<Path> *)0;
-		while (i.next(k,p)) {
-			if (p->references() <= 1) {
-				_paths.erase(*k);
+	// A path a reader is copying out of the table right now may be expired
+	// here anyway. That's harmless: it keeps working and the next getPath()
+	// for that endpoint simply creates a new canonical Path.
+	std::vector< Path::HashKey > rearmPaths;
+	for(std::vector< Path::HashKey >::const_iterator k(duePaths.begin());k!=duePaths.end();++k) {
+		bool current = false;
+		if (!_paths.eraseIf(*k,[&current](const SharedPtr<Path> &p) -> bool {
+			current = true;
+			return (p.references() <= 1);
+		})) {
+			if (current) {
+				rearmPaths.push_back(*k);
 			}
 		}
 	}
+
+	if ((!rearmPeers.empty())||(!rearmPaths.empty())) {
+		Mutex::Lock _l(_timers_m);
+		for(std::vector< std::pair< int64_t,SharedPtr<Peer> > >::const_iterator p(rearmPeers.begin());p!=rearmPeers.end();++p) {
+			_peerTimers.schedule(p->first,p->second);
+		}
+		for(std::vector< Path::HashKey >::const_iterator k(rearmPaths.begin());k!=rearmPaths.end();++k) {
+			_pathTimers.schedule(now + ZT_HOUSEKEEPING_PERIOD,*k);
+		}
+	}
+
+#ifndef ZT_NO_PEER_METRICS
+	if ((now - _lastPeerMetricsRefresh) >= ZT_PEER_METRICS_REFRESH_PERIOD) {
+		_lastPeerMetricsRefresh = now;
+		_peerMetrics.refresh(now,_peers.entries());
+	}
+#endif
+
+	if (Epoch::pending() > 0) {
+		Epoch::collect();
+	}
 }
 
 void Topology::_memoizeUpstreams(void *tPtr)
 {
-	// assumes _upstreams_m and _peers_m are locked
+	// assumes _upstreams_m is locked
 	_upstreamAddresses.clear();
 	_amUpstream = false;
 
@@ -408,9 +459,8 @@ void Topology::_memoizeUpstreams(void *tPtr)
 			_amUpstream = true;
 		} else if (std::find(_upstreamAddresses.begin(),_upstreamAddresses.end(),id.address()) == _upstreamAddresses.end()) {
 			_upstreamAddresses.push_back(id.address());
-			SharedPtr<Peer> &hp = _peers[id.address()];
-			if (!hp) {
-				hp = new Peer(RR,RR->identity,id);
+			if (!_peers.contains(id.address())) {
+				_insertPeer(SharedPtr<Peer>(new Peer(RR,RR->identity,id)));
 			}
 		}
 	}
@@ -421,9 +471,8 @@ void Topology::_memoizeUpstreams(void *tPtr)
 				_amUpstream = true;
 			} else if (std::find(_upstreamAddresses.begin(),_upstreamAddresses.end(),i->identity.address()) == _upstreamAddresses.end()) {
 				_upstreamAddresses.push_back(i->identity.address());
-				SharedPtr<Peer> &hp = _peers[i->identity.address()];
-				if (!hp) {
-					hp = new Peer(RR,RR->identity,i->identity);
+				if (!_peers.contains(i->identity.address())) {
+					_insertPeer(SharedPtr<Peer>(new Peer(RR,RR->identity,i->identity)));
 				}
 			}
 		}
@@ -432,6 +481,29 @@ void Topology::_memoizeUpstreams(void *tPtr)
 	std::sort(_upstreamAddresses.begin(),_upstreamAddresses.end());
 }
 
+SharedPtr<Path> Topology::_createPath(const int64_t l,const InetAddress &r)
+{
+	const Path::HashKey k(l,r);
+	const SharedPtr<Path> np(new Path(l,r));
+	const SharedPtr<Path> p(_paths.setIfAbsent(k,np));
+	if (p == np) {
+		Mutex::Lock _l(_timers_m);
+		_pathTimers.schedule(RR->node->now() + ZT_HOUSEKEEPING_PERIOD,k);
+	}
+	return p;
+}
+
+SharedPtr<Peer> Topology::_insertPeer(const SharedPtr<Peer> &peer)
+{
+	const SharedPtr<Peer> p(_peers.setIfAbsent(peer->address(),peer));
+	if (p == peer) {
+		const int64_t now = RR->node->now();
+		Mutex::Lock _l(_timers_m);
+		_peerTimers.schedule(std::max(peer->lastReceive() + ZT_PEER_ACTIVITY_TIMEOUT,now + ZT_HOUSEKEEPING_PERIOD),peer);
+	}
+	return p;
+}
+
 void Topology::_savePeer(void *tPtr,const SharedPtr<Peer> &peer)
 {
 	try {
@@ -32,6 +32,10 @@
 #include "Mutex.hpp"
 #include "InetAddress.hpp"
 #include "Hashtable.hpp"
+#include "ConcurrentHashtable.hpp"
+#include "Borrowed.hpp"
+#include "TimerWheel.hpp"
+#include "PeerMetrics.hpp"
 #include "World.hpp"
 
 namespace ZeroTier {
@@ -87,12 +91,60 @@ public:
 	 */
 	inline SharedPtr<Peer> getPeerNoCache(const Address &zta)
 	{
-		Mutex::Lock _l(_peers_m);
-		const SharedPtr<Peer> *const ap = _peers.get(zta);
-		if (ap) {
-			return *ap;
+		return _peers.get(zta);
+	}
+
+	/**
+	 * Borrow a peer that is presently in memory without touching its reference count
+	 *
+	 * The caller must hold an Epoch::Guard, and the result is only valid
+	 * until it is released. Like getPeerNoCache() this does not consult the
+	 * disk cache.
+	 *
+	 * @param zta ZeroTier address
+	 * @return Borrowed peer or NULL if not in memory
+	 */
+	inline Borrowed<Peer> borrowPeer(const Address &zta) const
+	{
+		return Borrowed<Peer>(_peers.borrow(zta));
+	}
+
+	/**
+	 * Borrow a peer, falling back to getPeer() if it is not in memory
+	 *
+	 * The caller must hold an Epoch::Guard, and the result is only valid
+	 * until it is released.
+	 *
+	 * @param tPtr Thread pointer to be handed through to any callbacks called as a result of this call
+	 * @param zta ZeroTier address of peer
+	 * @return Borrowed peer or NULL if not found
+	 */
+	inline Borrowed<Peer> borrowPeer(void *tPtr,const Address &zta)
+	{
+		Peer *const p = _peers.borrow(zta);
+		if (p) {
+			return Borrowed<Peer>(p);
 		}
-		return SharedPtr<Peer>();
+		return Borrowed<Peer>(getPeer(tPtr,zta).ptr()); // anything returned is held by the table
+	}
+
+	/**
+	 * Borrow a Path object for a given local and remote physical address, creating if needed
+	 *
+	 * The caller must hold an Epoch::Guard, and the result is only valid
+	 * until it is released.
+	 *
+	 * @param l Local socket
+	 * @param r Remote address
+	 * @return Borrowed canonicalized Path object
+	 */
+	inline Borrowed<Path> borrowPath(const int64_t l,const InetAddress &r)
+	{
+		Path *const p = _paths.borrow(Path::HashKey(l,r));
+		if (p) {
+			return Borrowed<Path>(p);
+		}
+		return Borrowed<Path>(_createPath(l,r).ptr()); // table still holds a reference
 	}
 
 	/**
@@ -104,12 +156,11 @@ public:
 	 */
 	inline SharedPtr<Path> getPath(const int64_t l,const InetAddress &r)
 	{
-		Mutex::Lock _l(_paths_m);
-		SharedPtr<Path> &p = _paths[Path::HashKey(l,r)];
-		if (!p) {
-			p.set(new Path(l,r));
+		const SharedPtr<Path> p(_paths.get(Path::HashKey(l,r)));
+		if (p) {
+			return p;
 		}
-		return p;
+		return _createPath(l,r);
 	}
 
 	/**
@@ -276,7 +327,11 @@ public:
 	void removeMoon(void *tPtr,const uint64_t id);
 
 	/**
-	 * Clean and flush database
+	 * Expire dead peers and unused paths whose expiration timers are due
+	 *
+	 * Each peer and path gets a timer when it is added and re-arms it when
+	 * it's checked and still in use, so this only touches what is due and
+	 * is cheap enough to call on every background task tick.
 	 */
 	void doPeriodicTasks(void *tPtr,int64_t now);
 
@@ -287,35 +342,30 @@ public:
 	inline unsigned long countActive(int64_t now) const
 	{
 		unsigned long cnt = 0;
-		Mutex::Lock _l(_peers_m);
-		Hashtable< Address,SharedPtr<Peer> >::Iterator i(const_cast<Topology *>(this)->_peers);
-		Address *a = (Address *)0;
-		SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
-		while (i.next(a,p)) {
-			const SharedPtr<Path> pp((*p)->getAppropriatePath(now,false));
+		_peers.each([&cnt,now](const Address &a,const SharedPtr<Peer> &p) {
+			const SharedPtr<Path> pp(p->getAppropriatePath(now,false));
 			if (pp) {
 				++cnt;
 			}
-		}
+		});
 		return cnt;
 	}
 
 	/**
 	 * Apply a function or function object to all peers
 	 *
+	 * This does not lock the peer table. Peers added or removed while this
+	 * runs may or may not be visited.
+	 *
 	 * @param f Function to apply
 	 * @tparam F Function or function object type
 	 */
 	template<typename F>
 	inline void eachPeer(F f)
 	{
-		Mutex::Lock _l(_peers_m);
-		Hashtable< Address,SharedPtr<Peer> >::Iterator i(_peers);
-		Address *a = (Address *)0;
-		SharedPtr<Peer> *p = (SharedPtr<Peer> *)0;
-		while (i.next(a,p)) {
-			f(*this,*((const SharedPtr<Peer> *)p));
-		}
+		_peers.each([this,&f](const Address &a,const SharedPtr<Peer> &p) {
+			f(*this,p);
+		});
 	}
 
 	/**
@@ -323,10 +373,16 @@ public:
 	 */
 	inline std::vector< std::pair< Address,SharedPtr<Peer> > > allPeers() const
 	{
-		Mutex::Lock _l(_peers_m);
 		return _peers.entries();
 	}
 
+#ifndef ZT_NO_PEER_METRICS
+	/**
+	 * @return Per-peer metrics exporter
+	 */
+	inline PeerMetrics &peerMetrics() { return _peerMetrics; }
+#endif
+
 	/**
 	 * @return True if I am a root server in a planet or moon
 	 */
@@ -443,17 +499,27 @@ private:
 	Identity _getIdentity(void *tPtr,const Address &zta);
 	void _memoizeUpstreams(void *tPtr);
 	void _savePeer(void *tPtr,const SharedPtr<Peer> &peer);
+	SharedPtr<Path> _createPath(const int64_t l,const InetAddress &r);
+	SharedPtr<Peer> _insertPeer(const SharedPtr<Peer> &peer);
 
 	const RuntimeEnvironment *const RR;
 
 	std::pair<InetAddress,ZT_PhysicalPathConfiguration> _physicalPathConfig[ZT_MAX_CONFIGURABLE_PATHS];
 	volatile unsigned int _numConfiguredPhysicalPaths;
 
-	Hashtable< Address,SharedPtr<Peer> > _peers;
-	Mutex _peers_m;
+	ConcurrentHashtable< Address,Peer > _peers;
+	ConcurrentHashtable< Path::HashKey,Path > _paths;
 
-	Hashtable< Path::HashKey,SharedPtr<Path> > _paths;
-	Mutex _paths_m;
+	// Expiration timers. Peer timers hold the peer so a timer left over
+	// from a removed and re-added peer can be recognized and dropped.
+	TimerWheel< SharedPtr<Peer> > _peerTimers;
+	TimerWheel< Path::HashKey > _pathTimers;
+	Mutex _timers_m;
+
+#ifndef ZT_NO_PEER_METRICS
+	PeerMetrics _peerMetrics;
+	int64_t _lastPeerMetricsRefresh;
+#endif
 
 	World _planet;
 	std::vector<World> _moons;
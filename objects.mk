@@ -6,6 +6,7 @@ CORE_OBJS=\
 	node/Capability.o \
 	node/CertificateOfMembership.o \
 	node/CertificateOfOwnership.o \
+	node/Epoch.o \
 	node/Identity.o \
 	node/IncomingPacket.o \
 	node/InetAddress.o \
@@ -19,6 +20,7 @@ CORE_OBJS=\
 	node/Packet.o \
 	node/Path.o \
 	node/Peer.o \
+	node/PeerMetrics.o \
 	node/Poly1305.o \
 	node/Revocation.o \
 	node/Salsa20.o \
@@ -39,12 +41,15 @@ ONE_OBJS=\
 	controller/DBMirrorSet.o \
 	controller/DB.o \
 	controller/FileDB.o \
+	controller/LogDB.o \
 	controller/LFDB.o \
 	controller/PostgreSQL.o \
 	osdep/EthernetTap.o \
 	osdep/ManagedRoute.o \
 	osdep/Http.o \
+	osdep/PeerCache.o \
 	service/SoftwareUpdater.o \
+	service/MetricsExposition.o \
 	service/OneService.o \
 	node/IptablesManager.o
 
@@ -89,6 +89,8 @@
 
 #include "service/OneService.hpp"
 
+#include "controller/LogDB.hpp"
+
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
@@ -2787,6 +2789,48 @@ static int idtool(int argc,char **argv)
 	return 0;
 }
 
+/****************************************************************************/
+/* Controller log database import and export                                */
+/****************************************************************************/
+
+static void dbtoolPrintHelp(FILE *out,const char *pn)
+{
+	fprintf(out,"Usage: %s <command> [<args>]" ZT_EOL_S"" ZT_EOL_S"Commands:" ZT_EOL_S,pn);
+	fprintf(out,"  import <controller.d> <log database>" ZT_EOL_S);
+	fprintf(out,"  export <log database> <controller.d>" ZT_EOL_S);
+	fprintf(out,"" ZT_EOL_S"The controller must not be running. Use log:<log database> as" ZT_EOL_S);
+	fprintf(out,"controllerDbPath in local.conf to run the controller from a log database." ZT_EOL_S);
+}
+
+#ifdef __WINDOWS__
+static int dbtool(int argc, _TCHAR* argv[])
+#else
+static int dbtool(int argc,char **argv)
+#endif
+{
+	if (argc != 4) {
+		dbtoolPrintHelp(stdout,argv[0]);
+		return 1;
+	}
+
+	long n;
+	if (!strcmp(argv[1],"import")) {
+		n = LogDB::importFileDB(argv[2],argv[3]);
+		if (n < 0) {
+			fprintf(stderr,"%s: unable to write %s (does it already hold a log database?)" ZT_EOL_S,argv[0],argv[3]);
+			return 1;
+		}
+	} else if (!strcmp(argv[1],"export")) {
+		n = LogDB::exportFileDB(argv[2],argv[3]);
+	} else {
+		dbtoolPrintHelp(stdout,argv[0]);
+		return 1;
+	}
+	printf("%ld records copied from %s to %s" ZT_EOL_S,n,argv[2],argv[3]);
+
+	return 0;
+}
+
 /****************************************************************************/
 /* Unix helper functions and signal handlers                                */
 /****************************************************************************/
@@ -3133,6 +3177,7 @@ static void printHelp(const char *cn,FILE *out)
 
 	fprintf(out,"  -i                - Generate and manage identities (zerotier-idtool)" ZT_EOL_S);
 	fprintf(out,"  -q                - Query API (zerotier-cli)" ZT_EOL_S);
+	fprintf(out,"  -L                - Import or export controller log database" ZT_EOL_S);
 }
 
 class _OneServiceRunner
@@ -3277,6 +3322,12 @@ int main(int argc,char **argv)
 						return 0;
 					} else return idtool(argc-1,argv+1);
 
+				case 'L': // Import or export controller log database
+					if (argv[i][2]) {
+						printHelp(argv[0],stdout);
+						return 0;
+					} else return dbtool(argc-1,argv+1);
+
 				case 'q': // Invoke cli personality
 					if (argv[i][2]) {
 						printHelp(argv[0],stdout);
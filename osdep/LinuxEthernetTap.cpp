@@ -25,6 +25,7 @@
 #include "OSUtils.hpp"
 #include "LinuxEthernetTap.hpp"
 #include "LinuxNetLink.hpp"
+#include "LinuxIoUring.hpp"
 
 #include <stdint.h>
 #include <stdio.h>
@@ -62,6 +63,9 @@
 
 #define ZT_TAP_BUF_SIZE (1024 * 16)
 
+// Number of reads each rx thread keeps in flight when using io_uring
+#define ZT_TAP_IO_URING_DEPTH 16
+
 // ff:ff:ff:ff:ff:ff with no ADI
 static const ZeroTier::MulticastGroup _blindWildcardMulticastGroup(ZeroTier::MAC(0xff),0);
 
@@ -315,6 +319,14 @@ LinuxEthernetTap::LinuxEthernetTap(
 				return;
 			}
 
+#if defined(ZT_USE_IO_URING) && defined(ZT_IO_URING_AVAILABLE)
+			// Returns false if the kernel won't give us a ring, or if the ring
+			// fails later on, in which case we just fall through to select().
+			if (_ioUringRxLoop()) {
+				return;
+			}
+#endif
+
 			FD_ZERO(&readfds);
 			FD_ZERO(&nullfds);
 			nfds = (int)std::max(_shutdownSignalPipe[0], _fd) + 1;
@@ -361,6 +373,124 @@ LinuxEthernetTap::LinuxEthernetTap(
 	}
 }
 
+#if defined(ZT_USE_IO_URING) && defined(ZT_IO_URING_AVAILABLE)
+bool LinuxEthernetTap::_ioUringRxLoop()
+{
+	static const uint64_t shutdownTag = 0xffffffffffffffffULL;
+	static const uint64_t pollTag = 0xfffffffffffffffeULL;
+
+	// Declared before the ring so the ring is torn down first if we bail out below
+	std::vector<uint8_t> bufs((size_t)ZT_TAP_IO_URING_DEPTH * ZT_TAP_BUF_SIZE);
+	LinuxIoUring ring;
+	if (!ring.init((ZT_TAP_IO_URING_DEPTH * 2) + 2)) {
+		return false;
+	}
+
+	struct iovec iov[ZT_TAP_IO_URING_DEPTH];
+	for (unsigned int i = 0; i < ZT_TAP_IO_URING_DEPTH; ++i) {
+		iov[i].iov_base = bufs.data() + ((size_t)i * ZT_TAP_BUF_SIZE);
+		iov[i].iov_len = ZT_TAP_BUF_SIZE;
+	}
+	// Registered buffers are an optimization; plain reads work without them
+	const bool fixed = ring.registerBuffers(iov, ZT_TAP_IO_URING_DEPTH);
+
+	// Buffers not currently posted to the kernel. The tap fd is O_NONBLOCK, so
+	// a read completes with -EAGAIN when the queue is empty and we park that
+	// buffer until a single POLL_ADD tells us the device is readable again.
+	std::vector<unsigned int> idle;
+	idle.reserve(ZT_TAP_IO_URING_DEPTH);
+	bool pollArmed = false;
+
+	ring.prepPollAdd(_shutdownSignalPipe[0], POLLIN, shutdownTag);
+	for (unsigned int i = 0; i < ZT_TAP_IO_URING_DEPTH; ++i) {
+		if (fixed)
+			ring.prepReadFixed(_fd, iov[i].iov_base, ZT_TAP_BUF_SIZE, i, (uint64_t)i);
+		else ring.prepRead(_fd, iov[i].iov_base, ZT_TAP_BUF_SIZE, (uint64_t)i);
+	}
+	int err = ring.submit(0);
+	if (err < 0) {
+		fprintf(stderr, "WARNING: io_uring_enter() failed on tap device %s (%s), falling back to select()\n", _dev.c_str(), strerror(-err));
+		return false;
+	}
+
+	// Once draining we only hand on frames that are already sitting in our
+	// buffers; nothing new is posted to the ring.
+	bool shutdown = false;
+	bool draining = false;
+	auto complete = [&](uint64_t ud, int32_t res, uint32_t flags) {
+		if (ud == shutdownTag) {
+			shutdown = true;
+			return;
+		}
+		if (ud == pollTag) {
+			pollArmed = false;
+			if (draining)
+				return;
+			for (std::vector<unsigned int>::const_iterator i(idle.begin()); i != idle.end(); ++i) {
+				if (fixed)
+					ring.prepReadFixed(_fd, iov[*i].iov_base, ZT_TAP_BUF_SIZE, *i, (uint64_t)*i);
+				else ring.prepRead(_fd, iov[*i].iov_base, ZT_TAP_BUF_SIZE, (uint64_t)*i);
+			}
+			idle.clear();
+			return;
+		}
+
+		const unsigned int bi = (unsigned int)ud;
+		if (res == -EAGAIN) {
+			idle.push_back(bi);
+			if ((! pollArmed) && (! draining)) {
+				pollArmed = ring.prepPollAdd(_fd, POLLIN, pollTag);
+			}
+			return;
+		}
+		if (res < 0) {
+			shutdown = true; // fd closed or device gone
+			return;
+		}
+
+		const uint8_t *const b = (const uint8_t *)iov[bi].iov_base;
+		unsigned int r = (unsigned int)res;
+		if (r > 14) {
+			if (r > (_mtu + 14))
+				r = _mtu + 14;
+			if (_enabled) {
+				MAC to(b, 6), from(b + 6, 6);
+				unsigned int etherType = Utils::ntoh(((const uint16_t*)b)[6]);
+				_handler(_arg, nullptr, _nwid, from, to, etherType, 0, (const void*)(b + 14), r - 14);
+			}
+		}
+
+		if (draining)
+			return;
+		if (fixed)
+			ring.prepReadFixed(_fd, iov[bi].iov_base, ZT_TAP_BUF_SIZE, bi, ud);
+		else ring.prepRead(_fd, iov[bi].iov_base, ZT_TAP_BUF_SIZE, ud);
+	};
+
+	while ((! shutdown) && (_run)) {
+		err = ring.submit(1);
+		if ((err < 0) && (err != -EBUSY)) {
+			// Reads the kernel has already completed hold frames it has taken off
+			// the tap queue, so deliver those before the ring goes away. Reads
+			// that have not completed yet are cancelled when the ring is closed
+			// and leave their frames queued for the select() loop.
+			fprintf(stderr, "WARNING: io_uring_enter() failed on tap device %s (%s), falling back to select()\n", _dev.c_str(), strerror(-err));
+			draining = true;
+			do {
+				while (ring.reap(complete) > 0) {
+				}
+			} while ((ring.flushCompletions() == 0) && (ring.reap(complete) > 0));
+			return shutdown;
+		}
+		// On EBUSY the completion queue is full: reaping below makes room and
+		// the next submit() re-enters the SQEs the kernel did not take.
+		ring.reap(complete);
+	}
+
+	return true;
+}
+#endif
+
 LinuxEthernetTap::~LinuxEthernetTap()
 {
 	_run = false;
@@ -61,6 +61,10 @@ public:
 	virtual void setDns(const char *domain, const std::vector<InetAddress> &servers) {}
 
 private:
+#ifdef ZT_USE_IO_URING
+	bool _ioUringRxLoop();
+#endif
+
 	void (*_handler)(void *,void *,uint64_t,const MAC &,const MAC &,unsigned int,unsigned int,const void *,unsigned int);
 	void *_arg;
 	uint64_t _nwid;
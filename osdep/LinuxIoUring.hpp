@@ -0,0 +1,347 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_LINUXIOURING_HPP
+#define ZT_LINUXIOURING_HPP
+
+#if defined(__linux__) || defined(linux) || defined(__linux)
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include <linux/io_uring.h>
+
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#define ZT_IO_URING_AVAILABLE 1
+#endif
+
+#endif // Linux
+
+#ifdef ZT_IO_URING_AVAILABLE
+
+namespace ZeroTier {
+
+/**
+ * Minimal io_uring submission/completion ring
+ *
+ * This talks to the kernel directly via syscall() so there is no dependency
+ * on liburing. It's intentionally tiny: one ring per thread, no SQPOLL, and
+ * only the opcodes the TAP receive path needs (poll, read, fixed-buffer
+ * read). It is not thread safe; each thread that wants to do I/O through
+ * io_uring should own its own instance.
+ *
+ * Callers must check init() and fall back to ordinary blocking or select()
+ * based I/O if it fails, since io_uring may be missing, disabled by sysctl
+ * (kernel.io_uring_disabled), or filtered by seccomp in containers.
+ */
+class LinuxIoUring
+{
+public:
+	LinuxIoUring() :
+		_fd(-1),
+		_sqRing((void *)0),
+		_cqRing((void *)0),
+		_sqes((struct io_uring_sqe *)0),
+		_sqRingSize(0),
+		_cqRingSize(0),
+		_sqesSize(0),
+		_sqPending(0)
+	{
+		memset(&_p,0,sizeof(_p));
+	}
+
+	~LinuxIoUring() { close(); }
+
+	/**
+	 * @return True if this kernel will let us create an io_uring instance
+	 */
+	static inline bool supported()
+	{
+		LinuxIoUring r;
+		return r.init(2);
+	}
+
+	/**
+	 * Create and map the ring
+	 *
+	 * @param entries Submission queue depth (rounded up to a power of two by the kernel)
+	 * @return True on success, false if io_uring is not available
+	 */
+	inline bool init(unsigned int entries)
+	{
+		close();
+		memset(&_p,0,sizeof(_p));
+		_fd = (int)::syscall(__NR_io_uring_setup,entries,&_p);
+		if (_fd < 0) {
+			_fd = -1;
+			return false;
+		}
+
+		_sqRingSize = _p.sq_off.array + (_p.sq_entries * sizeof(uint32_t));
+		_cqRingSize = _p.cq_off.cqes + (_p.cq_entries * sizeof(struct io_uring_cqe));
+		if ((_p.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+			if (_cqRingSize > _sqRingSize)
+				_sqRingSize = _cqRingSize;
+			_cqRingSize = _sqRingSize;
+		}
+
+		_sqRing = ::mmap((void *)0,_sqRingSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,_fd,IORING_OFF_SQ_RING);
+		if (_sqRing == MAP_FAILED) {
+			_sqRing = (void *)0;
+			close();
+			return false;
+		}
+		if ((_p.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+			_cqRing = _sqRing;
+		} else {
+			_cqRing = ::mmap((void *)0,_cqRingSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,_fd,IORING_OFF_CQ_RING);
+			if (_cqRing == MAP_FAILED) {
+				_cqRing = (void *)0;
+				close();
+				return false;
+			}
+		}
+
+		_sqesSize = _p.sq_entries * sizeof(struct io_uring_sqe);
+		_sqes = (struct io_uring_sqe *)::mmap((void *)0,_sqesSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,_fd,IORING_OFF_SQES);
+		if ((void *)_sqes == MAP_FAILED) {
+			_sqes = (struct io_uring_sqe *)0;
+			close();
+			return false;
+		}
+
+		_sqHead = (uint32_t *)((uint8_t *)_sqRing + _p.sq_off.head);
+		_sqTail = (uint32_t *)((uint8_t *)_sqRing + _p.sq_off.tail);
+		_sqMask = *(uint32_t *)((uint8_t *)_sqRing + _p.sq_off.ring_mask);
+		_sqArray = (uint32_t *)((uint8_t *)_sqRing + _p.sq_off.array);
+		_cqHead = (uint32_t *)((uint8_t *)_cqRing + _p.cq_off.head);
+		_cqTail = (uint32_t *)((uint8_t *)_cqRing + _p.cq_off.tail);
+		_cqMask = *(uint32_t *)((uint8_t *)_cqRing + _p.cq_off.ring_mask);
+		_cqes = (struct io_uring_cqe *)((uint8_t *)_cqRing + _p.cq_off.cqes);
+		_sqPending = 0;
+
+		return true;
+	}
+
+	/**
+	 * Unmap and close ring (also done on destruction)
+	 */
+	inline void close()
+	{
+		if (_sqes)
+			::munmap((void *)_sqes,_sqesSize);
+		if ((_cqRing)&&(_cqRing != _sqRing))
+			::munmap(_cqRing,_cqRingSize);
+		if (_sqRing)
+			::munmap(_sqRing,_sqRingSize);
+		if (_fd >= 0)
+			::close(_fd);
+		_fd = -1;
+		_sqRing = (void *)0;
+		_cqRing = (void *)0;
+		_sqes = (struct io_uring_sqe *)0;
+	}
+
+	/**
+	 * @return True if init() succeeded and ring is open
+	 */
+	inline bool ok() const { return (_fd >= 0); }
+
+	/**
+	 * Register a set of fixed buffers for READ_FIXED
+	 *
+	 * Registered buffers are pinned once so the kernel does not have to map
+	 * and unmap user pages on every operation.
+	 *
+	 * @param iov Buffers (must remain valid for the life of the ring)
+	 * @param n Number of buffers
+	 * @return True on success
+	 */
+	inline bool registerBuffers(const struct iovec *iov,unsigned int n)
+	{
+		return (::syscall(__NR_io_uring_register,_fd,IORING_REGISTER_BUFFERS,iov,n) == 0);
+	}
+
+	/**
+	 * Get the next free submission queue entry
+	 *
+	 * @return SQE (zeroed) or NULL if the submission queue is full
+	 */
+	inline struct io_uring_sqe *sqe()
+	{
+		const uint32_t head = __atomic_load_n(_sqHead,__ATOMIC_ACQUIRE);
+		const uint32_t tail = *_sqTail + _sqPending;
+		if ((tail - head) >= _p.sq_entries)
+			return (struct io_uring_sqe *)0;
+		const uint32_t idx = tail & _sqMask;
+		struct io_uring_sqe *const s = &(_sqes[idx]);
+		memset(s,0,sizeof(struct io_uring_sqe));
+		_sqArray[idx] = idx;
+		++_sqPending;
+		return s;
+	}
+
+	inline bool prepPollAdd(int fd,short events,uint64_t userData)
+	{
+		struct io_uring_sqe *const s = sqe();
+		if (!s)
+			return false;
+		s->opcode = IORING_OP_POLL_ADD;
+		s->fd = fd;
+		s->poll_events = (uint16_t)events;
+		s->user_data = userData;
+		return true;
+	}
+
+	inline bool prepRead(int fd,void *buf,unsigned int len,uint64_t userData)
+	{
+		return (_prepReadSqe(IORING_OP_READ,fd,buf,len,userData) != (struct io_uring_sqe *)0);
+	}
+
+	/**
+	 * Read into a buffer previously registered with registerBuffers()
+	 *
+	 * @param bufIndex Index of registered buffer containing buf
+	 */
+	inline bool prepReadFixed(int fd,void *buf,unsigned int len,unsigned int bufIndex,uint64_t userData)
+	{
+		struct io_uring_sqe *const s = _prepReadSqe(IORING_OP_READ_FIXED,fd,buf,len,userData);
+		if (!s)
+			return false;
+		s->buf_index = (uint16_t)bufIndex;
+		return true;
+	}
+
+	/**
+	 * Publish all prepared SQEs and optionally wait for completions
+	 *
+	 * This is the only system call made per batch of I/O. SQEs published by
+	 * an earlier call that failed (e.g. with EBUSY while the completion queue
+	 * was full) are submitted again along with the new ones.
+	 *
+	 * @param waitFor Minimum number of completions to wait for (0 to just submit)
+	 * @return Number of SQEs consumed or negative errno on error
+	 */
+	inline int submit(unsigned int waitFor = 0)
+	{
+		if (_sqPending) {
+			__atomic_store_n(_sqTail,*_sqTail + _sqPending,__ATOMIC_RELEASE);
+			_sqPending = 0;
+		}
+		const unsigned int n = *_sqTail - __atomic_load_n(_sqHead,__ATOMIC_ACQUIRE);
+		if ((n == 0)&&(waitFor == 0))
+			return 0;
+		return _enter(n,waitFor,(waitFor > 0) ? IORING_ENTER_GETEVENTS : 0);
+	}
+
+	/**
+	 * Have the kernel move any completions it is holding back (because the
+	 * completion queue was full) into the queue, without waiting
+	 *
+	 * @return Zero or negative errno on error
+	 */
+	inline int flushCompletions()
+	{
+		const int r = _enter(0,0,IORING_ENTER_GETEVENTS);
+		return (r < 0) ? r : 0;
+	}
+
+	/**
+	 * Reap all available completions
+	 *
+	 * @param f Function or lambda taking (uint64_t userData,int32_t res,uint32_t flags)
+	 * @return Number of completions reaped
+	 */
+	template<typename F>
+	inline unsigned int reap(F f)
+	{
+		unsigned int cnt = 0;
+		uint32_t head = *_cqHead;
+		const uint32_t tail = __atomic_load_n(_cqTail,__ATOMIC_ACQUIRE);
+		while (head != tail) {
+			const struct io_uring_cqe *const c = &(_cqes[head & _cqMask]);
+			const uint64_t ud = c->user_data;
+			const int32_t res = c->res;
+			const uint32_t fl = c->flags;
+			++head;
+			__atomic_store_n(_cqHead,head,__ATOMIC_RELEASE);
+			f(ud,res,fl);
+			++cnt;
+		}
+		return cnt;
+	}
+
+	/**
+	 * @return Number of submission queue slots
+	 */
+	inline unsigned int depth() const { return _p.sq_entries; }
+
+private:
+	inline int _enter(unsigned int toSubmit,unsigned int waitFor,unsigned int flags)
+	{
+		for(;;) {
+			const int r = (int)::syscall(__NR_io_uring_enter,_fd,toSubmit,waitFor,flags,(void *)0,0);
+			if (r >= 0)
+				return r;
+			if (errno != EINTR)
+				return -errno;
+		}
+	}
+
+	inline struct io_uring_sqe *_prepReadSqe(uint8_t op,int fd,void *buf,unsigned int len,uint64_t userData)
+	{
+		struct io_uring_sqe *const s = sqe();
+		if (!s)
+			return s;
+		s->opcode = op;
+		s->fd = fd;
+		s->addr = (uint64_t)(uintptr_t)buf;
+		s->len = len;
+		s->off = (uint64_t)-1; // current file position, ignored for sockets and character devices
+		s->user_data = userData;
+		return s;
+	}
+
+	int _fd;
+	struct io_uring_params _p;
+	void *_sqRing;
+	void *_cqRing;
+	struct io_uring_sqe *_sqes;
+	size_t _sqRingSize;
+	size_t _cqRingSize;
+	size_t _sqesSize;
+	uint32_t *_sqHead;
+	uint32_t *_sqTail;
+	uint32_t _sqMask;
+	uint32_t *_sqArray;
+	uint32_t *_cqHead;
+	uint32_t *_cqTail;
+	uint32_t _cqMask;
+	struct io_uring_cqe *_cqes;
+	unsigned int _sqPending;
+
+	LinuxIoUring(const LinuxIoUring &) {}
+	LinuxIoUring &operator=(const LinuxIoUring &) { return *this; }
+};
+
+} // namespace ZeroTier
+
+#endif // ZT_IO_URING_AVAILABLE
+
+#endif
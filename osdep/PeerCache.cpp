@@ -0,0 +1,496 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef __WINDOWS__
+
+#include "PeerCache.hpp"
+#include "OSUtils.hpp"
+
+#include "../node/Constants.hpp"
+#include "../node/Utils.hpp"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+// File header (occupies the first slot)
+#define ZT_PEER_CACHE_MAGIC 0x5a545043 // "ZTPC"
+#define ZT_PEER_CACHE_VERSION 1
+
+// Slot layout
+#define ZT_PEER_CACHE_SLOT_KEY 0        // uint64_t address, or one of the two below
+#define ZT_PEER_CACHE_SLOT_TS 8         // int64_t time written
+#define ZT_PEER_CACHE_SLOT_LEN 16       // uint16_t length of data
+#define ZT_PEER_CACHE_SLOT_FLAGS 18     // uint16_t
+#define ZT_PEER_CACHE_SLOT_CHECKSUM 20  // uint32_t over everything before it plus data
+#define ZT_PEER_CACHE_SLOT_DATA 24
+#define ZT_PEER_CACHE_SLOT_CAPACITY (ZT_PEER_CACHE_SLOT_SIZE - ZT_PEER_CACHE_SLOT_DATA)
+
+#define ZT_PEER_CACHE_KEY_EMPTY 0ULL
+#define ZT_PEER_CACHE_KEY_ERASED 0xffffffffffffffffULL
+
+#define ZT_PEER_CACHE_FLAG_OVERFLOW 0x0001 // state didn't fit and is stored elsewhere
+
+namespace ZeroTier {
+
+namespace {
+
+struct _Header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slotSize;
+	uint32_t reserved;
+	uint64_t slots;
+};
+
+template<typename T>
+static inline T _field(const uint8_t *slot,const unsigned int at)
+{
+	T v;
+	memcpy(&v,slot + at,sizeof(T));
+	return v;
+}
+
+template<typename T>
+static inline void _setField(uint8_t *slot,const unsigned int at,const T v)
+{
+	memcpy(slot + at,&v,sizeof(T));
+}
+
+static inline uint8_t *_slot(uint8_t *map,const uint64_t i)
+{
+	return map + ((i + 1) * ZT_PEER_CACHE_SLOT_SIZE);
+}
+
+// Find a peer's slot, or if forInsert the slot it should go in, or NULL
+static uint8_t *_probe(uint8_t *map,const uint64_t slots,const uint64_t address,const bool forInsert)
+{
+	uint8_t *erased = (uint8_t *)0;
+	uint64_t i = ((address * 0x9e3779b97f4a7c15ULL) >> 24) & (slots - 1);
+	for(uint64_t n=0;n<slots;++n) {
+		uint8_t *const s = _slot(map,i);
+		const uint64_t k = _field<uint64_t>(s,ZT_PEER_CACHE_SLOT_KEY);
+		if (k == address)
+			return s;
+		if (k == ZT_PEER_CACHE_KEY_EMPTY)
+			return (forInsert) ? ((erased) ? erased : s) : (uint8_t *)0;
+		if ((k == ZT_PEER_CACHE_KEY_ERASED)&&(!erased))
+			erased = s;
+		i = (i + 1) & (slots - 1);
+	}
+	return (forInsert) ? erased : (uint8_t *)0;
+}
+
+static uint8_t *_mapFile(const int fd,const uint64_t slots)
+{
+	void *const m = mmap((void *)0,(size_t)((slots + 1) * ZT_PEER_CACHE_SLOT_SIZE),PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+	return (m == MAP_FAILED) ? (uint8_t *)0 : reinterpret_cast<uint8_t *>(m);
+}
+
+} // anonymous namespace
+
+PeerCache::PeerCache() :
+	_fd(-1),
+	_map((uint8_t *)0),
+	_slots(0),
+	_used(0),
+	_tombstones(0)
+{
+}
+
+PeerCache::~PeerCache()
+{
+	close();
+}
+
+bool PeerCache::open(const char *path,const char *fallbackPath)
+{
+	close();
+
+	std::lock_guard<std::mutex> l(_lock);
+	_path = path;
+	_fallbackPath = fallbackPath;
+	_fd = ::open(path,O_RDWR|O_CREAT,0600);
+	if (_fd < 0)
+		return false;
+
+	struct stat st;
+	_Header h;
+	memset(&h,0,sizeof(h));
+	if ((fstat(_fd,&st) == 0)&&(st.st_size >= ZT_PEER_CACHE_SLOT_SIZE)&&(pread(_fd,&h,sizeof(h),0) == (ssize_t)sizeof(h))
+	    &&(h.magic == ZT_PEER_CACHE_MAGIC)&&(h.version == ZT_PEER_CACHE_VERSION)&&(h.slotSize == ZT_PEER_CACHE_SLOT_SIZE)
+	    &&(h.slots >= ZT_PEER_CACHE_MIN_SLOTS)&&((h.slots & (h.slots - 1)) == 0)&&((uint64_t)st.st_size == ((h.slots + 1) * ZT_PEER_CACHE_SLOT_SIZE))) {
+		_slots = h.slots;
+	} else {
+		// New, from another version, or damaged: start over, it's only a cache
+		_slots = ZT_PEER_CACHE_MIN_SLOTS;
+		h.magic = ZT_PEER_CACHE_MAGIC;
+		h.version = ZT_PEER_CACHE_VERSION;
+		h.slotSize = ZT_PEER_CACHE_SLOT_SIZE;
+		h.reserved = 0;
+		h.slots = _slots;
+		if ((ftruncate(_fd,0) != 0)||(ftruncate(_fd,(off_t)((_slots + 1) * ZT_PEER_CACHE_SLOT_SIZE)) != 0)||(pwrite(_fd,&h,sizeof(h),0) != (ssize_t)sizeof(h))) {
+			::close(_fd);
+			_fd = -1;
+			return false;
+		}
+	}
+
+	_map = _mapFile(_fd,_slots);
+	if (!_map) {
+		::close(_fd);
+		_fd = -1;
+		return false;
+	}
+
+	// One sequential pass to count peers and drop slots torn by a crash. Bad
+	// slots become erased rather than empty so probe chains through them hold.
+	madvise(_map,(size_t)((_slots + 1) * ZT_PEER_CACHE_SLOT_SIZE),MADV_SEQUENTIAL);
+	_used = 0;
+	_tombstones = 0;
+	for(uint64_t i=0;i<_slots;++i) {
+		uint8_t *const s = _slot(_map,i);
+		const uint64_t k = _field<uint64_t>(s,ZT_PEER_CACHE_SLOT_KEY);
+		if (k == ZT_PEER_CACHE_KEY_EMPTY)
+			continue;
+		if (k != ZT_PEER_CACHE_KEY_ERASED) {
+			const unsigned int len = _field<uint16_t>(s,ZT_PEER_CACHE_SLOT_LEN);
+			if ((len <= ZT_PEER_CACHE_SLOT_CAPACITY)&&(_field<uint32_t>(s,ZT_PEER_CACHE_SLOT_CHECKSUM) == _checksum(s,len))) {
+				++_used;
+				continue;
+			}
+			_setField<uint64_t>(s,ZT_PEER_CACHE_SLOT_KEY,ZT_PEER_CACHE_KEY_ERASED);
+		}
+		++_tombstones;
+	}
+	madvise(_map,(size_t)((_slots + 1) * ZT_PEER_CACHE_SLOT_SIZE),MADV_RANDOM);
+
+	return true;
+}
+
+void PeerCache::close()
+{
+	flush();
+	std::lock_guard<std::mutex> l(_lock);
+	if (_map) {
+		msync(_map,(size_t)((_slots + 1) * ZT_PEER_CACHE_SLOT_SIZE),MS_SYNC);
+		munmap(_map,(size_t)((_slots + 1) * ZT_PEER_CACHE_SLOT_SIZE));
+		_map = (uint8_t *)0;
+	}
+	if (_fd >= 0) {
+		::close(_fd);
+		_fd = -1;
+	}
+	_slots = 0;
+	_used = 0;
+	_tombstones = 0;
+	_changes.clear();
+	_elsewhere.clear();
+}
+
+int PeerCache::get(const uint64_t address,void *data,const unsigned int maxlen)
+{
+	std::lock_guard<std::mutex> l(_lock);
+	if (!_map)
+		return -1;
+
+	auto c = _changes.find(address);
+	if (c != _changes.end()) {
+		if (c->second.op == _OP_ERASE)
+			return -1;
+		if (c->second.op == _OP_OVERFLOW)
+			return -2;
+		const unsigned int len = std::min((unsigned int)c->second.data.size(),maxlen);
+		memcpy(data,c->second.data.data(),len);
+		return (int)len;
+	}
+	if (_elsewhere.count(address))
+		return -2;
+
+	const uint8_t *const s = _find(address,false);
+	if (!s)
+		return -1;
+	if ((_field<uint16_t>(s,ZT_PEER_CACHE_SLOT_FLAGS) & ZT_PEER_CACHE_FLAG_OVERFLOW) != 0)
+		return -2;
+	const unsigned int len = std::min((unsigned int)_field<uint16_t>(s,ZT_PEER_CACHE_SLOT_LEN),maxlen);
+	memcpy(data,s + ZT_PEER_CACHE_SLOT_DATA,len);
+	return (int)len;
+}
+
+bool PeerCache::put(const uint64_t address,const void *data,const unsigned int len)
+{
+	if ((address == ZT_PEER_CACHE_KEY_EMPTY)||(address == ZT_PEER_CACHE_KEY_ERASED))
+		return false;
+	const bool fits = (len <= ZT_PEER_CACHE_SLOT_CAPACITY);
+	std::lock_guard<std::mutex> l(_lock);
+	_Change &c = _changes[address];
+	c.ts = OSUtils::now();
+	if (fits) {
+		c.data.assign(reinterpret_cast<const char *>(data),len);
+		c.op = _OP_PUT;
+	} else {
+		c.data.clear();
+		c.op = _OP_OVERFLOW;
+	}
+	return fits;
+}
+
+void PeerCache::erase(const uint64_t address)
+{
+	std::lock_guard<std::mutex> l(_lock);
+	_Change &c = _changes[address];
+	c.ts = 0;
+	c.data.clear();
+	c.op = _OP_ERASE;
+}
+
+unsigned long PeerCache::flush()
+{
+	std::lock_guard<std::mutex> l(_lock);
+	if ((!_map)||(_changes.empty()))
+		return 0;
+
+	// Keep the table at most half full, counting erased slots since they lengthen probes too
+	if (((_used + _tombstones + _changes.size()) * 2) > _slots) {
+		uint64_t slots = _slots;
+		while (((_used + _changes.size()) * 2) > slots)
+			slots <<= 1;
+		if (!_rebuild(slots))
+			fprintf(stderr,"WARNING: unable to grow %s, saving peers that don't fit in %s instead" ZT_EOL_S,_path.c_str(),_fallbackPath.c_str());
+	}
+
+	unsigned long written = 0;
+	uint8_t *lo = _map + ((_slots + 1) * ZT_PEER_CACHE_SLOT_SIZE),*hi = _map;
+	for(auto c=_changes.begin();c!=_changes.end();++c) {
+		uint8_t *s = _find(c->first,false);
+		if (c->second.op == _OP_ERASE) {
+			_elsewhere.erase(c->first); // the caller removes its file
+			if (!s)
+				continue;
+			_setField<uint64_t>(s,ZT_PEER_CACHE_SLOT_KEY,ZT_PEER_CACHE_KEY_ERASED);
+			--_used;
+			++_tombstones;
+		} else {
+			const bool overflow = (c->second.op == _OP_OVERFLOW);
+			if (s) {
+				// Unchanged state isn't written again, as with the peers.d files
+				const uint16_t flags = _field<uint16_t>(s,ZT_PEER_CACHE_SLOT_FLAGS);
+				if ( (overflow) ? ((flags & ZT_PEER_CACHE_FLAG_OVERFLOW) != 0) : (((flags & ZT_PEER_CACHE_FLAG_OVERFLOW) == 0)&&(_field<uint16_t>(s,ZT_PEER_CACHE_SLOT_LEN) == c->second.data.size())&&(memcmp(s + ZT_PEER_CACHE_SLOT_DATA,c->second.data.data(),c->second.data.size()) == 0)) )
+					continue;
+			} else {
+				s = _find(c->first,true);
+				if (!s) {
+					// Full, and couldn't be grown above
+					_storeElsewhere(c->first,c->second);
+					continue;
+				}
+				if (_field<uint64_t>(s,ZT_PEER_CACHE_SLOT_KEY) == ZT_PEER_CACHE_KEY_ERASED)
+					--_tombstones;
+				++_used;
+			}
+			_write(s,c->first,c->second.ts,c->second.data.data(),(unsigned int)c->second.data.size(),overflow);
+			if ((_elsewhere.erase(c->first))&&(!overflow))
+				OSUtils::rm(_fallbackFile(c->first).c_str());
+		}
+		++written;
+		if (s < lo)
+			lo = s;
+		if ((s + ZT_PEER_CACHE_SLOT_SIZE) > hi)
+			hi = s + ZT_PEER_CACHE_SLOT_SIZE;
+	}
+	_changes.clear();
+
+	if (hi > lo) {
+		const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+		uint8_t *const start = _map + ((((uintptr_t)(lo - _map)) / page) * page);
+		msync(start,(size_t)(hi - start),MS_ASYNC);
+	}
+
+	return written;
+}
+
+unsigned long PeerCache::clean(const int64_t olderThan)
+{
+	std::lock_guard<std::mutex> l(_lock);
+	if (!_map)
+		return 0;
+	unsigned long dropped = 0;
+	for(uint64_t i=0;i<_slots;++i) {
+		uint8_t *const s = _slot(_map,i);
+		const uint64_t k = _field<uint64_t>(s,ZT_PEER_CACHE_SLOT_KEY);
+		if ((k != ZT_PEER_CACHE_KEY_EMPTY)&&(k != ZT_PEER_CACHE_KEY_ERASED)&&(_field<int64_t>(s,ZT_PEER_CACHE_SLOT_TS) < olderThan)&&(_changes.find(k) == _changes.end())) {
+			_setField<uint64_t>(s,ZT_PEER_CACHE_SLOT_KEY,ZT_PEER_CACHE_KEY_ERASED);
+			--_used;
+			++_tombstones;
+			++dropped;
+		}
+	}
+	return dropped;
+}
+
+unsigned long PeerCache::importDirectory(const char *path)
+{
+	if (!isOpen())
+		return 0;
+
+	const std::string dir(path);
+	std::vector<std::string> files(OSUtils::listDirectory(path,false));
+	std::vector<std::string> imported;
+	std::string buf;
+	for(auto f=files.begin();f!=files.end();++f) {
+		if ((f->length() != 15)||(f->substr(10) != ".peer"))
+			continue;
+		const uint64_t address = Utils::hexStrToU64(f->substr(0,10).c_str());
+		const std::string fp(dir + ZT_PATH_SEPARATOR_S + *f);
+		buf.clear();
+		if ((!address)||(!OSUtils::readFile(fp.c_str(),buf))||(buf.empty()))
+			continue;
+		if (put(address,buf.data(),(unsigned int)buf.size()))
+			imported.push_back(fp);
+	}
+	flush();
+
+	// Files are only removed once what replaces them is on disk, and not at
+	// all for peers that didn't fit and were saved as files again
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		if (_map)
+			msync(_map,(size_t)((_slots + 1) * ZT_PEER_CACHE_SLOT_SIZE),MS_SYNC);
+		imported.erase(std::remove_if(imported.begin(),imported.end(),[this,&dir](const std::string &fp) {
+			return (_elsewhere.count(Utils::hexStrToU64(fp.substr(dir.length() + 1,10).c_str())) != 0);
+		}),imported.end());
+	}
+	for(auto fp=imported.begin();fp!=imported.end();++fp)
+		OSUtils::rm(fp->c_str());
+	rmdir(path); // only if that was everything
+
+	return (unsigned long)imported.size();
+}
+
+unsigned long PeerCache::size() const
+{
+	std::lock_guard<std::mutex> l(_lock);
+	return (unsigned long)_used;
+}
+
+bool PeerCache::_rebuild(const uint64_t slots)
+{
+	// Build the new table in a separate file and rename it over the old one,
+	// so a crash part way through leaves one or the other intact.
+	const std::string tmpPath(_path + ".new");
+	const int fd = ::open(tmpPath.c_str(),O_RDWR|O_CREAT|O_TRUNC,0600);
+	if (fd < 0)
+		return false;
+	if (ftruncate(fd,(off_t)((slots + 1) * ZT_PEER_CACHE_SLOT_SIZE)) != 0) {
+		::close(fd);
+		OSUtils::rm(tmpPath.c_str());
+		return false;
+	}
+	uint8_t *const map = _mapFile(fd,slots);
+	if (!map) {
+		::close(fd);
+		OSUtils::rm(tmpPath.c_str());
+		return false;
+	}
+
+	_Header h;
+	memset(&h,0,sizeof(h));
+	h.magic = ZT_PEER_CACHE_MAGIC;
+	h.version = ZT_PEER_CACHE_VERSION;
+	h.slotSize = ZT_PEER_CACHE_SLOT_SIZE;
+	h.slots = slots;
+	memcpy(map,&h,sizeof(h));
+
+	uint64_t used = 0;
+	for(uint64_t i=0;i<_slots;++i) {
+		const uint8_t *const s = _slot(_map,i);
+		const uint64_t k = _field<uint64_t>(s,ZT_PEER_CACHE_SLOT_KEY);
+		if ((k != ZT_PEER_CACHE_KEY_EMPTY)&&(k != ZT_PEER_CACHE_KEY_ERASED)) {
+			memcpy(_probe(map,slots,k,true),s,ZT_PEER_CACHE_SLOT_SIZE);
+			++used;
+		}
+	}
+
+	msync(map,(size_t)((slots + 1) * ZT_PEER_CACHE_SLOT_SIZE),MS_SYNC);
+	if (rename(tmpPath.c_str(),_path.c_str()) != 0) {
+		munmap(map,(size_t)((slots + 1) * ZT_PEER_CACHE_SLOT_SIZE));
+		::close(fd);
+		OSUtils::rm(tmpPath.c_str());
+		return false;
+	}
+
+	munmap(_map,(size_t)((_slots + 1) * ZT_PEER_CACHE_SLOT_SIZE));
+	::close(_fd);
+	_fd = fd;
+	_map = map;
+	_slots = slots;
+	_used = used;
+	_tombstones = 0;
+	return true;
+}
+
+void PeerCache::_storeElsewhere(const uint64_t address,const _Change &c)
+{
+	// Peers too big for a slot are already in the caller's own file
+	if (c.op == _OP_PUT) {
+		OSUtils::mkdir(_fallbackPath);
+		if (!OSUtils::writeFile(_fallbackFile(address).c_str(),c.data))
+			return;
+	}
+	_elsewhere.insert(address);
+}
+
+std::string PeerCache::_fallbackFile(const uint64_t address) const
+{
+	char fn[32];
+	OSUtils::ztsnprintf(fn,sizeof(fn),ZT_PATH_SEPARATOR_S "%.10llx.peer",(unsigned long long)address);
+	return _fallbackPath + fn;
+}
+
+uint8_t *PeerCache::_find(const uint64_t address,const bool forInsert) const
+{
+	return _probe(_map,_slots,address,forInsert);
+}
+
+uint32_t PeerCache::_checksum(const uint8_t *slot,const unsigned int len)
+{
+	// FNV-1a, only there to catch slots torn by a crash
+	uint32_t h = 0x811c9dc5;
+	for(unsigned int i=0;i<ZT_PEER_CACHE_SLOT_CHECKSUM;++i)
+		h = (h ^ slot[i]) * 0x01000193;
+	for(unsigned int i=0;i<len;++i)
+		h = (h ^ slot[ZT_PEER_CACHE_SLOT_DATA + i]) * 0x01000193;
+	return h;
+}
+
+void PeerCache::_write(uint8_t *slot,const uint64_t address,const int64_t ts,const void *data,const unsigned int len,const bool overflow)
+{
+	_setField<int64_t>(slot,ZT_PEER_CACHE_SLOT_TS,ts);
+	_setField<uint16_t>(slot,ZT_PEER_CACHE_SLOT_LEN,(uint16_t)((overflow) ? 0 : len));
+	_setField<uint16_t>(slot,ZT_PEER_CACHE_SLOT_FLAGS,(uint16_t)((overflow) ? ZT_PEER_CACHE_FLAG_OVERFLOW : 0));
+	if (!overflow)
+		memcpy(slot + ZT_PEER_CACHE_SLOT_DATA,data,len);
+	_setField<uint64_t>(slot,ZT_PEER_CACHE_SLOT_KEY,address);
+	_setField<uint32_t>(slot,ZT_PEER_CACHE_SLOT_CHECKSUM,_checksum(slot,(overflow) ? 0 : len));
+}
+
+} // namespace ZeroTier
+
+#endif // !__WINDOWS__
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_PEERCACHE_HPP
+#define ZT_PEERCACHE_HPP
+
+#ifndef __WINDOWS__
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// Bytes per slot including its header; peers that don't fit are kept elsewhere
+#define ZT_PEER_CACHE_SLOT_SIZE 256
+
+// Slots in a new cache file (power of two)
+#define ZT_PEER_CACHE_MIN_SLOTS 1024
+
+// How often the service writes changed peers back to the cache file (ms)
+#define ZT_PEER_CACHE_FLUSH_INTERVAL 10000
+
+namespace ZeroTier {
+
+/**
+ * Cached peer state in one memory-mapped file
+ *
+ * Replaces one file per peer in peers.d. The file is an open-addressed hash
+ * table of fixed-size slots keyed by ZeroTier address, so finding a peer is a
+ * probe or two in mapped memory and a peer the cache has never seen costs no
+ * I/O at all.
+ *
+ * put() and erase() only note the change in memory. flush() applies all
+ * changes since the last one to the mapped slots, skipping peers whose state
+ * hasn't changed, and then syncs the pages it touched in one go. The service
+ * calls it every ZT_PEER_CACHE_FLUSH_INTERVAL and on shutdown, so a crash
+ * loses at most that much, and this is only a cache. Each slot carries a
+ * checksum and slots torn by a crash are dropped when the file is opened.
+ *
+ * Opening the file reads it once from start to end to check every slot,
+ * which also brings it into memory in a single sequential pass.
+ *
+ * Peer state too large for a slot (many paths) is marked as such and left
+ * to the caller to store some other way.
+ *
+ * If the table is full and can't be grown (e.g. the disk is full), new peers
+ * are written as peers.d style files to a fallback directory instead, and
+ * get() reports them as stored elsewhere so the caller reads those files.
+ */
+class PeerCache
+{
+public:
+	PeerCache();
+	~PeerCache();
+
+	/**
+	 * Open or create a cache file
+	 *
+	 * @param path Cache file
+	 * @param fallbackPath Directory for <address>.peer files of peers the cache can't hold
+	 * @return True on success
+	 */
+	bool open(const char *path,const char *fallbackPath);
+
+	/**
+	 * Flush and unmap the cache file
+	 */
+	void close();
+
+	inline bool isOpen() const { return (_map != (uint8_t *)0); }
+
+	/**
+	 * @param address Peer address
+	 * @param data Buffer for peer state
+	 * @param maxlen Size of buffer
+	 * @return Length of state, -1 if not cached, or -2 if the peer's state didn't fit and is stored elsewhere
+	 */
+	int get(const uint64_t address,void *data,const unsigned int maxlen);
+
+	/**
+	 * @param address Peer address
+	 * @param data Peer state
+	 * @param len Length of state
+	 * @return False if state doesn't fit in a slot (the peer is marked as stored elsewhere)
+	 */
+	bool put(const uint64_t address,const void *data,const unsigned int len);
+
+	/**
+	 * @param address Peer address
+	 */
+	void erase(const uint64_t address);
+
+	/**
+	 * Write all changes since the last flush to the file
+	 *
+	 * @return Number of slots changed
+	 */
+	unsigned long flush();
+
+	/**
+	 * Drop peers last written before a given time
+	 *
+	 * @param olderThan Time in ms since epoch
+	 * @return Number of peers dropped
+	 */
+	unsigned long clean(const int64_t olderThan);
+
+	/**
+	 * Move peers.d style files into this cache
+	 *
+	 * Files whose state fits in a slot are removed once it is stored.
+	 *
+	 * @param path Directory of <address>.peer files
+	 * @return Number of peers imported
+	 */
+	unsigned long importDirectory(const char *path);
+
+	/**
+	 * @return Number of peers in cache file (not counting unflushed changes)
+	 */
+	unsigned long size() const;
+
+private:
+	enum _Op
+	{
+		_OP_PUT,
+		_OP_OVERFLOW,
+		_OP_ERASE
+	};
+
+	struct _Change
+	{
+		int64_t ts;
+		std::string data;
+		_Op op;
+	};
+
+	bool _rebuild(const uint64_t slots);
+	void _storeElsewhere(const uint64_t address,const _Change &c);
+	std::string _fallbackFile(const uint64_t address) const;
+	uint8_t *_find(const uint64_t address,const bool forInsert) const;
+	static uint32_t _checksum(const uint8_t *slot,const unsigned int len);
+	static void _write(uint8_t *slot,const uint64_t address,const int64_t ts,const void *data,const unsigned int len,const bool overflow);
+
+	std::string _path;
+	std::string _fallbackPath;
+	int _fd;
+	uint8_t *_map;
+	uint64_t _slots;
+	uint64_t _used;      // slots holding a peer
+	uint64_t _tombstones; // slots whose peer was erased
+	std::unordered_map< uint64_t,_Change > _changes;
+	std::unordered_set< uint64_t > _elsewhere; // peers with no slot, in files under _fallbackPath
+	mutable std::mutex _lock;
+};
+
+} // namespace ZeroTier
+
+#endif // !__WINDOWS__
+
+#endif
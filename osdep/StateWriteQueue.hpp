@@ -0,0 +1,196 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_STATEWRITEQUEUE_HPP
+#define ZT_STATEWRITEQUEUE_HPP
+
+#include "../node/Metrics.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace ZeroTier {
+
+/**
+ * Write-behind queue for state objects
+ *
+ * put() returns at once and a worker thread does the write, so a slow disk
+ * doesn't hold up whichever thread saved the object (often one handling
+ * packets). Objects are written in the order they were first queued. Saving
+ * an object that is still waiting replaces the waiting copy in place, so an
+ * object saved many times in a burst is written once, with its last value.
+ *
+ * Until an object has been written, get() returns the queued copy, so reads
+ * never see an older version on disk. flush() waits until nothing is left
+ * to write, which the service does at shutdown.
+ */
+class StateWriteQueue
+{
+public:
+	/**
+	 * Does the actual write: (type, id, data, len), len < 0 to delete
+	 */
+	typedef std::function<void(int,const uint64_t *,const void *,int)> Writer;
+
+	StateWriteQueue(const Writer &writer) :
+		_writer(writer),
+		_running(true),
+		_thread(&StateWriteQueue::_run,this)
+	{
+	}
+
+	~StateWriteQueue()
+	{
+		flush();
+		{
+			std::lock_guard<std::mutex> l(_lock);
+			_running = false;
+			_c.notify_all();
+		}
+		_thread.join();
+	}
+
+	/**
+	 * @param type Object type
+	 * @param id Object ID (two words)
+	 * @param data Object data, or NULL to delete
+	 * @param len Length of data, or negative to delete
+	 */
+	inline void put(const int type,const uint64_t id[2],const void *data,const int len)
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		const _Key k(type,id[0],id[1]);
+		_Entry &e = _pending[k];
+		if (e.queued) {
+			Metrics::state_write_coalesced++;
+		} else {
+			_order.push_back(k);
+			e.queued = true;
+		}
+		if ((len >= 0)&&(data)) {
+			e.data.assign(reinterpret_cast<const char *>(data),(unsigned long)len);
+			e.erase = false;
+		} else {
+			e.data.clear();
+			e.erase = true;
+		}
+		Metrics::state_write_queue_depth = (double)_order.size();
+		_c.notify_all();
+	}
+
+	/**
+	 * @param n Set to length copied into data, or -1 if a delete is queued
+	 * @return True if object is queued (n is set), false to read it from disk
+	 */
+	inline bool get(const int type,const uint64_t id[2],void *data,const unsigned int maxlen,int &n) const
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		auto e = _pending.find(_Key(type,id[0],id[1]));
+		if (e == _pending.end())
+			return false;
+		if (e->second.erase) {
+			n = -1;
+		} else {
+			n = (int)std::min((unsigned int)e->second.data.size(),maxlen);
+			memcpy(data,e->second.data.data(),(size_t)n);
+		}
+		return true;
+	}
+
+	/**
+	 * Wait until everything queued has been written
+	 */
+	inline void flush()
+	{
+		std::unique_lock<std::mutex> l(_lock);
+		while ((_running)&&(!_pending.empty()))
+			_c.wait(l);
+	}
+
+	inline unsigned long size() const
+	{
+		std::lock_guard<std::mutex> l(_lock);
+		return (unsigned long)_order.size();
+	}
+
+private:
+	struct _Key
+	{
+		_Key(const int t,const uint64_t a,const uint64_t b) : type(t),id0(a),id1(b) {}
+		inline bool operator<(const _Key &k) const { return ((type < k.type)||((type == k.type)&&((id0 < k.id0)||((id0 == k.id0)&&(id1 < k.id1))))); }
+		int type;
+		uint64_t id0,id1;
+	};
+
+	struct _Entry
+	{
+		_Entry() : erase(false),queued(false) {}
+		std::string data;
+		bool erase;
+		bool queued; // in _order; false while the worker writes it unless put() again since
+	};
+
+	void _run()
+	{
+		std::unique_lock<std::mutex> l(_lock);
+		for(;;) {
+			while ((_running)&&(_order.empty()))
+				_c.wait(l);
+			if (_order.empty())
+				return;
+
+			const _Key k(_order.front());
+			_order.pop_front();
+			Metrics::state_write_queue_depth = (double)_order.size();
+			_Entry &e = _pending[k];
+			const std::string data(e.data);
+			const bool erase = e.erase;
+			e.queued = false;
+			l.unlock();
+
+			// Entries stay in _pending while being written so get() never falls through to a half written file
+			const uint64_t id[2] = { k.id0,k.id1 };
+			const auto start = std::chrono::steady_clock::now();
+			_writer(k.type,id,(erase) ? (const void *)0 : data.data(),(erase) ? -1 : (int)data.size());
+			Metrics::state_write_latency_all.Observe((uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+
+			l.lock();
+			auto e2 = _pending.find(k);
+			if ((e2 != _pending.end())&&(!e2->second.queued))
+				_pending.erase(e2); // else put() again while writing, and queued again
+			_c.notify_all();
+		}
+	}
+
+	const Writer _writer;
+	std::map< _Key,_Entry > _pending;
+	std::deque<_Key> _order; // objects waiting to be written, in the order first queued
+	bool _running;
+	mutable std::mutex _lock;
+	std::condition_variable _c;
+	std::thread _thread;
+};
+
+} // namespace ZeroTier
+
+#endif
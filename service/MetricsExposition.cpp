@@ -0,0 +1,448 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#include "MetricsExposition.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <sstream>
+#include <vector>
+
+#include <prometheus/text_serializer.h>
+
+namespace ZeroTier {
+
+namespace {
+
+// FNV-1a, only used to notice when a family's contents change
+class _Fingerprint
+{
+public:
+	_Fingerprint() : _h(0xcbf29ce484222325ULL) {}
+	inline void add(const void *data,unsigned long len)
+	{
+		for(unsigned long i=0;i<len;++i) {
+			_h ^= (uint64_t)reinterpret_cast<const uint8_t *>(data)[i];
+			_h *= 0x100000001b3ULL;
+		}
+	}
+	inline void add(const std::string &s) { add(s.data(),(unsigned long)s.length()); add("",1); }
+	inline void add(const double v) { add(&v,sizeof(v)); }
+	inline void add(const uint64_t v) { add(&v,sizeof(v)); }
+	inline uint64_t get() const { return _h; }
+private:
+	uint64_t _h;
+};
+
+static uint64_t _fingerprint(const prometheus::MetricFamily &family)
+{
+	_Fingerprint fp;
+	fp.add((uint64_t)family.type);
+	fp.add(family.help);
+	fp.add((uint64_t)family.metric.size());
+	for(std::vector<prometheus::ClientMetric>::const_iterator m(family.metric.begin());m!=family.metric.end();++m) {
+		fp.add((uint64_t)m->label.size());
+		for(std::vector<prometheus::ClientMetric::Label>::const_iterator l(m->label.begin());l!=m->label.end();++l) {
+			fp.add(l->name);
+			fp.add(l->value);
+		}
+		switch(family.type) {
+			case prometheus::Metric::Type::Counter:
+				fp.add(m->counter.value);
+				break;
+			case prometheus::Metric::Type::Gauge:
+				fp.add(m->gauge.value);
+				break;
+			case prometheus::Metric::Type::Summary:
+				fp.add((uint64_t)m->summary.sample_count);
+				fp.add(m->summary.sample_sum);
+				for(std::vector<prometheus::ClientMetric::Quantile>::const_iterator q(m->summary.quantile.begin());q!=m->summary.quantile.end();++q) {
+					fp.add(q->quantile);
+					fp.add(q->value);
+				}
+				break;
+			case prometheus::Metric::Type::Untyped:
+				fp.add(m->untyped.value);
+				break;
+			case prometheus::Metric::Type::Histogram:
+				fp.add((uint64_t)m->histogram.sample_count);
+				fp.add(m->histogram.sample_sum);
+				for(std::vector<prometheus::ClientMetric::Bucket>::const_iterator b(m->histogram.bucket.begin());b!=m->histogram.bucket.end();++b) {
+					fp.add((uint64_t)b->cumulative_count);
+					fp.add(b->upper_bound);
+				}
+				break;
+		}
+		fp.add((uint64_t)m->timestamp_ms);
+	}
+	return fp.get();
+}
+
+/*
+ * OpenMetrics text
+ */
+
+static void _omValue(std::string &out,const double v)
+{
+	if (isnan(v)) {
+		out.append("NaN");
+	} else if (isinf(v)) {
+		out.append((v < 0.0) ? "-Inf" : "+Inf");
+	} else {
+		char tmp[64];
+		snprintf(tmp,sizeof(tmp),"%.17g",v);
+		out.append(tmp);
+	}
+}
+
+static void _omValue(std::string &out,const uint64_t v)
+{
+	char tmp[32];
+	snprintf(tmp,sizeof(tmp),"%llu",(unsigned long long)v);
+	out.append(tmp);
+}
+
+static void _omEscape(std::string &out,const std::string &s)
+{
+	for(std::string::const_iterator c(s.begin());c!=s.end();++c) {
+		switch(*c) {
+			case '\n': out.append("\\n"); break;
+			case '\\': out.append("\\\\"); break;
+			case '"': out.append("\\\""); break;
+			default: out.push_back(*c); break;
+		}
+	}
+}
+
+static void _omHead(std::string &out,const std::string &name,const char *suffix,const prometheus::ClientMetric &m,const char *extraName = (const char *)0,const double extraValue = 0.0)
+{
+	out.append(name);
+	out.append(suffix);
+	if ((!m.label.empty())||(extraName)) {
+		out.push_back('{');
+		bool first = true;
+		for(std::vector<prometheus::ClientMetric::Label>::const_iterator l(m.label.begin());l!=m.label.end();++l) {
+			if (!first) {
+				out.push_back(',');
+			}
+			first = false;
+			out.append(l->name);
+			out.append("=\"");
+			_omEscape(out,l->value);
+			out.push_back('"');
+		}
+		if (extraName) {
+			if (!first) {
+				out.push_back(',');
+			}
+			out.append(extraName);
+			out.append("=\"");
+			_omValue(out,extraValue);
+			out.push_back('"');
+		}
+		out.push_back('}');
+	}
+	out.push_back(' ');
+}
+
+static void _omTail(std::string &out,const prometheus::ClientMetric &m)
+{
+	if (m.timestamp_ms != 0) {
+		// OpenMetrics timestamps are in seconds
+		char tmp[64];
+		snprintf(tmp,sizeof(tmp)," %lld.%03d",(long long)(m.timestamp_ms / 1000),(int)(m.timestamp_ms % 1000));
+		out.append(tmp);
+	}
+	out.push_back('\n');
+}
+
+static void _renderOpenMetrics(const prometheus::MetricFamily &family,std::string &out)
+{
+	// Counter samples must end in _total and the family name must not
+	std::string name(family.name);
+	if ((family.type == prometheus::Metric::Type::Counter)&&(name.length() > 6)&&(name.compare(name.length() - 6,6,"_total") == 0)) {
+		name.resize(name.length() - 6);
+	}
+
+	out.append("# TYPE ");
+	out.append(name);
+	switch(family.type) {
+		case prometheus::Metric::Type::Counter: out.append(" counter\n"); break;
+		case prometheus::Metric::Type::Gauge: out.append(" gauge\n"); break;
+		case prometheus::Metric::Type::Summary: out.append(" summary\n"); break;
+		case prometheus::Metric::Type::Untyped: out.append(" unknown\n"); break;
+		case prometheus::Metric::Type::Histogram: out.append(" histogram\n"); break;
+	}
+	if (!family.help.empty()) {
+		out.append("# HELP ");
+		out.append(name);
+		out.push_back(' ');
+		_omEscape(out,family.help);
+		out.push_back('\n');
+	}
+
+	for(std::vector<prometheus::ClientMetric>::const_iterator m(family.metric.begin());m!=family.metric.end();++m) {
+		switch(family.type) {
+			case prometheus::Metric::Type::Counter:
+				_omHead(out,name,"_total",*m);
+				_omValue(out,m->counter.value);
+				_omTail(out,*m);
+				break;
+			case prometheus::Metric::Type::Gauge:
+				_omHead(out,name,"",*m);
+				_omValue(out,m->gauge.value);
+				_omTail(out,*m);
+				break;
+			case prometheus::Metric::Type::Untyped:
+				_omHead(out,name,"",*m);
+				_omValue(out,m->untyped.value);
+				_omTail(out,*m);
+				break;
+			case prometheus::Metric::Type::Summary:
+				for(std::vector<prometheus::ClientMetric::Quantile>::const_iterator q(m->summary.quantile.begin());q!=m->summary.quantile.end();++q) {
+					_omHead(out,name,"",*m,"quantile",q->quantile);
+					_omValue(out,q->value);
+					_omTail(out,*m);
+				}
+				_omHead(out,name,"_sum",*m);
+				_omValue(out,m->summary.sample_sum);
+				_omTail(out,*m);
+				_omHead(out,name,"_count",*m);
+				_omValue(out,(uint64_t)m->summary.sample_count);
+				_omTail(out,*m);
+				break;
+			case prometheus::Metric::Type::Histogram: {
+				bool haveInf = false;
+				for(std::vector<prometheus::ClientMetric::Bucket>::const_iterator b(m->histogram.bucket.begin());b!=m->histogram.bucket.end();++b) {
+					_omHead(out,name,"_bucket",*m,"le",b->upper_bound);
+					_omValue(out,(uint64_t)b->cumulative_count);
+					_omTail(out,*m);
+					haveInf |= (isinf(b->upper_bound) && (b->upper_bound > 0.0));
+				}
+				if (!haveInf) {
+					_omHead(out,name,"_bucket",*m,"le",INFINITY);
+					_omValue(out,(uint64_t)m->histogram.sample_count);
+					_omTail(out,*m);
+				}
+				_omHead(out,name,"_sum",*m);
+				_omValue(out,m->histogram.sample_sum);
+				_omTail(out,*m);
+				_omHead(out,name,"_count",*m);
+				_omValue(out,(uint64_t)m->histogram.sample_count);
+				_omTail(out,*m);
+			}	break;
+		}
+	}
+}
+
+/*
+ * Delimited protobuf, see io.prometheus.client metrics.proto
+ */
+
+static void _pbVarint(std::string &out,uint64_t v)
+{
+	while (v >= 0x80) {
+		out.push_back((char)((v & 0x7f) | 0x80));
+		v >>= 7;
+	}
+	out.push_back((char)v);
+}
+
+static inline void _pbKey(std::string &out,const unsigned int field,const unsigned int wireType)
+{
+	_pbVarint(out,((uint64_t)field << 3) | wireType);
+}
+
+static void _pbBytes(std::string &out,const unsigned int field,const std::string &v)
+{
+	_pbKey(out,field,2);
+	_pbVarint(out,(uint64_t)v.length());
+	out.append(v);
+}
+
+static void _pbDouble(std::string &out,const unsigned int field,const double v)
+{
+	uint64_t bits;
+	memcpy(&bits,&v,8);
+	_pbKey(out,field,1);
+	for(unsigned int i=0;i<8;++i) {
+		out.push_back((char)(bits & 0xff));
+		bits >>= 8;
+	}
+}
+
+static void _pbUInt(std::string &out,const unsigned int field,const uint64_t v)
+{
+	_pbKey(out,field,0);
+	_pbVarint(out,v);
+}
+
+static void _renderProtobuf(const prometheus::MetricFamily &family,std::string &out)
+{
+	std::string mf,metric,sub,item;
+
+	_pbBytes(mf,1,family.name);
+	if (!family.help.empty()) {
+		_pbBytes(mf,2,family.help);
+	}
+	switch(family.type) {
+		case prometheus::Metric::Type::Counter: _pbUInt(mf,3,0); break;
+		case prometheus::Metric::Type::Gauge: _pbUInt(mf,3,1); break;
+		case prometheus::Metric::Type::Summary: _pbUInt(mf,3,2); break;
+		case prometheus::Metric::Type::Untyped: _pbUInt(mf,3,3); break;
+		case prometheus::Metric::Type::Histogram: _pbUInt(mf,3,4); break;
+	}
+
+	for(std::vector<prometheus::ClientMetric>::const_iterator m(family.metric.begin());m!=family.metric.end();++m) {
+		metric.clear();
+		for(std::vector<prometheus::ClientMetric::Label>::const_iterator l(m->label.begin());l!=m->label.end();++l) {
+			sub.clear();
+			_pbBytes(sub,1,l->name);
+			_pbBytes(sub,2,l->value);
+			_pbBytes(metric,1,sub);
+		}
+		sub.clear();
+		switch(family.type) {
+			case prometheus::Metric::Type::Counter:
+				_pbDouble(sub,1,m->counter.value);
+				_pbBytes(metric,3,sub);
+				break;
+			case prometheus::Metric::Type::Gauge:
+				_pbDouble(sub,1,m->gauge.value);
+				_pbBytes(metric,2,sub);
+				break;
+			case prometheus::Metric::Type::Summary:
+				_pbUInt(sub,1,m->summary.sample_count);
+				_pbDouble(sub,2,m->summary.sample_sum);
+				for(std::vector<prometheus::ClientMetric::Quantile>::const_iterator q(m->summary.quantile.begin());q!=m->summary.quantile.end();++q) {
+					item.clear();
+					_pbDouble(item,1,q->quantile);
+					_pbDouble(item,2,q->value);
+					_pbBytes(sub,3,item);
+				}
+				_pbBytes(metric,4,sub);
+				break;
+			case prometheus::Metric::Type::Untyped:
+				_pbDouble(sub,1,m->untyped.value);
+				_pbBytes(metric,5,sub);
+				break;
+			case prometheus::Metric::Type::Histogram:
+				_pbUInt(sub,1,m->histogram.sample_count);
+				_pbDouble(sub,2,m->histogram.sample_sum);
+				for(std::vector<prometheus::ClientMetric::Bucket>::const_iterator b(m->histogram.bucket.begin());b!=m->histogram.bucket.end();++b) {
+					item.clear();
+					_pbUInt(item,1,b->cumulative_count);
+					_pbDouble(item,2,b->upper_bound);
+					_pbBytes(sub,3,item);
+				}
+				_pbBytes(metric,7,sub);
+				break;
+		}
+		if (m->timestamp_ms != 0) {
+			_pbUInt(metric,6,(uint64_t)m->timestamp_ms);
+		}
+		_pbBytes(mf,4,metric);
+	}
+
+	_pbVarint(out,(uint64_t)mf.length());
+	out.append(mf);
+}
+
+static void _renderText(const prometheus::MetricFamily &family,std::string &out)
+{
+	std::ostringstream tmp;
+	prometheus::TextSerializer::Serialize(tmp,std::vector<prometheus::MetricFamily>(1,family));
+	out.append(tmp.str());
+}
+
+} // anonymous namespace
+
+MetricsExposition::MetricsExposition(prometheus::Registry &registry) :
+	_registry(registry),
+	_generation(0)
+{
+}
+
+MetricsExposition::Format MetricsExposition::negotiate(const std::string &accept)
+{
+	if ((accept.find("application/vnd.google.protobuf") != std::string::npos)&&(accept.find("io.prometheus.client.MetricFamily") != std::string::npos)&&(accept.find("encoding=delimited") != std::string::npos)) {
+		return FORMAT_PROTOBUF;
+	}
+	if (accept.find("application/openmetrics-text") != std::string::npos) {
+		return FORMAT_OPENMETRICS;
+	}
+	return FORMAT_TEXT;
+}
+
+const char *MetricsExposition::contentType(const Format f)
+{
+	switch(f) {
+		case FORMAT_OPENMETRICS:
+			return "application/openmetrics-text; version=1.0.0; charset=utf-8";
+		case FORMAT_PROTOBUF:
+			return "application/vnd.google.protobuf; proto=io.prometheus.client.MetricFamily; encoding=delimited";
+		default:
+			return "text/plain; version=0.0.4; charset=utf-8";
+	}
+}
+
+unsigned long MetricsExposition::render(const Format f,std::string &out)
+{
+	const std::vector<prometheus::MetricFamily> families(_registry.Collect());
+	unsigned long reused = 0;
+
+	Mutex::Lock _l(_lock);
+	const uint64_t gen = ++_generation;
+
+	out.clear();
+	for(std::vector<prometheus::MetricFamily>::const_iterator family(families.begin());family!=families.end();++family) {
+		_Cached &c = _cache[family->name];
+		c.generation = gen;
+		const uint64_t fp = _fingerprint(*family);
+		if (fp != c.fingerprint) {
+			c.fingerprint = fp;
+			for(unsigned int i=0;i<3;++i) {
+				c.rendered[i].clear();
+			}
+		}
+		std::string &r = c.rendered[(unsigned int)f];
+		if (r.empty()) {
+			switch(f) {
+				case FORMAT_OPENMETRICS: _renderOpenMetrics(*family,r); break;
+				case FORMAT_PROTOBUF: _renderProtobuf(*family,r); break;
+				default: _renderText(*family,r); break;
+			}
+		} else {
+			++reused;
+		}
+		out.append(r);
+	}
+	if (f == FORMAT_OPENMETRICS) {
+		out.append("# EOF\n");
+	}
+
+	// Forget families that no longer exist
+	for(std::map< std::string,_Cached >::iterator c(_cache.begin());c!=_cache.end();) {
+		if (c->second.generation != gen) {
+			_cache.erase(c++);
+		} else {
+			++c;
+		}
+	}
+
+	return reused;
+}
+
+} // namespace ZeroTier
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c)2019 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+#ifndef ZT_METRICSEXPOSITION_HPP
+#define ZT_METRICSEXPOSITION_HPP
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include <prometheus/registry.h>
+
+#include "../node/Mutex.hpp"
+
+namespace ZeroTier {
+
+/**
+ * Renders a Prometheus registry for the /metrics endpoint
+ *
+ * The registry is collected on every request so scrapes see current
+ * values, but each family's serialized form is cached along with a
+ * fingerprint of its labels and values. Families that haven't changed
+ * since the last scrape in the same format (most of them on a quiet node,
+ * e.g. controller metrics on a non-controller) are copied from the cache
+ * instead of being formatted again.
+ *
+ * Supports the classic text format, OpenMetrics text, and delimited
+ * protobuf (io.prometheus.client.MetricFamily), chosen from the request's
+ * Accept header.
+ */
+class MetricsExposition
+{
+public:
+	enum Format
+	{
+		FORMAT_TEXT = 0,
+		FORMAT_OPENMETRICS = 1,
+		FORMAT_PROTOBUF = 2
+	};
+
+	MetricsExposition(prometheus::Registry &registry);
+
+	/**
+	 * Pick an output format from an HTTP Accept header
+	 *
+	 * Protobuf is only chosen if asked for with the delimited encoding of
+	 * MetricFamily, as Prometheus does. Anything unrecognized gets text.
+	 *
+	 * @param accept Accept header value (may be empty)
+	 * @return Format to render
+	 */
+	static Format negotiate(const std::string &accept);
+
+	/**
+	 * @param f Format
+	 * @return Content-Type for responses in this format
+	 */
+	static const char *contentType(const Format f);
+
+	/**
+	 * Collect the registry and render it
+	 *
+	 * @param f Format
+	 * @param out String to fill (replaced)
+	 * @return Number of families whose cached rendering was reused
+	 */
+	unsigned long render(const Format f,std::string &out);
+
+private:
+	struct _Cached
+	{
+		_Cached() : fingerprint(0),generation(0) {}
+		uint64_t fingerprint;
+		uint64_t generation;
+		std::string rendered[3];
+	};
+
+	prometheus::Registry &_registry;
+	std::map< std::string,_Cached > _cache;
+	uint64_t _generation;
+	Mutex _lock;
+};
+
+} // namespace ZeroTier
+
+#endif
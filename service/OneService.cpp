@@ -54,13 +54,16 @@
 #include "../osdep/Phy.hpp"
 #include "../osdep/OSUtils.hpp"
 #include "../osdep/Http.hpp"
+#include "../osdep/PeerCache.hpp"
 #include "../osdep/PortMapper.hpp"
+#include "../osdep/StateWriteQueue.hpp"
 #include "../osdep/Binder.hpp"
 #include "../osdep/ManagedRoute.hpp"
 #include "../osdep/BlockingQueue.hpp"
 
 #include "OneService.hpp"
 #include "SoftwareUpdater.hpp"
+#include "MetricsExposition.hpp"
 
 #include <cpp-httplib/httplib.h>
 
@@ -794,6 +797,7 @@ public:
 	const std::string _homePath;
 	std::string _authToken;
 	std::string _metricsToken;
+	MetricsExposition _metricsExposition;
 	std::string _controllerDbPath;
 	const std::string _networksPath;
 	const std::string _moonsPath;
@@ -979,6 +983,14 @@ public:
 	std::map<InetAddress, PeerIntroduction> _peerIntroductions;
 	Mutex _peerIntroductions_m;
 
+#ifndef __WINDOWS__
+	// Peer state, in place of one file per peer in peers.d
+	PeerCache _peerCache;
+#endif
+
+	// Writes network configs, moons, planets and peers that don't fit the cache
+	StateWriteQueue _stateWriteQueue;
+
 	// Track first-time events for debugging
 	std::set<Address> _seenPeerFileAccess;		  // Track first peer file access per ZT address
 	std::set<std::pair<Address, InetAddress> > _seenPacketSendAttempts;	  // Track first packet send attempt per ZT address + IP
@@ -993,6 +1005,7 @@ public:
 
 	OneServiceImpl(const char *hp,unsigned int port) :
 		_homePath((hp) ? hp : ".")
+		,_metricsExposition(prometheus::simpleapi::registry)
 		,_controllerDbPath(_homePath + ZT_PATH_SEPARATOR_S "controller.d")
 		,_networksPath(_homePath + ZT_PATH_SEPARATOR_S "networks.d")
 		,_moonsPath(_homePath + ZT_PATH_SEPARATOR_S "moons.d")
@@ -1033,15 +1046,12 @@ public:
 		,_rc(NULL)
 		,_ssoRedirectURL()
 		,_iptablesEnabled(false)
+		,_stateWriteQueue([this](int type,const uint64_t *id,const void *data,int len) { this->_writeStateObject((enum ZT_StateObjectType)type,id,data,len); })
 	{
 		_ports[0] = 0;
 		_ports[1] = 0;
 		_ports[2] = 0;
 
-		prometheus::simpleapi::saver.set_registry(prometheus::simpleapi::registry_ptr);
-		prometheus::simpleapi::saver.set_delay(std::chrono::seconds(5));
-		prometheus::simpleapi::saver.set_out_file(_homePath + ZT_PATH_SEPARATOR + "metrics.prom");
-
 #if ZT_VAULT_SUPPORT
 		curl_global_init(CURL_GLOBAL_DEFAULT);
 #endif
@@ -1140,6 +1150,19 @@ public:
 				_metricsToken = _trimString(_metricsToken);
 			}
 
+#ifndef __WINDOWS__
+			{
+				// Peers saved by older versions, or saved as files because the cache was
+				// full and couldn't be grown, are moved into the cache when it's opened
+				const std::string peersPath(_homePath + ZT_PATH_SEPARATOR_S "peers.d");
+				if (_peerCache.open((_homePath + ZT_PATH_SEPARATOR_S "peers.cache").c_str(),peersPath.c_str())) {
+					_peerCache.importDirectory(peersPath.c_str());
+				} else {
+					fprintf(stderr,"WARNING: unable to open peers.cache, saving peers in peers.d instead" ZT_EOL_S);
+				}
+			}
+#endif
+
 			{
 				struct ZT_Node_Callbacks cb;
 				cb.version = 0;
@@ -1163,6 +1186,14 @@ public:
 			readLocalSettings();
 			applyLocalConfig();
 
+			// /metrics is served from memory. Also writing metrics.prom every few
+			// seconds is optional since it costs a full serialization each time.
+			if (OSUtils::jsonBool(_localConfig["settings"]["metricsFile"],true)) {
+				prometheus::simpleapi::saver.set_delay(std::chrono::seconds(5));
+				prometheus::simpleapi::saver.set_out_file(_homePath + ZT_PATH_SEPARATOR + "metrics.prom");
+				prometheus::simpleapi::saver.set_registry(prometheus::simpleapi::registry_ptr);
+			}
+
 			// Save original port number to show it if bind error
 			const int _configuredPort = _primaryPort;
 
@@ -1288,6 +1319,7 @@ public:
 			int64_t lastBindRefresh = 0;
 			int64_t lastUpdateCheck = clockShouldBe;
 			int64_t lastCleanedPeersDb = 0;
+			int64_t lastPeerCacheFlush = clockShouldBe;
 			int64_t lastLocalConfFileCheck = OSUtils::now();
 			int64_t lastIptablesCheck = OSUtils::now();
 			int64_t lastOnline = lastLocalConfFileCheck;
@@ -1450,7 +1482,18 @@ public:
 				if ((now - lastCleanedPeersDb) >= 3600000) {
 					lastCleanedPeersDb = now;
 					OSUtils::cleanDirectory((_homePath + ZT_PATH_SEPARATOR_S "peers.d").c_str(),now - 2592000000LL); // delete older than 30 days
+#ifndef __WINDOWS__
+					_peerCache.clean(now - 2592000000LL);
+#endif
+				}
+
+#ifndef __WINDOWS__
+				// Write peers saved since the last time to peers.cache together
+				if ((now - lastPeerCacheFlush) >= ZT_PEER_CACHE_FLUSH_INTERVAL) {
+					lastPeerCacheFlush = now;
+					_peerCache.flush();
 				}
+#endif
 
 				const unsigned long delay = (dl > now) ? (unsigned long)(dl - now) : 500;
 				clockShouldBe = now + (int64_t)delay;
@@ -1529,6 +1572,10 @@ public:
 		_updater = (SoftwareUpdater *)0;
 		delete _node;
 		_node = (Node *)0;
+#ifndef __WINDOWS__
+		_peerCache.close(); // after the node, which saves every peer as it goes
+#endif
+		_stateWriteQueue.flush();
 
 		return _termReason;
 	}
@@ -2455,14 +2502,10 @@ public:
 		_controlPlaneV6.Get(ssoPath, ssoGet);
 #endif
 		auto metricsGet = [this](const httplib::Request &req, httplib::Response &res) {
-			std::string statspath = _homePath + ZT_PATH_SEPARATOR + "metrics.prom";
+			const MetricsExposition::Format fmt = MetricsExposition::negotiate(req.get_header_value("Accept"));
 			std::string metrics;
-			if (OSUtils::readFile(statspath.c_str(), metrics)) {
-				res.set_content(metrics, "text/plain");
-			} else {
-				res.set_content("{}", "application/json");
-				res.status = 500;
-			}
+			_metricsExposition.render(fmt, metrics);
+			res.set_content(metrics, MetricsExposition::contentType(fmt));
 		};
 		_controlPlane.Get(metricsPath, metricsGet);
 		_controlPlaneV6.Get(metricsPath, metricsGet);
@@ -2993,6 +3036,22 @@ public:
 		}
 		_portMappingEnabled = OSUtils::jsonBool(settings["portMappingEnabled"],true);
 		_node->setLowBandwidthMode(OSUtils::jsonBool(settings["lowBandwidthMode"],false));
+		_node->setLocalAddressResolution(OSUtils::jsonBool(settings["localAddressResolution"],false));
+		{
+			std::vector<Address> peerMetricsAllow;
+			json &pma = settings["peerMetricsAllow"];
+			if (pma.is_array()) {
+				for(unsigned long i=0;i<pma.size();++i) {
+					const uint64_t a = Utils::hexStrToU64(OSUtils::jsonString(pma[i],"").c_str()) & 0xffffffffffULL;
+					if (a) {
+						peerMetricsAllow.push_back(Address(a));
+					}
+				}
+			}
+			// Read signed so a negative setting clamps to 0 rather than wrapping to "export everyone"
+			const int64_t topK = (int64_t)OSUtils::jsonInt(settings["peerMetricsTopK"],ZT_PEER_METRICS_DEFAULT_TOP_K);
+			_node->setPeerMetricsExport((unsigned int)std::max(std::min(topK,(int64_t)ZT_PEER_METRICS_MAX_TOP_K),(int64_t)0),peerMetricsAllow);
+		}
 #if defined(__LINUX__) || defined(__FreeBSD__)
 		_multicoreEnabled = OSUtils::jsonBool(settings["multicoreEnabled"],false);
 		_concurrency = OSUtils::jsonInt(settings["concurrency"],1);
@@ -3843,6 +3902,27 @@ public:
 			// else fallback to disk
 		}
 #endif
+#ifndef __WINDOWS__
+		if ((type == ZT_STATE_OBJECT_PEER)&&(_peerCache.isOpen())) {
+			if ((len >= 0)&&(data)) {
+				if (_peerCache.put(id[0],data,(unsigned int)len))
+					return;
+				// else too big for the cache, save it as a file below
+			} else {
+				_peerCache.erase(id[0]); // and any file below
+			}
+		}
+#endif
+		if ((type == ZT_STATE_OBJECT_IDENTITY_PUBLIC)||(type == ZT_STATE_OBJECT_IDENTITY_SECRET)) {
+			_writeStateObject(type,id,data,len); // identity is written before anything else runs, keep it simple
+		} else {
+			_stateWriteQueue.put((int)type,id,data,len);
+		}
+	}
+
+	// Write or delete one state object's file, on _stateWriteQueue's thread for all but the identity
+	inline void _writeStateObject(enum ZT_StateObjectType type,const uint64_t id[2],const void *data,int len)
+	{
 		char p[1024];
 		FILE *f;
 		bool secure = false;
@@ -4036,6 +4116,20 @@ public:
 					fprintf(stderr, "PEER_FILE_ACCESS: %s (%.10llx.peer)" ZT_EOL_S, peerBuf, (unsigned long long)id[0]);
 				}
 			}
+#ifndef __WINDOWS__
+			if (_peerCache.isOpen()) {
+				const int n = _peerCache.get(id[0],data,maxlen);
+				if (n != -2)
+					return n;
+				// else too big for the cache, read the file below
+			}
+#endif
+		}
+
+		{
+			int n = -1;
+			if (_stateWriteQueue.get((int)type,id,data,maxlen,n))
+				return n; // not written yet, or its delete isn't
 		}
 
 		FILE *f = fopen(p,"rb");
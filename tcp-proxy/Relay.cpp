@@ -0,0 +1,884 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2016  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !(defined(__linux__) || defined(__LINUX__) || defined(__LINUX) || defined(LINUX))
+#error "tcp-proxy uses epoll and only builds on Linux"
+#endif
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // accept4, recvmmsg, sendmmsg
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Relay.hpp"
+#include "RingBuffer.hpp"
+
+// Largest datagram relayed to a client, as before
+#define ZT_TCP_PROXY_MAX_DATAGRAM 2048
+
+// Most epoll events handled per wakeup
+#define ZT_TCP_PROXY_MAX_EVENTS 256
+
+// Offsets in ZeroTier packet and fragment headers (see node/Packet.hpp)
+#define ZT_TCP_PROXY_ZT_IDX_DEST 8                 // in both
+#define ZT_TCP_PROXY_ZT_IDX_SOURCE 13              // in packets, where fragments have 0xff
+#define ZT_TCP_PROXY_ZT_FRAGMENT_INDICATOR 0xff
+#define ZT_TCP_PROXY_ZT_MIN_PACKET_LENGTH 18
+
+namespace ZeroTier {
+
+class Relay::_Worker
+{
+public:
+	_Worker(const unsigned int id,const unsigned int sharedUdp,const unsigned long logSample,const bool logConnections) :
+		_id(id),
+		_sharedUdpCount(sharedUdp),
+		_logSample(logSample),
+		_logConnections(logConnections),
+		_ep(epoll_create1(EPOLL_CLOEXEC)),
+		_wake(eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC)),
+		_listener(-1),
+		_acceptPaused(false),
+		_now(time((time_t *)0)),
+		_sampleCounter(0),
+		_nextShared(0),
+		_pool(ZT_TCP_PROXY_MAX_FREE_BUFFERS),
+		_running(false),
+		_clientCount(0),
+		_accepted(0),
+		_rejected(0),
+		_tcpToUdpPackets(0),
+		_tcpToUdpBytes(0),
+		_udpToTcpPackets(0),
+		_udpToTcpBytes(0),
+		_dropped(0),
+		_unmatched(0),
+		_conflicts(0),
+		_routes(0),
+		_buffers(0)
+	{
+		_listenerH.type = _LISTENER;
+		_listenerH.client = (_Client *)0;
+		_listenerH.fd = -1;
+		_wakeH.type = _WAKE;
+		_wakeH.client = (_Client *)0;
+		_wakeH.fd = -1;
+		if ((_ep >= 0)&&(_wake >= 0)) {
+			struct epoll_event ev;
+			memset(&ev,0,sizeof(ev));
+			ev.events = EPOLLIN;
+			ev.data.ptr = &_wakeH;
+			epoll_ctl(_ep,EPOLL_CTL_ADD,_wake,&ev);
+		}
+
+		// Records and datagrams in a batch share these, so only the iovecs and addresses vary
+		memset(_txMsgs,0,sizeof(_txMsgs));
+		memset(_rxMsgs,0,sizeof(_rxMsgs));
+		for(unsigned int i=0;i<ZT_TCP_PROXY_BATCH;++i) {
+			_txMsgs[i].msg_hdr.msg_iov = &(_txIov[i]);
+			_txMsgs[i].msg_hdr.msg_iovlen = 1;
+			_txMsgs[i].msg_hdr.msg_name = &(_txAddr[i]);
+			_txMsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+			_rxIov[i].iov_base = _rxBuf[i];
+			_rxIov[i].iov_len = ZT_TCP_PROXY_MAX_DATAGRAM;
+			_rxMsgs[i].msg_hdr.msg_iov = &(_rxIov[i]);
+			_rxMsgs[i].msg_hdr.msg_iovlen = 1;
+			_rxMsgs[i].msg_hdr.msg_name = &(_rxAddr[i]);
+		}
+	}
+
+	~_Worker()
+	{
+		stop();
+		if (_listener >= 0)
+			::close(_listener);
+		for(std::vector<_Handle>::iterator u(_shared.begin());u!=_shared.end();++u)
+			::close(u->fd);
+		if (_wake >= 0)
+			::close(_wake);
+		if (_ep >= 0)
+			::close(_ep);
+	}
+
+	bool listen(const struct sockaddr_in &addr,unsigned short &port)
+	{
+		if ((_ep < 0)||(_wake < 0))
+			return false;
+		_listener = socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC,0);
+		if (_listener < 0)
+			return false;
+		int one = 1;
+		setsockopt(_listener,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+		if (setsockopt(_listener,SOL_SOCKET,SO_REUSEPORT,&one,sizeof(one)) != 0)
+			return false;
+		struct sockaddr_in a(addr);
+		if (port)
+			a.sin_port = htons(port); // join the port the first worker was given
+		if ((bind(_listener,(const struct sockaddr *)&a,sizeof(a)) != 0)||(::listen(_listener,SOMAXCONN) != 0))
+			return false;
+		socklen_t alen = sizeof(a);
+		if (getsockname(_listener,(struct sockaddr *)&a,&alen) != 0)
+			return false;
+		port = ntohs(a.sin_port);
+		struct epoll_event ev;
+		memset(&ev,0,sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = &_listenerH;
+		if (epoll_ctl(_ep,EPOLL_CTL_ADD,_listener,&ev) != 0)
+			return false;
+
+		// Fixed before any client arrives, so handles never move
+		_shared.resize(_sharedUdpCount);
+		for(unsigned int i=0;i<_sharedUdpCount;++i) {
+			_shared[i].type = _SHARED_UDP;
+			_shared[i].client = (_Client *)0;
+			_shared[i].fd = _udpSocket();
+			if (_shared[i].fd < 0)
+				return false;
+			// These take every client's replies, so past net.core.rmem_max if we're allowed (CAP_NET_ADMIN)
+			int bs = ZT_TCP_PROXY_SHARED_UDP_BUFFER;
+			if (setsockopt(_shared[i].fd,SOL_SOCKET,SO_RCVBUFFORCE,&bs,sizeof(bs)) != 0)
+				setsockopt(_shared[i].fd,SOL_SOCKET,SO_RCVBUF,&bs,sizeof(bs));
+			if (setsockopt(_shared[i].fd,SOL_SOCKET,SO_SNDBUFFORCE,&bs,sizeof(bs)) != 0)
+				setsockopt(_shared[i].fd,SOL_SOCKET,SO_SNDBUF,&bs,sizeof(bs));
+			ev.data.ptr = &(_shared[i]);
+			if (epoll_ctl(_ep,EPOLL_CTL_ADD,_shared[i].fd,&ev) != 0)
+				return false;
+		}
+		return true;
+	}
+
+	void start()
+	{
+		_running = true;
+		_thread = std::thread(&_Worker::_run,this);
+	}
+
+	void stop()
+	{
+		if (!_thread.joinable())
+			return;
+		_running = false;
+		const uint64_t one = 1;
+		if (write(_wake,&one,sizeof(one)) < 0) {} // the loop also wakes once a second
+		_thread.join();
+	}
+
+	void stats(Relay::Stats &s) const
+	{
+		s.clients += _clientCount.load(std::memory_order_relaxed);
+		s.accepted += _accepted.load(std::memory_order_relaxed);
+		s.rejected += _rejected.load(std::memory_order_relaxed);
+		s.tcpToUdpPackets += _tcpToUdpPackets.load(std::memory_order_relaxed);
+		s.tcpToUdpBytes += _tcpToUdpBytes.load(std::memory_order_relaxed);
+		s.udpToTcpPackets += _udpToTcpPackets.load(std::memory_order_relaxed);
+		s.udpToTcpBytes += _udpToTcpBytes.load(std::memory_order_relaxed);
+		s.dropped += _dropped.load(std::memory_order_relaxed);
+		s.unmatched += _unmatched.load(std::memory_order_relaxed);
+		s.conflicts += _conflicts.load(std::memory_order_relaxed);
+		s.routes += _routes.load(std::memory_order_relaxed);
+		s.buffers += _buffers.load(std::memory_order_relaxed);
+	}
+
+private:
+	enum _Type
+	{
+		_LISTENER,
+		_WAKE,
+		_TCP,
+		_UDP,
+		_SHARED_UDP
+	};
+
+	struct _Client;
+
+	// What an epoll event is for
+	struct _Handle
+	{
+		_Type type;
+		_Client *client; // NULL for shared sockets
+		int fd;
+	};
+
+	// Where a reply on a shared UDP socket comes from and which ZeroTier address it's for
+	struct _Route
+	{
+		_Route(const struct sockaddr_in &a,const uint64_t z) : ip(a.sin_addr.s_addr),port(a.sin_port),ztAddress(z) {}
+		inline bool operator==(const _Route &r) const { return ((ip == r.ip)&&(port == r.port)&&(ztAddress == r.ztAddress)); }
+		uint32_t ip;
+		uint16_t port;
+		uint64_t ztAddress;
+	};
+
+	struct _RouteHasher
+	{
+		inline std::size_t operator()(const _Route &r) const { return (std::size_t)(((((uint64_t)r.ip << 16) | (uint64_t)r.port) * 0x9e3779b97f4a7c15ULL) ^ r.ztAddress); }
+	};
+
+	struct _RouteEntry
+	{
+		_Client *client;
+		time_t lastUsed;  // last sent on by its client
+		time_t claimed;   // taken by its client
+		bool confirmed;   // answered by the remote since it was taken
+	};
+
+	struct _Client
+	{
+		int tcp;
+		int udp;        // own socket, or shared socket in shared mode
+		std::vector<_Route> routes; // learned for this client in shared mode
+		bool flushPending;
+		RingBuffer in;  // records received, up to the end of the last complete one
+		RingBuffer out; // records waiting to be sent
+		time_t lastActivity;
+		bool newVersion;
+		bool waitingWritable;
+		bool closed;
+		_Handle tcpH;
+		_Handle udpH;
+	};
+
+	void _log(const char *fmt,...)
+	{
+		char buf[512];
+		va_list ap;
+		va_start(ap,fmt);
+		vsnprintf(buf,sizeof(buf),fmt,ap);
+		va_end(ap);
+		printf("ts=%lld worker=%u %s\n",(long long)_now,_id,buf);
+	}
+
+	static const char *_ipString(const struct sockaddr_in &a,char buf[INET_ADDRSTRLEN])
+	{
+		if (!inet_ntop(AF_INET,&(a.sin_addr),buf,INET_ADDRSTRLEN))
+			buf[0] = 0;
+		return buf;
+	}
+
+	void _run()
+	{
+		struct epoll_event ev[ZT_TCP_PROXY_MAX_EVENTS];
+		time_t lastHousekeeping = time((time_t *)0);
+		while (_running) {
+			const int n = epoll_wait(_ep,ev,ZT_TCP_PROXY_MAX_EVENTS,1000);
+			_now = time((time_t *)0);
+			for(int i=0;i<n;++i) {
+				_Handle *const h = (_Handle *)ev[i].data.ptr;
+				switch(h->type) {
+					case _LISTENER:
+						_accept();
+						break;
+					case _WAKE: {
+						uint64_t v;
+						if (read(_wake,&v,sizeof(v)) < 0) {}
+					}	break;
+					case _TCP:
+						if ((ev[i].events & (EPOLLIN|EPOLLHUP|EPOLLERR))&&(!h->client->closed))
+							_tcpReadable(h->client);
+						if ((ev[i].events & EPOLLOUT)&&(!h->client->closed))
+							_flush(h->client);
+						break;
+					case _UDP:
+						if (!h->client->closed)
+							_udpReadable(h->fd,h->client);
+						break;
+					case _SHARED_UDP:
+						_udpReadable(h->fd,(_Client *)0);
+						break;
+				}
+			}
+
+			// Clients closed above may still have had events in this batch, so they're freed only now
+			for(std::vector<_Client *>::iterator c(_closed.begin());c!=_closed.end();++c)
+				delete *c;
+			_closed.clear();
+
+			if ((_now - lastHousekeeping) >= ZT_TCP_PROXY_HOUSEKEEPING_INTERVAL) {
+				lastHousekeeping = _now;
+				_housekeeping();
+			}
+
+			_clientCount.store((uint64_t)_clients.size(),std::memory_order_relaxed);
+			_routes.store((uint64_t)_nat.size(),std::memory_order_relaxed);
+			_buffers.store((uint64_t)_pool.inUse(),std::memory_order_relaxed);
+		}
+
+		std::vector<_Client *> all;
+		for(std::unordered_map<int,_Client *>::iterator c(_clients.begin());c!=_clients.end();++c)
+			all.push_back(c->second);
+		for(std::vector<_Client *>::iterator c(all.begin());c!=all.end();++c) {
+			_close(*c,(const char *)0);
+			delete *c;
+		}
+		_closed.clear();
+		_clientCount.store(0,std::memory_order_relaxed);
+		_routes.store(0,std::memory_order_relaxed);
+		_buffers.store(0,std::memory_order_relaxed);
+	}
+
+	void _accept()
+	{
+		for(;;) {
+			struct sockaddr_in from;
+			socklen_t fromLen = sizeof(from);
+			const int s = accept4(_listener,(struct sockaddr *)&from,&fromLen,SOCK_NONBLOCK|SOCK_CLOEXEC);
+			if (s < 0) {
+				if (errno == EINTR)
+					continue;
+				if ((errno == EMFILE)||(errno == ENFILE)||(errno == ENOBUFS)||(errno == ENOMEM)) {
+					// Out of descriptors: stop accepting until housekeeping rather than spin on the listener
+					_log("event=accept_paused error=%d",errno);
+					epoll_ctl(_ep,EPOLL_CTL_DEL,_listener,(struct epoll_event *)0);
+					_acceptPaused = true;
+				}
+				return;
+			}
+
+			const int u = (_shared.empty()) ? _udpSocket() : _shared[(_nextShared++) % _shared.size()].fd;
+			if (u < 0) {
+				::close(s);
+				_rejected.fetch_add(1,std::memory_order_relaxed);
+				if (_logConnections)
+					_log("event=reject reason=no_udp_socket");
+				continue;
+			}
+
+			int one = 1;
+			setsockopt(s,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+
+			_Client *const c = new _Client();
+			c->tcp = s;
+			c->udp = u;
+			c->lastActivity = _now;
+			c->flushPending = false;
+			c->newVersion = false;
+			c->waitingWritable = false;
+			c->closed = false;
+			c->tcpH.type = _TCP;
+			c->tcpH.client = c;
+			c->tcpH.fd = s;
+			c->udpH.type = _UDP;
+			c->udpH.client = c;
+			c->udpH.fd = u;
+
+			struct epoll_event ev;
+			memset(&ev,0,sizeof(ev));
+			ev.events = EPOLLIN;
+			ev.data.ptr = &(c->tcpH);
+			epoll_ctl(_ep,EPOLL_CTL_ADD,s,&ev);
+			if (_shared.empty()) {
+				ev.data.ptr = &(c->udpH);
+				epoll_ctl(_ep,EPOLL_CTL_ADD,u,&ev);
+			}
+			_clients[s] = c;
+
+			_accepted.fetch_add(1,std::memory_order_relaxed);
+			if (_logConnections) {
+				char ip[INET_ADDRSTRLEN];
+				_log("event=accept fd=%d from=%s:%d",s,_ipString(from,ip),(int)ntohs(from.sin_port));
+			}
+		}
+	}
+
+	int _udpSocket()
+	{
+		const int u = socket(AF_INET,SOCK_DGRAM|SOCK_NONBLOCK|SOCK_CLOEXEC,0);
+		if (u < 0)
+			return -1;
+		struct sockaddr_in a;
+		memset(&a,0,sizeof(a));
+		a.sin_family = AF_INET; // any address, and any port the kernel has free
+		if (bind(u,(const struct sockaddr *)&a,sizeof(a)) != 0) {
+			::close(u);
+			return -1;
+		}
+		return u;
+	}
+
+	void _close(_Client *c,const char *reason)
+	{
+		if (c->closed)
+			return;
+		c->closed = true;
+		::close(c->tcp); // also drops both from epoll
+		if (_shared.empty()) {
+			::close(c->udp);
+		} else {
+			for(std::vector<_Route>::iterator r(c->routes.begin());r!=c->routes.end();++r) {
+				std::unordered_map<_Route,_RouteEntry,_RouteHasher>::iterator e(_nat.find(*r));
+				if ((e != _nat.end())&&(e->second.client == c))
+					_nat.erase(e);
+			}
+			c->routes.clear();
+		}
+		if (c->in.attached())
+			_pool.put(c->in.detach());
+		if (c->out.attached())
+			_pool.put(c->out.detach());
+		_clients.erase(c->tcp); // now, as accept() may hand out the same descriptor before the client is freed
+		_closed.push_back(c);
+		if ((reason)&&(_logConnections))
+			_log("event=close fd=%d reason=%s",c->tcp,reason);
+	}
+
+	void _tcpReadable(_Client *c)
+	{
+		if (!c->in.attached()) {
+			char *const b = _pool.get();
+			if (!b) {
+				_close(c,"out_of_memory");
+				return;
+			}
+			c->in.attach(b);
+		}
+
+		struct iovec v[2];
+		const int nv = c->in.freeSpace(v);
+		if (!nv) {
+			_close(c,"record_too_large"); // can't happen, a record is at most 5 + 65535 bytes
+			return;
+		}
+		const ssize_t n = readv(c->tcp,v,nv);
+		if (n > 0) {
+			c->in.produced((unsigned long)n);
+			c->lastActivity = _now;
+			_frames(c);
+		} else if ((n == 0)||((errno != EAGAIN)&&(errno != EWOULDBLOCK)&&(errno != EINTR))) {
+			_close(c,(n == 0) ? "eof" : "read_error");
+			return;
+		}
+
+		if (!c->in.size())
+			_pool.put(c->in.detach());
+	}
+
+	// Relay every complete record in c->in, leaving any partial one for next time
+	void _frames(_Client *c)
+	{
+		unsigned int count = 0;
+		while (c->in.size() >= 5) {
+			const unsigned long mlen = ( (((unsigned long)c->in.at(3)) << 8) | ((unsigned long)c->in.at(4)) );
+			if (c->in.size() < (mlen + 5))
+				break;
+
+			if (mlen == 4) {
+				// Right now just sending this means the client is 'new enough' for the IP header
+				c->newVersion = true;
+				if (_logConnections)
+					_log("event=hello fd=%d",c->tcp);
+			} else if (mlen >= 7) {
+				// At most one record per pass can wrap around the end of the ring, so one scratch buffer will do
+				const char *payload = c->in.contiguous(5,mlen,_scratch);
+				unsigned long payloadLen = mlen;
+
+				struct sockaddr_in &dest = _txAddr[count];
+				memset(&dest,0,sizeof(dest));
+				if (c->newVersion) {
+					if (*payload == (char)4) {
+						// New clients tell us where their packets go.
+						++payload;
+						dest.sin_family = AF_INET;
+						memcpy(&(dest.sin_addr.s_addr),payload,4);
+						payload += 4;
+						memcpy(&(dest.sin_port),payload,2); // will be in network byte order already
+						payload += 2;
+						payloadLen -= 7;
+					}
+				} else {
+					// For old clients we will just proxy everything to a local ZT instance. The
+					// fact that this will come from 127.0.0.1 will in turn prevent that instance
+					// from doing unite() with us. It'll just forward. There will not be many of
+					// these.
+					dest.sin_family = AF_INET;
+					dest.sin_addr.s_addr = htonl(0x7f000001); // 127.0.0.1
+					dest.sin_port = htons(9993);
+				}
+
+				// Note: we do not relay to privileged ports... just an abuse prevention rule.
+				if ((ntohs(dest.sin_port) > 1024)&&(payloadLen >= 16)) {
+					if (!_shared.empty())
+						_learn(c,dest,payload,payloadLen);
+					_txIov[count].iov_base = const_cast<char *>(payload);
+					_txIov[count].iov_len = payloadLen;
+					if ((_logSample)&&((++_sampleCounter % _logSample) == 0)) {
+						char ip[INET_ADDRSTRLEN];
+						_log("event=relay dir=tcp_to_udp fd=%d to=%s:%d len=%lu",c->tcp,_ipString(dest,ip),(int)ntohs(dest.sin_port),payloadLen);
+					}
+					if (++count == ZT_TCP_PROXY_BATCH) {
+						_sendDatagrams(c,count);
+						count = 0;
+					}
+				}
+			}
+
+			c->in.consume(mlen + 5);
+		}
+		if (count)
+			_sendDatagrams(c,count);
+	}
+
+	void _sendDatagrams(_Client *c,const unsigned int count)
+	{
+		unsigned int i = 0;
+		uint64_t packets = 0,bytes = 0;
+		while (i < count) {
+			const int n = sendmmsg(c->udp,_txMsgs + i,count - i,MSG_DONTWAIT);
+			if (n > 0) {
+				for(int k=0;k<n;++k)
+					bytes += _txIov[i + k].iov_len;
+				packets += (uint64_t)n;
+				i += (unsigned int)n;
+			} else if ((n < 0)&&(errno == EINTR)) {
+				continue;
+			} else {
+				_dropped.fetch_add(1,std::memory_order_relaxed); // this one failed, go on with the rest
+				++i;
+			}
+		}
+		_tcpToUdpPackets.fetch_add(packets,std::memory_order_relaxed);
+		_tcpToUdpBytes.fetch_add(bytes,std::memory_order_relaxed);
+	}
+
+	// Learn where replies to this client's packet will come from, if it's a packet and not a fragment
+	void _learn(_Client *c,const struct sockaddr_in &dest,const char *payload,const unsigned long len)
+	{
+		if ((len < ZT_TCP_PROXY_ZT_MIN_PACKET_LENGTH)||((uint8_t)payload[ZT_TCP_PROXY_ZT_IDX_SOURCE] == ZT_TCP_PROXY_ZT_FRAGMENT_INDICATOR))
+			return;
+		const _Route r(dest,_ztAddress(payload + ZT_TCP_PROXY_ZT_IDX_SOURCE));
+		_RouteEntry &e = _nat[r];
+		if (e.client != c) {
+			if (e.client) {
+				// Same ZeroTier address on another connection. That's a client that
+				// reconnected if the old connection has gone quiet, but could be a
+				// forged source address while it's still in use. A remote only
+				// answers packets that authenticate as that address, so a route it
+				// has never answered may be held by a forger and is kept only briefly.
+				if ((!e.client->closed)&&(e.confirmed ? ((_now - e.lastUsed) < ZT_TCP_PROXY_NAT_TAKEOVER_GRACE) : ((_now - e.claimed) < ZT_TCP_PROXY_NAT_UNCONFIRMED_GRACE))) {
+					_conflicts.fetch_add(1,std::memory_order_relaxed);
+					return;
+				}
+				std::vector<_Route> &old = e.client->routes;
+				old.erase(std::remove(old.begin(),old.end(),r),old.end());
+			}
+			e.client = c;
+			e.claimed = _now;
+			e.confirmed = false;
+			c->routes.push_back(r);
+		}
+		e.lastUsed = _now;
+	}
+
+	static inline uint64_t _ztAddress(const char *p)
+	{
+		const uint8_t *const b = reinterpret_cast<const uint8_t *>(p);
+		return ( ((uint64_t)b[0] << 32) | ((uint64_t)b[1] << 24) | ((uint64_t)b[2] << 16) | ((uint64_t)b[3] << 8) | (uint64_t)b[4] );
+	}
+
+	/**
+	 * @param fd Socket that's readable
+	 * @param owner Client the socket belongs to, or NULL to find each datagram's client by route
+	 */
+	void _udpReadable(const int fd,_Client *const owner)
+	{
+		uint64_t packets = 0,bytes = 0,dropped = 0,unmatched = 0;
+		for(;;) {
+			for(unsigned int i=0;i<ZT_TCP_PROXY_BATCH;++i)
+				_rxMsgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+			const int n = recvmmsg(fd,_rxMsgs,ZT_TCP_PROXY_BATCH,MSG_DONTWAIT,(struct timespec *)0);
+			if (n <= 0)
+				break;
+
+			for(int i=0;i<n;++i) {
+				const struct sockaddr_in &from = _rxAddr[i];
+				const unsigned long len = _rxMsgs[i].msg_len;
+				if ((from.sin_family != AF_INET)||(len < 16)||(len >= ZT_TCP_PROXY_MAX_DATAGRAM)||(_rxMsgs[i].msg_hdr.msg_flags & MSG_TRUNC))
+					continue;
+
+				_Client *c = owner;
+				if (!c) {
+					std::unordered_map<_Route,_RouteEntry,_RouteHasher>::iterator e(_nat.find(_Route(from,_ztAddress(_rxBuf[i] + ZT_TCP_PROXY_ZT_IDX_DEST))));
+					if ((e == _nat.end())||(e->second.client->closed)) {
+						++unmatched;
+						continue;
+					}
+					// Replies don't keep the route, or a half-open old connection would
+					// hold it for as long as the remote keeps sending.
+					e->second.confirmed = true;
+					c = e->second.client;
+				}
+				c->lastActivity = _now;
+
+				if (!c->out.attached()) {
+					char *const b = _pool.get();
+					if (!b) {
+						++dropped;
+						continue;
+					}
+					c->out.attach(b);
+				}
+
+				unsigned long mlen = len;
+				if (c->newVersion)
+					mlen += 7; // new clients get IP info
+
+				if (c->out.available() < (5 + mlen)) {
+					++dropped;
+					continue;
+				}
+
+				char hdr[12];
+				unsigned int hlen = 0;
+				hdr[hlen++] = 0x17; // look like TLS data
+				hdr[hlen++] = 0x03; // look like TLS 1.2
+				hdr[hlen++] = 0x03; // look like TLS 1.2
+				hdr[hlen++] = (char)((mlen >> 8) & 0xff);
+				hdr[hlen++] = (char)(mlen & 0xff);
+				if (c->newVersion) {
+					hdr[hlen++] = (char)4; // IPv4
+					memcpy(hdr + hlen,&(from.sin_addr.s_addr),4);
+					hlen += 4;
+					memcpy(hdr + hlen,&(from.sin_port),2);
+					hlen += 2;
+				}
+				c->out.append(hdr,hlen);
+				c->out.append(_rxBuf[i],len);
+				++packets;
+				bytes += len;
+				if (!c->flushPending) {
+					c->flushPending = true;
+					_touched.push_back(c);
+				}
+
+				if ((_logSample)&&((++_sampleCounter % _logSample) == 0)) {
+					char ip[INET_ADDRSTRLEN];
+					_log("event=relay dir=udp_to_tcp fd=%d from=%s:%d len=%lu",c->tcp,_ipString(from,ip),(int)ntohs(from.sin_port),len);
+				}
+			}
+
+			if (n < ZT_TCP_PROXY_BATCH)
+				break;
+		}
+
+		_udpToTcpPackets.fetch_add(packets,std::memory_order_relaxed);
+		_udpToTcpBytes.fetch_add(bytes,std::memory_order_relaxed);
+		if (dropped)
+			_dropped.fetch_add(dropped,std::memory_order_relaxed);
+		if (unmatched)
+			_unmatched.fetch_add(unmatched,std::memory_order_relaxed);
+
+		// Each client written to once, however many of the datagrams were for it
+		for(std::vector<_Client *>::iterator c(_touched.begin());c!=_touched.end();++c) {
+			(*c)->flushPending = false;
+			if (!(*c)->closed)
+				_flush(*c);
+		}
+		_touched.clear();
+	}
+
+	// Send as much of c->out as the socket takes, and wait for EPOLLOUT only while something is left
+	void _flush(_Client *c)
+	{
+		while (c->out.size()) {
+			struct iovec v[2];
+			struct msghdr m;
+			memset(&m,0,sizeof(m));
+			m.msg_iov = v;
+			m.msg_iovlen = (size_t)c->out.data(v);
+			const ssize_t n = sendmsg(c->tcp,&m,MSG_NOSIGNAL|MSG_DONTWAIT);
+			if (n > 0) {
+				c->out.consume((unsigned long)n);
+			} else if ((n < 0)&&(errno == EINTR)) {
+				continue;
+			} else if ((n < 0)&&((errno == EAGAIN)||(errno == EWOULDBLOCK))) {
+				break;
+			} else {
+				_close(c,"write_error");
+				return;
+			}
+		}
+
+		const bool waiting = (c->out.size() != 0);
+		if (!waiting) {
+			if (c->out.attached())
+				_pool.put(c->out.detach());
+		}
+		if (waiting != c->waitingWritable) {
+			struct epoll_event ev;
+			memset(&ev,0,sizeof(ev));
+			ev.events = (waiting) ? (EPOLLIN|EPOLLOUT) : EPOLLIN;
+			ev.data.ptr = &(c->tcpH);
+			epoll_ctl(_ep,EPOLL_CTL_MOD,c->tcp,&ev);
+			c->waitingWritable = waiting;
+		}
+	}
+
+	void _housekeeping()
+	{
+		std::vector<_Client *> idle;
+		for(std::unordered_map<int,_Client *>::iterator c(_clients.begin());c!=_clients.end();++c) {
+			if ((_now - c->second->lastActivity) >= ZT_TCP_PROXY_CONNECTION_TIMEOUT_SECONDS)
+				idle.push_back(c->second);
+		}
+		for(std::vector<_Client *>::iterator c(idle.begin());c!=idle.end();++c)
+			_close(*c,"timeout");
+
+		for(std::unordered_map<_Route,_RouteEntry,_RouteHasher>::iterator e(_nat.begin());e!=_nat.end();) {
+			if ((_now - e->second.lastUsed) >= ZT_TCP_PROXY_NAT_TIMEOUT) {
+				std::vector<_Route> &routes = e->second.client->routes;
+				routes.erase(std::remove(routes.begin(),routes.end(),e->first),routes.end());
+				_nat.erase(e++);
+			} else {
+				++e;
+			}
+		}
+		for(std::vector<_Client *>::iterator c(_closed.begin());c!=_closed.end();++c)
+			delete *c;
+		_closed.clear();
+
+		if (_acceptPaused) {
+			struct epoll_event ev;
+			memset(&ev,0,sizeof(ev));
+			ev.events = EPOLLIN;
+			ev.data.ptr = &_listenerH;
+			if (epoll_ctl(_ep,EPOLL_CTL_ADD,_listener,&ev) == 0) {
+				_acceptPaused = false;
+				_log("event=accept_resumed");
+			}
+		}
+	}
+
+	const unsigned int _id;
+	const unsigned int _sharedUdpCount;
+	const unsigned long _logSample;
+	const bool _logConnections;
+	int _ep;
+	int _wake;
+	int _listener;
+	bool _acceptPaused;
+	_Handle _listenerH;
+	_Handle _wakeH;
+	time_t _now;
+	unsigned long _sampleCounter;
+
+	std::unordered_map<int,_Client *> _clients; // by TCP socket
+	std::vector<_Client *> _closed;
+	std::vector<_Client *> _touched; // clients with replies to send after a batch of datagrams
+	std::vector<_Handle> _shared;    // shared UDP sockets, if any
+	unsigned long _nextShared;
+	std::unordered_map<_Route,_RouteEntry,_RouteHasher> _nat;
+	BufferPool _pool;
+
+	struct mmsghdr _txMsgs[ZT_TCP_PROXY_BATCH];
+	struct iovec _txIov[ZT_TCP_PROXY_BATCH];
+	struct sockaddr_in _txAddr[ZT_TCP_PROXY_BATCH];
+	struct mmsghdr _rxMsgs[ZT_TCP_PROXY_BATCH];
+	struct iovec _rxIov[ZT_TCP_PROXY_BATCH];
+	struct sockaddr_in _rxAddr[ZT_TCP_PROXY_BATCH];
+	char _rxBuf[ZT_TCP_PROXY_BATCH][ZT_TCP_PROXY_MAX_DATAGRAM];
+	char _scratch[65536];
+
+	std::atomic<bool> _running;
+	std::thread _thread;
+
+	std::atomic<uint64_t> _clientCount;
+	std::atomic<uint64_t> _accepted;
+	std::atomic<uint64_t> _rejected;
+	std::atomic<uint64_t> _tcpToUdpPackets;
+	std::atomic<uint64_t> _tcpToUdpBytes;
+	std::atomic<uint64_t> _udpToTcpPackets;
+	std::atomic<uint64_t> _udpToTcpBytes;
+	std::atomic<uint64_t> _dropped;
+	std::atomic<uint64_t> _unmatched;
+	std::atomic<uint64_t> _conflicts;
+	std::atomic<uint64_t> _routes;
+	std::atomic<uint64_t> _buffers;
+};
+
+Relay::Relay(const unsigned int threads,const unsigned int sharedUdp,const unsigned long logSample,const bool logConnections) :
+	_port(0)
+{
+	for(unsigned int i=0;i<((threads) ? threads : 1);++i)
+		_workers.push_back(new _Worker(i,sharedUdp,logSample,logConnections));
+}
+
+Relay::~Relay()
+{
+	stop();
+	for(std::vector<_Worker *>::iterator w(_workers.begin());w!=_workers.end();++w)
+		delete *w;
+}
+
+bool Relay::listen(const struct sockaddr_in &addr)
+{
+	unsigned short port = ntohs(addr.sin_port);
+	for(std::vector<_Worker *>::iterator w(_workers.begin());w!=_workers.end();++w) {
+		if (!(*w)->listen(addr,port))
+			return false;
+	}
+	_port = port;
+	return true;
+}
+
+unsigned short Relay::port() const
+{
+	return _port;
+}
+
+void Relay::start()
+{
+	for(std::vector<_Worker *>::iterator w(_workers.begin());w!=_workers.end();++w)
+		(*w)->start();
+}
+
+void Relay::stop()
+{
+	for(std::vector<_Worker *>::iterator w(_workers.begin());w!=_workers.end();++w)
+		(*w)->stop();
+}
+
+Relay::Stats Relay::stats() const
+{
+	Stats s;
+	for(std::vector<_Worker *>::const_iterator w(_workers.begin());w!=_workers.end();++w)
+		(*w)->stats(s);
+	return s;
+}
+
+} // namespace ZeroTier
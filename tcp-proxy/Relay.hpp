@@ -0,0 +1,187 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2016  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZT_TCP_PROXY_RELAY_HPP
+#define ZT_TCP_PROXY_RELAY_HPP
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include <vector>
+
+#define ZT_TCP_PROXY_CONNECTION_TIMEOUT_SECONDS 300
+
+// How often each worker looks for idle clients (seconds)
+#define ZT_TCP_PROXY_HOUSEKEEPING_INTERVAL 10
+
+// Free buffers each worker keeps for reuse
+#define ZT_TCP_PROXY_MAX_FREE_BUFFERS 256
+
+// Datagrams or records moved per system call
+#define ZT_TCP_PROXY_BATCH 64
+
+// How long a reply route learned in shared UDP mode lasts without its client sending on it (seconds)
+#define ZT_TCP_PROXY_NAT_TIMEOUT 180
+
+// How long a reply route must go unused by its client before another client can take it over (seconds)
+#define ZT_TCP_PROXY_NAT_TAKEOVER_GRACE 30
+
+// How long a client holds a reply route the remote has never answered before another client can take it over (seconds)
+#define ZT_TCP_PROXY_NAT_UNCONFIRMED_GRACE 5
+
+// Receive and send buffer size of each shared UDP socket
+#define ZT_TCP_PROXY_SHARED_UDP_BUFFER 16777216
+
+namespace ZeroTier {
+
+/*
+ * ZeroTier TCP Proxy Server
+ *
+ * This implements a simple packet encapsulation that is designed to look like
+ * a TLS connection. It's not a TLS connection, but it sends TLS format record
+ * headers. It could be extended in the future to implement a fake TLS
+ * handshake.
+ *
+ * At the moment, each packet is just made to look like TLS application data:
+ *   <[1] TLS content type> - currently 0x17 for "application data"
+ *   <[1] TLS major version> - currently 0x03 for TLS 1.2
+ *   <[1] TLS minor version> - currently 0x03 for TLS 1.2
+ *   <[2] payload length> - 16-bit length of payload in bytes
+ *   <[...] payload> - Message payload
+ *
+ * TCP is inherently inefficient for encapsulating Ethernet, since TCP and TCP
+ * like protocols over TCP lead to double-ACKs. So this transport is only used
+ * to enable access when UDP or other datagram protocols are not available.
+ *
+ * Clients send a greeting, which is a four-byte message that contains:
+ *   <[1] ZeroTier major version>
+ *   <[1] minor version>
+ *   <[2] revision>
+ *
+ * If a client has sent a greeting, it uses the new version of this protocol
+ * in which every encapsulated ZT packet is prepended by an IP address where
+ * it should be forwarded (or where it came from for replies). This causes
+ * this proxy to act as a remote UDP socket similar to a socks proxy, which
+ * will allow us to move this function off the rootservers and onto dedicated
+ * proxy nodes.
+ *
+ * Older ZT clients that do not send this message get their packets relayed
+ * to/from 127.0.0.1:9993, which will allow them to talk to and relay via
+ * the ZT node on the same machine as the proxy. We'll only support this for
+ * as long as such nodes appear to be in the wild.
+ */
+
+/**
+ * Relays records between TCP clients and UDP
+ *
+ * Each of N worker threads has its own epoll instance and its own listening
+ * socket on the same port (SO_REUSEPORT), so the kernel spreads new
+ * connections across workers and a client, with its TCP and UDP sockets,
+ * stays on the worker that accepted it. Workers share nothing but counters.
+ *
+ * Records are framed in place in each client's receive ring and sent on with
+ * one sendmmsg() per read. Datagrams are taken with recvmmsg() and framed
+ * straight into the client's send ring. Ring buffers come from a per-worker
+ * pool and are only held while they hold data.
+ *
+ * By default each client gets a UDP socket of its own, so anything sent to
+ * that socket goes back to the client. With sharedUdp set, each worker
+ * instead sends for all its clients through sharedUdp sockets bound once at
+ * startup, and works out which client a reply is for the way a NAT would:
+ * from the (remote IP, remote port, destination ZeroTier address) of the
+ * reply. The relay learns those from the source address in packets clients
+ * send, so a reply only reaches a client that has sent to that remote.
+ * Another client claiming the same route only gets it once the first has
+ * disconnected or not used it for ZT_TCP_PROXY_NAT_TAKEOVER_GRACE, so one
+ * forged source address can't divert a live client's replies. Routes not
+ * used for ZT_TCP_PROXY_NAT_TIMEOUT are forgotten. Clients then
+ * cost one descriptor instead of two and accepting one needs no bind().
+ *
+ * Connection events are logged one line each as key=value pairs. Relayed
+ * packets are only logged if sampling is on, one in every logSample.
+ *
+ * Linux only.
+ */
+class Relay
+{
+public:
+	struct Stats
+	{
+		Stats() : clients(0),accepted(0),rejected(0),tcpToUdpPackets(0),tcpToUdpBytes(0),udpToTcpPackets(0),udpToTcpBytes(0),dropped(0),unmatched(0),conflicts(0),routes(0),buffers(0) {}
+		uint64_t clients;         // connected now
+		uint64_t accepted;
+		uint64_t rejected;        // closed at once for want of a UDP socket
+		uint64_t tcpToUdpPackets;
+		uint64_t tcpToUdpBytes;
+		uint64_t udpToTcpPackets;
+		uint64_t udpToTcpBytes;
+		uint64_t dropped;         // datagrams not relayed because a send failed or a client's send ring was full
+		uint64_t unmatched;       // datagrams on shared UDP sockets with no route to a client
+		uint64_t conflicts;       // packets claiming a reply route another client is using
+		uint64_t routes;          // reply routes known in shared UDP mode
+		uint64_t buffers;         // ring buffers held by clients
+	};
+
+	/**
+	 * @param threads Number of worker threads
+	 * @param sharedUdp UDP sockets each worker shares among its clients, or 0 for one per client
+	 * @param logSample Log one in this many relayed packets, or 0 for none
+	 * @param logConnections Log accepts, greetings and closes
+	 */
+	Relay(const unsigned int threads,const unsigned int sharedUdp,const unsigned long logSample,const bool logConnections);
+
+	~Relay();
+
+	/**
+	 * Bind listening sockets, one per worker, and any shared UDP sockets
+	 *
+	 * @param addr Address and port to listen on, port 0 for any
+	 * @return True on success
+	 */
+	bool listen(const struct sockaddr_in &addr);
+
+	/**
+	 * @return Port bound by listen()
+	 */
+	unsigned short port() const;
+
+	/**
+	 * Start worker threads
+	 */
+	void start();
+
+	/**
+	 * Stop and join worker threads, closing all clients
+	 */
+	void stop();
+
+	/**
+	 * @return Totals across all workers
+	 */
+	Stats stats() const;
+
+private:
+	class _Worker;
+
+	std::vector<_Worker *> _workers;
+	unsigned short _port;
+};
+
+} // namespace ZeroTier
+
+#endif
@@ -0,0 +1,240 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2016  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ZT_TCP_PROXY_RINGBUFFER_HPP
+#define ZT_TCP_PROXY_RINGBUFFER_HPP
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include <vector>
+
+// Size of every buffer (power of two, and larger than the biggest record of 5 + 65535 bytes)
+#define ZT_TCP_PROXY_BUFFER_SIZE 131072
+
+namespace ZeroTier {
+
+/**
+ * Free list of ZT_TCP_PROXY_BUFFER_SIZE blocks
+ *
+ * Clients only hold buffers while they have data in them, so most of the
+ * time an idle client holds none and the blocks go round between the busy
+ * ones. Up to maxFree returned blocks are kept for reuse and the rest go
+ * back to the allocator. Not thread safe: each worker has its own.
+ */
+class BufferPool
+{
+public:
+	BufferPool(const unsigned long maxFree) :
+		_maxFree(maxFree),
+		_inUse(0)
+	{
+	}
+
+	~BufferPool()
+	{
+		for(std::vector<char *>::iterator b(_free.begin());b!=_free.end();++b)
+			free(*b);
+	}
+
+	/**
+	 * @return Block, or NULL if out of memory
+	 */
+	inline char *get()
+	{
+		char *b;
+		if (_free.empty()) {
+			b = (char *)malloc(ZT_TCP_PROXY_BUFFER_SIZE);
+			if (!b)
+				return (char *)0;
+		} else {
+			b = _free.back();
+			_free.pop_back();
+		}
+		++_inUse;
+		return b;
+	}
+
+	inline void put(char *b)
+	{
+		--_inUse;
+		if (_free.size() < _maxFree) {
+			_free.push_back(b);
+		} else {
+			free(b);
+		}
+	}
+
+	inline unsigned long inUse() const { return _inUse; }
+	inline unsigned long cached() const { return (unsigned long)_free.size(); }
+
+private:
+	std::vector<char *> _free;
+	const unsigned long _maxFree;
+	unsigned long _inUse;
+};
+
+/**
+ * Byte ring over a block borrowed from a BufferPool
+ *
+ * Reads and writes go through at most two iovecs, one each side of the end
+ * of the block, so the kernel fills and drains it directly.
+ */
+class RingBuffer
+{
+public:
+	RingBuffer() :
+		_b((char *)0),
+		_head(0),
+		_size(0)
+	{
+	}
+
+	inline bool attached() const { return (_b != (char *)0); }
+
+	/**
+	 * @param b Empty block to use
+	 */
+	inline void attach(char *b)
+	{
+		_b = b;
+		_head = 0;
+		_size = 0;
+	}
+
+	/**
+	 * @return Block, which the caller gives back to its pool
+	 */
+	inline char *detach()
+	{
+		char *const b = _b;
+		_b = (char *)0;
+		_head = 0;
+		_size = 0;
+		return b;
+	}
+
+	inline unsigned long size() const { return _size; }
+	inline unsigned long available() const { return (ZT_TCP_PROXY_BUFFER_SIZE - _size); }
+
+	/**
+	 * @param i Offset from start of data, less than size()
+	 * @return Byte at offset
+	 */
+	inline uint8_t at(const unsigned long i) const { return (uint8_t)_b[(_head + i) & (ZT_TCP_PROXY_BUFFER_SIZE - 1)]; }
+
+	/**
+	 * Get len bytes at an offset in one piece
+	 *
+	 * @param scratch Buffer of at least len bytes, used only if the bytes wrap around the end of the block
+	 * @return Pointer to bytes, valid until data is next added
+	 */
+	inline const char *contiguous(const unsigned long offset,const unsigned long len,char *scratch) const
+	{
+		const unsigned long start = (_head + offset) & (ZT_TCP_PROXY_BUFFER_SIZE - 1);
+		if ((start + len) <= ZT_TCP_PROXY_BUFFER_SIZE)
+			return _b + start;
+		const unsigned long first = ZT_TCP_PROXY_BUFFER_SIZE - start;
+		memcpy(scratch,_b + start,first);
+		memcpy(scratch + first,_b,len - first);
+		return scratch;
+	}
+
+	/**
+	 * @return False if there isn't room (nothing is added)
+	 */
+	inline bool append(const void *data,const unsigned long len)
+	{
+		if (len > available())
+			return false;
+		const unsigned long tail = (_head + _size) & (ZT_TCP_PROXY_BUFFER_SIZE - 1);
+		const unsigned long first = ((tail + len) <= ZT_TCP_PROXY_BUFFER_SIZE) ? len : (ZT_TCP_PROXY_BUFFER_SIZE - tail);
+		memcpy(_b + tail,data,first);
+		if (first < len)
+			memcpy(_b,reinterpret_cast<const char *>(data) + first,len - first);
+		_size += len;
+		return true;
+	}
+
+	/**
+	 * @param v Set to free space to read into
+	 * @return Number of iovecs set (0 if full)
+	 */
+	inline int freeSpace(struct iovec v[2]) const
+	{
+		if (_size == ZT_TCP_PROXY_BUFFER_SIZE)
+			return 0;
+		const unsigned long tail = (_head + _size) & (ZT_TCP_PROXY_BUFFER_SIZE - 1);
+		v[0].iov_base = _b + tail;
+		if (tail >= _head) {
+			v[0].iov_len = ZT_TCP_PROXY_BUFFER_SIZE - tail;
+			if (_head) {
+				v[1].iov_base = _b;
+				v[1].iov_len = _head;
+				return 2;
+			}
+			return 1;
+		}
+		v[0].iov_len = _head - tail;
+		return 1;
+	}
+
+	/**
+	 * @param v Set to data to write out
+	 * @return Number of iovecs set (0 if empty)
+	 */
+	inline int data(struct iovec v[2]) const
+	{
+		if (!_size)
+			return 0;
+		v[0].iov_base = _b + _head;
+		if ((_head + _size) <= ZT_TCP_PROXY_BUFFER_SIZE) {
+			v[0].iov_len = _size;
+			return 1;
+		}
+		v[0].iov_len = ZT_TCP_PROXY_BUFFER_SIZE - _head;
+		v[1].iov_base = _b;
+		v[1].iov_len = _size - v[0].iov_len;
+		return 2;
+	}
+
+	/**
+	 * Note bytes read into the space returned by freeSpace()
+	 */
+	inline void produced(const unsigned long n) { _size += n; }
+
+	/**
+	 * Drop bytes from the front
+	 */
+	inline void consume(const unsigned long n)
+	{
+		_size -= n;
+		_head = (_size) ? ((_head + n) & (ZT_TCP_PROXY_BUFFER_SIZE - 1)) : 0;
+	}
+
+private:
+	char *_b;
+	unsigned long _head;
+	unsigned long _size;
+};
+
+} // namespace ZeroTier
+
+#endif
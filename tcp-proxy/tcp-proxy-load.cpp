@@ -0,0 +1,750 @@
+/*
+ * ZeroTier One - Network Virtualization Everywhere
+ * Copyright (C) 2011-2016  ZeroTier, Inc.  https://www.zerotier.com/
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Load generator for tcp-proxy
+ *
+ * Simulates many tunnel clients on loopback. A UDP echo server stands in
+ * for the ZeroTier nodes clients talk to. All clients first connect and
+ * greet the relay, which gives the accept rate and the relay's memory per
+ * connected client. Then each keeps a window of packets addressed to the
+ * echo server in flight, checking every reply byte for byte and timing its
+ * round trip. Packets not answered within a second count as lost.
+ *
+ * Packets carry a ZeroTier header with the client's own address as source
+ * and the echo server swaps source and destination, as a node replying
+ * would, so the relay's shared UDP mode can route the replies.
+ *
+ * Once the packets flow, one more connection sends packets claiming to be
+ * from client 0, as a client trying to take its replies would. The run
+ * fails if any of client 0's replies reach it.
+ *
+ * By default the relay runs in this process on a free port. Use -p to
+ * load a tcp-proxy started separately on 127.0.0.1 instead, e.g. to watch
+ * its own logs and memory use.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Relay.hpp"
+
+// Connections each client thread has in progress at once, to stay inside the listen backlog
+#define ZT_TCP_PROXY_LOAD_CONNECTING 256
+
+// A packet not answered in this long is counted lost (ms)
+#define ZT_TCP_PROXY_LOAD_LOSS_TIMEOUT 1000
+
+// Clients connect from this many loopback addresses (127.0.0.2 and up), as one has too few ephemeral ports for 50k
+#define ZT_TCP_PROXY_LOAD_SOURCES 64
+
+// ZeroTier address the echo server answers as; clients are 0x0a00000000 + their number
+#define ZT_TCP_PROXY_LOAD_ECHO_ADDRESS 0x1122334455ULL
+
+// Offsets of destination and source in a ZeroTier packet header, and where our timestamp goes
+#define ZT_TCP_PROXY_LOAD_IDX_DEST 8
+#define ZT_TCP_PROXY_LOAD_IDX_SOURCE 13
+#define ZT_TCP_PROXY_LOAD_IDX_TS 18
+#define ZT_TCP_PROXY_LOAD_MIN_LENGTH 32
+
+// Packet ID the forging connection uses, and how often it sends (us)
+#define ZT_TCP_PROXY_LOAD_FORGED_ID 0xffffffffU
+#define ZT_TCP_PROXY_LOAD_FORGE_INTERVAL 10000
+
+using namespace ZeroTier;
+
+static uint64_t nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+struct Options
+{
+	unsigned int clients;
+	unsigned int packets;   // per client
+	unsigned int length;    // payload bytes
+	unsigned int window;    // packets in flight per client
+	unsigned int threads;   // client threads
+	unsigned int relayThreads;
+	unsigned int sharedUdp; // of the relay run here
+	int port;               // external relay, or 0 to run one here
+};
+
+static void putZtAddress(char *p,const uint64_t a)
+{
+	for(int i=0;i<5;++i)
+		p[i] = (char)((a >> (32 - (i * 8))) & 0xff);
+}
+
+// As a node replying to a packet would address its reply
+static void swapZtAddresses(char *p)
+{
+	char tmp[5];
+	memcpy(tmp,p + ZT_TCP_PROXY_LOAD_IDX_DEST,5);
+	memcpy(p + ZT_TCP_PROXY_LOAD_IDX_DEST,p + ZT_TCP_PROXY_LOAD_IDX_SOURCE,5);
+	memcpy(p + ZT_TCP_PROXY_LOAD_IDX_SOURCE,tmp,5);
+}
+
+// Resident memory of this process in bytes
+static uint64_t rss()
+{
+	unsigned long pages = 0,resident = 0;
+	FILE *f = fopen("/proc/self/statm","r");
+	if (f) {
+		if (fscanf(f,"%lu %lu",&pages,&resident) != 2)
+			resident = 0;
+		fclose(f);
+	}
+	return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+// Kernel slab memory in bytes, which is where socket state lives
+static uint64_t slab()
+{
+	char line[256];
+	unsigned long kb = 0;
+	FILE *f = fopen("/proc/meminfo","r");
+	if (f) {
+		while (fgets(line,sizeof(line),f)) {
+			if (sscanf(line,"Slab: %lu kB",&kb) == 1)
+				break;
+		}
+		fclose(f);
+	}
+	return (uint64_t)kb * 1024ULL;
+}
+
+// Reflects every datagram to its sender, as a node answering would
+static void echoServer(const int s,std::atomic<bool> *running)
+{
+	struct mmsghdr msgs[64];
+	struct iovec iov[64];
+	struct sockaddr_in from[64];
+	static char bufs[64][2048];
+	while (*running) {
+		for(int i=0;i<64;++i) {
+			memset(&(msgs[i]),0,sizeof(msgs[i]));
+			iov[i].iov_base = bufs[i];
+			iov[i].iov_len = sizeof(bufs[i]);
+			msgs[i].msg_hdr.msg_iov = &(iov[i]);
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &(from[i]);
+			msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+		}
+		const int n = recvmmsg(s,msgs,64,MSG_WAITFORONE,(struct timespec *)0);
+		if (n <= 0)
+			continue; // SO_RCVTIMEO expired, check running
+		for(int i=0;i<n;++i) {
+			iov[i].iov_len = msgs[i].msg_len;
+			if ((msgs[i].msg_len >= ZT_TCP_PROXY_LOAD_MIN_LENGTH)&&((uint8_t)bufs[i][ZT_TCP_PROXY_LOAD_IDX_SOURCE] != 0xff))
+				swapZtAddresses(bufs[i]);
+		}
+		int sent = 0;
+		while (sent < n) {
+			const int r = sendmmsg(s,msgs + sent,n - sent,0);
+			sent += (r > 0) ? r : 1;
+		}
+	}
+}
+
+// Sends packets with client 0's ZeroTier address until stopped, and counts client 0's replies it gets
+static void forger(const struct sockaddr_in relay,const struct sockaddr_in echo,const unsigned int length,std::atomic<bool> *running,unsigned long *sent,unsigned long *stolen)
+{
+	usleep(100000); // start once client 0 is using its route
+	const int s = socket(AF_INET,SOCK_STREAM|SOCK_CLOEXEC,0);
+	if (s < 0)
+		return;
+	if (connect(s,(const struct sockaddr *)&relay,sizeof(relay)) != 0) {
+		close(s);
+		return;
+	}
+	static const char hello[9] = { 0x17,0x03,0x03,0x00,0x04,1,12,0,0 };
+	send(s,hello,sizeof(hello),MSG_NOSIGNAL);
+
+	char frame[5 + 7 + 2048];
+	const unsigned int mlen = 7 + length;
+	memset(frame,0,sizeof(frame));
+	frame[0] = 0x17;
+	frame[1] = 0x03;
+	frame[2] = 0x03;
+	frame[3] = (char)((mlen >> 8) & 0xff);
+	frame[4] = (char)(mlen & 0xff);
+	frame[5] = 4;
+	memcpy(frame + 6,&(echo.sin_addr.s_addr),4);
+	memcpy(frame + 10,&(echo.sin_port),2);
+	const uint32_t id = ZT_TCP_PROXY_LOAD_FORGED_ID;
+	memcpy(frame + 12,&id,4);
+	putZtAddress(frame + 12 + ZT_TCP_PROXY_LOAD_IDX_DEST,ZT_TCP_PROXY_LOAD_ECHO_ADDRESS);
+	putZtAddress(frame + 12 + ZT_TCP_PROXY_LOAD_IDX_SOURCE,0x0a00000000ULL);
+
+	std::string in;
+	char buf[65536];
+	while (*running) {
+		if (send(s,frame,5 + mlen,MSG_NOSIGNAL) == (ssize_t)(5 + mlen))
+			++*sent;
+		usleep(ZT_TCP_PROXY_LOAD_FORGE_INTERVAL);
+		for(;;) {
+			const ssize_t n = recv(s,buf,sizeof(buf),MSG_DONTWAIT);
+			if (n <= 0)
+				break;
+			in.append(buf,(size_t)n);
+		}
+		size_t p = 0;
+		while ((in.size() - p) >= 5) {
+			const unsigned int l = (((unsigned int)(uint8_t)in[p + 3]) << 8) | (unsigned int)(uint8_t)in[p + 4];
+			if ((in.size() - p) < (5 + l))
+				break;
+			uint32_t rid = ZT_TCP_PROXY_LOAD_FORGED_ID;
+			if (l >= 11)
+				memcpy(&rid,in.data() + p + 12,4);
+			if (rid != ZT_TCP_PROXY_LOAD_FORGED_ID)
+				++*stolen;
+			p += 5 + l;
+		}
+		in.erase(0,p);
+	}
+	close(s);
+}
+
+struct Client
+{
+	Client() : fd(-1),id(0),sent(0),received(0),lost(0),lastProgress(0),connected(false),done(false) {}
+	int fd;
+	uint32_t id;
+	unsigned int sent;
+	unsigned int received;
+	unsigned int lost;
+	uint64_t lastProgress;
+	std::string in;
+	std::string out;
+	bool connected;
+	bool done;
+};
+
+struct ThreadResult
+{
+	ThreadResult() : connectFailed(0),errors(0),received(0),lost(0),bytes(0) {}
+	unsigned long connectFailed;
+	unsigned long errors;    // replies that didn't match what was sent
+	unsigned long received;
+	unsigned long lost;
+	uint64_t bytes;          // payload bytes received
+	std::vector<uint32_t> rtt; // us
+};
+
+class ClientThread
+{
+public:
+	ClientThread(const Options &o,const struct sockaddr_in &relay,const struct sockaddr_in &echo,const uint32_t firstId,const unsigned int count) :
+		_o(o),
+		_relay(relay),
+		_echo(echo),
+		_clients(count),
+		_ep(epoll_create1(EPOLL_CLOEXEC)),
+		_nextConnect(0),
+		_connecting(0),
+		_finished(0)
+	{
+		for(unsigned int i=0;i<count;++i)
+			_clients[i].id = firstId + i;
+	}
+
+	~ClientThread()
+	{
+		for(std::vector<Client>::iterator c(_clients.begin());c!=_clients.end();++c) {
+			if (c->fd >= 0)
+				close(c->fd);
+		}
+		close(_ep);
+	}
+
+	// Connect and greet every client
+	void connectAll(const uint64_t deadline)
+	{
+		struct epoll_event ev[256];
+		while ((_nextConnect < _clients.size())||(_connecting)) {
+			_connectMore();
+			const int n = epoll_wait(_ep,ev,256,50);
+			for(int i=0;i<n;++i) {
+				Client &c = _clients[ev[i].data.u32];
+				if ((c.done)||(c.connected))
+					continue;
+				int err = 0;
+				socklen_t errLen = sizeof(err);
+				getsockopt(c.fd,SOL_SOCKET,SO_ERROR,&err,&errLen);
+				--_connecting;
+				if (err) {
+					++result.connectFailed;
+					_finish(c);
+					continue;
+				}
+				c.connected = true;
+				static const char hello[9] = { 0x17,0x03,0x03,0x00,0x04,1,12,0,0 };
+				c.out.append(hello,sizeof(hello));
+				_write(c);
+			}
+			if (nowNs() > deadline) {
+				for(std::vector<Client>::iterator c(_clients.begin());c!=_clients.end();++c) {
+					if ((!c->done)&&(!c->connected)) {
+						++result.connectFailed;
+						_finish(*c);
+					}
+				}
+				break;
+			}
+		}
+	}
+
+	// Send every client's packets and wait for the replies
+	void run(const uint64_t deadline)
+	{
+		struct epoll_event ev[256];
+		uint64_t lastTick = nowNs();
+		for(std::vector<Client>::iterator c(_clients.begin());c!=_clients.end();++c) {
+			if (!c->done) {
+				c->lastProgress = lastTick;
+				_fill(*c,lastTick);
+				_write(*c);
+			}
+		}
+		while (_finished < _clients.size()) {
+			const int n = epoll_wait(_ep,ev,256,50);
+			const uint64_t now = nowNs();
+			for(int i=0;i<n;++i) {
+				Client &c = _clients[ev[i].data.u32];
+				if (c.done)
+					continue;
+				if (ev[i].events & (EPOLLIN|EPOLLHUP|EPOLLERR))
+					_read(c,now);
+				if ((!c.done)&&(!c.out.empty()))
+					_write(c);
+			}
+
+			if ((now - lastTick) >= 100000000ULL) {
+				lastTick = now;
+				for(std::vector<Client>::iterator c(_clients.begin());c!=_clients.end();++c) {
+					if ((!c->done)&&((now - c->lastProgress) >= (ZT_TCP_PROXY_LOAD_LOSS_TIMEOUT * 1000000ULL))) {
+						c->lost += c->sent - c->received - c->lost;
+						c->lastProgress = now;
+						_fill(*c,now);
+						if (!c->out.empty())
+							_write(*c);
+						_check(*c);
+					}
+				}
+			}
+			if (now > deadline) {
+				for(std::vector<Client>::iterator c(_clients.begin());c!=_clients.end();++c) {
+					if (!c->done) {
+						c->lost += c->sent - c->received - c->lost;
+						_finish(*c);
+					}
+				}
+			}
+		}
+		for(std::vector<Client>::iterator c(_clients.begin());c!=_clients.end();++c) {
+			result.received += c->received;
+			if (c->connected)
+				result.lost += c->lost + (_o.packets - c->sent);
+		}
+	}
+
+	ThreadResult result;
+
+private:
+	void _connectMore()
+	{
+		while ((_connecting < ZT_TCP_PROXY_LOAD_CONNECTING)&&(_nextConnect < _clients.size())) {
+			Client &c = _clients[_nextConnect];
+			c.fd = socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC,0);
+			if (c.fd < 0) {
+				++result.connectFailed;
+				_finish(c);
+				++_nextConnect;
+				continue;
+			}
+			int one = 1;
+			setsockopt(c.fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+#ifdef IP_BIND_ADDRESS_NO_PORT
+			setsockopt(c.fd,IPPROTO_IP,IP_BIND_ADDRESS_NO_PORT,&one,sizeof(one)); // pick the port at connect(), per destination
+#endif
+			struct sockaddr_in src;
+			memset(&src,0,sizeof(src));
+			src.sin_family = AF_INET;
+			src.sin_addr.s_addr = htonl(0x7f000002 + (c.id % ZT_TCP_PROXY_LOAD_SOURCES));
+			bind(c.fd,(const struct sockaddr *)&src,sizeof(src));
+			if ((connect(c.fd,(const struct sockaddr *)&_relay,sizeof(_relay)) != 0)&&(errno != EINPROGRESS)) {
+				++result.connectFailed;
+				_finish(c);
+				++_nextConnect;
+				continue;
+			}
+			struct epoll_event ev;
+			memset(&ev,0,sizeof(ev));
+			ev.events = EPOLLIN|EPOLLOUT;
+			ev.data.u32 = _nextConnect;
+			epoll_ctl(_ep,EPOLL_CTL_ADD,c.fd,&ev);
+			++_connecting;
+			++_nextConnect;
+		}
+	}
+
+	// Queue packets until the window is full or all have been sent
+	void _fill(Client &c,const uint64_t now)
+	{
+		char frame[5 + 7 + 2048];
+		const unsigned int mlen = 7 + _o.length;
+		while ((c.sent < _o.packets)&&((c.sent - c.received - c.lost) < _o.window)) {
+			frame[0] = 0x17;
+			frame[1] = 0x03;
+			frame[2] = 0x03;
+			frame[3] = (char)((mlen >> 8) & 0xff);
+			frame[4] = (char)(mlen & 0xff);
+			frame[5] = 4;
+			memcpy(frame + 6,&(_echo.sin_addr.s_addr),4);
+			memcpy(frame + 10,&(_echo.sin_port),2);
+			_payload(c.id,c.sent,now,frame + 12);
+			c.out.append(frame,5 + mlen);
+			++c.sent;
+		}
+	}
+
+	// Packet ID is the client and sequence number, then the ZeroTier addresses, then when it was sent
+	void _payload(const uint32_t id,const uint32_t seq,const uint64_t ts,char *p) const
+	{
+		memcpy(p,&id,4);
+		memcpy(p + 4,&seq,4);
+		putZtAddress(p + ZT_TCP_PROXY_LOAD_IDX_DEST,ZT_TCP_PROXY_LOAD_ECHO_ADDRESS);
+		putZtAddress(p + ZT_TCP_PROXY_LOAD_IDX_SOURCE,0x0a00000000ULL + (uint64_t)id);
+		memcpy(p + ZT_TCP_PROXY_LOAD_IDX_TS,&ts,8);
+		for(unsigned int i=ZT_TCP_PROXY_LOAD_IDX_TS+8;i<_o.length;++i)
+			p[i] = (char)(id + seq + i);
+	}
+
+	void _write(Client &c)
+	{
+		const ssize_t n = send(c.fd,c.out.data(),c.out.size(),MSG_NOSIGNAL|MSG_DONTWAIT);
+		if (n > 0)
+			c.out.erase(0,(size_t)n);
+		struct epoll_event ev;
+		memset(&ev,0,sizeof(ev));
+		ev.events = (c.out.empty()) ? EPOLLIN : (EPOLLIN|EPOLLOUT);
+		ev.data.u32 = (uint32_t)(&c - &(_clients[0]));
+		epoll_ctl(_ep,EPOLL_CTL_MOD,c.fd,&ev);
+	}
+
+	void _read(Client &c,const uint64_t now)
+	{
+		char buf[65536];
+		const ssize_t n = recv(c.fd,buf,sizeof(buf),MSG_DONTWAIT);
+		if (n <= 0) {
+			if ((n == 0)||((errno != EAGAIN)&&(errno != EWOULDBLOCK)&&(errno != EINTR))) {
+				c.lost += c.sent - c.received - c.lost;
+				c.lost += _o.packets - c.sent;
+				c.sent = _o.packets;
+				++result.errors; // the relay hung up on us
+				_finish(c);
+			}
+			return;
+		}
+		c.in.append(buf,(size_t)n);
+
+		char expect[2048];
+		size_t p = 0;
+		while ((c.in.size() - p) >= 5) {
+			const unsigned int mlen = (((unsigned int)(uint8_t)c.in[p + 3]) << 8) | (unsigned int)(uint8_t)c.in[p + 4];
+			if ((c.in.size() - p) < (5 + mlen))
+				break;
+			const char *const f = c.in.data() + p;
+			uint32_t id = 0,seq = 0;
+			uint64_t ts = 0;
+			if ((mlen == (7 + _o.length))&&(f[5] == 4)&&(memcmp(f + 6,&(_echo.sin_addr.s_addr),4) == 0)&&(memcmp(f + 10,&(_echo.sin_port),2) == 0)) {
+				memcpy(&id,f + 12,4);
+				if (id == ZT_TCP_PROXY_LOAD_FORGED_ID) {
+					p += 5 + mlen; // reply to a forged packet, which the real client 0 rightly gets
+					continue;
+				}
+				memcpy(&seq,f + 16,4);
+				memcpy(&ts,f + 12 + ZT_TCP_PROXY_LOAD_IDX_TS,8);
+				_payload(id,seq,ts,expect);
+				swapZtAddresses(expect);
+			}
+			if ((id != c.id)||(seq >= c.sent)||(memcmp(f + 12,expect,_o.length) != 0)) {
+				++result.errors;
+			} else if ((c.received + c.lost) < c.sent) {
+				++c.received;
+				result.bytes += _o.length;
+				result.rtt.push_back((uint32_t)((now - ts) / 1000ULL));
+				c.lastProgress = now;
+			}
+			p += 5 + mlen;
+		}
+		c.in.erase(0,p);
+
+		_fill(c,now);
+		_check(c);
+	}
+
+	void _check(Client &c)
+	{
+		if ((c.sent == _o.packets)&&((c.received + c.lost) >= c.sent))
+			_finish(c);
+	}
+
+	void _finish(Client &c)
+	{
+		if (c.done)
+			return;
+		c.done = true;
+		++_finished;
+		if (c.fd >= 0) {
+			if (c.connected) {
+				// Stay connected until the end, so all clients are on the relay at once
+				epoll_ctl(_ep,EPOLL_CTL_DEL,c.fd,(struct epoll_event *)0);
+			} else {
+				close(c.fd);
+				c.fd = -1;
+			}
+		}
+	}
+
+	const Options &_o;
+	const struct sockaddr_in _relay;
+	const struct sockaddr_in _echo;
+	std::vector<Client> _clients;
+	int _ep;
+	unsigned int _nextConnect;
+	unsigned int _connecting;
+	unsigned int _finished;
+};
+
+static void printHelp(const char *pn)
+{
+	printf("Usage: %s [-c <clients>] [-n <packets>] [-l <bytes>] [-w <window>] [-t <threads>] [-r <relay threads>] [-u <sockets>] [-p <port>]\n",pn);
+	printf("  -c <clients>  Tunnel clients (default: 10000)\n");
+	printf("  -n <packets>  Packets each client sends (default: 100)\n");
+	printf("  -l <bytes>    Packet size (default: 512, 32 to 2000)\n");
+	printf("  -w <window>   Packets each client keeps in flight (default: 4)\n");
+	printf("  -t <threads>  Client threads (default: 2)\n");
+	printf("  -r <threads>  Worker threads of the relay run here (default: one per core)\n");
+	printf("  -u <sockets>  Shared UDP sockets per worker of the relay run here (default: one per client)\n");
+	printf("  -p <port>     Load a tcp-proxy already listening on 127.0.0.1:<port> instead\n");
+}
+
+int main(int argc,char **argv)
+{
+	signal(SIGPIPE,SIG_IGN);
+
+	Options o;
+	o.clients = 10000;
+	o.packets = 100;
+	o.length = 512;
+	o.window = 4;
+	o.threads = 2;
+	o.relayThreads = std::thread::hardware_concurrency();
+	o.sharedUdp = 0;
+	o.port = 0;
+	int ch;
+	while ((ch = getopt(argc,argv,"c:n:l:w:t:r:u:p:h")) != -1) {
+		switch(ch) {
+			case 'c': o.clients = (unsigned int)atoi(optarg); break;
+			case 'n': o.packets = (unsigned int)atoi(optarg); break;
+			case 'l': o.length = (unsigned int)atoi(optarg); break;
+			case 'w': o.window = (unsigned int)atoi(optarg); break;
+			case 't': o.threads = (unsigned int)atoi(optarg); break;
+			case 'r': o.relayThreads = (unsigned int)atoi(optarg); break;
+			case 'u': o.sharedUdp = (unsigned int)atoi(optarg); break;
+			case 'p': o.port = atoi(optarg); break;
+			default:
+				printHelp(argv[0]);
+				return 1;
+		}
+	}
+	if ((!o.clients)||(!o.window)||(!o.threads)||(o.length < ZT_TCP_PROXY_LOAD_MIN_LENGTH)||(o.length > 2000)||(o.port < 0)||(o.port > 0xffff)) {
+		printHelp(argv[0]);
+		return 1;
+	}
+	if (!o.relayThreads)
+		o.relayThreads = 1;
+
+	// Each client is a descriptor here, and one or two more in the relay if it runs here too
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE,&rl) == 0) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE,&rl);
+		const rlim_t need = (rlim_t)o.clients * ((o.port) ? 1 : ((o.sharedUdp) ? 2 : 3)) + 64;
+		if (rl.rlim_cur < need) {
+			fprintf(stderr,"%s: need %llu descriptors but the limit is %llu, use fewer clients or run tcp-proxy separately with -p\n",argv[0],(unsigned long long)need,(unsigned long long)rl.rlim_cur);
+			return 1;
+		}
+	}
+
+	std::atomic<bool> running(true);
+	const int echo = socket(AF_INET,SOCK_DGRAM,0);
+	struct sockaddr_in echoAddr;
+	memset(&echoAddr,0,sizeof(echoAddr));
+	echoAddr.sin_family = AF_INET;
+	echoAddr.sin_addr.s_addr = htonl(0x7f000001);
+	{
+		int bs = 8388608;
+		setsockopt(echo,SOL_SOCKET,SO_RCVBUF,&bs,sizeof(bs));
+		setsockopt(echo,SOL_SOCKET,SO_SNDBUF,&bs,sizeof(bs));
+		struct timeval tv;
+		tv.tv_sec = 0;
+		tv.tv_usec = 100000;
+		setsockopt(echo,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+		socklen_t alen = sizeof(echoAddr);
+		if ((bind(echo,(const struct sockaddr *)&echoAddr,sizeof(echoAddr)) != 0)||(getsockname(echo,(struct sockaddr *)&echoAddr,&alen) != 0)) {
+			fprintf(stderr,"%s: unable to bind echo server\n",argv[0]);
+			return 1;
+		}
+	}
+	std::thread echoThread(echoServer,echo,&running);
+
+	Relay *relay = (Relay *)0;
+	struct sockaddr_in relayAddr;
+	memset(&relayAddr,0,sizeof(relayAddr));
+	relayAddr.sin_family = AF_INET;
+	relayAddr.sin_addr.s_addr = htonl(0x7f000001);
+	if (o.port) {
+		relayAddr.sin_port = htons((uint16_t)o.port);
+	} else {
+		relay = new Relay(o.relayThreads,o.sharedUdp,0,false);
+		if (!relay->listen(relayAddr)) {
+			fprintf(stderr,"%s: unable to start relay\n",argv[0]);
+			return 1;
+		}
+		relayAddr.sin_port = htons(relay->port());
+		relay->start();
+	}
+
+	if (relay) {
+		printf("%u clients, %u packets of %u bytes each, window %u, %u client threads, relay in process with %u threads and ",o.clients,o.packets,o.length,o.window,o.threads,o.relayThreads);
+		if (o.sharedUdp) {
+			printf("%u shared UDP sockets each\n",o.sharedUdp);
+		} else {
+			printf("a UDP socket per client\n");
+		}
+	} else {
+		printf("%u clients, %u packets of %u bytes each, window %u, %u client threads, relay on port %d\n",o.clients,o.packets,o.length,o.window,o.threads,o.port);
+	}
+
+	std::vector<ClientThread *> threads;
+	for(unsigned int t=0,first=0;t<o.threads;++t) {
+		const unsigned int count = (o.clients / o.threads) + ((t < (o.clients % o.threads)) ? 1 : 0);
+		threads.push_back(new ClientThread(o,relayAddr,echoAddr,first,count));
+		first += count;
+	}
+	const uint64_t rss0 = rss();
+	const uint64_t slab0 = slab();
+	const uint64_t start = nowNs();
+	const uint64_t deadline = start + 120000000000ULL + ((uint64_t)o.clients * 1000000ULL);
+	std::atomic<unsigned int> connected(0);
+	std::atomic<bool> go(false);
+	std::vector<std::thread> clientThreads;
+	for(std::vector<ClientThread *>::iterator t(threads.begin());t!=threads.end();++t) {
+		ClientThread *const ct = *t;
+		clientThreads.push_back(std::thread([ct,deadline,&connected,&go]() {
+			ct->connectAll(deadline);
+			++connected;
+			while (!go)
+				usleep(1000);
+			ct->run(deadline);
+		}));
+	}
+	while (connected < threads.size())
+		usleep(1000);
+	const uint64_t connectedAt = nowNs();
+	usleep(200000); // let the relay take the last greetings
+	const uint64_t rss1 = rss();
+	const uint64_t slab1 = slab();
+	go = true;
+	const uint64_t trafficStart = nowNs();
+	std::atomic<bool> forging(true);
+	unsigned long forged = 0,stolen = 0;
+	std::thread forgerThread(forger,relayAddr,echoAddr,o.length,&forging,&forged,&stolen);
+	for(std::vector<std::thread>::iterator t(clientThreads.begin());t!=clientThreads.end();++t)
+		t->join();
+	const uint64_t end = nowNs();
+	forging = false;
+	forgerThread.join();
+	const uint64_t rss2 = rss();
+
+	ThreadResult total;
+	for(std::vector<ClientThread *>::iterator t(threads.begin());t!=threads.end();++t) {
+		total.connectFailed += (*t)->result.connectFailed;
+		total.errors += (*t)->result.errors;
+		total.received += (*t)->result.received;
+		total.lost += (*t)->result.lost;
+		total.bytes += (*t)->result.bytes;
+		total.rtt.insert(total.rtt.end(),(*t)->result.rtt.begin(),(*t)->result.rtt.end());
+		delete *t;
+	}
+	std::sort(total.rtt.begin(),total.rtt.end());
+
+	const double seconds = (double)(end - trafficStart) / 1e9;
+	const double connectSeconds = (double)(connectedAt - start) / 1e9;
+	const unsigned long ok = o.clients - total.connectFailed;
+	printf("connected %lu clients in %.2fs (%.0f/s), %lu failed\n",ok,connectSeconds,(double)ok / connectSeconds,total.connectFailed);
+	if (ok) {
+		if (relay)
+			printf("memory per connected client: %.0f bytes in this process (the relay), %.0f bytes of kernel slab (both ends)\n",((double)rss1 - (double)rss0) / (double)ok,((double)slab1 - (double)slab0) / (double)ok);
+		else printf("memory per connected client: %.0f bytes of kernel slab (both ends)\n",((double)slab1 - (double)slab0) / (double)ok);
+	}
+	printf("%lu round trips in %.2fs: %.0f packets/s and %.1f Mbit/s through the relay each way\n",total.received,seconds,(double)total.received / seconds,((double)total.bytes * 8.0) / (seconds * 1e6));
+	if (!total.rtt.empty())
+		printf("round trip: p50 %uus p99 %uus max %uus\n",total.rtt[total.rtt.size() / 2],total.rtt[(total.rtt.size() * 99) / 100],total.rtt.back());
+	printf("%lu lost, %lu mismatched or cut off\n",total.lost,total.errors);
+	printf("%lu packets forged as client 0, %lu of its replies diverted\n",forged,stolen);
+
+	if (relay) {
+		const Relay::Stats s(relay->stats());
+		printf("relay: accepted %llu, rejected %llu, tcp->udp %llu packets, udp->tcp %llu packets, dropped %llu, unmatched %llu, conflicts %llu, routes %llu, %.1f MiB resident after traffic\n",(unsigned long long)s.accepted,(unsigned long long)s.rejected,(unsigned long long)s.tcpToUdpPackets,(unsigned long long)s.udpToTcpPackets,(unsigned long long)s.dropped,(unsigned long long)s.unmatched,(unsigned long long)s.conflicts,(unsigned long long)s.routes,(double)rss2 / 1048576.0);
+		relay->stop();
+		delete relay;
+	}
+	running = false;
+	echoThread.join();
+	close(echo);
+
+	return ((total.connectFailed)||(total.errors)||(stolen)) ? 1 : 0;
+}